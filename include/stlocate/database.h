@@ -36,9 +36,12 @@ struct stat;
 // ssize_t
 #include <sys/types.h>
 
+struct sl_database_cursor;
 struct sl_filesystem;
 struct sl_request;
+struct sl_result_file;
 struct sl_result_files;
+struct sl_result_statistics;
 
 /**
  * \struct sl_database_connection
@@ -115,8 +118,41 @@ struct sl_database_connection {
 		 */
 		int (*start_transaction)(struct sl_database_connection * connect);
 
+		/**
+		 * \brief Prepare \a connect before modifying database
+		 *
+		 * Depending on driver, modifications done until finish_update
+		 * is called can be hidden from other connections.
+		 *
+		 * \param[in] connect a database connection
+		 * \return a value which correspond to
+		 * \li 0 if ok
+		 * \li < 0 if error
+		 */
+		int (*start_update)(struct sl_database_connection * connect);
+		/**
+		 * \brief Publish or discard modifications done since start_update
+		 *
+		 * \param[in] connect a database connection
+		 * \param[in] commit publish modifications if \b true, discard them otherwise
+		 * \return a value which correspond to
+		 * \li 0 if ok
+		 * \li < 0 if error
+		 */
+		int (*finish_update)(struct sl_database_connection * connect, bool commit);
+
 		int (*create_database)(struct sl_database_connection * connect, int version);
 		int (*get_database_version)(struct sl_database_connection * connect);
+		/**
+		 * \brief Upgrade schema of database to \a version
+		 *
+		 * \param[in] connect a database connection
+		 * \param[in] version new version of database
+		 * \return a value which correspond to
+		 * \li 0 if ok
+		 * \li != 0 if error
+		 */
+		int (*upgrade_database)(struct sl_database_connection * connect, int version);
 
 		int (*delete_old_session)(struct sl_database_connection * connect, int host_id, int nb_session_kept);
 		int (*end_session)(struct sl_database_connection * connect, int session_id);
@@ -125,9 +161,92 @@ struct sl_database_connection {
 		int (*get_host_by_name)(struct sl_database_connection * connect, const char * hostname);
 		int (*sync_file)(struct sl_database_connection * connect, int s2fs, const char * filename, struct stat * st);
 		int (*sync_filesystem)(struct sl_database_connection * connect, int session_id, struct sl_filesystem * fs);
+		/**
+		 * \brief Store counters of session2filesystem \a s2fs
+		 *
+		 * Should be called before end_session
+		 *
+		 * \param[in] connect a database connection
+		 * \param[in] s2fs value returned by sync_filesystem
+		 * \param[in] stats counters collected while updating \a s2fs
+		 * \return a value which correspond to
+		 * \li 0 if ok
+		 * \li != 0 if error
+		 */
+		int (*sync_statistics)(struct sl_database_connection * connect, int s2fs, const struct sl_result_statistics * stats);
 
 		struct sl_result_files * (*find_file)(struct sl_database_connection * connect, int host_id, struct sl_request * request);
+		/**
+		 * \brief Start a lookup whose rows are fetched one at a time
+		 *
+		 * Rows come in the same order as with find_file, newest session first.
+		 *
+		 * \param[in] connect a database connection
+		 * \param[in] host_id id of host
+		 * \param[in] request criteria of lookup, copied by cursor
+		 * \return \b NULL if error, should be released with close_cursor
+		 *
+		 * \warning Only one cursor by connection should be opened at a time
+		 */
+		struct sl_database_cursor * (*open_cursor)(struct sl_database_connection * connect, int host_id, struct sl_request * request);
+		/**
+		 * \brief Fetch next row of \a cursor
+		 *
+		 * \param[in] cursor a cursor returned by open_cursor
+		 * \return \b NULL if there is no more rows or if error.
+		 * Returned row, and its strings, belong to \a cursor and
+		 * remain valid until next call of next_file or close_cursor.
+		 */
+		const struct sl_result_file * (*next_file)(struct sl_database_cursor * cursor);
+		/**
+		 * \brief Release \a cursor
+		 *
+		 * \param[in] cursor a cursor returned by open_cursor
+		 * \return a value which correspond to
+		 * \li 0 if ok
+		 * \li != 0 if an error occured while fetching rows
+		 */
+		int (*close_cursor)(struct sl_database_cursor * cursor);
+		/**
+		 * \brief Look for many files at once
+		 *
+		 * Faster than calling find_file for each request, like while
+		 * recovering a whole lost+found directory.
+		 *
+		 * \param[in] connect a database connection
+		 * \param[in] host_id id of host
+		 * \param[in] requests criteria of each lookup
+		 * \param[in] nb_requests number of \a requests
+		 * \return \b NULL if error, else one result set by request, in
+		 * the order of \a requests. Should be released with
+		 * sl_result_files_free_array
+		 */
+		struct sl_result_files ** (*find_files)(struct sl_database_connection * connect, int host_id, struct sl_request * requests, unsigned int nb_requests);
+		/**
+		 * \brief Get every known ancestor directory of \a path
+		 *
+		 * Lets a restore rebuild missing directories without calling
+		 * get_file_info once by level.
+		 *
+		 * \param[in] connect a database connection
+		 * \param[in] session_id id of a session
+		 * \param[in] fs_id id of a filesystem
+		 * \param[in] path path of a file, relative to its mount point
+		 * \return \b NULL if error, else ancestors from the top-most one
+		 * (mount point and \a path excluded). Should be released with
+		 * sl_result_files_free
+		 */
+		struct sl_result_files * (*get_ancestors)(struct sl_database_connection * connect, int session_id, int fs_id, const char * path);
 		struct sl_result_file * (*get_file_info)(struct sl_database_connection * connect, int session_id, int fs_id, const char * path);
+		/**
+		 * \brief Get counters of filesystem \a fs_id into session \a session_id
+		 *
+		 * \param[in] connect a database connection
+		 * \param[in] session_id id of a session
+		 * \param[in] fs_id id of a filesystem
+		 * \return \b NULL if there is no counters, should be released with free
+		 */
+		struct sl_result_statistics * (*get_statistics)(struct sl_database_connection * connect, int session_id, int fs_id);
 	} * ops;
 
 	/**
@@ -144,6 +263,21 @@ struct sl_database_connection {
 	struct sl_database_config * config;
 };
 
+/**
+ * \struct sl_database_cursor
+ * \brief Rows of a lookup, fetched one at a time
+ */
+struct sl_database_cursor {
+	/**
+	 * \brief private data
+	 */
+	void * data;
+	/**
+	 * \brief Reference to a database connection
+	 */
+	struct sl_database_connection * connect;
+};
+
 /**
  * \struct sl_database_config
  * \brief Describe a database configuration
@@ -167,6 +301,15 @@ struct sl_database_config {
 		 * \returns a database connection
 		 */
 		struct sl_database_connection * (*connect)(struct sl_database_config * db_config);
+		/**
+		 * \brief Create a new connection which is only used for lookups
+		 *
+		 * Such connection can not modify database but it can read it
+		 * while another process updates it.
+		 *
+		 * \returns a database connection
+		 */
+		struct sl_database_connection * (*connect_read_only)(struct sl_database_config * db_config);
 		/**
 		 * \brief This function releases all memory associated to database configuration
 		 *
@@ -181,6 +324,26 @@ struct sl_database_config {
 
 	int nb_session_kept;
 
+	/**
+	 * \enum sl_database_commit
+	 * \brief Granularity of transactions used while updating database
+	 *
+	 * \var commit
+	 * \brief Commit once per session or at least once per filesystem
+	 */
+	enum sl_database_commit {
+		sl_database_commit_session,
+		sl_database_commit_filesystem,
+	} commit;
+	/**
+	 * \brief Commit after this number of files, 0 means no limit
+	 */
+	unsigned int commit_nb_files;
+	/**
+	 * \brief Commit after this number of seconds, 0 means no limit
+	 */
+	unsigned int commit_delay;
+
 	/**
 	 * \brief private data
 	 */
@@ -251,8 +414,18 @@ struct sl_database {
  *
  * Will increment with new version of struct sl_database or struct sl_database_connection
  */
-#define STLOCATE_DATABASE_API_LEVEL 1
+#define STLOCATE_DATABASE_API_LEVEL 13
+
 
+/**
+ * \brief Fetch all remaining rows of \a cursor then close it
+ *
+ * Helps drivers to implement find_file on top of their cursor.
+ *
+ * \param[in] cursor a cursor returned by open_cursor, may be \b NULL
+ * \returns \b NULL if error, should be released with sl_result_files_free
+ */
+struct sl_result_files * sl_database_fetch_files(struct sl_database_cursor * cursor);
 
 /**
  * \brief Get a database configuration by his name
@@ -28,19 +28,48 @@
 #ifndef __STLOCATE_RESULT_H__
 #define __STLOCATE_RESULT_H__
 
+// bool
+#include <stdbool.h>
 #include <sys/types.h>
 
 struct sl_request {
 	int session_min_id;
 	int session_max_id;
 
+	// with fs_uuid, only chooses between filesystems of a session which share this uuid
 	dev_t dev_no;
 	ino_t inode;
+	// uuid of filesystem, kept across reboots unlike dev_no. Borrowed, NULL for any filesystem
+	const char * fs_uuid;
+	// glob pattern, like GLOB of sqlite, which should match the whole path relative to mount point. Borrowed, NULL for any path
+	const char * path_pattern;
+	// path_pattern is a POSIX extended regular expression which should match a part of path
+	bool path_regex;
+	// path relative to mount point, root of filesystem is "/". Borrowed, NULL for any path
+	const char * path;
+	// look for files under directory path, at any depth, instead of path itself
+	bool path_subtree;
+
+	// keep only rows of the newest session which matches
+	bool newest_only;
+	// rows of a same path into several sessions become one row, see first_session_id
+	bool collapse;
+	// maximum number of rows, 0 means no limit
+	unsigned int limit;
 };
 
+/**
+ * \brief A result set
+ *
+ * Rows and their strings are allocated with the result set, strings of a
+ * same filesystem are shared by its rows. So a row of a result set should
+ * not be released with sl_result_file_free.
+ */
 struct sl_result_files {
 	struct sl_result_file {
 		int session_id;
+		// oldest session of a collapsed row, else same as session_id
+		int first_session_id;
 		time_t session_start;
 		time_t session_end;
 
@@ -63,10 +92,168 @@ struct sl_result_files {
 	unsigned int nb_files;
 };
 
+/**
+ * \brief Counters of a filesystem, collected while updating a session
+ */
+struct sl_result_statistics {
+	unsigned long long nb_files;
+	unsigned long long nb_directories;
+	unsigned long long total_size;
+	time_t scan_duration;
+	unsigned int nb_errors;
+};
+
+/**
+ * \brief Rows of a result set being fetched
+ */
+struct sl_result_builder;
+
+/**
+ * \brief Rows of a cursor being selected, returned as soon as they are complete
+ */
+struct sl_result_selector;
+
 void sl_request_init(struct sl_request * request);
+/**
+ * \brief Check if rows of \a request should be added with sl_result_builder_select
+ *
+ * \param[in] request a request
+ * \return \b true if one of newest_only, collapse or limit is set
+ */
+bool sl_request_need_select(const struct sl_request * request);
+/**
+ * \brief Check if rows of \a request can be selected with a sl_result_selector
+ *
+ * A collapsed row counts toward limit before rows of older sessions are
+ * merged into it, so collapse with a limit needs a sl_result_builder.
+ *
+ * \param[in] request a request
+ * \return \b false if both collapse and limit are set
+ */
+bool sl_request_can_stream(const struct sl_request * request);
+
+/**
+ * \brief Create an empty result set builder
+ *
+ * \return should be released with sl_result_builder_finish or sl_result_builder_free
+ */
+struct sl_result_builder * sl_result_builder_new(void);
+/**
+ * \brief Copy \a file into \a builder
+ *
+ * \param[in] builder a result set builder
+ * \param[in] file a row, its strings can be borrowed
+ * \return 0 if ok
+ */
+int sl_result_builder_add(struct sl_result_builder * builder, const struct sl_result_file * file);
+/**
+ * \brief Set sessions which rows can come from, so that rows of a same path are only collapsed across consecutive sessions
+ *
+ * Without these sessions, ids of collapsed sessions should be consecutive.
+ *
+ * \param[in] builder a result set builder
+ * \param[in] sessions ids of sessions, from the newest one. Copied
+ * \param[in] nb_sessions number of \a sessions
+ * \return 0 if ok
+ */
+int sl_result_builder_set_sessions(struct sl_result_builder * builder, const int * sessions, unsigned int nb_sessions);
+/**
+ * \brief Copy \a file into \a builder, if options of \a request keep it
+ *
+ * Rows should be given from the newest session, like find_file returns them.
+ * With collapse, a row of a path is merged into the kept row of this path
+ * only if its session is just before the oldest session of the kept row.
+ *
+ * \param[in] builder a result set builder
+ * \param[in] request options newest_only, collapse and limit
+ * \param[in] file a row, its strings can be borrowed
+ * \return a value which correspond to
+ * \li 0 if \a file is kept or merged into a row with the same path
+ * \li 1 if \a file is skipped
+ * \li 2 if \a file is skipped and no following row can be kept
+ * \li < 0 if error
+ */
+int sl_result_builder_select(struct sl_result_builder * builder, const struct sl_request * request, const struct sl_result_file * file);
+/**
+ * \brief Build result set and release \a builder
+ *
+ * \param[in] builder a result set builder
+ * \return \b NULL if error, should be released with sl_result_files_free
+ */
+struct sl_result_files * sl_result_builder_finish(struct sl_result_builder * builder);
+/**
+ * \brief Release \a builder without building result set
+ *
+ * \param[in] builder a result set builder, may be \b NULL
+ */
+void sl_result_builder_free(struct sl_result_builder * builder);
+
+/**
+ * \brief Create a selector of rows, by options of \a request
+ *
+ * Unlike sl_result_builder_select, a collapsed row is returned once no row
+ * of older sessions can be merged into it, instead of once all rows are
+ * fetched. So collapsed rows come by their oldest session.
+ *
+ * \param[in] request options newest_only, collapse and limit, see sl_request_can_stream
+ * \return \b NULL if error, should be released with sl_result_selector_free
+ */
+struct sl_result_selector * sl_result_selector_new(const struct sl_request * request);
+/**
+ * \brief Copy \a file into \a selector, if options of request keep it
+ *
+ * Rows should be given from the newest session, and only once
+ * sl_result_selector_next has returned \b NULL.
+ *
+ * \param[in] selector a selector
+ * \param[in] file a row, its strings can be borrowed
+ * \return a value which correspond to
+ * \li 0 if \a file is kept or merged into a row with the same path
+ * \li 2 if \a file is skipped and no following row can be kept
+ * \li < 0 if error
+ */
+int sl_result_selector_add(struct sl_result_selector * selector, const struct sl_result_file * file);
+/**
+ * \brief Make rows which wait for rows of older sessions ready, once all rows have been added
+ *
+ * \param[in] selector a selector
+ * \return 0 if ok
+ */
+int sl_result_selector_finish(struct sl_result_selector * selector);
+void sl_result_selector_free(struct sl_result_selector * selector);
+/**
+ * \brief Get next ready row
+ *
+ * \param[in] selector a selector
+ * \return \b NULL if no row is ready, else a row valid until next call to sl_result_selector_add
+ */
+const struct sl_result_file * sl_result_selector_next(struct sl_result_selector * selector);
+/**
+ * \brief Set sessions which rows can come from, see sl_result_builder_set_sessions
+ *
+ * \param[in] selector a selector
+ * \param[in] sessions ids of sessions, from the newest one. Copied
+ * \param[in] nb_sessions number of \a sessions
+ * \return 0 if ok
+ */
+int sl_result_selector_set_sessions(struct sl_result_selector * selector, const int * sessions, unsigned int nb_sessions);
 
+/**
+ * \brief Copy \a src into \a dest, strings included
+ *
+ * \param[out] dest should be released with sl_result_file_free
+ * \param[in] src a row, like those returned by a cursor
+ */
+void sl_result_file_copy(struct sl_result_file * dest, const struct sl_result_file * src);
 void sl_result_file_free(struct sl_result_file * file);
 void sl_result_files_free(struct sl_result_files * result);
+/**
+ * \brief Release result sets returned by find_files
+ *
+ * \param[in] results an array of result sets, may be \b NULL
+ * \param[in] nb_results number of \a results
+ */
+void sl_result_files_free_array(struct sl_result_files ** results, unsigned int nb_results);
 
 #endif
 
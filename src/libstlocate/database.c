@@ -35,6 +35,7 @@
 
 #include <stlocate/hashtable.h>
 #include <stlocate/log.h>
+#include <stlocate/result.h>
 #include <stlocate/string.h>
 
 #include "database.h"
@@ -76,12 +77,50 @@ void sl_database_conf(const struct sl_hashtable * params) {
 		}
 	}
 
+	enum sl_database_commit commit = sl_database_commit_session;
+	struct sl_hashtable_value commit_val = sl_hashtable_get(params, "commit");
+	if (commit_val.type == sl_hashtable_value_string) {
+		if (!strcmp(commit_val.value.string, "filesystem"))
+			commit = sl_database_commit_filesystem;
+		else if (strcmp(commit_val.value.string, "session")) {
+			sl_log_write(sl_log_level_err, sl_log_type_conf, "Database: commit should be 'session' or 'filesystem' but not '%s'", commit_val.value.string);
+			return;
+		}
+	}
+
+	int commit_nb_files = 0;
+	struct sl_hashtable_value commit_nb_files_val = sl_hashtable_get(params, "commit_nb_files");
+	if (commit_nb_files_val.type != sl_hashtable_value_null) {
+		commit_nb_files = sl_hashtable_val_convert_to_signed_integer(&commit_nb_files_val);
+		if (commit_nb_files < 0) {
+			sl_log_write(sl_log_level_err, sl_log_type_conf, "Database: commit_nb_files should be a positive integer but not %d", commit_nb_files);
+			return;
+		}
+	}
+
+	int commit_delay = 0;
+	struct sl_hashtable_value commit_delay_val = sl_hashtable_get(params, "commit_delay");
+	if (commit_delay_val.type != sl_hashtable_value_null) {
+		commit_delay = sl_hashtable_val_convert_to_signed_integer(&commit_delay_val);
+		if (commit_delay < 0) {
+			sl_log_write(sl_log_level_err, sl_log_type_conf, "Database: commit_delay should be a positive integer but not %d", commit_delay);
+			return;
+		}
+	}
+
+	// intermediate commits imply that each filesystem is committed separately
+	if (commit_nb_files > 0 || commit_delay > 0)
+		commit = sl_database_commit_filesystem;
+
 	struct sl_database * db = sl_database_get_driver(driver.value.string);
 	if (db != NULL) {
 		struct sl_database_config * conf = db->ops->add(params);
 
 		if (conf != NULL) {
 			conf->nb_session_kept = nsk;
+			conf->commit = commit;
+			conf->commit_nb_files = commit_nb_files;
+			conf->commit_delay = commit_delay;
 
 			pthread_mutex_lock(&sl_database_lock);
 
@@ -107,6 +146,35 @@ static void sl_database_conf_free(void * key __attribute__((unused)), void * val
 	conf->ops->free(conf);
 }
 
+struct sl_result_files * sl_database_fetch_files(struct sl_database_cursor * cursor) {
+	if (cursor == NULL)
+		return NULL;
+
+	struct sl_database_connection * connect = cursor->connect;
+	struct sl_result_builder * builder = sl_result_builder_new();
+
+	const struct sl_result_file * file;
+	while ((file = connect->ops->next_file(cursor)) != NULL) {
+		if (sl_result_builder_add(builder, file)) {
+			sl_log_write(sl_log_level_err, sl_log_type_database, "Database: not enough memory to get result");
+			connect->ops->close_cursor(cursor);
+			sl_result_builder_free(builder);
+			return NULL;
+		}
+	}
+
+	if (connect->ops->close_cursor(cursor)) {
+		sl_result_builder_free(builder);
+		return NULL;
+	}
+
+	struct sl_result_files * result = sl_result_builder_finish(builder);
+	if (result == NULL)
+		sl_log_write(sl_log_level_err, sl_log_type_database, "Database: not enough memory to get result");
+
+	return result;
+}
+
 struct sl_database_config * sl_database_get_config_by_name(const char * name) {
 	if (name == NULL) {
 		sl_log_write(sl_log_level_err, sl_log_type_database, "Try to get a database configuration with name is NULL");
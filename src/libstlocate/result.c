@@ -25,10 +25,91 @@
 *  Last modified: Fri, 23 Aug 2013 09:55:10 +0200                         *
 \*************************************************************************/
 
-// free
+#define _GNU_SOURCE
+// bool
+#include <stdbool.h>
+// asprintf
+#include <stdio.h>
+// bsearch, calloc, free, malloc, realloc
 #include <stdlib.h>
+// memcpy, strdup, strlen
+#include <string.h>
 
+#include <stlocate/hashtable.h>
 #include <stlocate/result.h>
+#include <stlocate/string.h>
+#include <stlocate/util.h>
+
+// offset of a NULL string
+#define SL_RESULT_BUILDER_NULL ((size_t) -1)
+
+struct sl_result_builder {
+	// strings are kept as offsets until the buffer stops moving
+	struct sl_result_builder_row {
+		struct sl_result_file file;
+		size_t fs_uuid;
+		size_t fs_label;
+		size_t mount_point;
+		size_t path;
+	} * rows;
+	unsigned int nb_rows;
+	unsigned int max_rows;
+
+	char * strings;
+	size_t strings_length;
+	size_t strings_capacity;
+
+	// offsets of strings shared by rows of a same session2filesystem
+	struct sl_hashtable * interned;
+	// index of newest row by filesystem and path, used only to collapse rows
+	struct sl_hashtable * collapsed;
+	// sessions which rows can come from, from the newest one
+	int * sessions;
+	unsigned int nb_sessions;
+	// oldest session of kept rows
+	int oldest_session_id;
+};
+
+struct sl_result_selector {
+	bool newest_only;
+	bool collapse;
+	unsigned int limit;
+	unsigned int nb_kept;
+
+	// session of last added row
+	int session_id;
+	bool has_session;
+
+	/**
+	 * Rows are given from the newest session, so a collapsed row can only be
+	 * merged with a row of the session just before its oldest session.
+	 * Rows of the current session wait for the following session, and rows
+	 * of the previous session which have not been merged are ready.
+	 */
+	struct sl_result_selector_rows {
+		struct sl_result_selector_row {
+			struct sl_result_file file;
+			char * key;
+		} ** rows;
+		unsigned int nb_rows;
+		unsigned int max_rows;
+		// index of row by filesystem and path, only with collapse
+		struct sl_hashtable * keys;
+	} current, previous, ready;
+	unsigned int next_ready;
+
+	// sessions which rows can come from, from the newest one
+	int * sessions;
+	unsigned int nb_sessions;
+};
+
+static int sl_result_builder_append(struct sl_result_builder * builder, const char * string, bool intern, size_t * offset);
+static int sl_result_builder_compare_session(const void * a, const void * b);
+static bool sl_result_builder_is_next_session(const struct sl_result_builder * builder, int session_id, int next_session_id);
+static bool sl_result_is_next_session(const int * sessions, unsigned int nb_sessions, int session_id, int next_session_id);
+static int sl_result_selector_append(struct sl_result_selector_rows * rows, struct sl_result_selector_row * row);
+static void sl_result_selector_release(struct sl_result_selector_rows * rows);
+static int sl_result_selector_set_ready(struct sl_result_selector * selector, struct sl_result_selector_rows * rows);
 
 void sl_request_init(struct sl_request * request) {
 	request->session_min_id = 0;
@@ -36,8 +117,491 @@ void sl_request_init(struct sl_request * request) {
 
 	request->dev_no = -1;
 	request->inode = -1;
+	request->fs_uuid = NULL;
+	request->path_pattern = NULL;
+	request->path_regex = false;
+	request->path = NULL;
+	request->path_subtree = false;
+
+	request->newest_only = false;
+	request->collapse = false;
+	request->limit = 0;
+}
+
+bool sl_request_need_select(const struct sl_request * request) {
+	return request->newest_only || request->collapse || request->limit > 0;
+}
+
+bool sl_request_can_stream(const struct sl_request * request) {
+	return !request->collapse || request->limit == 0;
+}
+
+
+struct sl_result_builder * sl_result_builder_new() {
+	struct sl_result_builder * builder = malloc(sizeof(struct sl_result_builder));
+	builder->rows = NULL;
+	builder->nb_rows = builder->max_rows = 0;
+	builder->strings = NULL;
+	builder->strings_length = builder->strings_capacity = 0;
+	builder->interned = sl_hashtable_new2(sl_string_compute_hash, sl_util_basic_free);
+	builder->collapsed = NULL;
+	builder->sessions = NULL;
+	builder->nb_sessions = 0;
+	builder->oldest_session_id = 0;
+	return builder;
+}
+
+int sl_result_builder_set_sessions(struct sl_result_builder * builder, const int * sessions, unsigned int nb_sessions) {
+	free(builder->sessions);
+	builder->sessions = NULL;
+	builder->nb_sessions = 0;
+
+	if (nb_sessions == 0)
+		return 0;
+
+	builder->sessions = malloc(nb_sessions * sizeof(int));
+	if (builder->sessions == NULL)
+		return 1;
+
+	memcpy(builder->sessions, sessions, nb_sessions * sizeof(int));
+	builder->nb_sessions = nb_sessions;
+
+	return 0;
+}
+
+int sl_result_builder_add(struct sl_result_builder * builder, const struct sl_result_file * file) {
+	if (builder->nb_rows == builder->max_rows) {
+		unsigned int max_rows = builder->max_rows > 0 ? builder->max_rows << 1 : 16;
+		void * new_addr = realloc(builder->rows, max_rows * sizeof(struct sl_result_builder_row));
+		if (new_addr == NULL)
+			return 1;
+
+		builder->rows = new_addr;
+		builder->max_rows = max_rows;
+	}
+
+	struct sl_result_builder_row * row = builder->rows + builder->nb_rows;
+	row->file = *file;
+
+	int failed = sl_result_builder_append(builder, file->fs_uuid, true, &row->fs_uuid);
+	if (!failed)
+		failed = sl_result_builder_append(builder, file->fs_label, true, &row->fs_label);
+	if (!failed)
+		failed = sl_result_builder_append(builder, file->mount_point, true, &row->mount_point);
+	if (!failed)
+		failed = sl_result_builder_append(builder, file->path, false, &row->path);
+
+	if (!failed)
+		builder->nb_rows++;
+
+	return failed;
 }
 
+int sl_result_builder_select(struct sl_result_builder * builder, const struct sl_request * request, const struct sl_result_file * file) {
+	// first row belongs to the newest session
+	if (request->newest_only && builder->nb_rows > 0 && file->session_id != builder->rows[0].file.session_id)
+		return 2;
+
+	if (!request->collapse) {
+		if (request->limit > 0 && builder->nb_rows >= request->limit)
+			return 2;
+
+		return sl_result_builder_add(builder, file) ? -1 : 0;
+	}
+
+	// an older row only extends the range of sessions of the kept one, if there is no gap between them
+	char * key = NULL;
+	if (asprintf(&key, "%d:%s", file->fs_id, file->path) < 0)
+		return -1;
+
+	if (builder->collapsed == NULL)
+		builder->collapsed = sl_hashtable_new2(sl_string_compute_hash, sl_util_basic_free);
+
+	unsigned int * kept_row = NULL;
+	struct sl_hashtable_value val = sl_hashtable_get(builder->collapsed, key);
+	if (val.type == sl_hashtable_value_custom) {
+		kept_row = val.value.custom;
+
+		struct sl_result_file * kept = &builder->rows[*kept_row].file;
+		if (sl_result_builder_is_next_session(builder, kept->first_session_id, file->session_id)) {
+			kept->first_session_id = file->first_session_id;
+			if (file->first_session_id < builder->oldest_session_id)
+				builder->oldest_session_id = file->first_session_id;
+
+			free(key);
+			return 0;
+		}
+	}
+
+	if (request->limit > 0 && builder->nb_rows >= request->limit) {
+		free(key);
+
+		// rows are given from the newest session, so no kept row can be extended anymore
+		if (file->session_id < builder->oldest_session_id && !sl_result_builder_is_next_session(builder, builder->oldest_session_id, file->session_id))
+			return 2;
+
+		return 1;
+	}
+
+	if (sl_result_builder_add(builder, file)) {
+		free(key);
+		return -1;
+	}
+
+	if (builder->nb_rows == 1 || file->first_session_id < builder->oldest_session_id)
+		builder->oldest_session_id = file->first_session_id;
+
+	// following rows of this path are merged into the new one
+	if (kept_row != NULL) {
+		*kept_row = builder->nb_rows - 1;
+		free(key);
+		return 0;
+	}
+
+	kept_row = malloc(sizeof(unsigned int));
+	if (kept_row == NULL) {
+		free(key);
+		return -1;
+	}
+
+	*kept_row = builder->nb_rows - 1;
+	sl_hashtable_put(builder->collapsed, key, sl_hashtable_val_custom(kept_row));
+
+	return 0;
+}
+
+static int sl_result_builder_compare_session(const void * a, const void * b) {
+	const int * sa = a, * sb = b;
+	return *sb - *sa;
+}
+
+/**
+ * \brief Check if \a next_session_id is the session just before \a session_id
+ *
+ * Without sessions given by sl_result_builder_set_sessions, ids of
+ * sessions should be consecutive.
+ */
+static bool sl_result_builder_is_next_session(const struct sl_result_builder * builder, int session_id, int next_session_id) {
+	return sl_result_is_next_session(builder->sessions, builder->nb_sessions, session_id, next_session_id);
+}
+
+static bool sl_result_is_next_session(const int * sessions, unsigned int nb_sessions, int session_id, int next_session_id) {
+	if (sessions == NULL)
+		return next_session_id == session_id - 1;
+
+	const int * found = bsearch(&session_id, sessions, nb_sessions, sizeof(int), sl_result_builder_compare_session);
+	if (found == NULL || found + 1 == sessions + nb_sessions)
+		return false;
+
+	return found[1] == next_session_id;
+}
+
+static int sl_result_builder_append(struct sl_result_builder * builder, const char * string, bool intern, size_t * offset) {
+	if (string == NULL) {
+		*offset = SL_RESULT_BUILDER_NULL;
+		return 0;
+	}
+
+	if (intern) {
+		struct sl_hashtable_value val = sl_hashtable_get(builder->interned, string);
+		if (val.type == sl_hashtable_value_unsigned_integer) {
+			*offset = val.value.unsigned_integer;
+			return 0;
+		}
+	}
+
+	size_t length = strlen(string) + 1;
+	if (builder->strings_length + length > builder->strings_capacity) {
+		size_t capacity = builder->strings_capacity > 0 ? builder->strings_capacity : 4096;
+		while (builder->strings_length + length > capacity)
+			capacity <<= 1;
+
+		void * new_addr = realloc(builder->strings, capacity);
+		if (new_addr == NULL)
+			return 1;
+
+		builder->strings = new_addr;
+		builder->strings_capacity = capacity;
+	}
+
+	char * key = NULL;
+	if (intern) {
+		key = strdup(string);
+		if (key == NULL)
+			return 1;
+	}
+
+	*offset = builder->strings_length;
+	memcpy(builder->strings + builder->strings_length, string, length);
+	builder->strings_length += length;
+
+	if (intern)
+		sl_hashtable_put(builder->interned, key, sl_hashtable_val_unsigned_integer(*offset));
+
+	return 0;
+}
+
+struct sl_result_files * sl_result_builder_finish(struct sl_result_builder * builder) {
+	// result set, its rows and their strings share one allocation
+	size_t files_offset = sizeof(struct sl_result_files);
+	size_t strings_offset = files_offset + builder->nb_rows * sizeof(struct sl_result_file);
+
+	char * block = malloc(strings_offset + builder->strings_length);
+	if (block == NULL) {
+		sl_result_builder_free(builder);
+		return NULL;
+	}
+
+	struct sl_result_files * result = (struct sl_result_files *) block;
+	result->files = (struct sl_result_file *) (block + files_offset);
+	result->nb_files = builder->nb_rows;
+
+	char * strings = block + strings_offset;
+	if (builder->strings_length > 0)
+		memcpy(strings, builder->strings, builder->strings_length);
+
+	unsigned int i;
+	for (i = 0; i < builder->nb_rows; i++) {
+		const struct sl_result_builder_row * row = builder->rows + i;
+		struct sl_result_file * file = result->files + i;
+
+		*file = row->file;
+		file->fs_uuid = strings + row->fs_uuid;
+		file->fs_label = row->fs_label != SL_RESULT_BUILDER_NULL ? strings + row->fs_label : NULL;
+		file->mount_point = strings + row->mount_point;
+		file->path = strings + row->path;
+	}
+
+	sl_result_builder_free(builder);
+
+	return result;
+}
+
+void sl_result_builder_free(struct sl_result_builder * builder) {
+	if (builder == NULL)
+		return;
+
+	free(builder->rows);
+	free(builder->strings);
+	sl_hashtable_free(builder->interned);
+	sl_hashtable_free(builder->collapsed);
+	free(builder->sessions);
+	free(builder);
+}
+
+
+int sl_result_selector_add(struct sl_result_selector * selector, const struct sl_result_file * file) {
+	// previous ready rows have been returned by sl_result_selector_next
+	sl_result_selector_release(&selector->ready);
+	selector->next_ready = 0;
+
+	if (selector->has_session && file->session_id != selector->session_id) {
+		if (selector->newest_only)
+			return 2;
+
+		// rows of previous session which have not been merged can not be merged anymore
+		if (sl_result_selector_set_ready(selector, &selector->previous))
+			return -1;
+
+		if (sl_result_is_next_session(selector->sessions, selector->nb_sessions, selector->session_id, file->session_id)) {
+			struct sl_result_selector_rows previous = selector->previous;
+			selector->previous = selector->current;
+			selector->current = previous;
+		} else if (sl_result_selector_set_ready(selector, &selector->current))
+			return -1;
+	}
+	selector->session_id = file->session_id;
+	selector->has_session = true;
+
+	if (!selector->collapse && selector->limit > 0 && selector->nb_kept >= selector->limit)
+		return 2;
+
+	char * key = NULL;
+	if (selector->collapse && asprintf(&key, "%d:%s", file->fs_id, file->path) < 0)
+		return -1;
+
+	// older row extends the range of sessions of the row kept by previous session
+	if (key != NULL && selector->previous.keys != NULL) {
+		struct sl_hashtable_value val = sl_hashtable_get(selector->previous.keys, key);
+		if (val.type == sl_hashtable_value_unsigned_integer && selector->previous.rows[val.value.unsigned_integer] != NULL) {
+			struct sl_result_selector_row * row = selector->previous.rows[val.value.unsigned_integer];
+			free(key);
+
+			if (sl_result_selector_append(&selector->current, row))
+				return -1;
+
+			selector->previous.rows[val.value.unsigned_integer] = NULL;
+			row->file.first_session_id = file->first_session_id;
+			return 0;
+		}
+	}
+
+	struct sl_result_selector_row * row = malloc(sizeof(struct sl_result_selector_row));
+	if (row == NULL) {
+		free(key);
+		return -1;
+	}
+
+	sl_result_file_copy(&row->file, file);
+	row->key = key;
+
+	int failed;
+	if (selector->collapse)
+		failed = sl_result_selector_append(&selector->current, row);
+	else
+		failed = sl_result_selector_append(&selector->ready, row);
+
+	if (failed) {
+		sl_result_file_free(&row->file);
+		free(row->key);
+		free(row);
+		return -1;
+	}
+
+	selector->nb_kept++;
+
+	return 0;
+}
+
+static int sl_result_selector_append(struct sl_result_selector_rows * rows, struct sl_result_selector_row * row) {
+	if (rows->nb_rows == rows->max_rows) {
+		unsigned int max_rows = rows->max_rows > 0 ? rows->max_rows << 1 : 16;
+		void * new_addr = realloc(rows->rows, max_rows * sizeof(struct sl_result_selector_row *));
+		if (new_addr == NULL)
+			return 1;
+
+		rows->rows = new_addr;
+		rows->max_rows = max_rows;
+	}
+
+	if (row->key != NULL) {
+		if (rows->keys == NULL)
+			rows->keys = sl_hashtable_new(sl_string_compute_hash);
+		sl_hashtable_put(rows->keys, row->key, sl_hashtable_val_unsigned_integer(rows->nb_rows));
+	}
+
+	rows->rows[rows->nb_rows] = row;
+	rows->nb_rows++;
+
+	return 0;
+}
+
+int sl_result_selector_finish(struct sl_result_selector * selector) {
+	sl_result_selector_release(&selector->ready);
+	selector->next_ready = 0;
+
+	if (sl_result_selector_set_ready(selector, &selector->previous))
+		return 1;
+	return sl_result_selector_set_ready(selector, &selector->current);
+}
+
+void sl_result_selector_free(struct sl_result_selector * selector) {
+	if (selector == NULL)
+		return;
+
+	sl_result_selector_release(&selector->current);
+	sl_result_selector_release(&selector->previous);
+	sl_result_selector_release(&selector->ready);
+	free(selector->current.rows);
+	free(selector->previous.rows);
+	free(selector->ready.rows);
+	free(selector->sessions);
+	free(selector);
+}
+
+struct sl_result_selector * sl_result_selector_new(const struct sl_request * request) {
+	struct sl_result_selector * selector = calloc(1, sizeof(struct sl_result_selector));
+	if (selector == NULL)
+		return NULL;
+
+	selector->newest_only = request->newest_only;
+	selector->collapse = request->collapse;
+	selector->limit = request->limit;
+
+	return selector;
+}
+
+const struct sl_result_file * sl_result_selector_next(struct sl_result_selector * selector) {
+	if (selector->next_ready == selector->ready.nb_rows)
+		return NULL;
+
+	return &selector->ready.rows[selector->next_ready++]->file;
+}
+
+static void sl_result_selector_release(struct sl_result_selector_rows * rows) {
+	// keys of hashtable belong to rows
+	sl_hashtable_free(rows->keys);
+	rows->keys = NULL;
+
+	unsigned int i;
+	for (i = 0; i < rows->nb_rows; i++) {
+		struct sl_result_selector_row * row = rows->rows[i];
+		if (row == NULL)
+			continue;
+
+		sl_result_file_free(&row->file);
+		free(row->key);
+		free(row);
+	}
+	rows->nb_rows = 0;
+}
+
+static int sl_result_selector_set_ready(struct sl_result_selector * selector, struct sl_result_selector_rows * rows) {
+	sl_hashtable_free(rows->keys);
+	rows->keys = NULL;
+
+	int failed = 0;
+	unsigned int i;
+	for (i = 0; i < rows->nb_rows; i++) {
+		struct sl_result_selector_row * row = rows->rows[i];
+		if (row == NULL)
+			continue;
+
+		// ready rows are not merged anymore
+		if (!failed) {
+			free(row->key);
+			row->key = NULL;
+			failed = sl_result_selector_append(&selector->ready, row);
+		}
+
+		if (failed) {
+			sl_result_file_free(&row->file);
+			free(row->key);
+			free(row);
+		}
+	}
+	rows->nb_rows = 0;
+
+	return failed;
+}
+
+int sl_result_selector_set_sessions(struct sl_result_selector * selector, const int * sessions, unsigned int nb_sessions) {
+	free(selector->sessions);
+	selector->sessions = NULL;
+	selector->nb_sessions = 0;
+
+	if (nb_sessions == 0)
+		return 0;
+
+	selector->sessions = malloc(nb_sessions * sizeof(int));
+	if (selector->sessions == NULL)
+		return 1;
+
+	memcpy(selector->sessions, sessions, nb_sessions * sizeof(int));
+	selector->nb_sessions = nb_sessions;
+
+	return 0;
+}
+
+
+void sl_result_file_copy(struct sl_result_file * dest, const struct sl_result_file * src) {
+	*dest = *src;
+
+	dest->fs_uuid = strdup(src->fs_uuid);
+	dest->fs_label = src->fs_label != NULL ? strdup(src->fs_label) : NULL;
+	dest->mount_point = strdup(src->mount_point);
+	dest->path = strdup(src->path);
+}
 
 void sl_result_file_free(struct sl_result_file * file) {
 	free(file->fs_uuid);
@@ -47,10 +611,18 @@ void sl_result_file_free(struct sl_result_file * file) {
 }
 
 void sl_result_files_free(struct sl_result_files * result) {
-	unsigned int i;
-	for (i = 0; i < result->nb_files; i++)
-		sl_result_file_free(result->files + i);
-	free(result->files);
+	// see sl_result_builder_finish
 	free(result);
 }
 
+void sl_result_files_free_array(struct sl_result_files ** results, unsigned int nb_results) {
+	if (results == NULL)
+		return;
+
+	unsigned int i;
+	for (i = 0; i < nb_results; i++)
+		if (results[i] != NULL)
+			sl_result_files_free(results[i]);
+	free(results);
+}
+
@@ -0,0 +1,195 @@
+/*************************************************************************\
+*                  ______  __                 __                          *
+*                 / __/ /_/ /  ___  _______ _/ /____                      *
+*                _\ \/ __/ /__/ _ \/ __/ _ `/ __/ -_)                     *
+*               /___/\__/____/\___/\__/\_,_/\__/\__/                      *
+*                                                                         *
+*  ---------------------------------------------------------------------  *
+*  This file is a part of StLocate                                        *
+*                                                                         *
+*  StLocate is free software; you can redistribute it and/or              *
+*  modify it under the terms of the GNU General Public License            *
+*  as published by the Free Software Foundation; either version 3         *
+*  of the License, or (at your option) any later version.                 *
+*                                                                         *
+*  This program is distributed in the hope that it will be useful,        *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+*  GNU General Public License for more details.                           *
+*                                                                         *
+*  You should have received a copy of the GNU General Public License      *
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.  *
+*                                                                         *
+*  ---------------------------------------------------------------------  *
+*  Copyright (C) 2013, Clercin guillaume <gclercin@intellique.com>        *
+*  Last modified: Mon, 19 Oct 2026                                        *
+\*************************************************************************/
+
+#ifndef __STLOCATE_DB_FLAT_H__
+#define __STLOCATE_DB_FLAT_H__
+
+// bool
+#include <stdbool.h>
+// size_t
+#include <stddef.h>
+// int32_t, int64_t, uint32_t, uint64_t
+#include <stdint.h>
+// time_t
+#include <sys/types.h>
+
+#include <stlocate/database.h>
+
+struct sl_filesystem;
+struct sl_result_statistics;
+struct stat;
+
+#define SL_DATABASE_FLAT_MAGIC "STLFLAT"
+// format 2 has no blob of paths, it is still readable
+#define SL_DATABASE_FLAT_FORMAT 3
+// paths are front coded, with a full path every SL_DATABASE_FLAT_RESTART_INTERVAL paths
+#define SL_DATABASE_FLAT_RESTART_INTERVAL 16
+
+enum sl_database_flat_search_index {
+	sl_database_flat_search_index_none,
+	sl_database_flat_search_index_blob,
+};
+
+struct sl_database_flat_config_private {
+	char * path;
+	enum sl_database_flat_search_index search_index;
+};
+
+/**
+ * \brief Header of a session file
+ *
+ * A session file is written once, when its session is finished, then
+ * it is only read by using mmap. Offsets are relative to the beginning
+ * of file and each section is aligned on 8 bytes.
+ */
+struct sl_database_flat_header {
+	char magic[8];
+	uint32_t format;
+	int32_t host_id;
+	int32_t session_id;
+	uint32_t nb_filesystems;
+	int64_t start_time;
+	int64_t end_time;
+
+	uint64_t nb_files;
+	uint64_t filesystems_offset;
+	uint64_t strings_offset;
+	uint64_t keys_offset;
+	uint64_t records_offset;
+	uint64_t restarts_offset;
+	uint64_t paths_offset;
+	uint64_t paths_size;
+	uint64_t file_size;
+
+	/**
+	 * Since format 3, with search_index = blob, paths of records are also
+	 * stored in record order as one blob of strings separated by '\0'.
+	 * Blob restarts give offset of path of every
+	 * SL_DATABASE_FLAT_RESTART_INTERVAL records. Offsets are 0 without blob.
+	 */
+	uint64_t blob_restarts_offset;
+	uint64_t blob_offset;
+	uint64_t blob_size;
+};
+
+/**
+ * \brief A filesystem of session
+ *
+ * Strings are offsets into strings section, UINT32_MAX means no value.
+ * Records of a filesystem are contiguous and sorted by path.
+ */
+struct sl_database_flat_filesystem {
+	int32_t id;
+	uint32_t uuid;
+	uint32_t label;
+	uint32_t mount_point;
+	uint64_t dev_no;
+	uint64_t first_record;
+	uint64_t nb_records;
+
+	// counters collected while updating this filesystem
+	uint64_t nb_files;
+	uint64_t nb_directories;
+	uint64_t total_size;
+	int64_t scan_duration;
+	uint64_t nb_errors;
+};
+
+/**
+ * \brief Index of records, sorted by device then by inode
+ */
+struct sl_database_flat_key {
+	uint64_t dev_no;
+	uint64_t inode;
+	uint64_t record;
+};
+
+struct sl_database_flat_record {
+	uint32_t filesystem;
+	uint32_t mode;
+	uint32_t uid;
+	uint32_t gid;
+	int64_t size;
+	int64_t access_time;
+	int64_t modif_time;
+	uint64_t inode;
+};
+
+/**
+ * \brief A mapped session file
+ */
+struct sl_database_flat_session {
+	char * path;
+	void * address;
+	size_t length;
+
+	const struct sl_database_flat_header * header;
+	const struct sl_database_flat_filesystem * filesystems;
+	const char * strings;
+	const struct sl_database_flat_key * keys;
+	const struct sl_database_flat_record * records;
+	const uint64_t * restarts;
+	const unsigned char * paths;
+	// NULL if session has no blob of paths
+	const uint64_t * blob_restarts;
+	const char * blob;
+};
+
+struct sl_database_flat_builder;
+struct sl_database_flat_search;
+
+struct sl_database_config * sl_database_flat_config_add(struct sl_database * driver, const struct sl_hashtable * params);
+struct sl_database_connection * sl_database_flat_connection_add(struct sl_database_config * config, bool read_only);
+
+int sl_database_flat_builder_add_file(struct sl_database_flat_builder * builder, int s2fs, const char * path, const struct stat * st);
+int sl_database_flat_builder_add_filesystem(struct sl_database_flat_builder * builder, int fs_id, const struct sl_filesystem * fs);
+void sl_database_flat_builder_commit(struct sl_database_flat_builder * builder);
+void sl_database_flat_builder_free(struct sl_database_flat_builder * builder);
+struct sl_database_flat_builder * sl_database_flat_builder_new(int host_id, int session_id, time_t start_time);
+void sl_database_flat_builder_rollback(struct sl_database_flat_builder * builder);
+int sl_database_flat_builder_set_statistics(struct sl_database_flat_builder * builder, int s2fs, const struct sl_result_statistics * stats);
+int sl_database_flat_builder_write(struct sl_database_flat_builder * builder, const char * directory, time_t end_time, bool with_blob);
+
+void sl_database_flat_search_free(struct sl_database_flat_search * search);
+bool sl_database_flat_search_match(struct sl_database_flat_search * search, const char * path);
+struct sl_database_flat_search * sl_database_flat_search_new(const char * pattern, bool regex);
+int sl_database_flat_search_session(const struct sl_database_flat_search * search, const struct sl_database_flat_session * session, uint64_t first_record, uint64_t last_record, uint64_t ** records, uint64_t * nb_records);
+
+uint64_t sl_database_flat_session_find_inode(const struct sl_database_flat_session * session, uint64_t dev_no, uint64_t inode);
+bool sl_database_flat_session_find_path(const struct sl_database_flat_session * session, const struct sl_database_flat_filesystem * fs, const char * path, uint64_t * record);
+/**
+ * \brief Find records of \a fs which are \a path or, with \a subtree, which are under directory \a path
+ *
+ * With \a subtree and \a path "/", the range is every record of \a fs, root included.
+ */
+void sl_database_flat_session_find_path_range(const struct sl_database_flat_session * session, const struct sl_database_flat_filesystem * fs, const char * path, bool subtree, uint64_t * first_record, uint64_t * last_record);
+void sl_database_flat_session_free(struct sl_database_flat_session * session);
+const char * sl_database_flat_session_get_path(const struct sl_database_flat_session * session, uint64_t record, char ** buffer, size_t * capacity);
+const char * sl_database_flat_session_get_string(const struct sl_database_flat_session * session, uint32_t offset);
+struct sl_database_flat_session * sl_database_flat_session_open(const char * path);
+
+#endif
@@ -0,0 +1,128 @@
+/*************************************************************************\
+*                  ______  __                 __                          *
+*                 / __/ /_/ /  ___  _______ _/ /____                      *
+*                _\ \/ __/ /__/ _ \/ __/ _ `/ __/ -_)                     *
+*               /___/\__/____/\___/\__/\_,_/\__/\__/                      *
+*                                                                         *
+*  ---------------------------------------------------------------------  *
+*  This file is a part of StLocate                                        *
+*                                                                         *
+*  StLocate is free software; you can redistribute it and/or              *
+*  modify it under the terms of the GNU General Public License            *
+*  as published by the Free Software Foundation; either version 3         *
+*  of the License, or (at your option) any later version.                 *
+*                                                                         *
+*  This program is distributed in the hope that it will be useful,        *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+*  GNU General Public License for more details.                           *
+*                                                                         *
+*  You should have received a copy of the GNU General Public License      *
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.  *
+*                                                                         *
+*  ---------------------------------------------------------------------  *
+*  Copyright (C) 2013, Clercin guillaume <gclercin@intellique.com>        *
+*  Last modified: Mon, 19 Oct 2026                                        *
+\*************************************************************************/
+
+// free, malloc
+#include <stdlib.h>
+// strcmp, strdup
+#include <string.h>
+// access
+#include <unistd.h>
+
+#include <stlocate/hashtable.h>
+#include <stlocate/log.h>
+
+#include "common.h"
+
+static struct sl_database_connection * sl_database_flat_config_connect(struct sl_database_config * config);
+static struct sl_database_connection * sl_database_flat_config_connect_read_only(struct sl_database_config * config);
+static void sl_database_flat_config_free(struct sl_database_config * config);
+static int sl_database_flat_config_ping(struct sl_database_config * config);
+
+static struct sl_database_config_ops sl_database_flat_config_ops = {
+	.connect           = sl_database_flat_config_connect,
+	.connect_read_only = sl_database_flat_config_connect_read_only,
+	.free              = sl_database_flat_config_free,
+	.ping              = sl_database_flat_config_ping,
+};
+
+
+struct sl_database_config * sl_database_flat_config_add(struct sl_database * driver, const struct sl_hashtable * params) {
+	struct sl_hashtable_value storage = sl_hashtable_get(params, "storage");
+	struct sl_hashtable_value path = sl_hashtable_get(params, "path");
+
+	if (storage.type != sl_hashtable_value_string || path.type != sl_hashtable_value_string) {
+		if (storage.type != sl_hashtable_value_string)
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: storage value is required");
+		if (path.type != sl_hashtable_value_string)
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: path value is required");
+		return NULL;
+	}
+
+	enum sl_database_flat_search_index search_index = sl_database_flat_search_index_none;
+	struct sl_hashtable_value index = sl_hashtable_get(params, "search_index");
+	if (index.type == sl_hashtable_value_string) {
+		if (!strcmp(index.value.string, "blob"))
+			search_index = sl_database_flat_search_index_blob;
+		else if (strcmp(index.value.string, "none")) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: search_index should be 'none' or 'blob' but not '%s'", index.value.string);
+			return NULL;
+		}
+	}
+
+	struct sl_database_flat_config_private * self = malloc(sizeof(struct sl_database_flat_config_private));
+	self->path = strdup(path.value.string);
+	self->search_index = search_index;
+
+	struct sl_database_config * config = malloc(sizeof(struct sl_database_config));
+	config->name = strdup(storage.value.string);
+	config->ops = &sl_database_flat_config_ops;
+	config->data = self;
+	config->driver = driver;
+
+	sl_log_write(sl_log_level_info, sl_log_type_plugin_database, "Flat: new config defined { storage: '%s', path: '%s', search_index: '%s' }", storage.value.string, path.value.string, search_index == sl_database_flat_search_index_blob ? "blob" : "none");
+
+	return config;
+}
+
+static struct sl_database_connection * sl_database_flat_config_connect(struct sl_database_config * config) {
+	if (config == NULL)
+		return NULL;
+
+	return sl_database_flat_connection_add(config, false);
+}
+
+static struct sl_database_connection * sl_database_flat_config_connect_read_only(struct sl_database_config * config) {
+	if (config == NULL)
+		return NULL;
+
+	// session files are already mapped read-only, this only prevents writes
+	return sl_database_flat_connection_add(config, true);
+}
+
+static void sl_database_flat_config_free(struct sl_database_config * config) {
+	if (config == NULL)
+		return;
+
+	struct sl_database_flat_config_private * self = config->data;
+	free(self->path);
+	free(self);
+
+	free(config->name);
+	free(config);
+}
+
+static int sl_database_flat_config_ping(struct sl_database_config * config) {
+	struct sl_database_flat_config_private * self = config->data;
+
+	int failed = access(self->path, R_OK | X_OK);
+	if (!failed)
+		sl_log_write(sl_log_level_notice, sl_log_type_plugin_database, "Flat: ping database ok");
+	else
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: ping database failed");
+
+	return !failed;
+}
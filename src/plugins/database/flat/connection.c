@@ -0,0 +1,1308 @@
+/*************************************************************************\
+*                  ______  __                 __                          *
+*                 / __/ /_/ /  ___  _______ _/ /____                      *
+*                _\ \/ __/ /__/ _ \/ __/ _ `/ __/ -_)                     *
+*               /___/\__/____/\___/\__/\_,_/\__/\__/                      *
+*                                                                         *
+*  ---------------------------------------------------------------------  *
+*  This file is a part of StLocate                                        *
+*                                                                         *
+*  StLocate is free software; you can redistribute it and/or              *
+*  modify it under the terms of the GNU General Public License            *
+*  as published by the Free Software Foundation; either version 3         *
+*  of the License, or (at your option) any later version.                 *
+*                                                                         *
+*  This program is distributed in the hope that it will be useful,        *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+*  GNU General Public License for more details.                           *
+*                                                                         *
+*  You should have received a copy of the GNU General Public License      *
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.  *
+*                                                                         *
+*  ---------------------------------------------------------------------  *
+*  Copyright (C) 2013, Clercin guillaume <gclercin@intellique.com>        *
+*  Last modified: Mon, 19 Oct 2026                                        *
+\*************************************************************************/
+
+// asprintf, getline
+#define _GNU_SOURCE
+// opendir, readdir
+#include <dirent.h>
+// errno
+#include <errno.h>
+// open
+#include <fcntl.h>
+// asprintf, fclose, fopen, fprintf, getline, rename
+#include <stdio.h>
+// calloc, free, malloc, qsort, realloc
+#include <stdlib.h>
+// strchr, strcmp, strdup
+#include <string.h>
+// flock
+#include <sys/file.h>
+// fstat, mkdir, open, struct stat
+#include <sys/stat.h>
+// time
+#include <time.h>
+// close, fsync, unlink
+#include <unistd.h>
+
+#include <stlocate/filesystem.h>
+#include <stlocate/hashtable.h>
+#include <stlocate/log.h>
+#include <stlocate/result.h>
+#include <stlocate/string.h>
+
+#include "common.h"
+
+struct sl_database_flat_connection_private {
+	struct sl_database_flat_config_private * config;
+	// mapped session files, indexed by their path
+	struct sl_hashtable * sessions;
+	bool closed;
+	bool read_only;
+
+	struct sl_database_flat_builder * builder;
+	bool session_ended;
+	time_t end_time;
+	// lock of started session, which reserves its id
+	int session_lock;
+	int locked_session;
+};
+
+struct sl_database_flat_connection_cursor {
+	struct sl_database_flat_connection_private * connection;
+	int host_id;
+	struct sl_request request;
+	int session_min;
+	int session_max;
+
+	// sessions of host, from the newest
+	int * hosts;
+	int * sessions;
+	unsigned int nb_sessions;
+	unsigned int next_session;
+
+	// position of next record
+	struct sl_database_flat_session * session;
+	uint32_t next_filesystem;
+	const struct sl_database_flat_filesystem * fs;
+	uint64_t next_record;
+	uint64_t last_record;
+
+	// with a path, records of each filesystem are narrowed to a range
+	bool path_range;
+
+	// with a path pattern, records of current session found into its blob of paths
+	struct sl_database_flat_search * search;
+	uint64_t * matched;
+	uint64_t nb_matched;
+	uint64_t next_matched;
+
+	char * buffer;
+	size_t capacity;
+	struct sl_result_file file;
+	bool failed;
+
+	// rows kept by options of request
+	struct sl_result_files * selected;
+	unsigned int next_selected;
+	struct sl_result_selector * selector;
+	bool selected_all;
+};
+
+static int sl_database_flat_connection_close(struct sl_database_connection * connect);
+static int sl_database_flat_connection_free(struct sl_database_connection * connect);
+static bool sl_database_flat_connection_is_connection_closed(struct sl_database_connection * connect);
+
+static int sl_database_flat_connection_compare_session(const void * a, const void * b);
+static struct sl_database_flat_session * sl_database_flat_connection_get_session(struct sl_database_flat_connection_private * self, int host_id, int session_id);
+static unsigned int sl_database_flat_connection_list_sessions(struct sl_database_flat_connection_private * self, int host_id, int session_id, int ** hosts, int ** sessions);
+static int sl_database_flat_connection_lock_session(struct sl_database_flat_connection_private * self, int session_id);
+static int sl_database_flat_connection_registry(struct sl_database_flat_connection_private * self, const char * registry, const char * value, bool create);
+static void sl_database_flat_connection_session_free(void * key, void * value);
+static bool sl_database_flat_connection_session_is_dead(struct sl_database_flat_connection_private * self, int session_id);
+static void sl_database_flat_connection_unlock_session(struct sl_database_flat_connection_private * self);
+static int sl_database_flat_connection_write_version(struct sl_database_flat_connection_private * self, int version);
+
+static int sl_database_flat_connection_cancel_transaction(struct sl_database_connection * connect);
+static int sl_database_flat_connection_finish_transaction(struct sl_database_connection * connect);
+static int sl_database_flat_connection_start_transaction(struct sl_database_connection * connect);
+
+static int sl_database_flat_connection_finish_update(struct sl_database_connection * connect, bool commit);
+static int sl_database_flat_connection_start_update(struct sl_database_connection * connect);
+
+static int sl_database_flat_connection_create_database(struct sl_database_connection * connect, int version);
+static int sl_database_flat_connection_get_database_version(struct sl_database_connection * connect);
+static int sl_database_flat_connection_upgrade_database(struct sl_database_connection * connect, int version);
+
+static int sl_database_flat_connection_delete_old_session(struct sl_database_connection * connect, int host_id, int nb_session_kept);
+static int sl_database_flat_connection_end_session(struct sl_database_connection * connect, int session_id);
+static int sl_database_flat_connection_start_session(struct sl_database_connection * connect, int host_id);
+
+static int sl_database_flat_connection_get_host_by_name(struct sl_database_connection * connect, const char * hostname);
+static int sl_database_flat_connection_sync_file(struct sl_database_connection * connect, int s2fs, const char * filename, struct stat * st);
+static int sl_database_flat_connection_sync_filesystem(struct sl_database_connection * connect, int session_id, struct sl_filesystem * fs);
+static int sl_database_flat_connection_sync_statistics(struct sl_database_connection * connect, int s2fs, const struct sl_result_statistics * stats);
+
+static void sl_database_flat_connection_fill_result(struct sl_result_file * file, const struct sl_database_flat_session * session, const struct sl_database_flat_filesystem * fs, uint64_t record, const char * path);
+static bool sl_database_flat_connection_match_filesystem(const struct sl_database_flat_session * session, const struct sl_database_flat_filesystem * fs, const struct sl_request * request);
+static bool sl_database_flat_connection_match_path(const struct sl_request * request, const char * path);
+static struct sl_result_files * sl_database_flat_connection_find(struct sl_database_connection * connect, int host_id, struct sl_request * request);
+static struct sl_database_cursor * sl_database_flat_connection_open_cursor(struct sl_database_connection * connect, int host_id, struct sl_request * request);
+static const struct sl_result_file * sl_database_flat_connection_next_file(struct sl_database_cursor * cursor);
+static const struct sl_result_file * sl_database_flat_connection_next_selected(struct sl_database_flat_connection_cursor * cursor);
+static const struct sl_result_file * sl_database_flat_connection_cursor_next_row(struct sl_database_flat_connection_cursor * cursor);
+static int sl_database_flat_connection_close_cursor(struct sl_database_cursor * cursor);
+static struct sl_result_files ** sl_database_flat_connection_find_files(struct sl_database_connection * connect, int host_id, struct sl_request * requests, unsigned int nb_requests);
+static struct sl_database_flat_session * sl_database_flat_connection_get_session_by_id(struct sl_database_flat_connection_private * self, int session_id);
+static struct sl_result_files * sl_database_flat_connection_get_ancestors(struct sl_database_connection * connect, int session_id, int fs_id, const char * path);
+static struct sl_result_file * sl_database_flat_connection_get_file_info(struct sl_database_connection * connect, int session_id, int fs_id, const char * path);
+static struct sl_result_statistics * sl_database_flat_connection_get_statistics(struct sl_database_connection * connect, int session_id, int fs_id);
+
+static struct sl_database_connection_ops sl_database_flat_connection_ops = {
+	.close                = sl_database_flat_connection_close,
+	.free                 = sl_database_flat_connection_free,
+	.is_connection_closed = sl_database_flat_connection_is_connection_closed,
+
+	.cancel_transaction = sl_database_flat_connection_cancel_transaction,
+	.finish_transaction = sl_database_flat_connection_finish_transaction,
+	.start_transaction  = sl_database_flat_connection_start_transaction,
+
+	.finish_update = sl_database_flat_connection_finish_update,
+	.start_update  = sl_database_flat_connection_start_update,
+
+	.create_database      = sl_database_flat_connection_create_database,
+	.get_database_version = sl_database_flat_connection_get_database_version,
+	.upgrade_database     = sl_database_flat_connection_upgrade_database,
+
+	.delete_old_session = sl_database_flat_connection_delete_old_session,
+	.end_session        = sl_database_flat_connection_end_session,
+	.start_session      = sl_database_flat_connection_start_session,
+
+	.get_host_by_name = sl_database_flat_connection_get_host_by_name,
+	.sync_file        = sl_database_flat_connection_sync_file,
+	.sync_filesystem  = sl_database_flat_connection_sync_filesystem,
+	.sync_statistics  = sl_database_flat_connection_sync_statistics,
+
+	.find_file      = sl_database_flat_connection_find,
+	.open_cursor    = sl_database_flat_connection_open_cursor,
+	.next_file      = sl_database_flat_connection_next_file,
+	.close_cursor   = sl_database_flat_connection_close_cursor,
+	.find_files     = sl_database_flat_connection_find_files,
+	.get_ancestors  = sl_database_flat_connection_get_ancestors,
+	.get_file_info  = sl_database_flat_connection_get_file_info,
+	.get_statistics = sl_database_flat_connection_get_statistics,
+};
+
+
+struct sl_database_connection * sl_database_flat_connection_add(struct sl_database_config * config, bool read_only) {
+	struct sl_database_flat_config_private * db_config = config->data;
+
+	struct sl_database_flat_connection_private * self = malloc(sizeof(struct sl_database_flat_connection_private));
+	self->config = db_config;
+	self->sessions = sl_hashtable_new2(sl_string_compute_hash, sl_database_flat_connection_session_free);
+	self->closed = false;
+	self->read_only = read_only;
+	self->builder = NULL;
+	self->session_ended = false;
+	self->end_time = 0;
+	self->session_lock = -1;
+	self->locked_session = 0;
+
+	struct sl_database_connection * connection = malloc(sizeof(struct sl_database_connection));
+	connection->ops = &sl_database_flat_connection_ops;
+	connection->data = self;
+	connection->driver = config->driver;
+	connection->config = config;
+
+	return connection;
+}
+
+static int sl_database_flat_connection_close(struct sl_database_connection * connect) {
+	struct sl_database_flat_connection_private * self = connect->data;
+
+	sl_hashtable_free(self->sessions);
+	self->sessions = NULL;
+
+	sl_database_flat_builder_free(self->builder);
+	self->builder = NULL;
+	sl_database_flat_connection_unlock_session(self);
+
+	self->closed = true;
+
+	return 0;
+}
+
+static int sl_database_flat_connection_free(struct sl_database_connection * connect) {
+	struct sl_database_flat_connection_private * self = connect->data;
+
+	if (!self->closed)
+		sl_database_flat_connection_close(connect);
+
+	free(self);
+	free(connect);
+
+	return 0;
+}
+
+static bool sl_database_flat_connection_is_connection_closed(struct sl_database_connection * connect) {
+	struct sl_database_flat_connection_private * self = connect->data;
+	return self->closed;
+}
+
+
+static int sl_database_flat_connection_compare_session(const void * a, const void * b) {
+	const int * sa = a, * sb = b;
+	return *sb - *sa;
+}
+
+static struct sl_database_flat_session * sl_database_flat_connection_get_session(struct sl_database_flat_connection_private * self, int host_id, int session_id) {
+	char * path;
+	asprintf(&path, "%s/session.%d.%d", self->config->path, host_id, session_id);
+
+	struct sl_hashtable_value value = sl_hashtable_get(self->sessions, path);
+	if (value.type == sl_hashtable_value_custom) {
+		free(path);
+		return value.value.custom;
+	}
+
+	struct sl_database_flat_session * session = sl_database_flat_session_open(path);
+	if (session != NULL)
+		sl_hashtable_put(self->sessions, path, sl_hashtable_val_custom(session));
+	else
+		free(path);
+
+	return session;
+}
+
+/**
+ * List finished sessions of \a host_id (or of any host if \a host_id is negative),
+ * or only session \a session_id if positive. Sessions are sorted from the newest.
+ */
+static unsigned int sl_database_flat_connection_list_sessions(struct sl_database_flat_connection_private * self, int host_id, int session_id, int ** hosts, int ** sessions) {
+	*hosts = NULL;
+	*sessions = NULL;
+
+	DIR * dir = opendir(self->config->path);
+	if (dir == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: failed to open directory '%s' because %m", self->config->path);
+		return 0;
+	}
+
+	// pairs of (session, host), so sorting by session keeps host along
+	int * found = NULL;
+	unsigned int nb_found = 0;
+
+	struct dirent * entry;
+	while ((entry = readdir(dir)) != NULL) {
+		int host, session, length = 0;
+		if (sscanf(entry->d_name, "session.%d.%d%n", &host, &session, &length) < 2 || entry->d_name[length] != '\0')
+			continue;
+
+		if ((host_id >= 0 && host != host_id) || (session_id > 0 && session != session_id))
+			continue;
+
+		found = realloc(found, (nb_found + 1) * 2 * sizeof(int));
+		found[nb_found * 2] = session;
+		found[nb_found * 2 + 1] = host;
+		nb_found++;
+	}
+	closedir(dir);
+
+	if (nb_found == 0)
+		return 0;
+
+	qsort(found, nb_found, 2 * sizeof(int), sl_database_flat_connection_compare_session);
+
+	*hosts = malloc(nb_found * sizeof(int));
+	*sessions = malloc(nb_found * sizeof(int));
+
+	unsigned int i;
+	for (i = 0; i < nb_found; i++) {
+		(*sessions)[i] = found[i * 2];
+		(*hosts)[i] = found[i * 2 + 1];
+	}
+	free(found);
+
+	return nb_found;
+}
+
+/**
+ * A session being updated is locked by 'session.<id>.lock', created
+ * exclusively, so that concurrent updates never get the same id and so
+ * that files of a session in progress are never removed.
+ *
+ * \returns 0 if locked, 1 if id is already used and < 0 if error
+ */
+static int sl_database_flat_connection_lock_session(struct sl_database_flat_connection_private * self, int session_id) {
+	char * path;
+	asprintf(&path, "%s/session.%d.lock", self->config->path, session_id);
+
+	int fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) {
+		int failed = errno == EEXIST ? 1 : -1;
+		if (failed < 0)
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: failed to create '%s' because %m", path);
+		free(path);
+		return failed;
+	}
+	free(path);
+
+	// lock can be removed by sl_database_flat_connection_session_is_dead before being taken
+	struct stat st;
+	if (flock(fd, LOCK_EX) || fstat(fd, &st) || st.st_nlink == 0) {
+		close(fd);
+		return 1;
+	}
+
+	self->session_lock = fd;
+	self->locked_session = session_id;
+
+	return 0;
+}
+
+/**
+ * \brief Check if files of session \a session_id were left by an update which died
+ *
+ * If so, its lock is removed.
+ */
+static bool sl_database_flat_connection_session_is_dead(struct sl_database_flat_connection_private * self, int session_id) {
+	char * path;
+	asprintf(&path, "%s/session.%d.lock", self->config->path, session_id);
+
+	bool dead = false;
+	int fd = open(path, O_RDWR);
+	if (fd < 0)
+		dead = errno == ENOENT;
+	else if (!flock(fd, LOCK_EX | LOCK_NB)) {
+		// lock is removed while being held
+		unlink(path);
+		dead = true;
+	}
+
+	if (fd >= 0)
+		close(fd);
+	free(path);
+
+	return dead;
+}
+
+static void sl_database_flat_connection_unlock_session(struct sl_database_flat_connection_private * self) {
+	if (self->session_lock < 0)
+		return;
+
+	char * path;
+	asprintf(&path, "%s/session.%d.lock", self->config->path, self->locked_session);
+	unlink(path);
+	free(path);
+
+	close(self->session_lock);
+	self->session_lock = -1;
+	self->locked_session = 0;
+}
+
+/**
+ * Registries are text files with one value by line, id of value is its line number.
+ * Missing values are appended.
+ */
+static int sl_database_flat_connection_registry(struct sl_database_flat_connection_private * self, const char * registry, const char * value, bool create) {
+	char * path;
+	asprintf(&path, "%s/%s", self->config->path, registry);
+
+	FILE * file = fopen(path, create ? "a+" : "r");
+	if (file == NULL && !create && errno == ENOENT) {
+		free(path);
+		return -1;
+	} else if (file == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: failed to open '%s' because %m", path);
+		free(path);
+		return -1;
+	}
+
+	char * line = NULL;
+	size_t length = 0;
+	ssize_t nb_read;
+	int id = 0, found = -1;
+	while (found < 0 && (nb_read = getline(&line, &length, file)) > 0) {
+		id++;
+		if (line[nb_read - 1] == '\n')
+			line[nb_read - 1] = '\0';
+		if (!strcmp(line, value))
+			found = id;
+	}
+	free(line);
+
+	if (found < 0 && create) {
+		found = id + 1;
+		if (fprintf(file, "%s\n", value) < 0 || fflush(file) || fsync(fileno(file))) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: failed to append '%s' into '%s' because %m", value, path);
+			found = -2;
+		}
+	}
+
+	fclose(file);
+	free(path);
+
+	return found;
+}
+
+static void sl_database_flat_connection_session_free(void * key, void * value) {
+	free(key);
+	sl_database_flat_session_free(value);
+}
+
+static int sl_database_flat_connection_write_version(struct sl_database_flat_connection_private * self, int version) {
+	char * path, * tmp_path;
+	asprintf(&path, "%s/version", self->config->path);
+	asprintf(&tmp_path, "%s/version.tmp", self->config->path);
+
+	int failed = 0;
+	FILE * file = fopen(tmp_path, "w");
+	if (file == NULL)
+		failed = 1;
+	else {
+		if (fprintf(file, "%d\n", version) < 0 || fflush(file) || fsync(fileno(file)))
+			failed = 1;
+		if (fclose(file))
+			failed = 1;
+	}
+
+	if (!failed)
+		failed = rename(tmp_path, path);
+
+	if (failed) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: failed to write '%s' because %m", path);
+		unlink(tmp_path);
+	}
+
+	free(path);
+	free(tmp_path);
+
+	return failed;
+}
+
+
+static int sl_database_flat_connection_cancel_transaction(struct sl_database_connection * connect) {
+	struct sl_database_flat_connection_private * self = connect->data;
+	if (self->closed)
+		return 1;
+
+	if (self->builder != NULL)
+		sl_database_flat_builder_rollback(self->builder);
+	self->session_ended = false;
+
+	sl_log_write(sl_log_level_notice, sl_log_type_plugin_database, "Flat: cancel transaction ok");
+
+	return 0;
+}
+
+static int sl_database_flat_connection_finish_transaction(struct sl_database_connection * connect) {
+	struct sl_database_flat_connection_private * self = connect->data;
+	if (self->closed)
+		return 1;
+
+	if (self->builder == NULL)
+		return 0;
+
+	sl_database_flat_builder_commit(self->builder);
+
+	// a session file is published only once its session is finished
+	if (self->session_ended) {
+		int failed = sl_database_flat_builder_write(self->builder, self->config->path, self->end_time, self->config->search_index == sl_database_flat_search_index_blob);
+		if (failed) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: error when finish transaction");
+			return failed;
+		}
+
+		sl_database_flat_builder_free(self->builder);
+		self->builder = NULL;
+		self->session_ended = false;
+		sl_database_flat_connection_unlock_session(self);
+	}
+
+	sl_log_write(sl_log_level_notice, sl_log_type_plugin_database, "Flat: finish transaction ok");
+
+	return 0;
+}
+
+static int sl_database_flat_connection_start_transaction(struct sl_database_connection * connect) {
+	struct sl_database_flat_connection_private * self = connect->data;
+	if (self->closed || self->read_only)
+		return 1;
+
+	sl_log_write(sl_log_level_notice, sl_log_type_plugin_database, "Flat: start transaction ok");
+
+	return 0;
+}
+
+
+static int sl_database_flat_connection_finish_update(struct sl_database_connection * connect, bool commit __attribute__((unused))) {
+	struct sl_database_flat_connection_private * self = connect->data;
+	return self->closed;
+}
+
+static int sl_database_flat_connection_start_update(struct sl_database_connection * connect) {
+	struct sl_database_flat_connection_private * self = connect->data;
+	return self->closed;
+}
+
+
+static int sl_database_flat_connection_create_database(struct sl_database_connection * connect, int version) {
+	struct sl_database_flat_connection_private * self = connect->data;
+	if (self->closed)
+		return 1;
+
+	if (mkdir(self->config->path, 0755) && access(self->config->path, W_OK | X_OK)) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: failed to create directory '%s' because %m", self->config->path);
+		return 1;
+	}
+
+	int failed = sl_database_flat_connection_write_version(self, version);
+	if (!failed)
+		sl_log_write(sl_log_level_info, sl_log_type_plugin_database, "Flat: database created in '%s' (version: %d)", self->config->path, version);
+
+	return failed;
+}
+
+static int sl_database_flat_connection_get_database_version(struct sl_database_connection * connect) {
+	struct sl_database_flat_connection_private * self = connect->data;
+	if (self->closed)
+		return -1;
+
+	char * path;
+	asprintf(&path, "%s/version", self->config->path);
+
+	int version = -1;
+	FILE * file = fopen(path, "r");
+	if (file != NULL) {
+		if (fscanf(file, "%d", &version) != 1)
+			version = -1;
+		fclose(file);
+	}
+	free(path);
+
+	return version;
+}
+
+static int sl_database_flat_connection_upgrade_database(struct sl_database_connection * connect, int version) {
+	struct sl_database_flat_connection_private * self = connect->data;
+	if (self->closed)
+		return 1;
+
+	// session files do not depend on database version
+	return sl_database_flat_connection_write_version(self, version);
+}
+
+
+static int sl_database_flat_connection_delete_old_session(struct sl_database_connection * connect, int host_id, int nb_session_kept) {
+	struct sl_database_flat_connection_private * self = connect->data;
+	if (self->closed)
+		return 1;
+
+	int * hosts, * sessions;
+	unsigned int i, nb_sessions = sl_database_flat_connection_list_sessions(self, host_id, 0, &hosts, &sessions);
+
+	int nb_removed = 0, failed = 0;
+	for (i = nb_session_kept > 0 ? nb_session_kept : 0; i < nb_sessions; i++) {
+		char * path;
+		asprintf(&path, "%s/session.%d.%d", self->config->path, host_id, sessions[i]);
+
+		// mapping stays valid after unlink but is useless
+		sl_hashtable_remove(self->sessions, path);
+
+		if (unlink(path)) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: failed to remove '%s' because %m", path);
+			failed = -1;
+		} else
+			nb_removed++;
+
+		free(path);
+	}
+	free(hosts);
+	free(sessions);
+
+	// sessions of interrupted updates, sessions still locked are in progress
+	DIR * dir = opendir(self->config->path);
+	struct dirent * entry;
+	while (dir != NULL && (entry = readdir(dir)) != NULL) {
+		int host, session, length = 0;
+		if (sscanf(entry->d_name, "session.%d.lock%n", &session, &length) == 1 && length > 0 && entry->d_name[length] == '\0') {
+			if (session != self->locked_session)
+				sl_database_flat_connection_session_is_dead(self, session);
+			continue;
+		}
+
+		if (sscanf(entry->d_name, "session.%d.%d.tmp%n", &host, &session, &length) < 2 || length == 0 || entry->d_name[length] != '\0' || host != host_id)
+			continue;
+
+		if (session == self->locked_session || !sl_database_flat_connection_session_is_dead(self, session))
+			continue;
+
+		char * path;
+		asprintf(&path, "%s/%s", self->config->path, entry->d_name);
+		unlink(path);
+		free(path);
+	}
+	if (dir != NULL)
+		closedir(dir);
+
+	if (nb_removed > 0)
+		sl_log_write(sl_log_level_info, sl_log_type_plugin_database, "Flat: %d session(s) removed", nb_removed);
+
+	return failed;
+}
+
+static int sl_database_flat_connection_end_session(struct sl_database_connection * connect, int session_id) {
+	struct sl_database_flat_connection_private * self = connect->data;
+	if (self->closed)
+		return 1;
+
+	if (self->builder == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: session %d is not started", session_id);
+		return -1;
+	}
+
+	self->session_ended = true;
+	self->end_time = time(NULL);
+
+	return 0;
+}
+
+static int sl_database_flat_connection_start_session(struct sl_database_connection * connect, int host_id) {
+	struct sl_database_flat_connection_private * self = connect->data;
+	if (self->closed)
+		return 1;
+
+	int * hosts, * sessions;
+	unsigned int nb_sessions = sl_database_flat_connection_list_sessions(self, -1, 0, &hosts, &sessions);
+
+	int session_id = nb_sessions > 0 ? sessions[0] + 1 : 1;
+	free(hosts);
+	free(sessions);
+
+	// ids of sessions in progress are skipped
+	sl_database_flat_connection_unlock_session(self);
+	int failed;
+	while ((failed = sl_database_flat_connection_lock_session(self, session_id)) > 0)
+		session_id++;
+
+	if (failed < 0)
+		return -1;
+
+	sl_database_flat_builder_free(self->builder);
+	self->builder = sl_database_flat_builder_new(host_id, session_id, time(NULL));
+	self->session_ended = false;
+
+	return session_id;
+}
+
+
+static int sl_database_flat_connection_get_host_by_name(struct sl_database_connection * connect, const char * hostname) {
+	struct sl_database_flat_connection_private * self = connect->data;
+	if (self->closed)
+		return 1;
+
+	int host_id = sl_database_flat_connection_registry(self, "hosts", hostname, !self->read_only);
+	if (host_id < 0)
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: failed to get an host id");
+
+	return host_id;
+}
+
+static int sl_database_flat_connection_sync_file(struct sl_database_connection * connect, int s2fs, const char * filename, struct stat * st) {
+	struct sl_database_flat_connection_private * self = connect->data;
+	if (self->closed || self->builder == NULL)
+		return 1;
+
+	return sl_database_flat_builder_add_file(self->builder, s2fs, filename, st);
+}
+
+static int sl_database_flat_connection_sync_filesystem(struct sl_database_connection * connect, int session_id __attribute__((unused)), struct sl_filesystem * fs) {
+	struct sl_database_flat_connection_private * self = connect->data;
+	if (self->closed || self->builder == NULL)
+		return -1;
+
+	fs->id = sl_database_flat_connection_registry(self, "filesystems", fs->uuid, true);
+	if (fs->id < 0)
+		return -2;
+
+	return sl_database_flat_builder_add_filesystem(self->builder, fs->id, fs);
+}
+
+static int sl_database_flat_connection_sync_statistics(struct sl_database_connection * connect, int s2fs, const struct sl_result_statistics * stats) {
+	struct sl_database_flat_connection_private * self = connect->data;
+	if (self->closed || self->builder == NULL)
+		return 1;
+
+	return sl_database_flat_builder_set_statistics(self->builder, s2fs, stats);
+}
+
+
+static void sl_database_flat_connection_fill_result(struct sl_result_file * file, const struct sl_database_flat_session * session, const struct sl_database_flat_filesystem * fs, uint64_t record, const char * path) {
+	const struct sl_database_flat_record * rec = session->records + record;
+
+	file->session_id = session->header->session_id;
+	file->first_session_id = file->session_id;
+	file->session_start = session->header->start_time;
+	file->session_end = session->header->end_time;
+
+	// strings are borrowed from mapped session
+	file->fs_id = fs->id;
+	file->fs_uuid = (char *) sl_database_flat_session_get_string(session, fs->uuid);
+	file->fs_label = (char *) sl_database_flat_session_get_string(session, fs->label);
+
+	file->dev_no = fs->dev_no;
+	file->mount_point = (char *) sl_database_flat_session_get_string(session, fs->mount_point);
+
+	file->inode = rec->inode;
+	file->path = (char *) path;
+	file->mode = rec->mode;
+	file->uid = rec->uid;
+	file->gid = rec->gid;
+	file->size = rec->size;
+	file->atime = rec->access_time;
+	file->mtime = rec->modif_time;
+}
+
+static bool sl_database_flat_connection_match_filesystem(const struct sl_database_flat_session * session, const struct sl_database_flat_filesystem * fs, const struct sl_request * request) {
+	if (request->fs_uuid == NULL)
+		return request->dev_no == (dev_t) -1 || fs->dev_no == (uint64_t) request->dev_no;
+
+	const char * uuid = sl_database_flat_session_get_string(session, fs->uuid);
+	if (uuid == NULL || strcmp(uuid, request->fs_uuid))
+		return false;
+
+	if (request->dev_no == (dev_t) -1 || fs->dev_no == (uint64_t) request->dev_no)
+		return true;
+
+	// with uuid, device number only chooses between filesystems which share it, like subvolumes of btrfs
+	uint32_t i;
+	for (i = 0; i < session->header->nb_filesystems; i++) {
+		const struct sl_database_flat_filesystem * other = session->filesystems + i;
+		if (other->dev_no != (uint64_t) request->dev_no)
+			continue;
+
+		const char * other_uuid = sl_database_flat_session_get_string(session, other->uuid);
+		if (other_uuid != NULL && !strcmp(other_uuid, request->fs_uuid))
+			return false;
+	}
+
+	return true;
+}
+
+static bool sl_database_flat_connection_match_path(const struct sl_request * request, const char * path) {
+	if (request->path == NULL)
+		return true;
+
+	if (!request->path_subtree)
+		return !strcmp(path, request->path);
+
+	size_t length = strlen(request->path);
+	while (length > 0 && request->path[length - 1] == '/')
+		length--;
+
+	// files under root are every file but root
+	if (length == 0)
+		return strcmp(path, "/");
+
+	return !strncmp(path, request->path, length) && path[length] == '/';
+}
+
+static struct sl_result_files * sl_database_flat_connection_find(struct sl_database_connection * connect, int host_id, struct sl_request * request) {
+	return sl_database_fetch_files(sl_database_flat_connection_open_cursor(connect, host_id, request));
+}
+
+static struct sl_database_cursor * sl_database_flat_connection_open_cursor(struct sl_database_connection * connect, int host_id, struct sl_request * request) {
+	struct sl_database_flat_connection_private * self = connect->data;
+	if (self->closed)
+		return NULL;
+
+	struct sl_database_flat_connection_cursor * cursor_data = malloc(sizeof(struct sl_database_flat_connection_cursor));
+	cursor_data->connection = self;
+	cursor_data->host_id = host_id;
+	cursor_data->request = *request;
+
+	cursor_data->session_min = cursor_data->session_max = 0;
+	if (request->session_min_id < request->session_max_id) {
+		cursor_data->session_min = request->session_min_id;
+		cursor_data->session_max = request->session_max_id;
+	} else if (request->session_min_id > 0)
+		cursor_data->session_min = cursor_data->session_max = request->session_min_id;
+
+	cursor_data->nb_sessions = sl_database_flat_connection_list_sessions(self, host_id, 0, &cursor_data->hosts, &cursor_data->sessions);
+	cursor_data->next_session = 0;
+
+	cursor_data->session = NULL;
+	cursor_data->next_filesystem = 0;
+	cursor_data->fs = NULL;
+	cursor_data->next_record = cursor_data->last_record = 0;
+
+	// files under root are all files of filesystem
+	cursor_data->path_range = request->path != NULL && (!request->path_subtree || strspn(request->path, "/") < strlen(request->path));
+
+	cursor_data->search = NULL;
+	cursor_data->matched = NULL;
+	cursor_data->nb_matched = cursor_data->next_matched = 0;
+
+	cursor_data->buffer = NULL;
+	cursor_data->capacity = 0;
+	cursor_data->failed = false;
+
+	cursor_data->selected = NULL;
+	cursor_data->next_selected = 0;
+	cursor_data->selector = NULL;
+	cursor_data->selected_all = false;
+
+	struct sl_database_cursor * cursor = malloc(sizeof(struct sl_database_cursor));
+	cursor->data = cursor_data;
+	cursor->connect = connect;
+
+	if (request->path_pattern != NULL) {
+		cursor_data->search = sl_database_flat_search_new(request->path_pattern, request->path_regex);
+		if (cursor_data->search == NULL) {
+			sl_database_flat_connection_close_cursor(cursor);
+			return NULL;
+		}
+	}
+
+	return cursor;
+}
+
+static const struct sl_result_file * sl_database_flat_connection_next_file(struct sl_database_cursor * cursor) {
+	struct sl_database_flat_connection_cursor * self = cursor->data;
+	if (!sl_request_need_select(&self->request))
+		return sl_database_flat_connection_cursor_next_row(self);
+
+	if (sl_request_can_stream(&self->request))
+		return sl_database_flat_connection_next_selected(self);
+
+	// collapsed rows are selected at first call, reading stops once no more row can be kept
+	if (self->selected == NULL && !self->failed) {
+		struct sl_result_builder * builder = sl_result_builder_new();
+
+		// rows are collapsed only across consecutive sessions of host
+		int status = 0;
+		if (sl_result_builder_set_sessions(builder, self->sessions, self->nb_sessions))
+			status = -1;
+
+		const struct sl_result_file * file;
+		while (status >= 0 && status < 2 && (file = sl_database_flat_connection_cursor_next_row(self)) != NULL)
+			status = sl_result_builder_select(builder, &self->request, file);
+
+		if (status < 0) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: not enough memory to get result");
+			sl_result_builder_free(builder);
+			self->failed = true;
+			return NULL;
+		}
+
+		self->selected = sl_result_builder_finish(builder);
+		self->failed = self->selected == NULL;
+	}
+
+	if (self->selected == NULL || self->next_selected == self->selected->nb_files)
+		return NULL;
+
+	return self->selected->files + self->next_selected++;
+}
+
+static const struct sl_result_file * sl_database_flat_connection_next_selected(struct sl_database_flat_connection_cursor * self) {
+	if (self->selector == NULL && !self->failed) {
+		self->selector = sl_result_selector_new(&self->request);
+
+		// rows are collapsed only across consecutive sessions of host
+		if (self->selector == NULL || (self->request.collapse && sl_result_selector_set_sessions(self->selector, self->sessions, self->nb_sessions))) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: not enough memory to get result");
+			self->failed = true;
+			return NULL;
+		}
+	}
+
+	// a row is returned once no row of an older session can be merged into it
+	while (!self->failed) {
+		const struct sl_result_file * file = sl_result_selector_next(self->selector);
+		if (file != NULL || self->selected_all)
+			return file;
+
+		int status = 2;
+		file = sl_database_flat_connection_cursor_next_row(self);
+		if (file != NULL)
+			status = sl_result_selector_add(self->selector, file);
+		else if (self->failed)
+			break;
+
+		if (status == 2) {
+			status = sl_result_selector_finish(self->selector) ? -1 : 0;
+			self->selected_all = true;
+		}
+
+		if (status < 0) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: not enough memory to get result");
+			self->failed = true;
+		}
+	}
+
+	return NULL;
+}
+
+static const struct sl_result_file * sl_database_flat_connection_cursor_next_row(struct sl_database_flat_connection_cursor * self) {
+	struct sl_request * request = &self->request;
+
+	for (;;) {
+		// next record found by search of current session
+		while (self->matched != NULL && self->next_matched < self->nb_matched) {
+			uint64_t record = self->matched[self->next_matched++];
+			const struct sl_database_flat_filesystem * fs = self->session->filesystems + self->session->records[record].filesystem;
+			if (!sl_database_flat_connection_match_filesystem(self->session, fs, request))
+				continue;
+
+			const char * path = sl_database_flat_session_get_path(self->session, record, &self->buffer, &self->capacity);
+			if (!sl_database_flat_connection_match_path(request, path))
+				continue;
+
+			sl_database_flat_connection_fill_result(&self->file, self->session, fs, record, path);
+			return &self->file;
+		}
+		free(self->matched);
+		self->matched = NULL;
+
+		// next record of current filesystem
+		while (self->fs != NULL && self->next_record < self->last_record) {
+			uint64_t record = self->next_record++;
+			if (request->inode != (ino_t) -1) {
+				const struct sl_database_flat_key * key = self->session->keys + record;
+				if (key->dev_no != self->fs->dev_no || key->inode != (uint64_t) request->inode)
+					break;
+
+				record = key->record;
+				if (self->session->records[record].filesystem != self->next_filesystem - 1)
+					continue;
+			}
+
+			const char * path = sl_database_flat_session_get_path(self->session, record, &self->buffer, &self->capacity);
+			if (!sl_database_flat_connection_match_path(request, path))
+				continue;
+
+			// session without blob of paths, each path of filesystem is checked
+			if (self->search != NULL && !sl_database_flat_search_match(self->search, path))
+				continue;
+
+			sl_database_flat_connection_fill_result(&self->file, self->session, self->fs, record, path);
+			return &self->file;
+		}
+		self->fs = NULL;
+
+		// next filesystem of current session
+		if (self->session != NULL && self->next_filesystem < self->session->header->nb_filesystems) {
+			const struct sl_database_flat_filesystem * fs = self->session->filesystems + self->next_filesystem;
+			self->next_filesystem++;
+
+			if (!sl_database_flat_connection_match_filesystem(self->session, fs, request))
+				continue;
+
+			self->fs = fs;
+			self->next_record = fs->first_record;
+			self->last_record = fs->first_record + fs->nb_records;
+			if (request->inode != (ino_t) -1) {
+				self->next_record = sl_database_flat_session_find_inode(self->session, fs->dev_no, request->inode);
+				self->last_record = self->session->header->nb_files;
+			} else if (self->path_range)
+				sl_database_flat_session_find_path_range(self->session, fs, request->path, request->path_subtree, &self->next_record, &self->last_record);
+			continue;
+		}
+		self->session = NULL;
+
+		// sessions are visited from the newest
+		if (self->next_session == self->nb_sessions)
+			return NULL;
+
+		int session_id = self->sessions[self->next_session];
+		self->next_session++;
+
+		if (self->session_min > 0 && (session_id < self->session_min || session_id > self->session_max))
+			continue;
+
+		self->session = sl_database_flat_connection_get_session(self->connection, self->host_id, session_id);
+		self->next_filesystem = 0;
+
+		if (self->session == NULL || self->search == NULL || self->session->blob == NULL || request->inode != (ino_t) -1 || self->path_range)
+			continue;
+
+		// blob is scanned once, over records of filesystems which can match
+		uint64_t first_record = self->session->header->nb_files, last_record = 0;
+		uint32_t i;
+		for (i = 0; i < self->session->header->nb_filesystems; i++) {
+			const struct sl_database_flat_filesystem * fs = self->session->filesystems + i;
+			if (fs->nb_records == 0 || !sl_database_flat_connection_match_filesystem(self->session, fs, request))
+				continue;
+
+			if (fs->first_record < first_record)
+				first_record = fs->first_record;
+			if (fs->first_record + fs->nb_records > last_record)
+				last_record = fs->first_record + fs->nb_records;
+		}
+
+		if (sl_database_flat_search_session(self->search, self->session, first_record, last_record, &self->matched, &self->nb_matched)) {
+			self->failed = true;
+			return NULL;
+		}
+		self->next_matched = 0;
+		self->next_filesystem = self->session->header->nb_filesystems;
+	}
+}
+
+static int sl_database_flat_connection_close_cursor(struct sl_database_cursor * cursor) {
+	struct sl_database_flat_connection_cursor * self = cursor->data;
+
+	int failed = self->failed;
+
+	sl_result_files_free(self->selected);
+	sl_result_selector_free(self->selector);
+	sl_database_flat_search_free(self->search);
+	free(self->matched);
+	free(self->buffer);
+	free(self->hosts);
+	free(self->sessions);
+	free(self);
+	free(cursor);
+
+	return failed;
+}
+
+static struct sl_result_files ** sl_database_flat_connection_find_files(struct sl_database_connection * connect, int host_id, struct sl_request * requests, unsigned int nb_requests) {
+	struct sl_database_flat_connection_private * self = connect->data;
+	if (self->closed)
+		return NULL;
+
+	struct sl_result_builder ** builders = malloc(nb_requests * sizeof(struct sl_result_builder *));
+	unsigned int i;
+	for (i = 0; i < nb_requests; i++)
+		builders[i] = sl_result_builder_new();
+
+	// requests which can not keep more rows, see sl_result_builder_select
+	bool * done = calloc(nb_requests, sizeof(bool));
+
+	// requests without an inode and a filesystem, given by dev_no or by uuid, can not use keys of sessions
+	// neither can requests with a path pattern or a path
+	int failed = 0;
+	for (i = 0; !failed && i < nb_requests; i++) {
+		if ((requests[i].dev_no != (dev_t) -1 || requests[i].fs_uuid != NULL) && requests[i].inode != (ino_t) -1 && requests[i].path_pattern == NULL && requests[i].path == NULL)
+			continue;
+
+		struct sl_database_cursor * cursor = sl_database_flat_connection_open_cursor(connect, host_id, requests + i);
+		if (cursor == NULL) {
+			failed = 1;
+			break;
+		}
+
+		const struct sl_result_file * file;
+		while (!failed && (file = sl_database_flat_connection_next_file(cursor)) != NULL)
+			failed = sl_result_builder_add(builders[i], file);
+
+		if (sl_database_flat_connection_close_cursor(cursor))
+			failed = 1;
+	}
+
+	// sessions are listed and mapped once for all requests
+	int * hosts, * sessions;
+	unsigned int j, nb_sessions = sl_database_flat_connection_list_sessions(self, host_id, 0, &hosts, &sessions);
+
+	for (i = 0; !failed && i < nb_requests; i++)
+		if (requests[i].collapse)
+			failed = sl_result_builder_set_sessions(builders[i], sessions, nb_sessions);
+
+	char * buffer = NULL;
+	size_t capacity = 0;
+
+	for (j = 0; !failed && j < nb_sessions; j++) {
+		struct sl_database_flat_session * session = NULL;
+
+		for (i = 0; !failed && i < nb_requests; i++) {
+			const struct sl_request * request = requests + i;
+			if ((request->dev_no == (dev_t) -1 && request->fs_uuid == NULL) || request->inode == (ino_t) -1 || request->path_pattern != NULL || request->path != NULL || done[i])
+				continue;
+
+			if (request->session_min_id < request->session_max_id) {
+				if (sessions[j] < request->session_min_id || sessions[j] > request->session_max_id)
+					continue;
+			} else if (request->session_min_id > 0 && sessions[j] != request->session_min_id)
+				continue;
+
+			if (session == NULL) {
+				session = sl_database_flat_connection_get_session(self, host_id, sessions[j]);
+				if (session == NULL)
+					break;
+			}
+
+			uint32_t k;
+			for (k = 0; !failed && !done[i] && k < session->header->nb_filesystems; k++) {
+				const struct sl_database_flat_filesystem * fs = session->filesystems + k;
+				if (!sl_database_flat_connection_match_filesystem(session, fs, request))
+					continue;
+
+				uint64_t l;
+				for (l = sl_database_flat_session_find_inode(session, fs->dev_no, request->inode); !failed && !done[i] && l < session->header->nb_files; l++) {
+					const struct sl_database_flat_key * key = session->keys + l;
+					if (key->dev_no != fs->dev_no || key->inode != (uint64_t) request->inode)
+						break;
+
+					if (session->records[key->record].filesystem != k)
+						continue;
+
+					struct sl_result_file file;
+					const char * path = sl_database_flat_session_get_path(session, key->record, &buffer, &capacity);
+					sl_database_flat_connection_fill_result(&file, session, fs, key->record, path);
+
+					int status = sl_result_builder_select(builders[i], request, &file);
+					failed = status < 0;
+					done[i] = status == 2;
+				}
+			}
+		}
+	}
+
+	free(buffer);
+	free(done);
+	free(hosts);
+	free(sessions);
+
+	struct sl_result_files ** results = malloc(nb_requests * sizeof(struct sl_result_files *));
+	for (i = 0; i < nb_requests; i++) {
+		results[i] = NULL;
+		if (failed)
+			sl_result_builder_free(builders[i]);
+		else if ((results[i] = sl_result_builder_finish(builders[i])) == NULL)
+			failed = 1;
+	}
+	free(builders);
+
+	if (failed) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: not enough memory to get result");
+		sl_result_files_free_array(results, nb_requests);
+		return NULL;
+	}
+
+	return results;
+}
+
+static struct sl_database_flat_session * sl_database_flat_connection_get_session_by_id(struct sl_database_flat_connection_private * self, int session_id) {
+	int * hosts, * sessions;
+	unsigned int nb_sessions = sl_database_flat_connection_list_sessions(self, -1, session_id, &hosts, &sessions);
+
+	struct sl_database_flat_session * session = NULL;
+	if (nb_sessions > 0)
+		session = sl_database_flat_connection_get_session(self, hosts[0], sessions[0]);
+	free(hosts);
+	free(sessions);
+
+	return session;
+}
+
+static struct sl_result_files * sl_database_flat_connection_get_ancestors(struct sl_database_connection * connect, int session_id, int fs_id, const char * path) {
+	struct sl_database_flat_connection_private * self = connect->data;
+	if (self->closed)
+		return NULL;
+
+	struct sl_database_flat_session * session = sl_database_flat_connection_get_session_by_id(self, session_id);
+	if (session == NULL)
+		return NULL;
+
+	const struct sl_database_flat_filesystem * fs = NULL;
+	uint32_t i;
+	for (i = 0; i < session->header->nb_filesystems && fs == NULL; i++)
+		if (session->filesystems[i].id == fs_id)
+			fs = session->filesystems + i;
+
+	if (fs == NULL)
+		return NULL;
+
+	struct sl_result_builder * builder = sl_result_builder_new();
+
+	// a file at mount point has no ancestor
+	if (path[0] == '\0')
+		return sl_result_builder_finish(builder);
+
+	// ancestors of 'a/b/c' are 'a' and 'a/b'
+	char * parent = strdup(path);
+	char * slash;
+	int failed = 0;
+	for (slash = strchr(parent + 1, '/'); !failed && slash != NULL; slash = strchr(slash + 1, '/')) {
+		*slash = '\0';
+
+		uint64_t record;
+		if (sl_database_flat_session_find_path(session, fs, parent, &record)) {
+			struct sl_result_file file;
+			sl_database_flat_connection_fill_result(&file, session, fs, record, parent);
+			failed = sl_result_builder_add(builder, &file);
+		}
+
+		*slash = '/';
+	}
+	free(parent);
+
+	if (failed) {
+		sl_result_builder_free(builder);
+		return NULL;
+	}
+
+	return sl_result_builder_finish(builder);
+}
+
+static struct sl_result_file * sl_database_flat_connection_get_file_info(struct sl_database_connection * connect, int session_id, int fs_id, const char * path) {
+	struct sl_database_flat_connection_private * self = connect->data;
+	if (self->closed)
+		return NULL;
+
+	struct sl_database_flat_session * session = sl_database_flat_connection_get_session_by_id(self, session_id);
+	if (session == NULL)
+		return NULL;
+
+	uint32_t i;
+	for (i = 0; i < session->header->nb_filesystems; i++) {
+		const struct sl_database_flat_filesystem * fs = session->filesystems + i;
+		if (fs->id != fs_id)
+			continue;
+
+		uint64_t record;
+		if (!sl_database_flat_session_find_path(session, fs, path, &record))
+			return NULL;
+
+		struct sl_result_file file;
+		sl_database_flat_connection_fill_result(&file, session, fs, record, path);
+
+		struct sl_result_file * result = malloc(sizeof(struct sl_result_file));
+		sl_result_file_copy(result, &file);
+		return result;
+	}
+
+	return NULL;
+}
+
+static struct sl_result_statistics * sl_database_flat_connection_get_statistics(struct sl_database_connection * connect, int session_id, int fs_id) {
+	struct sl_database_flat_connection_private * self = connect->data;
+	if (self->closed)
+		return NULL;
+
+	struct sl_database_flat_session * session = sl_database_flat_connection_get_session_by_id(self, session_id);
+	if (session == NULL)
+		return NULL;
+
+	uint32_t i;
+	for (i = 0; i < session->header->nb_filesystems; i++) {
+		const struct sl_database_flat_filesystem * fs = session->filesystems + i;
+		if (fs->id != fs_id)
+			continue;
+
+		struct sl_result_statistics * stats = malloc(sizeof(struct sl_result_statistics));
+		stats->nb_files = fs->nb_files;
+		stats->nb_directories = fs->nb_directories;
+		stats->total_size = fs->total_size;
+		stats->scan_duration = fs->scan_duration;
+		stats->nb_errors = fs->nb_errors;
+		return stats;
+	}
+
+	return NULL;
+}
@@ -0,0 +1,476 @@
+/*************************************************************************\
+*                  ______  __                 __                          *
+*                 / __/ /_/ /  ___  _______ _/ /____                      *
+*                _\ \/ __/ /__/ _ \/ __/ _ `/ __/ -_)                     *
+*               /___/\__/____/\___/\__/\_,_/\__/\__/                      *
+*                                                                         *
+*  ---------------------------------------------------------------------  *
+*  This file is a part of StLocate                                        *
+*                                                                         *
+*  StLocate is free software; you can redistribute it and/or              *
+*  modify it under the terms of the GNU General Public License            *
+*  as published by the Free Software Foundation; either version 3         *
+*  of the License, or (at your option) any later version.                 *
+*                                                                         *
+*  This program is distributed in the hope that it will be useful,        *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+*  GNU General Public License for more details.                           *
+*                                                                         *
+*  You should have received a copy of the GNU General Public License      *
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.  *
+*                                                                         *
+*  ---------------------------------------------------------------------  *
+*  Copyright (C) 2013, Clercin guillaume <gclercin@intellique.com>        *
+*  Last modified: Mon, 19 Oct 2026                                        *
+\*************************************************************************/
+
+
+// memmem, memrchr, rawmemchr
+#define _GNU_SOURCE
+// fnmatch
+#include <fnmatch.h>
+// pthread_create, pthread_join
+#include <pthread.h>
+// regcomp, regexec, regfree
+#include <regex.h>
+// calloc, free, malloc, realloc
+#include <stdlib.h>
+// memcpy, memmem, memrchr, rawmemchr, strchr, strdup, strlen, strpbrk
+#include <string.h>
+// madvise
+#include <sys/mman.h>
+// sysconf
+#include <unistd.h>
+
+#include <stlocate/log.h>
+
+#include "common.h"
+
+/**
+ * A search scans the blob of paths of a session, which is mapped. Only paths
+ * which contain the longest literal of pattern are matched against the whole
+ * pattern. memmem of glibc finds them, it jumps to candidates with its
+ * vectorized memchr. The blob is split into chunks of restart blocks,
+ * scanned by several threads.
+ */
+// minimum number of restart blocks by thread, threads are created then
+// joined for each session of each lookup
+#define SL_DATABASE_FLAT_SEARCH_MIN_BLOCKS 1024
+
+struct sl_database_flat_search {
+	char * pattern;
+	bool regex;
+	// used only by sl_database_flat_search_match, regexec of glibc is serialized
+	regex_t compiled;
+
+	// each matching path contains this literal
+	char * literal;
+	size_t literal_length;
+	// pattern matches any path which contains literal, like '*abc*'
+	bool literal_only;
+};
+
+struct sl_database_flat_search_chunk {
+	const struct sl_database_flat_search * search;
+	const struct sl_database_flat_session * session;
+	uint64_t first_block;
+	uint64_t last_block;
+
+	uint64_t * records;
+	uint64_t nb_records;
+	uint64_t max_records;
+	int failed;
+
+	pthread_t thread;
+	bool started;
+};
+
+static void sl_database_flat_search_literal_glob(struct sl_database_flat_search * search);
+static void sl_database_flat_search_literal_regex(struct sl_database_flat_search * search);
+static void sl_database_flat_search_literal_add(struct sl_database_flat_search * search, char * run, size_t * length, char c, bool end);
+static void sl_database_flat_search_scan(struct sl_database_flat_search_chunk * chunk);
+static void * sl_database_flat_search_scan_thread(void * arg);
+static size_t sl_database_flat_search_skip_bracket(const char * pattern, size_t i, bool escape);
+
+
+void sl_database_flat_search_free(struct sl_database_flat_search * search) {
+	if (search == NULL)
+		return;
+
+	if (search->regex)
+		regfree(&search->compiled);
+	free(search->pattern);
+	free(search->literal);
+	free(search);
+}
+
+/**
+ * Append \a c to current literal \a run, or end it if \a end is set.
+ * Longest ended run becomes literal of \a search.
+ */
+static void sl_database_flat_search_literal_add(struct sl_database_flat_search * search, char * run, size_t * length, char c, bool end) {
+	if (!end) {
+		run[(*length)++] = c;
+		return;
+	}
+
+	if (*length > search->literal_length) {
+		memcpy(search->literal, run, *length);
+		search->literal_length = *length;
+	}
+	*length = 0;
+}
+
+/**
+ * In a glob pattern, any character out of a bracket expression, except
+ * '*' and '?', is literal.
+ */
+static void sl_database_flat_search_literal_glob(struct sl_database_flat_search * search) {
+	const char * pattern = search->pattern;
+	char * run = malloc(strlen(pattern) + 1);
+	size_t length = 0, i = 0;
+
+	while (pattern[i] != '\0') {
+		if (pattern[i] == '*' || pattern[i] == '?') {
+			sl_database_flat_search_literal_add(search, run, &length, 0, true);
+			i++;
+		} else if (pattern[i] == '[') {
+			sl_database_flat_search_literal_add(search, run, &length, 0, true);
+			i = sl_database_flat_search_skip_bracket(pattern, i, true);
+			if (i == 0)
+				break;
+		} else if (pattern[i] == '\\' && pattern[i + 1] != '\0') {
+			sl_database_flat_search_literal_add(search, run, &length, pattern[i + 1], false);
+			i += 2;
+		} else {
+			sl_database_flat_search_literal_add(search, run, &length, pattern[i], false);
+			i++;
+		}
+	}
+	sl_database_flat_search_literal_add(search, run, &length, 0, true);
+
+	free(run);
+}
+
+/**
+ * In an extended regular expression, only characters which are not
+ * optional are kept. Groups and bracket expressions end a literal, an
+ * alternation anywhere means there is no literal.
+ */
+static void sl_database_flat_search_literal_regex(struct sl_database_flat_search * search) {
+	const char * pattern = search->pattern;
+	if (strchr(pattern, '|') != NULL)
+		return;
+
+	char * run = malloc(strlen(pattern) + 1);
+	size_t length = 0, i = 0;
+
+	while (pattern[i] != '\0') {
+		char c = pattern[i];
+
+		if (c == '(') {
+			sl_database_flat_search_literal_add(search, run, &length, 0, true);
+
+			unsigned int depth = 0;
+			while (pattern[i] != '\0') {
+				if (pattern[i] == '\\' && pattern[i + 1] != '\0')
+					i += 2;
+				else if (pattern[i] == '[') {
+					i = sl_database_flat_search_skip_bracket(pattern, i, false);
+					if (i == 0)
+						break;
+				} else if (pattern[i++] == '(')
+					depth++;
+				else if (pattern[i - 1] == ')' && --depth == 0)
+					break;
+			}
+
+			if (i == 0 || depth > 0)
+				break;
+			continue;
+		}
+
+		if (c == '[') {
+			sl_database_flat_search_literal_add(search, run, &length, 0, true);
+			i = sl_database_flat_search_skip_bracket(pattern, i, false);
+			if (i == 0)
+				break;
+			continue;
+		}
+
+		if (c == '{') {
+			sl_database_flat_search_literal_add(search, run, &length, 0, true);
+			const char * end = strchr(pattern + i, '}');
+			if (end == NULL)
+				break;
+			i = end - pattern + 1;
+			continue;
+		}
+
+		if (strchr(".^$)*+?", c) != NULL) {
+			sl_database_flat_search_literal_add(search, run, &length, 0, true);
+			i++;
+			continue;
+		}
+
+		// only escaped special characters are literal, others are extensions of GNU like \w or \<
+		if (c == '\\') {
+			c = pattern[i + 1];
+			if (c == '\0' || strchr(".[]()*+?{}|^$\\", c) == NULL) {
+				sl_database_flat_search_literal_add(search, run, &length, 0, true);
+				i += c != '\0' ? 2 : 1;
+				continue;
+			}
+			i++;
+		}
+		i++;
+
+		// an optional character ends literal, a repeated one ends it after itself
+		char next = pattern[i];
+		if (next == '*' || next == '?' || next == '{')
+			sl_database_flat_search_literal_add(search, run, &length, 0, true);
+		else {
+			sl_database_flat_search_literal_add(search, run, &length, c, false);
+			if (next == '+')
+				sl_database_flat_search_literal_add(search, run, &length, 0, true);
+		}
+	}
+	sl_database_flat_search_literal_add(search, run, &length, 0, true);
+
+	free(run);
+}
+
+bool sl_database_flat_search_match(struct sl_database_flat_search * search, const char * path) {
+	if (search->regex)
+		return !regexec(&search->compiled, path, 0, NULL, 0);
+
+	return !fnmatch(search->pattern, path, 0);
+}
+
+struct sl_database_flat_search * sl_database_flat_search_new(const char * pattern, bool regex) {
+	struct sl_database_flat_search * search = malloc(sizeof(struct sl_database_flat_search));
+	search->pattern = strdup(pattern);
+	search->regex = regex;
+	search->literal = malloc(strlen(pattern) + 1);
+	search->literal_length = 0;
+	search->literal_only = false;
+
+	if (regex && regcomp(&search->compiled, pattern, REG_EXTENDED | REG_NOSUB)) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: invalid regular expression '%s'", pattern);
+		search->regex = false;
+		sl_database_flat_search_free(search);
+		return NULL;
+	}
+
+	size_t length = strlen(pattern);
+	if (regex) {
+		sl_database_flat_search_literal_regex(search);
+		search->literal_only = length > 0 && strpbrk(pattern, ".[]()*+?{}|^$\\") == NULL;
+	} else {
+		sl_database_flat_search_literal_glob(search);
+		search->literal_only = length > 2 && search->literal_length == length - 2 && pattern[0] == '*' && pattern[length - 1] == '*' && strpbrk(pattern + 1, "?[\\") == NULL;
+	}
+
+	return search;
+}
+
+static void sl_database_flat_search_scan(struct sl_database_flat_search_chunk * chunk) {
+	const struct sl_database_flat_search * search = chunk->search;
+	const struct sl_database_flat_session * session = chunk->session;
+
+	// each thread has its own compiled pattern
+	regex_t regex;
+	if (search->regex && regcomp(&regex, search->pattern, REG_EXTENDED | REG_NOSUB)) {
+		chunk->failed = 1;
+		return;
+	}
+
+	uint64_t nb_blocks = (session->header->nb_files + SL_DATABASE_FLAT_RESTART_INTERVAL - 1) / SL_DATABASE_FLAT_RESTART_INTERVAL;
+	const char * begin = session->blob + session->blob_restarts[chunk->first_block];
+	const char * end = session->blob + session->header->blob_size;
+	if (chunk->last_block < nb_blocks)
+		end = session->blob + session->blob_restarts[chunk->last_block];
+
+	// last path whose record is known
+	const char * ptr = begin, * current = begin;
+	uint64_t block = chunk->first_block, record = block * SL_DATABASE_FLAT_RESTART_INTERVAL;
+	while (ptr < end) {
+		const char * path = ptr;
+		if (search->literal_length > 0) {
+			const char * found = memmem(ptr, end - ptr, search->literal, search->literal_length);
+			if (found == NULL)
+				break;
+
+			path = memrchr(ptr, '\0', found - ptr);
+			path = path != NULL ? path + 1 : ptr;
+		}
+
+		// each path of blob ends with '\0'
+		ptr = (const char *) rawmemchr(path, '\0') + 1;
+
+		// with a pattern like '*abc*', a found literal is enough
+		if (!search->literal_only) {
+			bool match;
+			if (search->regex)
+				match = !regexec(&regex, path, 0, NULL, 0);
+			else
+				match = !fnmatch(search->pattern, path, 0);
+
+			if (!match)
+				continue;
+		}
+
+		// record of path is counted from its restart block, or from previous match
+		while (block + 1 < chunk->last_block && session->blob + session->blob_restarts[block + 1] <= path) {
+			block++;
+			current = session->blob + session->blob_restarts[block];
+			record = block * SL_DATABASE_FLAT_RESTART_INTERVAL;
+		}
+
+		while (current < path) {
+			current = (const char *) rawmemchr(current, '\0') + 1;
+			record++;
+		}
+
+		if (chunk->nb_records == chunk->max_records) {
+			uint64_t max_records = chunk->max_records > 0 ? chunk->max_records << 1 : 256;
+			void * new_addr = realloc(chunk->records, max_records * sizeof(uint64_t));
+			if (new_addr == NULL) {
+				chunk->failed = 1;
+				break;
+			}
+
+			chunk->records = new_addr;
+			chunk->max_records = max_records;
+		}
+		chunk->records[chunk->nb_records++] = record;
+	}
+
+	if (search->regex)
+		regfree(&regex);
+}
+
+/**
+ * Return index of character following the bracket expression which starts
+ * at \a i, or 0 if it does not end. With \a escape, like fnmatch, a
+ * backslash escapes next character.
+ */
+static size_t sl_database_flat_search_skip_bracket(const char * pattern, size_t i, bool escape) {
+	i++;
+	if (pattern[i] == '!' || pattern[i] == '^')
+		i++;
+	if (pattern[i] == ']')
+		i++;
+
+	while (pattern[i] != '\0' && pattern[i] != ']') {
+		if (pattern[i] == '[' && pattern[i + 1] != '\0' && strchr(":.=", pattern[i + 1]) != NULL) {
+			// character class like [:alpha:]
+			char delimiter = pattern[i + 1];
+			i += 2;
+			while (pattern[i] != '\0' && (pattern[i] != delimiter || pattern[i + 1] != ']'))
+				i++;
+			if (pattern[i] == '\0')
+				return 0;
+			i += 2;
+		} else if (escape && pattern[i] == '\\' && pattern[i + 1] != '\0')
+			i += 2;
+		else
+			i++;
+	}
+
+	return pattern[i] == ']' ? i + 1 : 0;
+}
+
+static void * sl_database_flat_search_scan_thread(void * arg) {
+	sl_database_flat_search_scan(arg);
+	return NULL;
+}
+
+int sl_database_flat_search_session(const struct sl_database_flat_search * search, const struct sl_database_flat_session * session, uint64_t first_record, uint64_t last_record, uint64_t ** records, uint64_t * nb_records) {
+	*records = NULL;
+	*nb_records = 0;
+
+	if (session->blob == NULL || first_record >= last_record)
+		return 0;
+
+	uint64_t first_block = first_record / SL_DATABASE_FLAT_RESTART_INTERVAL;
+	uint64_t last_block = (last_record + SL_DATABASE_FLAT_RESTART_INTERVAL - 1) / SL_DATABASE_FLAT_RESTART_INTERVAL;
+
+	// scanned part of blob is read once, ahead of threads
+	uint64_t nb_blocks = (session->header->nb_files + SL_DATABASE_FLAT_RESTART_INTERVAL - 1) / SL_DATABASE_FLAT_RESTART_INTERVAL;
+	const char * begin = session->blob + session->blob_restarts[first_block];
+	const char * end = session->blob + session->header->blob_size;
+	if (last_block < nb_blocks)
+		end = session->blob + session->blob_restarts[last_block];
+
+	long page_size = sysconf(_SC_PAGESIZE);
+	char * aligned = (char *) ((uintptr_t) begin & ~(uintptr_t) (page_size - 1));
+	madvise(aligned, end - aligned, MADV_WILLNEED);
+
+	long nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	uint64_t nb_chunks = (last_block - first_block + SL_DATABASE_FLAT_SEARCH_MIN_BLOCKS - 1) / SL_DATABASE_FLAT_SEARCH_MIN_BLOCKS;
+	if (nb_cpus > 0 && nb_chunks > (uint64_t) nb_cpus)
+		nb_chunks = nb_cpus;
+	else if (nb_cpus < 1)
+		nb_chunks = 1;
+
+	struct sl_database_flat_search_chunk * chunks = calloc(nb_chunks, sizeof(struct sl_database_flat_search_chunk));
+	if (chunks == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: not enough memory to search paths of session %d", session->header->session_id);
+		return 1;
+	}
+
+	uint64_t i;
+	for (i = 0; i < nb_chunks; i++) {
+		chunks[i].search = search;
+		chunks[i].session = session;
+		chunks[i].first_block = first_block + (last_block - first_block) * i / nb_chunks;
+		chunks[i].last_block = first_block + (last_block - first_block) * (i + 1) / nb_chunks;
+	}
+
+	/**
+	 * Threads are joined, unlike those of thread pool, so a search ends
+	 * with its last chunk. First chunk is scanned by current thread, like
+	 * any chunk which can not be given to another thread.
+	 */
+	for (i = 1; i < nb_chunks; i++)
+		chunks[i].started = !pthread_create(&chunks[i].thread, NULL, sl_database_flat_search_scan_thread, chunks + i);
+
+	sl_database_flat_search_scan(chunks);
+
+	for (i = 1; i < nb_chunks; i++) {
+		if (chunks[i].started)
+			pthread_join(chunks[i].thread, NULL);
+		else
+			sl_database_flat_search_scan(chunks + i);
+	}
+
+	// records of chunks are already sorted
+	int failed = 0;
+	uint64_t total = 0;
+	for (i = 0; i < nb_chunks; i++) {
+		failed |= chunks[i].failed;
+		total += chunks[i].nb_records;
+	}
+
+	if (!failed && total > 0) {
+		*records = malloc(total * sizeof(uint64_t));
+		failed = *records == NULL;
+		for (i = 0; !failed && i < nb_chunks; i++) {
+			uint64_t j;
+			for (j = 0; j < chunks[i].nb_records; j++)
+				if (chunks[i].records[j] >= first_record && chunks[i].records[j] < last_record)
+					(*records)[(*nb_records)++] = chunks[i].records[j];
+		}
+	}
+
+	for (i = 0; i < nb_chunks; i++)
+		free(chunks[i].records);
+	free(chunks);
+
+	if (failed)
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: not enough memory to search paths of session %d", session->header->session_id);
+
+	return failed;
+}
@@ -0,0 +1,789 @@
+/*************************************************************************\
+*                  ______  __                 __                          *
+*                 / __/ /_/ /  ___  _______ _/ /____                      *
+*                _\ \/ __/ /__/ _ \/ __/ _ `/ __/ -_)                     *
+*               /___/\__/____/\___/\__/\_,_/\__/\__/                      *
+*                                                                         *
+*  ---------------------------------------------------------------------  *
+*  This file is a part of StLocate                                        *
+*                                                                         *
+*  StLocate is free software; you can redistribute it and/or              *
+*  modify it under the terms of the GNU General Public License            *
+*  as published by the Free Software Foundation; either version 3         *
+*  of the License, or (at your option) any later version.                 *
+*                                                                         *
+*  This program is distributed in the hope that it will be useful,        *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+*  GNU General Public License for more details.                           *
+*                                                                         *
+*  You should have received a copy of the GNU General Public License      *
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.  *
+*                                                                         *
+*  ---------------------------------------------------------------------  *
+*  Copyright (C) 2013, Clercin guillaume <gclercin@intellique.com>        *
+*  Last modified: Mon, 19 Oct 2026                                        *
+\*************************************************************************/
+
+#define _GNU_SOURCE
+// open
+#include <fcntl.h>
+// offsetof
+#include <stddef.h>
+// asprintf, fclose, fflush, fileno, fopen, fwrite, rename
+#include <stdio.h>
+// calloc, free, malloc, qsort, qsort_r, realloc
+#include <stdlib.h>
+// memchr, memcmp, memcpy, memset, strcmp, strdup, strlen
+#include <string.h>
+// madvise, mmap, munmap
+#include <sys/mman.h>
+// fstat, struct stat
+#include <sys/stat.h>
+// close, fsync, unlink
+#include <unistd.h>
+
+#include <stlocate/filesystem.h>
+#include <stlocate/log.h>
+#include <stlocate/result.h>
+
+#include "common.h"
+
+struct sl_database_flat_builder {
+	int host_id;
+	int session_id;
+	time_t start_time;
+
+	struct sl_database_flat_builder_filesystem {
+		int id;
+		char * uuid;
+		char * label;
+		char * mount_point;
+		dev_t dev_no;
+		struct sl_result_statistics stats;
+	} * filesystems;
+	unsigned int nb_filesystems;
+
+	struct sl_database_flat_builder_file {
+		uint64_t path;
+		struct sl_database_flat_record record;
+	} * files;
+	size_t nb_files;
+	size_t max_files;
+
+	char * paths;
+	size_t paths_length;
+	size_t paths_capacity;
+
+	// state of last committed transaction
+	unsigned int committed_filesystems;
+	size_t committed_files;
+	size_t committed_paths;
+};
+
+static int sl_database_flat_builder_compare_file(const void * a, const void * b, void * arg);
+static int sl_database_flat_builder_compare_key(const void * a, const void * b);
+static int sl_database_flat_builder_encode(unsigned char ** buffer, size_t * length, size_t * capacity, uint64_t value, const void * data, size_t data_length);
+static int sl_database_flat_builder_write_section(FILE * file, const void * data, size_t length, size_t * offset);
+static bool sl_database_flat_session_check(const struct sl_database_flat_session * session);
+static bool sl_database_flat_session_check_section(const struct sl_database_flat_header * header, uint64_t offset, uint64_t nb_items, size_t item_size);
+static uint64_t sl_database_flat_session_decode(const unsigned char ** ptr, const unsigned char * end);
+static uint64_t sl_database_flat_session_find_path_bound(const struct sl_database_flat_session * session, const struct sl_database_flat_filesystem * fs, const char * path, char ** buffer, size_t * capacity);
+
+
+int sl_database_flat_builder_add_file(struct sl_database_flat_builder * builder, int s2fs, const char * path, const struct stat * st) {
+	if (s2fs < 1 || (unsigned int) s2fs > builder->nb_filesystems) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: there is no filesystem associated to session2filesystem %d", s2fs);
+		return -1;
+	}
+
+	if (builder->nb_files == builder->max_files) {
+		size_t max_files = builder->max_files > 0 ? builder->max_files << 1 : 1024;
+		void * new_addr = realloc(builder->files, max_files * sizeof(struct sl_database_flat_builder_file));
+		if (new_addr == NULL) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: not enough memory to add file '%s'", path);
+			return -2;
+		}
+
+		builder->files = new_addr;
+		builder->max_files = max_files;
+	}
+
+	size_t length = strlen(path) + 1;
+	if (builder->paths_length + length > builder->paths_capacity) {
+		size_t capacity = builder->paths_capacity > 0 ? builder->paths_capacity : 65536;
+		while (builder->paths_length + length > capacity)
+			capacity <<= 1;
+
+		void * new_addr = realloc(builder->paths, capacity);
+		if (new_addr == NULL) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: not enough memory to add file '%s'", path);
+			return -2;
+		}
+
+		builder->paths = new_addr;
+		builder->paths_capacity = capacity;
+	}
+
+	struct sl_database_flat_builder_file * file = builder->files + builder->nb_files;
+	file->path = builder->paths_length;
+	file->record.filesystem = s2fs - 1;
+	file->record.mode = st->st_mode;
+	file->record.uid = st->st_uid;
+	file->record.gid = st->st_gid;
+	file->record.size = st->st_size;
+	file->record.access_time = st->st_atime;
+	file->record.modif_time = st->st_mtime;
+	file->record.inode = st->st_ino;
+
+	memcpy(builder->paths + builder->paths_length, path, length);
+	builder->paths_length += length;
+	builder->nb_files++;
+
+	return 0;
+}
+
+int sl_database_flat_builder_add_filesystem(struct sl_database_flat_builder * builder, int fs_id, const struct sl_filesystem * fs) {
+	void * new_addr = realloc(builder->filesystems, (builder->nb_filesystems + 1) * sizeof(struct sl_database_flat_builder_filesystem));
+	if (new_addr == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: not enough memory to add filesystem '%s'", fs->uuid);
+		return -1;
+	}
+
+	builder->filesystems = new_addr;
+	struct sl_database_flat_builder_filesystem * bfs = builder->filesystems + builder->nb_filesystems;
+	bfs->id = fs_id;
+	bfs->uuid = strdup(fs->uuid);
+	bfs->label = fs->label != NULL ? strdup(fs->label) : NULL;
+	bfs->mount_point = strdup(fs->mount_point);
+	bfs->dev_no = fs->device;
+	memset(&bfs->stats, 0, sizeof(bfs->stats));
+
+	// session2filesystem is the index of filesystem, starting from 1
+	return ++builder->nb_filesystems;
+}
+
+void sl_database_flat_builder_commit(struct sl_database_flat_builder * builder) {
+	builder->committed_filesystems = builder->nb_filesystems;
+	builder->committed_files = builder->nb_files;
+	builder->committed_paths = builder->paths_length;
+}
+
+static int sl_database_flat_builder_compare_file(const void * a, const void * b, void * arg) {
+	const struct sl_database_flat_builder_file * fa = a, * fb = b;
+	const char * paths = arg;
+
+	if (fa->record.filesystem != fb->record.filesystem)
+		return fa->record.filesystem < fb->record.filesystem ? -1 : 1;
+
+	return strcmp(paths + fa->path, paths + fb->path);
+}
+
+static int sl_database_flat_builder_compare_key(const void * a, const void * b) {
+	const struct sl_database_flat_key * ka = a, * kb = b;
+
+	if (ka->dev_no != kb->dev_no)
+		return ka->dev_no < kb->dev_no ? -1 : 1;
+	if (ka->inode != kb->inode)
+		return ka->inode < kb->inode ? -1 : 1;
+	if (ka->record != kb->record)
+		return ka->record < kb->record ? -1 : 1;
+	return 0;
+}
+
+static int sl_database_flat_builder_encode(unsigned char ** buffer, size_t * length, size_t * capacity, uint64_t value, const void * data, size_t data_length) {
+	if (*length + data_length + 10 > *capacity) {
+		size_t new_capacity = *capacity;
+		while (*length + data_length + 10 > new_capacity)
+			new_capacity <<= 1;
+
+		void * new_addr = realloc(*buffer, new_capacity);
+		if (new_addr == NULL)
+			return 1;
+
+		*buffer = new_addr;
+		*capacity = new_capacity;
+	}
+
+	// unsigned LEB128
+	do {
+		unsigned char byte = value & 0x7F;
+		value >>= 7;
+		(*buffer)[(*length)++] = byte | (value > 0 ? 0x80 : 0);
+	} while (value > 0);
+
+	if (data_length > 0) {
+		memcpy(*buffer + *length, data, data_length);
+		*length += data_length;
+	}
+
+	return 0;
+}
+
+void sl_database_flat_builder_free(struct sl_database_flat_builder * builder) {
+	if (builder == NULL)
+		return;
+
+	unsigned int i;
+	for (i = 0; i < builder->nb_filesystems; i++) {
+		free(builder->filesystems[i].uuid);
+		free(builder->filesystems[i].label);
+		free(builder->filesystems[i].mount_point);
+	}
+	free(builder->filesystems);
+	free(builder->files);
+	free(builder->paths);
+	free(builder);
+}
+
+struct sl_database_flat_builder * sl_database_flat_builder_new(int host_id, int session_id, time_t start_time) {
+	struct sl_database_flat_builder * builder = malloc(sizeof(struct sl_database_flat_builder));
+	memset(builder, 0, sizeof(struct sl_database_flat_builder));
+
+	builder->host_id = host_id;
+	builder->session_id = session_id;
+	builder->start_time = start_time;
+
+	return builder;
+}
+
+void sl_database_flat_builder_rollback(struct sl_database_flat_builder * builder) {
+	while (builder->nb_filesystems > builder->committed_filesystems) {
+		builder->nb_filesystems--;
+		free(builder->filesystems[builder->nb_filesystems].uuid);
+		free(builder->filesystems[builder->nb_filesystems].label);
+		free(builder->filesystems[builder->nb_filesystems].mount_point);
+	}
+
+	builder->nb_files = builder->committed_files;
+	builder->paths_length = builder->committed_paths;
+}
+
+int sl_database_flat_builder_set_statistics(struct sl_database_flat_builder * builder, int s2fs, const struct sl_result_statistics * stats) {
+	if (s2fs < 1 || (unsigned int) s2fs > builder->nb_filesystems) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: there is no filesystem associated to session2filesystem %d", s2fs);
+		return -1;
+	}
+
+	builder->filesystems[s2fs - 1].stats = *stats;
+	return 0;
+}
+
+int sl_database_flat_builder_write(struct sl_database_flat_builder * builder, const char * directory, time_t end_time, bool with_blob) {
+	qsort_r(builder->files, builder->nb_files, sizeof(struct sl_database_flat_builder_file), sl_database_flat_builder_compare_file, builder->paths);
+
+	struct sl_database_flat_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SL_DATABASE_FLAT_MAGIC, sizeof(SL_DATABASE_FLAT_MAGIC));
+	header.format = SL_DATABASE_FLAT_FORMAT;
+	header.host_id = builder->host_id;
+	header.session_id = builder->session_id;
+	header.nb_filesystems = builder->nb_filesystems;
+	header.start_time = builder->start_time;
+	header.end_time = end_time;
+	header.nb_files = builder->nb_files;
+
+	// filesystems and their strings
+	struct sl_database_flat_filesystem * filesystems = calloc(builder->nb_filesystems + 1, sizeof(struct sl_database_flat_filesystem));
+	char * strings = NULL;
+	size_t strings_length = 0;
+	unsigned int i;
+	size_t j = 0;
+	for (i = 0; i < builder->nb_filesystems; i++) {
+		struct sl_database_flat_builder_filesystem * bfs = builder->filesystems + i;
+		const char * values[] = { bfs->uuid, bfs->label, bfs->mount_point };
+		uint32_t offsets[3];
+
+		unsigned int k;
+		for (k = 0; k < 3; k++) {
+			if (values[k] == NULL) {
+				offsets[k] = UINT32_MAX;
+				continue;
+			}
+
+			size_t length = strlen(values[k]) + 1;
+			strings = realloc(strings, strings_length + length);
+			memcpy(strings + strings_length, values[k], length);
+			offsets[k] = strings_length;
+			strings_length += length;
+		}
+
+		filesystems[i].id = bfs->id;
+		filesystems[i].uuid = offsets[0];
+		filesystems[i].label = offsets[1];
+		filesystems[i].mount_point = offsets[2];
+		filesystems[i].dev_no = bfs->dev_no;
+		filesystems[i].nb_files = bfs->stats.nb_files;
+		filesystems[i].nb_directories = bfs->stats.nb_directories;
+		filesystems[i].total_size = bfs->stats.total_size;
+		filesystems[i].scan_duration = bfs->stats.scan_duration;
+		filesystems[i].nb_errors = bfs->stats.nb_errors;
+		filesystems[i].first_record = j;
+
+		while (j < builder->nb_files && builder->files[j].record.filesystem == i)
+			j++;
+		filesystems[i].nb_records = j - filesystems[i].first_record;
+	}
+
+	// records, keys and front coded paths
+	struct sl_database_flat_record * records = malloc((builder->nb_files + 1) * sizeof(struct sl_database_flat_record));
+	struct sl_database_flat_key * keys = malloc((builder->nb_files + 1) * sizeof(struct sl_database_flat_key));
+	size_t nb_restarts = (builder->nb_files + SL_DATABASE_FLAT_RESTART_INTERVAL - 1) / SL_DATABASE_FLAT_RESTART_INTERVAL;
+	uint64_t * restarts = malloc((nb_restarts + 1) * sizeof(uint64_t));
+
+	size_t paths_length = 0, paths_capacity = 65536;
+	unsigned char * paths = malloc(paths_capacity);
+
+	// blob is written from paths of builder, only its restarts are computed here
+	uint64_t * blob_restarts = with_blob ? malloc((nb_restarts + 1) * sizeof(uint64_t)) : NULL;
+	size_t blob_size = 0;
+
+	int failed = 0;
+	if (records == NULL || keys == NULL || restarts == NULL || paths == NULL || (with_blob && blob_restarts == NULL)) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: not enough memory to write session %d", builder->session_id);
+		failed = 1;
+	}
+
+	const char * previous = "";
+	for (j = 0; !failed && j < builder->nb_files; j++) {
+		struct sl_database_flat_builder_file * file = builder->files + j;
+		const char * path = builder->paths + file->path;
+
+		records[j] = file->record;
+
+		keys[j].dev_no = builder->filesystems[file->record.filesystem].dev_no;
+		keys[j].inode = file->record.inode;
+		keys[j].record = j;
+
+		size_t shared = 0;
+		if (j % SL_DATABASE_FLAT_RESTART_INTERVAL == 0)
+			restarts[j / SL_DATABASE_FLAT_RESTART_INTERVAL] = paths_length;
+		else
+			while (previous[shared] != '\0' && previous[shared] == path[shared])
+				shared++;
+
+		size_t length = strlen(path + shared);
+		if (sl_database_flat_builder_encode(&paths, &paths_length, &paths_capacity, shared, NULL, 0) || sl_database_flat_builder_encode(&paths, &paths_length, &paths_capacity, length, path + shared, length)) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: not enough memory to write session %d", builder->session_id);
+			failed = 1;
+			break;
+		}
+
+		if (with_blob) {
+			if (j % SL_DATABASE_FLAT_RESTART_INTERVAL == 0)
+				blob_restarts[j / SL_DATABASE_FLAT_RESTART_INTERVAL] = blob_size;
+			blob_size += shared + length + 1;
+		}
+
+		previous = path;
+	}
+
+	qsort(keys, builder->nb_files, sizeof(struct sl_database_flat_key), sl_database_flat_builder_compare_key);
+
+	// layout of file
+	size_t offset = (sizeof(header) + 7) & ~7;
+	header.filesystems_offset = offset;
+	offset = (offset + builder->nb_filesystems * sizeof(struct sl_database_flat_filesystem) + 7) & ~7;
+	header.strings_offset = offset;
+	offset = (offset + strings_length + 7) & ~7;
+	header.keys_offset = offset;
+	offset += builder->nb_files * sizeof(struct sl_database_flat_key);
+	header.records_offset = offset;
+	offset += builder->nb_files * sizeof(struct sl_database_flat_record);
+	header.restarts_offset = offset;
+	offset += nb_restarts * sizeof(uint64_t);
+	header.paths_offset = offset;
+	header.paths_size = paths_length;
+	offset += paths_length;
+	if (with_blob) {
+		offset = (offset + 7) & ~7;
+		header.blob_restarts_offset = offset;
+		offset += nb_restarts * sizeof(uint64_t);
+		header.blob_offset = offset;
+		header.blob_size = blob_size;
+		offset += blob_size;
+	}
+	header.file_size = offset;
+
+	char * path, * tmp_path;
+	asprintf(&path, "%s/session.%d.%d", directory, builder->host_id, builder->session_id);
+	asprintf(&tmp_path, "%s.tmp", path);
+
+	FILE * file = NULL;
+	if (!failed)
+		file = fopen(tmp_path, "w");
+	if (!failed && file == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: failed to create '%s' because %m", tmp_path);
+		failed = 1;
+	}
+
+	offset = 0;
+	if (!failed)
+		failed = sl_database_flat_builder_write_section(file, &header, sizeof(header), &offset);
+	if (!failed)
+		failed = sl_database_flat_builder_write_section(file, filesystems, builder->nb_filesystems * sizeof(struct sl_database_flat_filesystem), &offset);
+	if (!failed)
+		failed = sl_database_flat_builder_write_section(file, strings, strings_length, &offset);
+	if (!failed)
+		failed = sl_database_flat_builder_write_section(file, keys, builder->nb_files * sizeof(struct sl_database_flat_key), &offset);
+	if (!failed)
+		failed = sl_database_flat_builder_write_section(file, records, builder->nb_files * sizeof(struct sl_database_flat_record), &offset);
+	if (!failed)
+		failed = sl_database_flat_builder_write_section(file, restarts, nb_restarts * sizeof(uint64_t), &offset);
+	if (!failed)
+		failed = sl_database_flat_builder_write_section(file, paths, paths_length, &offset);
+	if (!failed && with_blob)
+		failed = sl_database_flat_builder_write_section(file, blob_restarts, nb_restarts * sizeof(uint64_t), &offset);
+	if (!failed && with_blob) {
+		failed = sl_database_flat_builder_write_section(file, NULL, 0, &offset);
+		for (j = 0; !failed && j < builder->nb_files; j++) {
+			const char * path = builder->paths + builder->files[j].path;
+			size_t length = strlen(path) + 1;
+			failed = fwrite(path, 1, length, file) != length;
+			offset += length;
+		}
+	}
+
+	if (!failed && (fflush(file) || fsync(fileno(file))))
+		failed = 1;
+
+	if (file != NULL && fclose(file))
+		failed = 1;
+
+	free(filesystems);
+	free(strings);
+	free(records);
+	free(keys);
+	free(restarts);
+	free(paths);
+	free(blob_restarts);
+
+	// session becomes visible once renamed
+	if (!failed) {
+		failed = rename(tmp_path, path);
+		if (failed)
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: failed to rename '%s' to '%s' because %m", tmp_path, path);
+	} else
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: failed to write '%s' because %m", tmp_path);
+
+	if (!failed) {
+		int fd = open(directory, O_RDONLY);
+		if (fd >= 0) {
+			fsync(fd);
+			close(fd);
+		}
+
+		sl_log_write(sl_log_level_info, sl_log_type_plugin_database, "Flat: session %d written into '%s' (%zu files, %zu bytes)", builder->session_id, path, builder->nb_files, (size_t) header.file_size);
+	} else
+		unlink(tmp_path);
+
+	free(path);
+	free(tmp_path);
+
+	return failed;
+}
+
+static int sl_database_flat_builder_write_section(FILE * file, const void * data, size_t length, size_t * offset) {
+	static const char padding[8] = { 0 };
+
+	size_t nb_padding = ((*offset + 7) & ~7) - *offset;
+	if (nb_padding > 0 && fwrite(padding, 1, nb_padding, file) != nb_padding)
+		return 1;
+	*offset += nb_padding;
+
+	if (length > 0 && fwrite(data, 1, length, file) != length)
+		return 1;
+	*offset += length;
+
+	return 0;
+}
+
+
+static bool sl_database_flat_session_check(const struct sl_database_flat_session * session) {
+	const struct sl_database_flat_header * header = session->header;
+	uint64_t nb_restarts = (header->nb_files + SL_DATABASE_FLAT_RESTART_INTERVAL - 1) / SL_DATABASE_FLAT_RESTART_INTERVAL;
+
+	// header of format 3 ends with offsets of blob
+	if (header->format >= 3 && header->file_size < sizeof(struct sl_database_flat_header))
+		return false;
+
+	if (!sl_database_flat_session_check_section(header, header->filesystems_offset, header->nb_filesystems, sizeof(struct sl_database_flat_filesystem)) ||
+		header->strings_offset > header->keys_offset ||
+		!sl_database_flat_session_check_section(header, header->strings_offset, header->keys_offset - header->strings_offset, 1) ||
+		!sl_database_flat_session_check_section(header, header->keys_offset, header->nb_files, sizeof(struct sl_database_flat_key)) ||
+		!sl_database_flat_session_check_section(header, header->records_offset, header->nb_files, sizeof(struct sl_database_flat_record)) ||
+		!sl_database_flat_session_check_section(header, header->restarts_offset, nb_restarts, sizeof(uint64_t)) ||
+		!sl_database_flat_session_check_section(header, header->paths_offset, header->paths_size, 1))
+		return false;
+
+	if (header->format >= 3 && header->blob_offset > 0 && (!sl_database_flat_session_check_section(header, header->blob_restarts_offset, nb_restarts, sizeof(uint64_t)) || !sl_database_flat_session_check_section(header, header->blob_offset, header->blob_size, 1)))
+		return false;
+
+	// strings and records of filesystems
+	size_t strings_size = header->keys_offset - header->strings_offset;
+	const char * strings = (const char *) session->address + header->strings_offset;
+	const struct sl_database_flat_filesystem * filesystems = (const void *) ((const char *) session->address + header->filesystems_offset);
+
+	uint32_t i;
+	for (i = 0; i < header->nb_filesystems; i++) {
+		const struct sl_database_flat_filesystem * fs = filesystems + i;
+		if (fs->first_record > header->nb_files || fs->nb_records > header->nb_files - fs->first_record)
+			return false;
+
+		const uint32_t offsets[] = { fs->uuid, fs->label, fs->mount_point };
+		unsigned int j;
+		for (j = 0; j < 3; j++)
+			if (offsets[j] != UINT32_MAX && (offsets[j] >= strings_size || memchr(strings + offsets[j], '\0', strings_size - offsets[j]) == NULL))
+				return false;
+	}
+
+	const uint64_t * restarts = (const void *) ((const char *) session->address + header->restarts_offset);
+	uint64_t j;
+	for (j = 0; j < nb_restarts; j++)
+		if (restarts[j] >= header->paths_size)
+			return false;
+
+	if (header->format >= 3 && header->blob_offset > 0) {
+		const uint64_t * blob_restarts = (const void *) ((const char *) session->address + header->blob_restarts_offset);
+		for (j = 0; j < nb_restarts; j++)
+			if (blob_restarts[j] >= header->blob_size)
+				return false;
+
+		// each path of blob is a string
+		if (header->blob_size > 0 && ((const char *) session->address)[header->blob_offset + header->blob_size - 1] != '\0')
+			return false;
+	}
+
+	return true;
+}
+
+static bool sl_database_flat_session_check_section(const struct sl_database_flat_header * header, uint64_t offset, uint64_t nb_items, size_t item_size) {
+	if (offset > header->file_size)
+		return false;
+
+	return nb_items <= (header->file_size - offset) / item_size;
+}
+
+static uint64_t sl_database_flat_session_decode(const unsigned char ** ptr, const unsigned char * end) {
+	uint64_t value = 0;
+	unsigned int shift = 0;
+	unsigned char byte;
+	do {
+		// a truncated value ends with section
+		if (*ptr >= end || shift >= 64)
+			return value;
+
+		byte = **ptr;
+		(*ptr)++;
+		value |= (uint64_t) (byte & 0x7F) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+
+	return value;
+}
+
+uint64_t sl_database_flat_session_find_inode(const struct sl_database_flat_session * session, uint64_t dev_no, uint64_t inode) {
+	// lower bound of (dev_no, inode)
+	uint64_t first = 0, last = session->header->nb_files;
+	while (first < last) {
+		uint64_t middle = first + ((last - first) >> 1);
+		const struct sl_database_flat_key * key = session->keys + middle;
+
+		if (key->dev_no < dev_no || (key->dev_no == dev_no && key->inode < inode))
+			first = middle + 1;
+		else
+			last = middle;
+	}
+
+	return first;
+}
+
+bool sl_database_flat_session_find_path(const struct sl_database_flat_session * session, const struct sl_database_flat_filesystem * fs, const char * path, uint64_t * record) {
+	char * buffer = NULL;
+	size_t capacity = 0;
+
+	uint64_t first = sl_database_flat_session_find_path_bound(session, fs, path, &buffer, &capacity);
+
+	bool found = false;
+	if (first < fs->first_record + fs->nb_records)
+		found = !strcmp(sl_database_flat_session_get_path(session, first, &buffer, &capacity), path);
+
+	free(buffer);
+
+	if (found)
+		*record = first;
+
+	return found;
+}
+
+static uint64_t sl_database_flat_session_find_path_bound(const struct sl_database_flat_session * session, const struct sl_database_flat_filesystem * fs, const char * path, char ** buffer, size_t * capacity) {
+	// lower bound of path, records of a filesystem are sorted by path
+	uint64_t first = fs->first_record, last = fs->first_record + fs->nb_records;
+	while (first < last) {
+		uint64_t middle = first + ((last - first) >> 1);
+		const char * current = sl_database_flat_session_get_path(session, middle, buffer, capacity);
+
+		if (strcmp(current, path) < 0)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+
+	return first;
+}
+
+void sl_database_flat_session_find_path_range(const struct sl_database_flat_session * session, const struct sl_database_flat_filesystem * fs, const char * path, bool subtree, uint64_t * first_record, uint64_t * last_record) {
+	char * buffer = NULL;
+	size_t capacity = 0;
+
+	if (!subtree) {
+		uint64_t record;
+		*first_record = *last_record = fs->first_record;
+		if (sl_database_flat_session_find_path(session, fs, path, &record)) {
+			*first_record = record;
+			*last_record = record + 1;
+		}
+		return;
+	}
+
+	// a directory is given without trailing '/'
+	size_t length = strlen(path);
+	while (length > 0 && path[length - 1] == '/')
+		length--;
+
+	if (length == 0) {
+		*first_record = fs->first_record;
+		*last_record = fs->first_record + fs->nb_records;
+		return;
+	}
+
+	// files under 'dir' are sorted from 'dir/' and before 'dir0', '0' follows '/'
+	char * bound = malloc(length + 2);
+	if (bound == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: not enough memory to look for files under '%s'", path);
+		*first_record = *last_record = fs->first_record;
+		return;
+	}
+
+	memcpy(bound, path, length);
+	bound[length + 1] = '\0';
+
+	bound[length] = '/';
+	*first_record = sl_database_flat_session_find_path_bound(session, fs, bound, &buffer, &capacity);
+
+	bound[length] = '0';
+	*last_record = sl_database_flat_session_find_path_bound(session, fs, bound, &buffer, &capacity);
+
+	free(bound);
+	free(buffer);
+}
+
+void sl_database_flat_session_free(struct sl_database_flat_session * session) {
+	if (session == NULL)
+		return;
+
+	munmap(session->address, session->length);
+	free(session->path);
+	free(session);
+}
+
+const char * sl_database_flat_session_get_path(const struct sl_database_flat_session * session, uint64_t record, char ** buffer, size_t * capacity) {
+	uint64_t i = record - record % SL_DATABASE_FLAT_RESTART_INTERVAL;
+	const unsigned char * ptr = session->paths + session->restarts[i / SL_DATABASE_FLAT_RESTART_INTERVAL];
+
+	const unsigned char * end = session->paths + session->header->paths_size;
+
+	// lengths of a corrupted file are bounded by previous path and by section of paths
+	size_t length = 0;
+	for (; i <= record; i++) {
+		size_t shared = sl_database_flat_session_decode(&ptr, end);
+		size_t suffix = sl_database_flat_session_decode(&ptr, end);
+		if (shared > length)
+			shared = length;
+		if (suffix > (size_t) (end - ptr))
+			suffix = end - ptr;
+
+		length = shared + suffix;
+		if (length + 1 > *capacity) {
+			*capacity = length + 256;
+			*buffer = realloc(*buffer, *capacity);
+		}
+
+		memcpy(*buffer + shared, ptr, suffix);
+		ptr += suffix;
+	}
+
+	(*buffer)[length] = '\0';
+	return *buffer;
+}
+
+const char * sl_database_flat_session_get_string(const struct sl_database_flat_session * session, uint32_t offset) {
+	if (offset == UINT32_MAX)
+		return NULL;
+
+	return session->strings + offset;
+}
+
+struct sl_database_flat_session * sl_database_flat_session_open(const char * path) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: failed to open '%s' because %m", path);
+		return NULL;
+	}
+
+	// header of format 2 ends before blob_restarts_offset
+	struct stat st;
+	if (fstat(fd, &st) || (size_t) st.st_size < offsetof(struct sl_database_flat_header, blob_restarts_offset)) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: '%s' is not a session file", path);
+		close(fd);
+		return NULL;
+	}
+
+	void * address = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (address == MAP_FAILED) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: failed to map '%s' because %m", path);
+		return NULL;
+	}
+
+	const struct sl_database_flat_header * header = address;
+	if (memcmp(header->magic, SL_DATABASE_FLAT_MAGIC, sizeof(SL_DATABASE_FLAT_MAGIC)) || header->format < 2 || header->format > SL_DATABASE_FLAT_FORMAT || header->file_size != (uint64_t) st.st_size) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: '%s' is not a session file or is corrupted", path);
+		munmap(address, st.st_size);
+		return NULL;
+	}
+
+	struct sl_database_flat_session * session = malloc(sizeof(struct sl_database_flat_session));
+	session->path = strdup(path);
+	session->address = address;
+	session->length = st.st_size;
+	session->header = header;
+
+	// every section should be inside file
+	if (!sl_database_flat_session_check(session)) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Flat: '%s' is corrupted", path);
+		munmap(address, st.st_size);
+		free(session->path);
+		free(session);
+		return NULL;
+	}
+
+	// lookups jump randomly into keys and paths
+	madvise(address, st.st_size, MADV_RANDOM);
+
+	session->filesystems = (const void *) ((const char *) address + header->filesystems_offset);
+	session->strings = (const char *) address + header->strings_offset;
+	session->keys = (const void *) ((const char *) address + header->keys_offset);
+	session->records = (const void *) ((const char *) address + header->records_offset);
+	session->restarts = (const void *) ((const char *) address + header->restarts_offset);
+	session->paths = (const unsigned char *) address + header->paths_offset;
+	session->blob_restarts = NULL;
+	session->blob = NULL;
+	if (header->format >= 3 && header->blob_offset > 0) {
+		session->blob_restarts = (const void *) ((const char *) address + header->blob_restarts_offset);
+		session->blob = (const char *) address + header->blob_offset;
+	}
+
+	return session;
+}
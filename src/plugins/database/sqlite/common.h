@@ -28,16 +28,271 @@
 #ifndef __STLOCATE_DB_SQLITE_H__
 #define __STLOCATE_DB_SQLITE_H__
 
+// pthread_cond_t, pthread_mutex_t
+#include <pthread.h>
+// sqlite3
+#include <sqlite3.h>
+// bool
+#include <stdbool.h>
+// uint64_t
+#include <stdint.h>
+// struct stat
+#include <sys/stat.h>
 #include <sys/types.h>
 
 #include <stlocate/database.h>
 
+// newest version of database schema
+#define SL_DATABASE_SQLITE_VERSION 2
+
 struct sl_hashtable;
 
+enum sl_database_sqlite_file_storage {
+	sl_database_sqlite_file_storage_delta,
+	sl_database_sqlite_file_storage_snapshot,
+};
+
+enum sl_database_sqlite_layout {
+	sl_database_sqlite_layout_filesystem,
+	sl_database_sqlite_layout_session,
+	sl_database_sqlite_layout_single,
+};
+
+enum sl_database_sqlite_path_compression {
+	sl_database_sqlite_path_compression_none,
+	sl_database_sqlite_path_compression_zstd,
+};
+
+enum sl_database_sqlite_path_storage {
+	sl_database_sqlite_path_storage_text,
+	sl_database_sqlite_path_storage_tree,
+};
+
+enum sl_database_sqlite_search_index {
+	sl_database_sqlite_search_index_none,
+	sl_database_sqlite_search_index_trigram,
+};
+
+enum sl_database_sqlite_update_mode {
+	sl_database_sqlite_update_mode_inplace,
+	sl_database_sqlite_update_mode_swap,
+};
+
+/**
+ * \brief Identifiers of prepared statements
+ *
+ * Each identifier names one SQL text, so a statement is prepared once
+ * per database handler and is found back without hashing its query.
+ */
+enum sl_database_sqlite_query {
+	sl_database_sqlite_query_compress_path,
+	sl_database_sqlite_query_compress_select_paths,
+	sl_database_sqlite_query_compress_select_s2fs,
+	sl_database_sqlite_query_compress_update_paths,
+	sl_database_sqlite_query_delete_dead_files,
+	sl_database_sqlite_query_delete_files,
+	sl_database_sqlite_query_delete_store_files,
+	sl_database_sqlite_query_delta_insert,
+	sl_database_sqlite_query_delta_select,
+	sl_database_sqlite_query_delta_update,
+	sl_database_sqlite_query_end_session,
+	sl_database_sqlite_query_end_session_v1,
+	sl_database_sqlite_query_find_batch,
+	sl_database_sqlite_query_find_batch_filter,
+	sl_database_sqlite_query_get_ancestors_delta,
+	sl_database_sqlite_query_get_ancestors_text,
+	sl_database_sqlite_query_get_file_info_delta,
+	sl_database_sqlite_query_get_file_info_text,
+	sl_database_sqlite_query_get_file_info_tree,
+	sl_database_sqlite_query_get_filesystem_uuid,
+	sl_database_sqlite_query_get_node,
+	sl_database_sqlite_query_get_previous_session,
+	sl_database_sqlite_query_get_sessions,
+	sl_database_sqlite_query_get_root,
+	sl_database_sqlite_query_get_child,
+	sl_database_sqlite_query_get_statistics,
+	sl_database_sqlite_query_get_stores_filesystem,
+	sl_database_sqlite_query_get_stores_filesystem_filter,
+	sl_database_sqlite_query_get_stores_session,
+	sl_database_sqlite_query_get_stores_session_filter,
+	sl_database_sqlite_query_get_version,
+	sl_database_sqlite_query_insert_dictionary,
+	sl_database_sqlite_query_insert_file,
+	sl_database_sqlite_query_insert_file_v1,
+	sl_database_sqlite_query_insert_filesystem,
+	sl_database_sqlite_query_insert_filter,
+	sl_database_sqlite_query_insert_host,
+	sl_database_sqlite_query_insert_lookup,
+	sl_database_sqlite_query_insert_node,
+	sl_database_sqlite_query_insert_s2fs,
+	sl_database_sqlite_query_insert_statistics,
+	sl_database_sqlite_query_search_index_delta,
+	sl_database_sqlite_query_search_index_snapshot,
+	sl_database_sqlite_query_select_filesystem,
+	sl_database_sqlite_query_select_host,
+	sl_database_sqlite_query_start_session,
+	sl_database_sqlite_query_start_session_v1,
+
+	/**
+	 * One statement by combination of filters of a request:
+	 * (session: none, range, equal) x (dev: no, yes) x (uuid: no, yes) x (path pattern: no, glob, regex, glob with path_index)
+	 * x (path: no, equal, under a directory, under root) x (inode: no, yes, with bloom filter)
+	 */
+	sl_database_sqlite_query_find,
+	sl_database_sqlite_query_find_last = sl_database_sqlite_query_find + 575,
+
+	sl_database_sqlite_query_nb,
+};
+
+struct sl_database_sqlite_config_private {
+	char * path;
+	enum sl_database_sqlite_layout layout;
+	enum sl_database_sqlite_path_storage path_storage;
+	enum sl_database_sqlite_file_storage file_storage;
+	enum sl_database_sqlite_path_compression path_compression;
+	enum sl_database_sqlite_search_index search_index;
+	enum sl_database_sqlite_update_mode update_mode;
+
+	unsigned int retention_chunk_size;
+	unsigned int retention_vacuum_pages;
+	unsigned int migration_batch_size;
+	// used by read-only connections
+	int64_t mmap_size;
+};
+
+/**
+ * \brief A step of a schema migration
+ *
+ * Rows of \a table which match \a pending are updated by \a update, by
+ * batches, until none is left.
+ */
+struct sl_database_sqlite_migration_step {
+	const char * description;
+	enum sl_database_sqlite_migration_scope {
+		sl_database_sqlite_migration_scope_main,
+		// table file, which can be into store databases
+		sl_database_sqlite_migration_scope_file,
+	} scope;
+	// executed once before converting rows, should be idempotent
+	const char * prepare;
+	const char * table;
+	const char * pending;
+	const char * update;
+};
+
+struct sl_database_sqlite_migration {
+	int from_version;
+	int to_version;
+	const struct sl_database_sqlite_migration_step * steps;
+	unsigned int nb_steps;
+};
+
+/**
+ * \brief Prepared statements of a database handler, indexed by sl_database_sqlite_query
+ */
+struct sl_database_sqlite_queries {
+	sqlite3_stmt * statements[sl_database_sqlite_query_nb];
+};
+
+/**
+ * \brief A database file which contains only rows of table file
+ *
+ * Rows are written by a dedicated thread so several stores can be
+ * filled in parallel.
+ */
+struct sl_database_sqlite_store {
+	char * path;
+	sqlite3 * db_handler;
+	struct sl_database_sqlite_queries * prepared_queries;
+	bool meta_attached;
+	bool read_only;
+	int version;
+	enum sl_database_sqlite_path_storage path_storage;
+	sqlite3_int64 next_file_id;
+
+	pthread_mutex_t lock;
+	pthread_cond_t wait;
+
+	struct sl_database_sqlite_store_file {
+		int s2fs;
+		sqlite3_int64 id;
+		sqlite3_int64 parent;
+		char * filename;
+		struct stat st;
+	} * files;
+	unsigned int first_file;
+	unsigned int nb_files;
+	unsigned int max_files;
+
+	bool running;
+	bool busy;
+	bool stop;
+	int failed;
+};
+
+/**
+ * \brief Inodes of a session2filesystem, used to build its filter
+ */
+struct sl_database_sqlite_filter {
+	int s2fs;
+	uint64_t * inodes;
+	unsigned int nb_inodes;
+	unsigned int max_inodes;
+};
+
+int sl_database_sqlite_compress_register(sqlite3 * db);
+int sl_database_sqlite_compress_session(sqlite3 * db, struct sl_database_sqlite_queries * queries, int session_id);
+
+int sl_database_sqlite_filter_add(struct sl_database_sqlite_filter * filter, uint64_t inode);
+void sl_database_sqlite_filter_free(struct sl_database_sqlite_filter * filter);
+int sl_database_sqlite_filter_register(sqlite3 * db);
+int sl_database_sqlite_filter_write(sqlite3 * db, struct sl_database_sqlite_queries * queries, const struct sl_database_sqlite_filter * filter);
+
 struct sl_database_config * sl_database_sqlite_config_add(struct sl_database * driver, const struct sl_hashtable * params);
-struct sl_database_connection * sl_database_sqlite_connection_add(struct sl_database_config * config, const char * path);
+struct sl_database_connection * sl_database_sqlite_connection_add(struct sl_database_config * config, bool read_only);
 
-int sl_database_sqlite_util_convert_to_time(const char * time);
+const struct sl_database_sqlite_migration * sl_database_sqlite_migrate_get(int from_version);
+int sl_database_sqlite_migrate_step(sqlite3 * db, const char * name, const struct sl_database_sqlite_migration_step * step, unsigned int batch_size);
 
-#endif
+int sl_database_sqlite_search_create(sqlite3 * db, enum sl_database_sqlite_file_storage file_storage);
+int sl_database_sqlite_search_drop(sqlite3 * db);
+int sl_database_sqlite_search_index_session(sqlite3 * db, struct sl_database_sqlite_queries * queries, enum sl_database_sqlite_file_storage file_storage, int session_id);
+int sl_database_sqlite_search_register(sqlite3 * db);
 
+int sl_database_sqlite_store_attach_meta(struct sl_database_sqlite_store * store, const char * meta_path);
+int sl_database_sqlite_store_begin(struct sl_database_sqlite_store * store);
+int sl_database_sqlite_store_commit(struct sl_database_sqlite_store * store);
+int sl_database_sqlite_store_flush(struct sl_database_sqlite_store * store);
+void sl_database_sqlite_store_free(struct sl_database_sqlite_store * store);
+int sl_database_sqlite_store_insert_file(struct sl_database_sqlite_store * store, int s2fs, sqlite3_int64 id, sqlite3_int64 parent, const char * filename, const struct stat * st);
+struct sl_database_sqlite_store * sl_database_sqlite_store_open(const char * path, int version, enum sl_database_sqlite_path_storage path_storage, bool read_only, int64_t mmap_size);
+int sl_database_sqlite_store_rollback(struct sl_database_sqlite_store * store);
+
+void sl_database_sqlite_util_clear_queries(struct sl_database_sqlite_queries * queries);
+int sl_database_sqlite_util_create_delta_file_table(sqlite3 * db);
+int sl_database_sqlite_util_create_filter_table(sqlite3 * db);
+int sl_database_sqlite_util_create_statistics_table(sqlite3 * db);
+int sl_database_sqlite_util_create_indexes(sqlite3 * db, const struct sl_database_sqlite_config_private * config);
+int sl_database_sqlite_util_create_path_index(sqlite3 * db, enum sl_database_sqlite_file_storage file_storage);
+int sl_database_sqlite_util_create_file_table(sqlite3 * db, bool foreign_key, enum sl_database_sqlite_path_storage path_storage);
+int sl_database_sqlite_util_delete_dead_files(sqlite3 * db, struct sl_database_sqlite_queries * queries, int fs_id, int last_session, unsigned int chunk_size, unsigned int vacuum_pages);
+int sl_database_sqlite_util_delete_files(sqlite3 * db, struct sl_database_sqlite_queries * queries, int s2fs, unsigned int chunk_size, unsigned int vacuum_pages);
+int sl_database_sqlite_util_exec(sqlite3 * db, const char * query);
+const char * sl_database_sqlite_util_file_storage_to_string(enum sl_database_sqlite_file_storage file_storage);
+void sl_database_sqlite_util_free_queries(struct sl_database_sqlite_queries * queries);
+sqlite3_int64 sl_database_sqlite_util_get_next_file_id(sqlite3 * db);
+time_t sl_database_sqlite_util_get_time(sqlite3_stmt * stmt, int column);
+int sl_database_sqlite_util_incremental_vacuum(sqlite3 * db, unsigned int nb_pages);
+int sl_database_sqlite_util_insert_file(sqlite3 * db, struct sl_database_sqlite_queries * queries, int version, int s2fs, const char * filename, const struct stat * st);
+int sl_database_sqlite_util_insert_node(sqlite3 * db, struct sl_database_sqlite_queries * queries, int s2fs, sqlite3_int64 id, sqlite3_int64 parent, const char * name, const struct stat * st);
+const char * sl_database_sqlite_util_layout_to_string(enum sl_database_sqlite_layout layout);
+struct sl_database_sqlite_queries * sl_database_sqlite_util_new_queries(void);
+sqlite3 * sl_database_sqlite_util_open(const char * path);
+sqlite3 * sl_database_sqlite_util_open_read_only(const char * path, int64_t mmap_size, bool immutable);
+const char * sl_database_sqlite_util_path_compression_to_string(enum sl_database_sqlite_path_compression path_compression);
+const char * sl_database_sqlite_util_path_storage_to_string(enum sl_database_sqlite_path_storage path_storage);
+sqlite3_stmt * sl_database_sqlite_util_prepare(sqlite3 * db, struct sl_database_sqlite_queries * queries, enum sl_database_sqlite_query id, const char * query);
+char * sl_database_sqlite_util_read_only_uri(const char * path, bool immutable);
+int sl_database_sqlite_util_sync_delta_file(sqlite3 * db, struct sl_database_sqlite_queries * queries, int fs_id, int session_id, int previous_session, const char * filename, const struct stat * st);
+
+#endif
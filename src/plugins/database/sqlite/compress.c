@@ -0,0 +1,365 @@
+/*************************************************************************\
+*                  ______  __                 __                          *
+*                 / __/ /_/ /  ___  _______ _/ /____                      *
+*                _\ \/ __/ /__/ _ \/ __/ _ `/ __/ -_)                     *
+*               /___/\__/____/\___/\__/\_,_/\__/\__/                      *
+*                                                                         *
+*  ---------------------------------------------------------------------  *
+*  This file is a part of StLocate                                        *
+*                                                                         *
+*  StLocate is free software; you can redistribute it and/or              *
+*  modify it under the terms of the GNU General Public License            *
+*  as published by the Free Software Foundation; either version 3         *
+*  of the License, or (at your option) any later version.                 *
+*                                                                         *
+*  This program is distributed in the hope that it will be useful,        *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+*  GNU General Public License for more details.                           *
+*                                                                         *
+*  You should have received a copy of the GNU General Public License      *
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.  *
+*                                                                         *
+*  ---------------------------------------------------------------------  *
+*  Copyright (C) 2013, Clercin guillaume <gclercin@intellique.com>        *
+*  Last modified: Mon, 19 Oct 2026                                        *
+\*************************************************************************/
+
+#define _GNU_SOURCE
+// snprintf
+#include <stdio.h>
+// free, malloc, realloc
+#include <stdlib.h>
+// memcpy
+#include <string.h>
+// ZDICT_isError, ZDICT_trainFromBuffer
+#include <zdict.h>
+// ZSTD_*
+#include <zstd.h>
+
+#include <stlocate/hashtable.h>
+#include <stlocate/log.h>
+#include <stlocate/string.h>
+
+#include "common.h"
+
+// paths used to train a dictionary
+#define SL_DATABASE_SQLITE_COMPRESS_SAMPLES_SIZE 16777216
+#define SL_DATABASE_SQLITE_COMPRESS_DICTIONARY_SIZE 65536
+#define SL_DATABASE_SQLITE_COMPRESS_LEVEL 9
+
+struct sl_database_sqlite_compress_cache {
+	ZSTD_DCtx * context;
+	struct sl_hashtable * compressors;
+	struct sl_hashtable * dictionaries;
+};
+
+struct sl_database_sqlite_compress_compressor {
+	ZSTD_CCtx * context;
+	ZSTD_CDict * dictionary;
+};
+
+static void sl_database_sqlite_compress_cache_free(void * cache);
+static void sl_database_sqlite_compress_compressor_free(void * key, void * value);
+static void sl_database_sqlite_compress_ddict_free(void * key, void * value);
+static sqlite3_stmt * sl_database_sqlite_compress_load_dictionary(sqlite3_context * context, sqlite3_value * s2fs);
+static void sl_database_sqlite_compress_path(sqlite3_context * context, int argc, sqlite3_value ** argv);
+static void sl_database_sqlite_compress_decompress_path(sqlite3_context * context, int argc, sqlite3_value ** argv);
+static int sl_database_sqlite_compress_filesystem(sqlite3 * db, struct sl_database_sqlite_queries * queries, int s2fs);
+
+
+static void sl_database_sqlite_compress_cache_free(void * cache) {
+	struct sl_database_sqlite_compress_cache * self = cache;
+	ZSTD_freeDCtx(self->context);
+	sl_hashtable_free(self->compressors);
+	sl_hashtable_free(self->dictionaries);
+	free(self);
+}
+
+static void sl_database_sqlite_compress_compressor_free(void * key, void * value) {
+	struct sl_database_sqlite_compress_compressor * self = value;
+	free(key);
+	ZSTD_freeCCtx(self->context);
+	ZSTD_freeCDict(self->dictionary);
+	free(self);
+}
+
+static void sl_database_sqlite_compress_ddict_free(void * key, void * value) {
+	free(key);
+	ZSTD_freeDDict(value);
+}
+
+/**
+ * \brief Select the dictionary of session2filesystem \a s2fs
+ *
+ * \returns a statement which points to the dictionary, which should be
+ * finalized by the caller, or \b NULL if there is no dictionary
+ */
+static sqlite3_stmt * sl_database_sqlite_compress_load_dictionary(sqlite3_context * context, sqlite3_value * s2fs) {
+	// statement is not kept so that closing database is never prevented
+	sqlite3_stmt * stmt_select;
+	if (sqlite3_prepare_v2(sqlite3_context_db_handle(context), "SELECT data FROM dictionary WHERE s2fs = ?1", -1, &stmt_select, NULL) != SQLITE_OK)
+		return NULL;
+
+	sqlite3_bind_value(stmt_select, 1, s2fs);
+	if (sqlite3_step(stmt_select) == SQLITE_ROW)
+		return stmt_select;
+
+	sqlite3_finalize(stmt_select);
+	return NULL;
+}
+
+/**
+ * sl_compress_path(path, s2fs)
+ *
+ * Compress \a path with the dictionary of session2filesystem \a s2fs.
+ * \a path is returned unchanged if there is no dictionary.
+ */
+static void sl_database_sqlite_compress_path(sqlite3_context * context, int argc __attribute__((unused)), sqlite3_value ** argv) {
+	if (sqlite3_value_type(argv[0]) != SQLITE_TEXT) {
+		sqlite3_result_value(context, argv[0]);
+		return;
+	}
+
+	struct sl_database_sqlite_compress_cache * cache = sqlite3_user_data(context);
+
+	char key[16];
+	snprintf(key, 16, "%d", sqlite3_value_int(argv[1]));
+
+	// a dictionary never changes once inserted, so it is loaded once by connection
+	struct sl_database_sqlite_compress_compressor * compressor = NULL;
+	struct sl_hashtable_value val = sl_hashtable_get(cache->compressors, key);
+	if (val.type == sl_hashtable_value_custom)
+		compressor = val.value.custom;
+	else {
+		sqlite3_stmt * stmt_select = sl_database_sqlite_compress_load_dictionary(context, argv[1]);
+		if (stmt_select == NULL) {
+			sqlite3_result_value(context, argv[0]);
+			return;
+		}
+
+		compressor = malloc(sizeof(struct sl_database_sqlite_compress_compressor));
+		compressor->context = ZSTD_createCCtx();
+		compressor->dictionary = ZSTD_createCDict(sqlite3_column_blob(stmt_select, 0), sqlite3_column_bytes(stmt_select, 0), SL_DATABASE_SQLITE_COMPRESS_LEVEL);
+		sqlite3_finalize(stmt_select);
+
+		if (compressor->context == NULL || compressor->dictionary == NULL) {
+			sl_database_sqlite_compress_compressor_free(NULL, compressor);
+			sqlite3_result_error(context, "failed to load dictionary", -1);
+			return;
+		}
+
+		// dictionary is known by session2filesystem
+		ZSTD_CCtx_setParameter(compressor->context, ZSTD_c_dictIDFlag, 0);
+		ZSTD_CCtx_refCDict(compressor->context, compressor->dictionary);
+
+		sl_hashtable_put(cache->compressors, strdup(key), sl_hashtable_val_custom(compressor));
+	}
+
+	const void * path = sqlite3_value_text(argv[0]);
+	size_t length = sqlite3_value_bytes(argv[0]);
+
+	size_t capacity = ZSTD_compressBound(length);
+	void * buffer = malloc(capacity);
+	if (buffer == NULL) {
+		sqlite3_result_error_nomem(context);
+		return;
+	}
+
+	size_t nb_write = ZSTD_compress2(compressor->context, buffer, capacity, path, length);
+
+	if (ZSTD_isError(nb_write)) {
+		free(buffer);
+		sqlite3_result_error(context, ZSTD_getErrorName(nb_write), -1);
+	} else
+		sqlite3_result_blob(context, buffer, nb_write, free);
+}
+
+/**
+ * sl_decompress_path(path, s2fs)
+ *
+ * Decompress \a path with the dictionary of session2filesystem \a s2fs.
+ * Paths stored as text are returned unchanged.
+ */
+static void sl_database_sqlite_compress_decompress_path(sqlite3_context * context, int argc __attribute__((unused)), sqlite3_value ** argv) {
+	if (sqlite3_value_type(argv[0]) != SQLITE_BLOB) {
+		sqlite3_result_value(context, argv[0]);
+		return;
+	}
+
+	struct sl_database_sqlite_compress_cache * cache = sqlite3_user_data(context);
+
+	char key[16];
+	snprintf(key, 16, "%d", sqlite3_value_int(argv[1]));
+
+	ZSTD_DDict * dictionary = NULL;
+	struct sl_hashtable_value val = sl_hashtable_get(cache->dictionaries, key);
+	if (val.type == sl_hashtable_value_custom)
+		dictionary = val.value.custom;
+	else {
+		sqlite3_stmt * stmt_select = sl_database_sqlite_compress_load_dictionary(context, argv[1]);
+		if (stmt_select != NULL) {
+			dictionary = ZSTD_createDDict(sqlite3_column_blob(stmt_select, 0), sqlite3_column_bytes(stmt_select, 0));
+			sqlite3_finalize(stmt_select);
+		}
+
+		if (dictionary == NULL) {
+			sqlite3_result_error(context, "there is no dictionary for this path", -1);
+			return;
+		}
+
+		sl_hashtable_put(cache->dictionaries, strdup(key), sl_hashtable_val_custom(dictionary));
+	}
+
+	const void * path = sqlite3_value_blob(argv[0]);
+	size_t length = sqlite3_value_bytes(argv[0]);
+
+	unsigned long long capacity = ZSTD_getFrameContentSize(path, length);
+	if (capacity == ZSTD_CONTENTSIZE_ERROR || capacity == ZSTD_CONTENTSIZE_UNKNOWN) {
+		sqlite3_result_error(context, "path is corrupted", -1);
+		return;
+	}
+
+	char * buffer = malloc(capacity + 1);
+	size_t nb_read = ZSTD_decompress_usingDDict(cache->context, buffer, capacity, path, length, dictionary);
+
+	if (ZSTD_isError(nb_read)) {
+		free(buffer);
+		sqlite3_result_error(context, ZSTD_getErrorName(nb_read), -1);
+	} else {
+		buffer[nb_read] = '\0';
+		sqlite3_result_text(context, buffer, nb_read, free);
+	}
+}
+
+int sl_database_sqlite_compress_register(sqlite3 * db) {
+	struct sl_database_sqlite_compress_cache * cache = malloc(sizeof(struct sl_database_sqlite_compress_cache));
+	cache->context = ZSTD_createDCtx();
+	cache->compressors = sl_hashtable_new2(sl_string_compute_hash, sl_database_sqlite_compress_compressor_free);
+	cache->dictionaries = sl_hashtable_new2(sl_string_compute_hash, sl_database_sqlite_compress_ddict_free);
+
+	/**
+	 * cache is released by sqlite with sl_decompress_path, even on failure.
+	 * Both functions read table dictionary so they are not deterministic.
+	 */
+	int failed = sqlite3_create_function_v2(db, "sl_decompress_path", 2, SQLITE_UTF8, cache, sl_database_sqlite_compress_decompress_path, NULL, NULL, sl_database_sqlite_compress_cache_free);
+	if (failed == SQLITE_OK)
+		failed = sqlite3_create_function_v2(db, "sl_compress_path", 2, SQLITE_UTF8, cache, sl_database_sqlite_compress_path, NULL, NULL, NULL);
+
+	if (failed != SQLITE_OK)
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to register compression functions because %s", sqlite3_errmsg(db));
+
+	return failed != SQLITE_OK;
+}
+
+int sl_database_sqlite_compress_session(sqlite3 * db, struct sl_database_sqlite_queries * queries, int session_id) {
+	static const char * query = "SELECT id FROM session2filesystem WHERE session = ?1";
+	sqlite3_stmt * stmt_select = sl_database_sqlite_util_prepare(db, queries, sl_database_sqlite_query_compress_select_s2fs, query);
+	if (stmt_select == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'select session2filesystem'");
+		return -1;
+	}
+
+	sqlite3_bind_int(stmt_select, 1, session_id);
+
+	int * s2fs = NULL;
+	unsigned int i, nb_s2fs = 0;
+	while (sqlite3_step(stmt_select) == SQLITE_ROW) {
+		void * new_addr = realloc(s2fs, (nb_s2fs + 1) * sizeof(int));
+		if (new_addr == NULL)
+			break;
+
+		s2fs = new_addr;
+		s2fs[nb_s2fs] = sqlite3_column_int(stmt_select, 0);
+		nb_s2fs++;
+	}
+	sqlite3_reset(stmt_select);
+
+	int failed = 0;
+	for (i = 0; i < nb_s2fs && !failed; i++)
+		failed = sl_database_sqlite_compress_filesystem(db, queries, s2fs[i]);
+	free(s2fs);
+
+	return failed;
+}
+
+static int sl_database_sqlite_compress_filesystem(sqlite3 * db, struct sl_database_sqlite_queries * queries, int s2fs) {
+	static const char * query = "SELECT path FROM file WHERE s2fs = ?1 AND typeof(path) = 'text'";
+	sqlite3_stmt * stmt_select = sl_database_sqlite_util_prepare(db, queries, sl_database_sqlite_query_compress_select_paths, query);
+	if (stmt_select == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'select path'");
+		return -1;
+	}
+
+	sqlite3_bind_int(stmt_select, 1, s2fs);
+
+	char * samples = malloc(SL_DATABASE_SQLITE_COMPRESS_SAMPLES_SIZE);
+	size_t * sample_sizes = NULL;
+	size_t samples_length = 0;
+	unsigned int nb_samples = 0;
+	while (sqlite3_step(stmt_select) == SQLITE_ROW) {
+		size_t length = sqlite3_column_bytes(stmt_select, 0);
+		if (samples_length + length > SL_DATABASE_SQLITE_COMPRESS_SAMPLES_SIZE)
+			break;
+
+		void * new_addr = realloc(sample_sizes, (nb_samples + 1) * sizeof(size_t));
+		if (new_addr == NULL)
+			break;
+
+		sample_sizes = new_addr;
+		sample_sizes[nb_samples] = length;
+		memcpy(samples + samples_length, sqlite3_column_text(stmt_select, 0), length);
+		samples_length += length;
+		nb_samples++;
+	}
+	sqlite3_reset(stmt_select);
+
+	void * dictionary = malloc(SL_DATABASE_SQLITE_COMPRESS_DICTIONARY_SIZE);
+	size_t dictionary_size = ZDICT_trainFromBuffer(dictionary, SL_DATABASE_SQLITE_COMPRESS_DICTIONARY_SIZE, samples, sample_sizes, nb_samples);
+	free(samples);
+	free(sample_sizes);
+
+	// a small filesystem has not enough paths to train a dictionary
+	if (ZDICT_isError(dictionary_size)) {
+		sl_log_write(sl_log_level_info, sl_log_type_plugin_database, "Sqlite: paths of session2filesystem %d are not compressed (%u paths) because %s", s2fs, nb_samples, ZDICT_getErrorName(dictionary_size));
+		free(dictionary);
+		return 0;
+	}
+
+	static const char * insert = "INSERT INTO dictionary(s2fs, data) VALUES (?1, ?2)";
+	sqlite3_stmt * stmt_insert = sl_database_sqlite_util_prepare(db, queries, sl_database_sqlite_query_insert_dictionary, insert);
+	if (stmt_insert == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'insert into dictionary'");
+		free(dictionary);
+		return -1;
+	}
+
+	sqlite3_bind_int(stmt_insert, 1, s2fs);
+	sqlite3_bind_blob(stmt_insert, 2, dictionary, dictionary_size, free);
+
+	int failed = sqlite3_step(stmt_insert) != SQLITE_DONE;
+	sqlite3_reset(stmt_insert);
+
+	if (failed) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to insert dictionary of session2filesystem %d because %s", s2fs, sqlite3_errmsg(db));
+		return -1;
+	}
+
+	static const char * update = "UPDATE file SET path = sl_compress_path(path, ?1) WHERE s2fs = ?1 AND typeof(path) = 'text'";
+	sqlite3_stmt * stmt_update = sl_database_sqlite_util_prepare(db, queries, sl_database_sqlite_query_compress_update_paths, update);
+	if (stmt_update == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'compress path'");
+		return -1;
+	}
+
+	sqlite3_bind_int(stmt_update, 1, s2fs);
+
+	failed = sqlite3_step(stmt_update) != SQLITE_DONE;
+	if (failed)
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to compress paths of session2filesystem %d because %s", s2fs, sqlite3_errmsg(db));
+	else
+		sl_log_write(sl_log_level_debug, sl_log_type_plugin_database, "Sqlite: paths of session2filesystem %d compressed with a dictionary of %zu bytes", s2fs, dictionary_size);
+	sqlite3_reset(stmt_update);
+
+	return failed;
+}
@@ -27,7 +27,7 @@
 
 // free, malloc
 #include <stdlib.h>
-// strdup
+// strcmp, strdup
 #include <string.h>
 // sqlite3_open
 #include <sqlite3.h>
@@ -37,18 +37,16 @@
 
 #include "common.h"
 
-struct sl_database_sqlite_config_private {
-	char * path;
-};
-
 static struct sl_database_connection * sl_database_sqlite_config_connect(struct sl_database_config * config);
+static struct sl_database_connection * sl_database_sqlite_config_connect_read_only(struct sl_database_config * config);
 static void sl_database_sqlite_config_free(struct sl_database_config * config);
 static int sl_database_sqlite_config_ping(struct sl_database_config * config);
 
 static struct sl_database_config_ops sl_database_sqlite_config_ops = {
-	.connect = sl_database_sqlite_config_connect,
-	.free    = sl_database_sqlite_config_free,
-	.ping    = sl_database_sqlite_config_ping,
+	.connect           = sl_database_sqlite_config_connect,
+	.connect_read_only = sl_database_sqlite_config_connect_read_only,
+	.free              = sl_database_sqlite_config_free,
+	.ping              = sl_database_sqlite_config_ping,
 };
 
 
@@ -64,8 +62,146 @@ struct sl_database_config * sl_database_sqlite_config_add(struct sl_database * d
 		return NULL;
 	}
 
+	enum sl_database_sqlite_update_mode update_mode = sl_database_sqlite_update_mode_inplace;
+	struct sl_hashtable_value mode = sl_hashtable_get(params, "update_mode");
+	if (mode.type == sl_hashtable_value_string) {
+		if (!strcmp(mode.value.string, "swap"))
+			update_mode = sl_database_sqlite_update_mode_swap;
+		else if (strcmp(mode.value.string, "inplace")) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: update_mode should be 'inplace' or 'swap' but not '%s'", mode.value.string);
+			return NULL;
+		}
+	}
+
+	enum sl_database_sqlite_layout layout = sl_database_sqlite_layout_single;
+	struct sl_hashtable_value lay = sl_hashtable_get(params, "layout");
+	if (lay.type == sl_hashtable_value_string) {
+		if (!strcmp(lay.value.string, "filesystem"))
+			layout = sl_database_sqlite_layout_filesystem;
+		else if (!strcmp(lay.value.string, "session"))
+			layout = sl_database_sqlite_layout_session;
+		else if (strcmp(lay.value.string, "single")) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: layout should be 'single', 'filesystem' or 'session' but not '%s'", lay.value.string);
+			return NULL;
+		}
+	}
+
+	enum sl_database_sqlite_path_storage path_storage = sl_database_sqlite_path_storage_text;
+	struct sl_hashtable_value storage_mode = sl_hashtable_get(params, "path_storage");
+	if (storage_mode.type == sl_hashtable_value_string) {
+		if (!strcmp(storage_mode.value.string, "tree"))
+			path_storage = sl_database_sqlite_path_storage_tree;
+		else if (strcmp(storage_mode.value.string, "text")) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: path_storage should be 'text' or 'tree' but not '%s'", storage_mode.value.string);
+			return NULL;
+		}
+	}
+
+	enum sl_database_sqlite_file_storage file_storage = sl_database_sqlite_file_storage_snapshot;
+	struct sl_hashtable_value files = sl_hashtable_get(params, "file_storage");
+	if (files.type == sl_hashtable_value_string) {
+		if (!strcmp(files.value.string, "delta"))
+			file_storage = sl_database_sqlite_file_storage_delta;
+		else if (strcmp(files.value.string, "snapshot")) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: file_storage should be 'snapshot' or 'delta' but not '%s'", files.value.string);
+			return NULL;
+		}
+	}
+
+	if (file_storage == sl_database_sqlite_file_storage_delta && (layout != sl_database_sqlite_layout_single || path_storage != sl_database_sqlite_path_storage_text)) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: file_storage 'delta' requires layout 'single' and path_storage 'text'");
+		return NULL;
+	}
+
+	enum sl_database_sqlite_path_compression path_compression = sl_database_sqlite_path_compression_none;
+	struct sl_hashtable_value compression = sl_hashtable_get(params, "path_compression");
+	if (compression.type == sl_hashtable_value_string) {
+		if (!strcmp(compression.value.string, "zstd"))
+			path_compression = sl_database_sqlite_path_compression_zstd;
+		else if (strcmp(compression.value.string, "none")) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: path_compression should be 'none' or 'zstd' but not '%s'", compression.value.string);
+			return NULL;
+		}
+	}
+
+	if (path_compression != sl_database_sqlite_path_compression_none && (layout != sl_database_sqlite_layout_single || path_storage != sl_database_sqlite_path_storage_text || file_storage != sl_database_sqlite_file_storage_snapshot)) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: path_compression '%s' requires layout 'single', path_storage 'text' and file_storage 'snapshot'", compression.value.string);
+		return NULL;
+	}
+
+	enum sl_database_sqlite_search_index search_index = sl_database_sqlite_search_index_none;
+	struct sl_hashtable_value index = sl_hashtable_get(params, "search_index");
+	if (index.type == sl_hashtable_value_string) {
+		if (!strcmp(index.value.string, "trigram"))
+			search_index = sl_database_sqlite_search_index_trigram;
+		else if (strcmp(index.value.string, "none")) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: search_index should be 'none' or 'trigram' but not '%s'", index.value.string);
+			return NULL;
+		}
+	}
+
+	if (search_index != sl_database_sqlite_search_index_none && (layout != sl_database_sqlite_layout_single || path_storage != sl_database_sqlite_path_storage_text)) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: search_index '%s' requires layout 'single' and path_storage 'text'", index.value.string);
+		return NULL;
+	}
+
+	if (layout != sl_database_sqlite_layout_single && update_mode == sl_database_sqlite_update_mode_swap) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: update_mode 'swap' requires layout 'single'");
+		return NULL;
+	}
+
+	int chunk_size = 10000;
+	struct sl_hashtable_value chunk = sl_hashtable_get(params, "retention_chunk_size");
+	if (chunk.type != sl_hashtable_value_null) {
+		chunk_size = sl_hashtable_val_convert_to_signed_integer(&chunk);
+		if (chunk_size < 1) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: retention_chunk_size should be a positive integer but not %d", chunk_size);
+			return NULL;
+		}
+	}
+
+	int vacuum_pages = 1024;
+	struct sl_hashtable_value pages = sl_hashtable_get(params, "retention_vacuum_pages");
+	if (pages.type != sl_hashtable_value_null) {
+		vacuum_pages = sl_hashtable_val_convert_to_signed_integer(&pages);
+		if (vacuum_pages < 0) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: retention_vacuum_pages should be a positive integer but not %d", vacuum_pages);
+			return NULL;
+		}
+	}
+
+	int batch_size = 10000;
+	struct sl_hashtable_value batch = sl_hashtable_get(params, "migration_batch_size");
+	if (batch.type != sl_hashtable_value_null) {
+		batch_size = sl_hashtable_val_convert_to_signed_integer(&batch);
+		if (batch_size < 1) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: migration_batch_size should be a positive integer but not %d", batch_size);
+			return NULL;
+		}
+	}
+
+	int64_t mmap_size = 268435456;
+	struct sl_hashtable_value mmap = sl_hashtable_get(params, "mmap_size");
+	if (mmap.type != sl_hashtable_value_null) {
+		mmap_size = sl_hashtable_val_convert_to_signed_integer(&mmap);
+		if (mmap_size < 0) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: mmap_size should be a positive integer but not %lld", (long long) mmap_size);
+			return NULL;
+		}
+	}
+
 	struct sl_database_sqlite_config_private * self = malloc(sizeof(struct sl_database_sqlite_config_private));
 	self->path = strdup(path.value.string);
+	self->layout = layout;
+	self->path_storage = path_storage;
+	self->file_storage = file_storage;
+	self->path_compression = path_compression;
+	self->search_index = search_index;
+	self->update_mode = update_mode;
+	self->retention_chunk_size = chunk_size;
+	self->retention_vacuum_pages = vacuum_pages;
+	self->migration_batch_size = batch_size;
+	self->mmap_size = mmap_size;
 
 	struct sl_database_config * config = malloc(sizeof(struct sl_database_config));
 	config->name = strdup(storage.value.string);
@@ -73,7 +209,7 @@ struct sl_database_config * sl_database_sqlite_config_add(struct sl_database * d
 	config->data = self;
 	config->driver = driver;
 
-	sl_log_write(sl_log_level_info, sl_log_type_plugin_database, "Sqlite: new config defined { storage: '%s', path: '%s' }", storage.value.string, path.value.string);
+	sl_log_write(sl_log_level_info, sl_log_type_plugin_database, "Sqlite: new config defined { storage: '%s', path: '%s', layout: '%s', path_storage: '%s', path_compression: '%s', file_storage: '%s', search_index: '%s', update_mode: '%s' }", storage.value.string, path.value.string, sl_database_sqlite_util_layout_to_string(layout), sl_database_sqlite_util_path_storage_to_string(path_storage), sl_database_sqlite_util_path_compression_to_string(path_compression), sl_database_sqlite_util_file_storage_to_string(file_storage), search_index == sl_database_sqlite_search_index_trigram ? "trigram" : "none", update_mode == sl_database_sqlite_update_mode_swap ? "swap" : "inplace");
 
 	return config;
 }
@@ -82,8 +218,14 @@ static struct sl_database_connection * sl_database_sqlite_config_connect(struct
 	if (config == NULL)
 		return NULL;
 
-	struct sl_database_sqlite_config_private * self = config->data;
-	return sl_database_sqlite_connection_add(config, self->path);
+	return sl_database_sqlite_connection_add(config, false);
+}
+
+static struct sl_database_connection * sl_database_sqlite_config_connect_read_only(struct sl_database_config * config) {
+	if (config == NULL)
+		return NULL;
+
+	return sl_database_sqlite_connection_add(config, true);
 }
 
 static void sl_database_sqlite_config_free(struct sl_database_config * config) {
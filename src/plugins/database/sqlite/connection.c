@@ -25,41 +25,153 @@
 *  Last modified: Sun, 25 Aug 2013 20:23:35 +0200                         *
 \*************************************************************************/
 
+// asprintf, rename
+#define _GNU_SOURCE
+// errno
+#include <errno.h>
+// open
+#include <fcntl.h>
+// fnmatch
+#include <fnmatch.h>
+// dirname
+#include <libgen.h>
+// regcomp, regexec, regfree
+#include <regex.h>
+// asprintf, rename
+#include <stdio.h>
 // free, malloc
 #include <stdlib.h>
 // sqlite3_open
 #include <sqlite3.h>
-// strdup
+// strchr, strdup, strrchr
 #include <string.h>
-// struct stat
+// chmod, open, struct stat
 #include <sys/stat.h>
+// time
+#include <time.h>
+// flock
+#include <sys/file.h>
+// close, fsync, unlink
+#include <unistd.h>
 
 #include <stlocate/filesystem.h>
 #include <stlocate/hashtable.h>
 #include <stlocate/log.h>
 #include <stlocate/result.h>
 #include <stlocate/string.h>
+#include <stlocate/util.h>
 
 #include "common.h"
 
+// an unfinished session older than this (in seconds) was left by an update which died
+#define SL_DATABASE_SQLITE_STALE_SESSION_TIMEOUT 86400
+
 struct sl_database_sqlite_connection_private {
 	sqlite3 * db_handler;
-	struct sl_hashtable * prepared_queries;
+	struct sl_database_sqlite_queries * prepared_queries;
+
+	struct sl_database_sqlite_config_private * config;
+	char * build_path;
+	// lock held while building, so that two updates do not share build_path
+	int build_lock;
+	bool read_only;
+
+	struct sl_hashtable * stores;
+	struct sl_database_sqlite_connection_store {
+		int s2fs;
+		struct sl_database_sqlite_store * store;
+	} * s2fs_stores;
+	unsigned int nb_s2fs_stores;
+	bool in_transaction;
+
+	// directories being walked, by session2filesystem, with path_storage = tree
+	struct sl_database_sqlite_connection_tree {
+		int s2fs;
+		struct sl_database_sqlite_connection_tree_dir {
+			char * path;
+			sqlite3_int64 id;
+		} * dirs;
+		unsigned int nb_dirs;
+	} * trees;
+	unsigned int nb_trees;
+	sqlite3_int64 next_file_id;
+
+	// sessions compared by session2filesystem, with file_storage = delta
+	struct sl_database_sqlite_connection_delta {
+		int s2fs;
+		int filesystem;
+		int session;
+		int previous_session;
+	} * deltas;
+	unsigned int nb_deltas;
+
+	// inodes of each session2filesystem of current session
+	struct sl_database_sqlite_filter * filters;
+	unsigned int nb_filters;
+	bool has_filters;
+	bool has_search_index;
+	bool has_statistics;
+
+	int version;
+};
+
+struct sl_database_sqlite_connection_cursor {
+	struct sl_database_sqlite_connection_private * connection;
+	int host_id;
+	struct sl_request request;
+
+	// sessions whose database is not yet visited, with layout session
+	sqlite3_stmt * stmt_stores;
+
+	// a lookup by database, sorted by session
+	struct sl_database_sqlite_connection_cursor_source {
+		sqlite3 * db;
+		struct sl_database_sqlite_queries * queries;
+		sqlite3_stmt * stmt;
+		struct sl_hashtable * paths;
+		bool has_row;
+	} * sources;
+	unsigned int nb_sources;
+	// source of last returned row
+	struct sl_database_sqlite_connection_cursor_source * current;
+
+	struct sl_result_file file;
+	bool failed;
+
+	// compiled path_pattern of a regex request, used with path_storage = tree
+	regex_t regex;
+	bool has_regex;
+
+	// rows kept by options of request
+	struct sl_result_files * selected;
+	unsigned int next_selected;
+	struct sl_result_selector * selector;
+	bool selected_all;
 };
 
 static int sl_database_sqlite_connection_close(struct sl_database_connection * connect);
 static int sl_database_sqlite_connection_free(struct sl_database_connection * connect);
-static void sl_database_sqlite_connection_hash_free(void * key, void * value);
 static bool sl_database_sqlite_connection_is_connection_closed(struct sl_database_connection * connect);
 
+static int sl_database_sqlite_connection_check_config(struct sl_database_sqlite_connection_private * self);
+static struct sl_database_sqlite_store * sl_database_sqlite_connection_get_store(struct sl_database_sqlite_connection_private * self, const char * uuid, bool create);
+static struct sl_database_sqlite_store * sl_database_sqlite_connection_get_store_by_s2fs(struct sl_database_sqlite_connection_private * self, int s2fs);
+static struct sl_database_sqlite_store * sl_database_sqlite_connection_get_session_store(struct sl_database_sqlite_connection_private * self, int session_id, bool create);
+static int sl_database_sqlite_connection_remove_session_store(struct sl_database_sqlite_connection_private * self, int session_id);
+static void sl_database_sqlite_connection_store_free(void * key, void * value);
+
 static int sl_database_sqlite_connection_cancel_transaction(struct sl_database_connection * connect);
 static int sl_database_sqlite_connection_finish_transaction(struct sl_database_connection * connect);
 static int sl_database_sqlite_connection_start_transaction(struct sl_database_connection * connect);
 
+static int sl_database_sqlite_connection_finish_update(struct sl_database_connection * connect, bool commit);
+static int sl_database_sqlite_connection_start_update(struct sl_database_connection * connect);
+static int sl_database_sqlite_connection_sync_path(const char * path);
+
 static int sl_database_sqlite_connection_create_database(struct sl_database_connection * connect, int version);
-static int sl_database_sqlite_connection_exec(sqlite3 * db, const char * query);
 static int sl_database_sqlite_connection_get_database_version(struct sl_database_connection * connect);
-static sqlite3_stmt * sl_database_sqlite_connection_prepare(struct sl_database_sqlite_connection_private * self, const char * query);
+static int sl_database_sqlite_connection_upgrade_database(struct sl_database_connection * connect, int version);
+static int sl_database_sqlite_connection_upgrade_stores(struct sl_database_sqlite_connection_private * self, const struct sl_database_sqlite_migration_step * step);
 
 static int sl_database_sqlite_connection_delete_old_session(struct sl_database_connection * connect, int host_id, int nb_session_kept);
 static int sl_database_sqlite_connection_end_session(struct sl_database_connection * connect, int session_id);
@@ -68,9 +180,33 @@ static int sl_database_sqlite_connection_start_session(struct sl_database_connec
 static int sl_database_sqlite_connection_get_host_by_name(struct sl_database_connection * connect, const char * hostname);
 static int sl_database_sqlite_connection_sync_file(struct sl_database_connection * connect, int s2fs, const char * filename, struct stat * st);
 static int sl_database_sqlite_connection_sync_filesystem(struct sl_database_connection * connect, int session_id, struct sl_filesystem * fs);
+static int sl_database_sqlite_connection_sync_statistics(struct sl_database_connection * connect, int s2fs, const struct sl_result_statistics * stats);
+static int sl_database_sqlite_connection_sync_node(struct sl_database_sqlite_connection_private * self, int s2fs, const char * filename, struct stat * st);
+static void sl_database_sqlite_connection_free_sync_state(struct sl_database_sqlite_connection_private * self);
 
 static struct sl_result_files * sl_database_sqlite_connection_find(struct sl_database_connection * connect, int host_id, struct sl_request * request);
+static struct sl_database_cursor * sl_database_sqlite_connection_open_cursor(struct sl_database_connection * connect, int host_id, struct sl_request * request);
+static int sl_database_sqlite_connection_cursor_add_source(struct sl_database_sqlite_connection_cursor * cursor, sqlite3 * db, struct sl_database_sqlite_queries * queries);
+static void sl_database_sqlite_connection_cursor_free_sources(struct sl_database_sqlite_connection_cursor * cursor);
+static const struct sl_result_file * sl_database_sqlite_connection_next_file(struct sl_database_cursor * cursor);
+static const struct sl_result_file * sl_database_sqlite_connection_next_selected(struct sl_database_sqlite_connection_cursor * cursor);
+static const struct sl_result_file * sl_database_sqlite_connection_cursor_next_row(struct sl_database_sqlite_connection_cursor * cursor);
+static int sl_database_sqlite_connection_close_cursor(struct sl_database_cursor * cursor);
+static int sl_database_sqlite_connection_get_sessions(struct sl_database_sqlite_connection_private * self, int host_id, int ** sessions, unsigned int * nb_sessions);
+static void sl_database_sqlite_connection_fill_result(sqlite3 * db, struct sl_database_sqlite_queries * queries, struct sl_hashtable * paths, sqlite3_stmt * stmt, int column, struct sl_result_file * file);
+static int sl_database_sqlite_connection_compare_session(const void * a, const void * b);
+static struct sl_result_files ** sl_database_sqlite_connection_find_files(struct sl_database_connection * connect, int host_id, struct sl_request * requests, unsigned int nb_requests);
+static bool sl_database_sqlite_connection_is_batched(const struct sl_request * request);
+static int sl_database_sqlite_connection_find_files_in(struct sl_database_sqlite_connection_private * self, sqlite3 * db, struct sl_database_sqlite_queries * queries, int host_id, struct sl_request * requests, unsigned int nb_requests, struct sl_result_builder ** builders);
+static sqlite3_stmt * sl_database_sqlite_connection_find_in(sqlite3 * db, struct sl_database_sqlite_queries * queries, struct sl_database_sqlite_config_private * config, bool use_filters, bool use_search_index, int host_id, struct sl_request * request);
+static sqlite3_int64 sl_database_sqlite_connection_find_node(sqlite3 * db, struct sl_database_sqlite_queries * queries, int session_id, int fs_id, const char * path);
+static const char * sl_database_sqlite_connection_get_path(sqlite3 * db, struct sl_database_sqlite_queries * queries, struct sl_hashtable * paths, sqlite3_int64 id);
+static struct sl_result_files * sl_database_sqlite_connection_get_ancestors(struct sl_database_connection * connect, int session_id, int fs_id, const char * path);
+static struct sl_result_files * sl_database_sqlite_connection_get_ancestors_in(sqlite3 * db, struct sl_database_sqlite_queries * queries, struct sl_database_sqlite_config_private * config, int session_id, int fs_id, const char * path);
+static int sl_database_sqlite_connection_get_file_db(struct sl_database_sqlite_connection_private * self, int session_id, int fs_id, sqlite3 ** db, struct sl_database_sqlite_queries ** queries);
 static struct sl_result_file * sl_database_sqlite_connection_get_file_info(struct sl_database_connection * connect, int session_id, int fs_id, const char * path);
+static struct sl_result_file * sl_database_sqlite_connection_get_file_info_in(sqlite3 * db, struct sl_database_sqlite_queries * queries, struct sl_database_sqlite_config_private * config, int session_id, int fs_id, const char * path);
+static struct sl_result_statistics * sl_database_sqlite_connection_get_statistics(struct sl_database_connection * connect, int session_id, int fs_id);
 
 static struct sl_database_connection_ops sl_database_sqlite_connection_ops = {
 	.close                = sl_database_sqlite_connection_close,
@@ -81,8 +217,12 @@ static struct sl_database_connection_ops sl_database_sqlite_connection_ops = {
 	.finish_transaction = sl_database_sqlite_connection_finish_transaction,
 	.start_transaction  = sl_database_sqlite_connection_start_transaction,
 
+	.finish_update = sl_database_sqlite_connection_finish_update,
+	.start_update  = sl_database_sqlite_connection_start_update,
+
 	.create_database      = sl_database_sqlite_connection_create_database,
 	.get_database_version = sl_database_sqlite_connection_get_database_version,
+	.upgrade_database     = sl_database_sqlite_connection_upgrade_database,
 
 	.delete_old_session = sl_database_sqlite_connection_delete_old_session,
 	.end_session        = sl_database_sqlite_connection_end_session,
@@ -91,25 +231,61 @@ static struct sl_database_connection_ops sl_database_sqlite_connection_ops = {
 	.get_host_by_name = sl_database_sqlite_connection_get_host_by_name,
 	.sync_file        = sl_database_sqlite_connection_sync_file,
 	.sync_filesystem  = sl_database_sqlite_connection_sync_filesystem,
-
-	.find_file     = sl_database_sqlite_connection_find,
-	.get_file_info = sl_database_sqlite_connection_get_file_info,
+	.sync_statistics  = sl_database_sqlite_connection_sync_statistics,
+
+	.find_file      = sl_database_sqlite_connection_find,
+	.open_cursor    = sl_database_sqlite_connection_open_cursor,
+	.next_file      = sl_database_sqlite_connection_next_file,
+	.close_cursor   = sl_database_sqlite_connection_close_cursor,
+	.find_files     = sl_database_sqlite_connection_find_files,
+	.get_ancestors  = sl_database_sqlite_connection_get_ancestors,
+	.get_file_info  = sl_database_sqlite_connection_get_file_info,
+	.get_statistics = sl_database_sqlite_connection_get_statistics,
 };
 
 
-struct sl_database_connection * sl_database_sqlite_connection_add(struct sl_database_config * config, const char * path) {
-	sqlite3 * handler = NULL;
-	int ret = sqlite3_open(path, &handler);
-	if (ret != SQLITE_OK) {
-		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to open database at '%s'", path);
-		return NULL;
-	}
+struct sl_database_connection * sl_database_sqlite_connection_add(struct sl_database_config * config, bool read_only) {
+	struct sl_database_sqlite_config_private * db_config = config->data;
 
-	sl_database_sqlite_connection_exec(handler, "PRAGMA foreign_keys = ON");
+	sqlite3 * handler;
+	// only swap mode never modifies database in place
+	if (read_only)
+		handler = sl_database_sqlite_util_open_read_only(db_config->path, db_config->mmap_size, db_config->update_mode == sl_database_sqlite_update_mode_swap && db_config->layout == sl_database_sqlite_layout_single);
+	else
+		handler = sl_database_sqlite_util_open(db_config->path);
+	if (handler == NULL)
+		return NULL;
 
 	struct sl_database_sqlite_connection_private * self = malloc(sizeof(struct sl_database_sqlite_connection_private));
 	self->db_handler = handler;
-	self->prepared_queries = sl_hashtable_new2(sl_string_compute_hash, sl_database_sqlite_connection_hash_free);
+	self->prepared_queries = sl_database_sqlite_util_new_queries();
+	self->config = db_config;
+	self->build_path = NULL;
+	self->build_lock = -1;
+	self->read_only = read_only;
+	self->stores = sl_hashtable_new2(sl_string_compute_hash, sl_database_sqlite_connection_store_free);
+	self->s2fs_stores = NULL;
+	self->nb_s2fs_stores = 0;
+	self->in_transaction = false;
+	self->trees = NULL;
+	self->nb_trees = 0;
+	self->next_file_id = 0;
+	self->deltas = NULL;
+	self->nb_deltas = 0;
+	self->filters = NULL;
+	self->nb_filters = 0;
+	self->has_filters = false;
+	self->has_search_index = false;
+	self->has_statistics = false;
+	self->version = 0;
+
+	if (sl_database_sqlite_connection_check_config(self)) {
+		sl_database_sqlite_util_free_queries(self->prepared_queries);
+		sl_hashtable_free(self->stores);
+		sqlite3_close(handler);
+		free(self);
+		return NULL;
+	}
 
 	struct sl_database_connection * connection = malloc(sizeof(struct sl_database_connection));
 	connection->ops = &sl_database_sqlite_connection_ops;
@@ -117,22 +293,30 @@ struct sl_database_connection * sl_database_sqlite_connection_add(struct sl_data
 	connection->driver = config->driver;
 	connection->config = config;
 
-	sl_log_write(sl_log_level_info, sl_log_type_plugin_database, "Sqlite: open database at '%s', OK", path);
-
 	return connection;
 }
 
 static int sl_database_sqlite_connection_close(struct sl_database_connection * connect) {
 	struct sl_database_sqlite_connection_private * self = connect->data;
 
+	// statements should be finalized before closing database
+	sl_database_sqlite_util_free_queries(self->prepared_queries);
+	self->prepared_queries = NULL;
+
 	int failed = 0;
 	if (self->db_handler != NULL) {
 		failed = sqlite3_close(self->db_handler);
 		self->db_handler = NULL;
 	}
 
-	sl_hashtable_free(self->prepared_queries);
-	self->prepared_queries = NULL;
+	sl_hashtable_free(self->stores);
+	self->stores = NULL;
+
+	free(self->s2fs_stores);
+	self->s2fs_stores = NULL;
+	self->nb_s2fs_stores = 0;
+
+	sl_database_sqlite_connection_free_sync_state(self);
 
 	return failed != SQLITE_OK;
 }
@@ -147,28 +331,196 @@ static int sl_database_sqlite_connection_free(struct sl_database_connection * co
 	if (failed)
 		return failed;
 
+	if (self->build_path != NULL) {
+		unlink(self->build_path);
+		free(self->build_path);
+	}
+	if (self->build_lock > -1)
+		close(self->build_lock);
+
 	free(self);
 	free(connect);
 
 	return 0;
 }
 
-static void sl_database_sqlite_connection_hash_free(void * key, void * value) {
-	free(key);
-	sqlite3_finalize(value);
-}
-
 static bool sl_database_sqlite_connection_is_connection_closed(struct sl_database_connection * connect) {
 	struct sl_database_sqlite_connection_private * self = connect->data;
 	return self->db_handler == NULL;
 }
 
+static int sl_database_sqlite_connection_check_config(struct sl_database_sqlite_connection_private * self) {
+	sqlite3_stmt * stmt_select;
+	int failed = sqlite3_prepare_v2(self->db_handler, "SELECT key, value FROM config WHERE key IN ('file_storage', 'layout', 'path_compression', 'path_storage', 'version')", -1, &stmt_select, NULL);
+	if (failed)
+		// there is no database yet
+		return 0;
+
+	char * file_storage = NULL, * layout = NULL, * path_compression = NULL, * path_storage = NULL;
+	while (sqlite3_step(stmt_select) == SQLITE_ROW) {
+		const char * key = (const char *) sqlite3_column_text(stmt_select, 0);
+		if (!strcmp(key, "file_storage"))
+			file_storage = strdup((const char *) sqlite3_column_text(stmt_select, 1));
+		else if (!strcmp(key, "layout"))
+			layout = strdup((const char *) sqlite3_column_text(stmt_select, 1));
+		else if (!strcmp(key, "path_compression"))
+			path_compression = strdup((const char *) sqlite3_column_text(stmt_select, 1));
+		else if (!strcmp(key, "path_storage"))
+			path_storage = strdup((const char *) sqlite3_column_text(stmt_select, 1));
+		else
+			self->version = sqlite3_column_int(stmt_select, 1);
+	}
+	sqlite3_finalize(stmt_select);
+
+	failed = strcmp(layout != NULL ? layout : "single", sl_database_sqlite_util_layout_to_string(self->config->layout)) != 0;
+	if (failed)
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: database '%s' uses layout '%s' but configuration requires layout '%s'", self->config->path, layout != NULL ? layout : "single", sl_database_sqlite_util_layout_to_string(self->config->layout));
+
+	if (!failed) {
+		failed = strcmp(path_storage != NULL ? path_storage : "text", sl_database_sqlite_util_path_storage_to_string(self->config->path_storage)) != 0;
+		if (failed)
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: database '%s' uses path_storage '%s' but configuration requires path_storage '%s'", self->config->path, path_storage != NULL ? path_storage : "text", sl_database_sqlite_util_path_storage_to_string(self->config->path_storage));
+	}
+
+	if (!failed) {
+		failed = strcmp(file_storage != NULL ? file_storage : "snapshot", sl_database_sqlite_util_file_storage_to_string(self->config->file_storage)) != 0;
+		if (failed)
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: database '%s' uses file_storage '%s' but configuration requires file_storage '%s'", self->config->path, file_storage != NULL ? file_storage : "snapshot", sl_database_sqlite_util_file_storage_to_string(self->config->file_storage));
+	}
+
+	if (!failed) {
+		failed = strcmp(path_compression != NULL ? path_compression : "none", sl_database_sqlite_util_path_compression_to_string(self->config->path_compression)) != 0;
+		if (failed)
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: database '%s' uses path_compression '%s' but configuration requires path_compression '%s'", self->config->path, path_compression != NULL ? path_compression : "none", sl_database_sqlite_util_path_compression_to_string(self->config->path_compression));
+	}
+
+	free(file_storage);
+	free(layout);
+	free(path_compression);
+	free(path_storage);
+
+	// tables added after version 2
+	if (!failed && sqlite3_prepare_v2(self->db_handler, "SELECT name FROM sqlite_master WHERE type = 'table' AND name IN ('path_index', 'session_filter', 'session_statistics')", -1, &stmt_select, NULL) == SQLITE_OK) {
+		while (sqlite3_step(stmt_select) == SQLITE_ROW) {
+			const char * table = (const char *) sqlite3_column_text(stmt_select, 0);
+			if (!strcmp(table, "path_index"))
+				self->has_search_index = true;
+			else if (!strcmp(table, "session_filter"))
+				self->has_filters = true;
+			else
+				self->has_statistics = true;
+		}
+		sqlite3_finalize(stmt_select);
+	}
+
+	return failed;
+}
+
+static struct sl_database_sqlite_store * sl_database_sqlite_connection_get_store(struct sl_database_sqlite_connection_private * self, const char * uuid, bool create) {
+	struct sl_hashtable_value val = sl_hashtable_get(self->stores, uuid);
+	if (val.type == sl_hashtable_value_custom)
+		return val.value.custom;
+
+	char * path;
+	asprintf(&path, "%s.%s", self->config->path, uuid);
+
+	if (!create && access(path, F_OK)) {
+		free(path);
+		return NULL;
+	}
+
+	struct sl_database_sqlite_store * store = sl_database_sqlite_store_open(path, self->version, self->config->path_storage, self->read_only, self->config->mmap_size);
+	free(path);
+
+	if (store == NULL)
+		return NULL;
+
+	if (self->in_transaction && sl_database_sqlite_store_begin(store)) {
+		sl_database_sqlite_store_free(store);
+		return NULL;
+	}
+
+	sl_hashtable_put(self->stores, strdup(uuid), sl_hashtable_val_custom(store));
+
+	return store;
+}
+
+static struct sl_database_sqlite_store * sl_database_sqlite_connection_get_store_by_s2fs(struct sl_database_sqlite_connection_private * self, int s2fs) {
+	unsigned int i;
+	for (i = self->nb_s2fs_stores; i > 0; i--)
+		if (self->s2fs_stores[i - 1].s2fs == s2fs)
+			return self->s2fs_stores[i - 1].store;
+
+	return NULL;
+}
+
+static struct sl_database_sqlite_store * sl_database_sqlite_connection_get_session_store(struct sl_database_sqlite_connection_private * self, int session_id, bool create) {
+	char * name;
+	asprintf(&name, "session.%d", session_id);
+
+	struct sl_database_sqlite_store * store = sl_database_sqlite_connection_get_store(self, name, create);
+	free(name);
+
+	return store;
+}
+
+static int sl_database_sqlite_connection_remove_session_store(struct sl_database_sqlite_connection_private * self, int session_id) {
+	char * name;
+	asprintf(&name, "session.%d", session_id);
+
+	struct sl_hashtable_value val = sl_hashtable_get(self->stores, name);
+	if (val.type == sl_hashtable_value_custom) {
+		struct sl_database_sqlite_store * store = val.value.custom;
+
+		unsigned int i, j;
+		for (i = 0, j = 0; i < self->nb_s2fs_stores; i++)
+			if (self->s2fs_stores[i].store != store)
+				self->s2fs_stores[j++] = self->s2fs_stores[i];
+		self->nb_s2fs_stores = j;
+
+		sl_hashtable_remove(self->stores, name);
+	}
+	free(name);
+
+	char * path;
+	asprintf(&path, "%s.session.%d", self->config->path, session_id);
+
+	int failed = unlink(path);
+	if (failed && errno == ENOENT)
+		failed = 0;
+	else if (failed)
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to remove '%s' because %m", path);
+
+	// remove journal left by an interrupted update
+	char * journal;
+	asprintf(&journal, "%s-journal", path);
+	unlink(journal);
+	free(journal);
+
+	free(path);
+
+	return failed;
+}
+
+static void sl_database_sqlite_connection_store_free(void * key, void * value) {
+	free(key);
+	sl_database_sqlite_store_free(value);
+}
+
 
 static int sl_database_sqlite_connection_cancel_transaction(struct sl_database_connection * connect) {
 	struct sl_database_sqlite_connection_private * self = connect->data;
 	if (self->db_handler == NULL)
 		return 1;
 
+	self->in_transaction = false;
+
+	uint32_t i, nb_stores;
+	struct sl_hashtable_value * stores = sl_hashtable_values(self->stores, &nb_stores);
+	for (i = 0; i < nb_stores; i++)
+		sl_database_sqlite_store_rollback(stores[i].value.custom);
+	free(stores);
+
 	char * error = NULL;
 	int failed = sqlite3_exec(self->db_handler, "ROLLBACK", NULL, NULL, &error);
 
@@ -188,13 +540,30 @@ static int sl_database_sqlite_connection_finish_transaction(struct sl_database_c
 	if (self->db_handler == NULL)
 		return 1;
 
+	// commit stores first, so main database never references missing files
+	uint32_t i, nb_stores;
+	int failed = 0;
+	struct sl_hashtable_value * stores = sl_hashtable_values(self->stores, &nb_stores);
+	for (i = 0; i < nb_stores && !failed; i++) {
+		struct sl_database_sqlite_store * store = stores[i].value.custom;
+		failed = sl_database_sqlite_store_commit(store);
+		if (failed)
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error when finish transaction of '%s'", store->path);
+	}
+	free(stores);
+
+	if (failed)
+		return failed;
+
 	char * error = NULL;
-	int failed = sqlite3_exec(self->db_handler, "COMMIT", NULL, NULL, &error);
+	failed = sqlite3_exec(self->db_handler, "COMMIT", NULL, NULL, &error);
 
 	if (failed)
 		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error when finish transaction because %s", error);
-	else
+	else {
+		self->in_transaction = false;
 		sl_log_write(sl_log_level_notice, sl_log_type_plugin_database, "Sqlite: finish transaction ok");
+	}
 
 	if (error != NULL)
 		sqlite3_free(error);
@@ -204,7 +573,7 @@ static int sl_database_sqlite_connection_finish_transaction(struct sl_database_c
 
 static int sl_database_sqlite_connection_start_transaction(struct sl_database_connection * connect) {
 	struct sl_database_sqlite_connection_private * self = connect->data;
-	if (self->db_handler == NULL)
+	if (self->db_handler == NULL || self->read_only)
 		return 1;
 
 	char * error = NULL;
@@ -218,72 +587,280 @@ static int sl_database_sqlite_connection_start_transaction(struct sl_database_co
 	if (error != NULL)
 		sqlite3_free(error);
 
+	if (failed == SQLITE_OK) {
+		self->in_transaction = true;
+
+		uint32_t i, nb_stores;
+		struct sl_hashtable_value * stores = sl_hashtable_values(self->stores, &nb_stores);
+		for (i = 0; i < nb_stores && !failed; i++)
+			failed = sl_database_sqlite_store_begin(stores[i].value.custom);
+		free(stores);
+	}
+
 	return failed != SQLITE_OK;
 }
 
 
-static int sl_database_sqlite_connection_create_database(struct sl_database_connection * connect, int version) {
+static int sl_database_sqlite_connection_finish_update(struct sl_database_connection * connect, bool commit) {
 	struct sl_database_sqlite_connection_private * self = connect->data;
+	if (self->build_path == NULL)
+		return 0;
+
+	sl_database_sqlite_util_clear_queries(self->prepared_queries);
+
+	int failed = 0;
+	if (commit)
+		failed = sl_database_sqlite_util_exec(self->db_handler, "PRAGMA journal_mode = DELETE");
+
+	if (sqlite3_close(self->db_handler) != SQLITE_OK) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to close database '%s' because %s", self->build_path, sqlite3_errmsg(self->db_handler));
+		failed = 1;
+	}
+	self->db_handler = NULL;
+
+	if (commit && !failed)
+		failed = sl_database_sqlite_connection_sync_path(self->build_path);
+
+	if (commit && !failed) {
+		struct stat st;
+		if (!stat(self->config->path, &st))
+			chmod(self->build_path, st.st_mode & 07777);
+
+		failed = rename(self->build_path, self->config->path);
+		if (failed)
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to rename '%s' to '%s' because %m", self->build_path, self->config->path);
+	}
+
+	if (commit && !failed) {
+		char * directory = strdup(self->config->path);
+		sl_database_sqlite_connection_sync_path(dirname(directory));
+		free(directory);
+
+		sl_log_write(sl_log_level_notice, sl_log_type_plugin_database, "Sqlite: database '%s' replaced by '%s'", self->config->path, self->build_path);
+	} else {
+		unlink(self->build_path);
+		sl_log_write(sl_log_level_notice, sl_log_type_plugin_database, "Sqlite: discard database '%s'", self->build_path);
+	}
+
+	free(self->build_path);
+	self->build_path = NULL;
+
+	close(self->build_lock);
+	self->build_lock = -1;
+
+	self->db_handler = sl_database_sqlite_util_open(self->config->path);
 	if (self->db_handler == NULL)
+		failed = 1;
+
+	return failed;
+}
+
+static int sl_database_sqlite_connection_start_update(struct sl_database_connection * connect) {
+	struct sl_database_sqlite_connection_private * self = connect->data;
+	if (self->db_handler == NULL || self->read_only)
+		return 1;
+
+	if (self->config->update_mode != sl_database_sqlite_update_mode_swap || self->build_path != NULL)
+		return 0;
+
+	/**
+	 * Lock file is never removed, so every update locks the same inode.
+	 * A build left without its lock was left by an update which died.
+	 */
+	char * lock_path;
+	asprintf(&lock_path, "%s.build.lock", self->config->path);
+
+	int lock = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (lock < 0) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to open lock file '%s' because %m", lock_path);
+		free(lock_path);
+		return 1;
+	}
+
+	if (flock(lock, LOCK_EX | LOCK_NB)) {
+		if (errno == EWOULDBLOCK)
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: another update is building '%s'", self->config->path);
+		else
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to lock '%s' because %m", lock_path);
+		close(lock);
+		free(lock_path);
+		return 1;
+	}
+	free(lock_path);
+
+	char * build_path;
+	asprintf(&build_path, "%s.build", self->config->path);
+
+	if (!unlink(build_path))
+		sl_log_write(sl_log_level_warn, sl_log_type_plugin_database, "Sqlite: remove stale database '%s'", build_path);
+	else if (errno != ENOENT) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to remove stale database '%s' because %m", build_path);
+		close(lock);
+		free(build_path);
+		return 1;
+	}
+
+	sqlite3 * build = sl_database_sqlite_util_open(build_path);
+	if (build == NULL) {
+		close(lock);
+		free(build_path);
+		return 1;
+	}
+
+	int failed = 0;
+	sqlite3_backup * backup = sqlite3_backup_init(build, "main", self->db_handler, "main");
+	if (backup != NULL) {
+		sqlite3_backup_step(backup, -1);
+		failed = sqlite3_backup_finish(backup) != SQLITE_OK;
+	} else
+		failed = 1;
+
+	if (failed) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to copy '%s' into '%s' because %s", self->config->path, build_path, sqlite3_errmsg(build));
+		sqlite3_close(build);
+		unlink(build_path);
+		close(lock);
+		free(build_path);
+		return 1;
+	}
+
+	sl_database_sqlite_util_exec(build, "PRAGMA journal_mode = MEMORY");
+	sl_database_sqlite_util_exec(build, "PRAGMA synchronous = OFF");
+
+	sl_database_sqlite_util_clear_queries(self->prepared_queries);
+	sqlite3_close(self->db_handler);
+
+	self->db_handler = build;
+	self->build_path = build_path;
+	self->build_lock = lock;
+
+	sl_log_write(sl_log_level_notice, sl_log_type_plugin_database, "Sqlite: building new database into '%s'", build_path);
+
+	return 0;
+}
+
+static int sl_database_sqlite_connection_sync_path(const char * path) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to open '%s' because %m", path);
+		return 1;
+	}
+
+	int failed = fsync(fd);
+	if (failed)
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to synchronize '%s' because %m", path);
+
+	close(fd);
+
+	return failed;
+}
+
+
+static int sl_database_sqlite_connection_create_database(struct sl_database_connection * connect, int version) {
+	struct sl_database_sqlite_connection_private * self = connect->data;
+	if (self->db_handler == NULL || self->read_only)
 		return 1;
 
-	if (version < 1 || version > 1) {
+	if (version < 1 || version > SL_DATABASE_SQLITE_VERSION) {
 		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: wrong version of database (%d)", version);
 		return 1;
 	}
 
-	int failed = sl_database_sqlite_connection_exec(self->db_handler, "CREATE TABLE host (id INTEGER PRIMARY KEY, name TEXT UNIQUE)");
+	if (version < 2 && self->config->path_storage != sl_database_sqlite_path_storage_text) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: path_storage '%s' requires version 2 of database", sl_database_sqlite_util_path_storage_to_string(self->config->path_storage));
+		return 1;
+	}
+
+	if (version < 2 && self->config->file_storage != sl_database_sqlite_file_storage_snapshot) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: file_storage '%s' requires version 2 of database", sl_database_sqlite_util_file_storage_to_string(self->config->file_storage));
+		return 1;
+	}
+
+	if (version < 2 && self->config->path_compression != sl_database_sqlite_path_compression_none) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: path_compression '%s' requires version 2 of database", sl_database_sqlite_util_path_compression_to_string(self->config->path_compression));
+		return 1;
+	}
+
+	// should be set before creating any table
+	int failed = sl_database_sqlite_util_exec(self->db_handler, "PRAGMA auto_vacuum = INCREMENTAL");
 	if (failed)
 		return failed;
 
-	failed = sl_database_sqlite_connection_exec(self->db_handler, "CREATE TABLE session (id INTEGER PRIMARY KEY, start_time INTEGER NOT NULL, end_time INTEGER NULL, host INTEGER NOT NULL REFERENCES host(id) ON UPDATE CASCADE ON DELETE CASCADE, CHECK (start_time <= end_time))");
+	failed = sl_database_sqlite_util_exec(self->db_handler, "CREATE TABLE host (id INTEGER PRIMARY KEY, name TEXT UNIQUE)");
 	if (failed)
 		return failed;
 
-	failed = sl_database_sqlite_connection_exec(self->db_handler, "CREATE TABLE filesystem (id INTEGER PRIMARY KEY, uuid TEXT NOT NULL UNIQUE, label TEXT, type TEXT NOT NULL)");
+	failed = sl_database_sqlite_util_exec(self->db_handler, "CREATE TABLE session (id INTEGER PRIMARY KEY, start_time INTEGER NOT NULL, end_time INTEGER NULL, host INTEGER NOT NULL REFERENCES host(id) ON UPDATE CASCADE ON DELETE CASCADE, CHECK (start_time <= end_time))");
 	if (failed)
 		return failed;
 
-	failed = sl_database_sqlite_connection_exec(self->db_handler, "CREATE TABLE session2filesystem (id INTEGER PRIMARY KEY, session INTEGER NOT NULL REFERENCES session(id) ON UPDATE CASCADE ON DELETE CASCADE, filesystem INTEGER NOT NULL REFERENCES filesystem(id) ON UPDATE CASCADE ON DELETE CASCADE, mount_point TEXT NOT NULL, dev_no INTEGER NOT NULL CHECK (dev_no >= 0), disk_free INTEGER NOT NULL CHECK (disk_free >= 0), disk_total INTEGER NOT NULL CHECK (disk_total >= 0), block_size INTEGER NOT NULL CHECK (block_size >= 0), CHECK (disk_free <= disk_total))");
+	failed = sl_database_sqlite_util_exec(self->db_handler, "CREATE TABLE filesystem (id INTEGER PRIMARY KEY, uuid TEXT NOT NULL UNIQUE, label TEXT, type TEXT NOT NULL)");
+	if (failed)
+		return failed;
+
+	failed = sl_database_sqlite_util_exec(self->db_handler, "CREATE TABLE session2filesystem (id INTEGER PRIMARY KEY, session INTEGER NOT NULL REFERENCES session(id) ON UPDATE CASCADE ON DELETE CASCADE, filesystem INTEGER NOT NULL REFERENCES filesystem(id) ON UPDATE CASCADE ON DELETE CASCADE, mount_point TEXT NOT NULL, dev_no INTEGER NOT NULL CHECK (dev_no >= 0), disk_free INTEGER NOT NULL CHECK (disk_free >= 0), disk_total INTEGER NOT NULL CHECK (disk_total >= 0), block_size INTEGER NOT NULL CHECK (block_size >= 0), CHECK (disk_free <= disk_total))");
+	if (failed)
+		return failed;
+
+	// with other layouts, rows of table file are stored into separated databases
+	if (self->config->file_storage == sl_database_sqlite_file_storage_delta) {
+		failed = sl_database_sqlite_util_create_delta_file_table(self->db_handler);
+		if (failed)
+			return failed;
+	} else if (self->config->layout == sl_database_sqlite_layout_single) {
+		failed = sl_database_sqlite_util_create_file_table(self->db_handler, true, self->config->path_storage);
+		if (failed)
+			return failed;
+	}
+
+	// indexes used by lookups
+	failed = sl_database_sqlite_util_create_indexes(self->db_handler, self->config);
 	if (failed)
 		return failed;
 
-	failed = sl_database_sqlite_connection_exec(self->db_handler, "CREATE TABLE file (s2fs INTEGER NOT NULL REFERENCES session2filesystem(id) ON UPDATE CASCADE ON DELETE CASCADE, inode INTEGER NOT NULL CHECK (inode >= 0), path TEXT NOT NULL, mode INTEGER NOT NULL CHECK (mode >= 0), uid INTEGER NOT NULL CHECK (uid >= 0), gid INTEGER NOT NULL CHECK (gid >= 0), size INTEGER NOT NULL CHECK (size >= 0), access_time INTEGER NOT NULL, modif_time INTEGER NOT NULL)");
+	// dictionaries used to compress paths of each session2filesystem
+	if (self->config->path_compression != sl_database_sqlite_path_compression_none) {
+		failed = sl_database_sqlite_util_exec(self->db_handler, "CREATE TABLE dictionary (s2fs INTEGER PRIMARY KEY REFERENCES session2filesystem(id) ON UPDATE CASCADE ON DELETE CASCADE, data BLOB NOT NULL)");
+		if (failed)
+			return failed;
+	}
+
+	// filters of inodes of each session2filesystem
+	failed = sl_database_sqlite_util_create_filter_table(self->db_handler);
 	if (failed)
 		return failed;
+	self->has_filters = true;
 
-	failed = sl_database_sqlite_connection_exec(self->db_handler, "CREATE INDEX inode ON file(s2fs, inode)");
+	// counters of each session2filesystem
+	failed = sl_database_sqlite_util_create_statistics_table(self->db_handler);
 	if (failed)
 		return failed;
+	self->has_statistics = true;
 
-	failed = sl_database_sqlite_connection_exec(self->db_handler, "CREATE TABLE config (key TEXT NOT NULL UNIQUE, VALUE TEXT)");
+	failed = sl_database_sqlite_util_exec(self->db_handler, "CREATE TABLE config (key TEXT NOT NULL UNIQUE, VALUE TEXT)");
 	if (failed)
 		return failed;
 
 	sqlite3_stmt * stmt_insert;
-	static const char * query = "INSERT INTO config VALUES ('version', '1')";
+	static const char * query = "INSERT INTO config VALUES ('version', ?2), ('layout', ?1), ('path_storage', ?3), ('file_storage', ?4), ('path_compression', ?5)";
 	failed = sqlite3_prepare_v2(self->db_handler, query, -1, &stmt_insert, NULL);
 	if (failed) {
 		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'insert into config'");
 		return failed;
 	}
 
+	sqlite3_bind_text(stmt_insert, 1, sl_database_sqlite_util_layout_to_string(self->config->layout), -1, SQLITE_STATIC);
+	sqlite3_bind_int(stmt_insert, 2, version);
+	sqlite3_bind_text(stmt_insert, 3, sl_database_sqlite_util_path_storage_to_string(self->config->path_storage), -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt_insert, 4, sl_database_sqlite_util_file_storage_to_string(self->config->file_storage), -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt_insert, 5, sl_database_sqlite_util_path_compression_to_string(self->config->path_compression), -1, SQLITE_STATIC);
 	failed = sqlite3_step(stmt_insert);
 	sqlite3_finalize(stmt_insert);
 
-	return (failed != SQLITE_DONE);
-}
-
-static int sl_database_sqlite_connection_exec(sqlite3 * db, const char * query) {
-	char * error = NULL;
-	int failed = sqlite3_exec(db, query, NULL, NULL, &error);
-
-	if (failed != SQLITE_OK) {
-		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to execute query %s because %s", query, error);
-		sqlite3_free(error);
-	}
+	if (failed == SQLITE_DONE)
+		self->version = version;
 
-	return failed != SQLITE_OK;
+	return (failed != SQLITE_DONE);
 }
 
 static int sl_database_sqlite_connection_get_database_version(struct sl_database_connection * connect) {
@@ -292,7 +869,7 @@ static int sl_database_sqlite_connection_get_database_version(struct sl_database
 		return 1;
 
 	static const char * query = "SELECT value FROM config WHERE key = \"version\" LIMIT 1";
-	sqlite3_stmt * smt = sl_database_sqlite_connection_prepare(self, query);
+	sqlite3_stmt * smt = sl_database_sqlite_util_prepare(self->db_handler, self->prepared_queries, sl_database_sqlite_query_get_version, query);
 	if (smt == NULL) {
 		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to prepare query '%s', because %s", query, sqlite3_errmsg(self->db_handler));
 		return -1;
@@ -304,37 +881,114 @@ static int sl_database_sqlite_connection_get_database_version(struct sl_database
 		return -1;
 	}
 
-	return sqlite3_column_int(smt, 0);
+	self->version = sqlite3_column_int(smt, 0);
+	sqlite3_reset(smt);
+
+	return self->version;
 }
 
-static sqlite3_stmt * sl_database_sqlite_connection_prepare(struct sl_database_sqlite_connection_private * self, const char * query) {
-	if (sl_hashtable_has_key(self->prepared_queries, query)) {
-		struct sl_hashtable_value val = sl_hashtable_get(self->prepared_queries, query);
-		sqlite3_reset(val.value.custom);
-		return val.value.custom;
+static int sl_database_sqlite_connection_upgrade_database(struct sl_database_connection * connect, int version) {
+	struct sl_database_sqlite_connection_private * self = connect->data;
+	if (self->db_handler == NULL || self->read_only)
+		return 1;
+
+	if (version <= self->version || version > SL_DATABASE_SQLITE_VERSION) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: upgrade database from version %d to version %d is not supported", self->version, version);
+		return 1;
 	}
 
-	sqlite3_stmt * query_smt;
-	int failed = sqlite3_prepare_v2(self->db_handler, query, -1, &query_smt, NULL);
-	if (!failed) {
-		sl_hashtable_put(self->prepared_queries, strdup(query), sl_hashtable_val_custom(query_smt));
-		return query_smt;
+	while (self->version < version) {
+		const struct sl_database_sqlite_migration * migration = sl_database_sqlite_migrate_get(self->version);
+		if (migration == NULL) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: there is no migration from version %d", self->version);
+			return 1;
+		}
+
+		sl_log_write(sl_log_level_notice, sl_log_type_plugin_database, "Sqlite: upgrading database '%s' from version %d to version %d", self->config->path, migration->from_version, migration->to_version);
+
+		unsigned int i;
+		int failed = 0;
+		for (i = 0; i < migration->nb_steps && !failed; i++) {
+			const struct sl_database_sqlite_migration_step * step = migration->steps + i;
+
+			// with other layouts, table file is into store databases
+			if (step->scope == sl_database_sqlite_migration_scope_main || self->config->layout == sl_database_sqlite_layout_single || self->config->file_storage == sl_database_sqlite_file_storage_delta)
+				failed = sl_database_sqlite_migrate_step(self->db_handler, self->config->path, step, self->config->migration_batch_size);
+			else
+				failed = sl_database_sqlite_connection_upgrade_stores(self, step);
+		}
+
+		// version changes only once all rows are converted
+		if (!failed) {
+			char * query = sqlite3_mprintf("UPDATE config SET value = '%d' WHERE key = 'version'", migration->to_version);
+			failed = sl_database_sqlite_util_exec(self->db_handler, query);
+			sqlite3_free(query);
+		}
+
+		if (failed) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: upgrade of database '%s' to version %d interrupted, it will be resumed by next upgrade", self->config->path, migration->to_version);
+			return failed;
+		}
+
+		uint32_t nb_stores;
+		struct sl_hashtable_value * stores = sl_hashtable_values(self->stores, &nb_stores);
+		for (i = 0; i < nb_stores; i++) {
+			struct sl_database_sqlite_store * store = stores[i].value.custom;
+			store->version = migration->to_version;
+		}
+		free(stores);
+
+		self->version = migration->to_version;
+		sl_database_sqlite_util_clear_queries(self->prepared_queries);
+
+		sl_log_write(sl_log_level_notice, sl_log_type_plugin_database, "Sqlite: database '%s' upgraded to version %d", self->config->path, self->version);
 	}
 
-	return NULL;
+	return 0;
+}
+
+static int sl_database_sqlite_connection_upgrade_stores(struct sl_database_sqlite_connection_private * self, const struct sl_database_sqlite_migration_step * step) {
+	const char * query = "SELECT uuid FROM filesystem";
+	if (self->config->layout == sl_database_sqlite_layout_session)
+		query = "SELECT id FROM session";
+
+	sqlite3_stmt * stmt_select;
+	int failed = sqlite3_prepare_v2(self->db_handler, query, -1, &stmt_select, NULL);
+	if (failed) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'get stores'");
+		return failed;
+	}
+
+	while (!failed && sqlite3_step(stmt_select) == SQLITE_ROW) {
+		struct sl_database_sqlite_store * store;
+		if (self->config->layout == sl_database_sqlite_layout_session)
+			store = sl_database_sqlite_connection_get_session_store(self, sqlite3_column_int(stmt_select, 0), false);
+		else
+			store = sl_database_sqlite_connection_get_store(self, (const char *) sqlite3_column_text(stmt_select, 0), false);
+
+		if (store != NULL)
+			failed = sl_database_sqlite_migrate_step(store->db_handler, store->path, step, self->config->migration_batch_size);
+	}
+	sqlite3_finalize(stmt_select);
+
+	return failed;
 }
 
 
 static int sl_database_sqlite_connection_delete_old_session(struct sl_database_connection * connect, int host_id, int nb_session_kept) {
 	struct sl_database_sqlite_connection_private * self = connect->data;
-	if (self->db_handler == NULL)
+	if (self->db_handler == NULL || self->read_only)
 		return 1;
 
-	sl_hashtable_free(self->prepared_queries);
-	self->prepared_queries = sl_hashtable_new2(sl_string_compute_hash, sl_database_sqlite_connection_hash_free);
+	sl_database_sqlite_util_clear_queries(self->prepared_queries);
 
+	/**
+	 * An unfinished session can be an update in progress, even an older one,
+	 * so it is only removed once it is stale. start_time is a date with
+	 * version 1 of database.
+	 */
 	sqlite3_stmt * stmt_ctt;
-	static const char * query_ctt = "CREATE TEMP TABLE remove_session AS SELECT s1.id AS session FROM session s1 LEFT JOIN session s2 ON s1.id < s2.id AND s1.host = s2.host WHERE s1.host = ?1 GROUP BY s1.id HAVING COUNT(s2.id) >= ?2";
+	static const char * query_ctt = "CREATE TEMP TABLE remove_session AS SELECT id AS session FROM session WHERE host = ?1 AND ((end_time IS NULL AND CAST(CASE typeof(start_time) WHEN 'integer' THEN start_time ELSE strftime('%s', start_time) END AS INTEGER) < ?3) OR id IN (SELECT id FROM session WHERE host = ?1 AND end_time IS NOT NULL ORDER BY id DESC LIMIT -1 OFFSET ?2))";
 	int failed = sqlite3_prepare_v2(self->db_handler, query_ctt, -1, &stmt_ctt, NULL);
 	if (failed) {
 		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'create table remove_session'");
@@ -343,6 +997,7 @@ static int sl_database_sqlite_connection_delete_old_session(struct sl_database_c
 
 	sqlite3_bind_int(stmt_ctt, 1, host_id);
 	sqlite3_bind_int(stmt_ctt, 2, nb_session_kept);
+	sqlite3_bind_int64(stmt_ctt, 3, time(NULL) - SL_DATABASE_SQLITE_STALE_SESSION_TIMEOUT);
 	failed = sqlite3_step(stmt_ctt);
 	sqlite3_finalize(stmt_ctt);
 
@@ -351,16 +1006,105 @@ static int sl_database_sqlite_connection_delete_old_session(struct sl_database_c
 		return -1;
 	}
 
+	/**
+	 * With layout session, removed_ids contains ids of removed sessions.
+	 * With file_storage = delta, it contains ids of filesystems whose files
+	 * can be dead once sessions are removed.
+	 * Otherwise, removed_files contains ids of session2filesystem and the
+	 * store which contains their files (NULL for main database).
+	 */
+	const char * query_select = "SELECT s2fs.id, fs.uuid FROM session2filesystem s2fs INNER JOIN filesystem fs ON s2fs.filesystem = fs.id WHERE s2fs.session IN (SELECT session FROM remove_session)";
+	if (self->config->layout == sl_database_sqlite_layout_session)
+		query_select = "SELECT session FROM remove_session";
+	else if (self->config->file_storage == sl_database_sqlite_file_storage_delta)
+		query_select = "SELECT DISTINCT filesystem, (SELECT MAX(session) FROM remove_session) FROM session2filesystem WHERE session IN (SELECT session FROM remove_session)";
+
+	sqlite3_stmt * stmt_select;
+	failed = sqlite3_prepare_v2(self->db_handler, query_select, -1, &stmt_select, NULL);
+	if (failed) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'select removed session2filesystem'");
+		sl_database_sqlite_util_exec(self->db_handler, "DROP TABLE remove_session");
+		return -1;
+	}
+
+	bool by_id = self->config->layout == sl_database_sqlite_layout_session || self->config->file_storage == sl_database_sqlite_file_storage_delta;
+	struct sl_database_sqlite_connection_store * removed_files = NULL;
+	int * removed_ids = NULL;
+	unsigned int i, nb_removed_files = 0, nb_removed_ids = 0;
+	int last_removed_session = 0;
+	while (sqlite3_step(stmt_select) == SQLITE_ROW) {
+		if (self->config->file_storage == sl_database_sqlite_file_storage_delta)
+			last_removed_session = sqlite3_column_int(stmt_select, 1);
+
+		if (by_id) {
+			void * new_addr = realloc(removed_ids, (nb_removed_ids + 1) * sizeof(int));
+			if (new_addr == NULL)
+				break;
+
+			removed_ids = new_addr;
+			removed_ids[nb_removed_ids] = sqlite3_column_int(stmt_select, 0);
+			nb_removed_ids++;
+			continue;
+		}
+
+		struct sl_database_sqlite_store * store = NULL;
+		if (self->config->layout == sl_database_sqlite_layout_filesystem) {
+			store = sl_database_sqlite_connection_get_store(self, (const char *) sqlite3_column_text(stmt_select, 1), false);
+			if (store == NULL)
+				continue;
+		}
+
+		void * new_addr = realloc(removed_files, (nb_removed_files + 1) * sizeof(struct sl_database_sqlite_connection_store));
+		if (new_addr == NULL)
+			break;
+
+		removed_files = new_addr;
+		removed_files[nb_removed_files].s2fs = sqlite3_column_int(stmt_select, 0);
+		removed_files[nb_removed_files].store = store;
+		nb_removed_files++;
+	}
+	sqlite3_finalize(stmt_select);
+
+	// remove files by chunks so that deleting sessions has nothing left to cascade
+	failed = 0;
+	for (i = 0; i < nb_removed_files && !failed; i++) {
+		struct sl_database_sqlite_store * store = removed_files[i].store;
+
+		if (store != NULL)
+			failed = sl_database_sqlite_util_delete_files(store->db_handler, store->prepared_queries, removed_files[i].s2fs, self->config->retention_chunk_size, self->config->retention_vacuum_pages);
+		else
+			failed = sl_database_sqlite_util_delete_files(self->db_handler, self->prepared_queries, removed_files[i].s2fs, self->config->retention_chunk_size, self->config->retention_vacuum_pages);
+	}
+
+	if (failed) {
+		sl_database_sqlite_util_exec(self->db_handler, "DROP TABLE remove_session");
+		free(removed_files);
+		free(removed_ids);
+		return -1;
+	}
+
 	char * error;
 	failed = sqlite3_exec(self->db_handler, "DELETE FROM session WHERE id IN (SELECT session FROM remove_session)", NULL, NULL, &error);
 	if (failed != SQLITE_OK) {
 		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'delete from session' because %s", error);
 		sqlite3_free(error);
+		free(removed_files);
+		free(removed_ids);
 		return -1;
 	}
 
 	int nb_changed = sqlite3_changes(self->db_handler);
 
+	// with file_storage = delta, files are kept as long as a remaining session uses them
+	int files_failed = 0;
+	for (i = 0; i < nb_removed_ids && self->config->file_storage == sl_database_sqlite_file_storage_delta && !files_failed; i++)
+		files_failed = sl_database_sqlite_util_delete_dead_files(self->db_handler, self->prepared_queries, removed_ids[i], last_removed_session, self->config->retention_chunk_size, self->config->retention_vacuum_pages);
+
+	for (i = 0; i < nb_removed_ids && self->config->layout == sl_database_sqlite_layout_session; i++)
+		sl_database_sqlite_connection_remove_session_store(self, removed_ids[i]);
+	free(removed_files);
+	free(removed_ids);
+
 	failed = sqlite3_exec(self->db_handler, "DROP TABLE remove_session", NULL, NULL, &error);
 	if (failed != SQLITE_OK) {
 		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while dropping table remove_session because %s", error);
@@ -368,17 +1112,13 @@ static int sl_database_sqlite_connection_delete_old_session(struct sl_database_c
 		return -1;
 	}
 
-	if (nb_changed < 1)
-		return 0;
-
-	failed = sqlite3_exec(self->db_handler, "VACUUM", NULL, NULL, &error);
+	if (nb_changed > 0)
+		sl_log_write(sl_log_level_info, sl_log_type_plugin_database, "Sqlite: %d session(s) removed", nb_changed);
 
-	if (failed != SQLITE_OK) {
-		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to vaccum, error: %s", error);
-		sqlite3_free(error);
-	}
+	if (files_failed)
+		return -1;
 
-	return failed != SQLITE_OK;
+	return sl_database_sqlite_util_incremental_vacuum(self->db_handler, self->config->retention_vacuum_pages);
 }
 
 static int sl_database_sqlite_connection_end_session(struct sl_database_connection * connect, int session_id) {
@@ -386,14 +1126,55 @@ static int sl_database_sqlite_connection_end_session(struct sl_database_connecti
 	if (self->db_handler == NULL)
 		return 1;
 
-	static const char * query = "UPDATE session SET end_time = datetime('now') WHERE id = ?1";
-	sqlite3_stmt * stmt_update = sl_database_sqlite_connection_prepare(self, query);
+	// filters are built once all inodes of session are known
+	if (!self->has_filters) {
+		if (sl_database_sqlite_util_create_filter_table(self->db_handler))
+			return -1;
+		self->has_filters = true;
+	}
+
+	unsigned int i;
+	for (i = 0; i < self->nb_filters; i++)
+		if (sl_database_sqlite_filter_write(self->db_handler, self->prepared_queries, self->filters + i))
+			return -1;
+
+	// paths are indexed before being compressed
+	if (self->config->search_index != sl_database_sqlite_search_index_none) {
+		if (!self->has_search_index) {
+			if (sl_database_sqlite_search_create(self->db_handler, self->config->file_storage))
+				return -1;
+			self->has_search_index = true;
+		} else if (sl_database_sqlite_search_index_session(self->db_handler, self->prepared_queries, self->config->file_storage, session_id))
+			return -1;
+	} else if (self->has_search_index) {
+		// an index which misses sessions would hide their files
+		if (sl_database_sqlite_search_drop(self->db_handler))
+			return -1;
+		self->has_search_index = false;
+	}
+
+	// dictionaries are trained once all paths of session are known
+	if (self->config->path_compression != sl_database_sqlite_path_compression_none && sl_database_sqlite_compress_session(self->db_handler, self->prepared_queries, session_id))
+		return -1;
+
+	enum sl_database_sqlite_query id = sl_database_sqlite_query_end_session;
+	const char * query = "UPDATE session SET end_time = ?2 WHERE id = ?1";
+	if (self->version < 2) {
+		id = sl_database_sqlite_query_end_session_v1;
+		query = "UPDATE session SET end_time = datetime('now') WHERE id = ?1";
+	}
+
+	sqlite3_stmt * stmt_update = sl_database_sqlite_util_prepare(self->db_handler, self->prepared_queries, id, query);
 	if (stmt_update == NULL) {
 		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'update session'");
 		return -1;
 	}
 
 	sqlite3_bind_int(stmt_update, 1, session_id);
+	if (self->version >= 2)
+		sqlite3_bind_int64(stmt_update, 2, time(NULL));
+
+	sl_database_sqlite_connection_free_sync_state(self);
 
 	return sqlite3_step(stmt_update) != SQLITE_DONE;
 }
@@ -403,16 +1184,29 @@ static int sl_database_sqlite_connection_start_session(struct sl_database_connec
 	if (self->db_handler == NULL)
 		return 1;
 
-	static const char * query = "INSERT INTO session(start_time, host) VALUES (datetime('now'), ?1)";
-	sqlite3_stmt * stmt_insert = sl_database_sqlite_connection_prepare(self, query);
+	if (sl_database_sqlite_util_create_indexes(self->db_handler, self->config)) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to create indexes into '%s'", self->config->path);
+		return -1;
+	}
+
+	enum sl_database_sqlite_query id = sl_database_sqlite_query_start_session;
+	const char * query = "INSERT INTO session(start_time, host) VALUES (?2, ?1)";
+	if (self->version < 2) {
+		id = sl_database_sqlite_query_start_session_v1;
+		query = "INSERT INTO session(start_time, host) VALUES (datetime('now'), ?1)";
+	}
+
+	sqlite3_stmt * stmt_insert = sl_database_sqlite_util_prepare(self->db_handler, self->prepared_queries, id, query);
 	if (stmt_insert == NULL) {
 		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'insert into session'");
 		return -1;
 	}
 
 	sqlite3_bind_int(stmt_insert, 1, host_id);
-	int failed = sqlite3_step(stmt_insert);
+	if (self->version >= 2)
+		sqlite3_bind_int64(stmt_insert, 2, time(NULL));
 
+	int failed = sqlite3_step(stmt_insert);
 	if (failed != SQLITE_DONE)
 		return -1;
 
@@ -426,7 +1220,7 @@ static int sl_database_sqlite_connection_get_host_by_name(struct sl_database_con
 		return 1;
 
 	static const char * query = "SELECT id FROM host WHERE name = ?1 LIMIT 1";
-	sqlite3_stmt * stmt_select = sl_database_sqlite_connection_prepare(self, query);
+	sqlite3_stmt * stmt_select = sl_database_sqlite_util_prepare(self->db_handler, self->prepared_queries, sl_database_sqlite_query_select_host, query);
 	if (stmt_select == NULL) {
 		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'get host by name'");
 		return -1;
@@ -436,10 +1230,15 @@ static int sl_database_sqlite_connection_get_host_by_name(struct sl_database_con
 
 	int failed = sqlite3_step(stmt_select);
 	if (failed == SQLITE_ROW) {
-		return sqlite3_column_int(stmt_select, 0);
+		// a pending statement would lock schema changes of start_session
+		int host_id = sqlite3_column_int(stmt_select, 0);
+		sqlite3_reset(stmt_select);
+		return host_id;
+	} else if (failed == SQLITE_DONE && self->read_only) {
+		return -1;
 	} else if (failed == SQLITE_DONE) {
 		static const char * insert = "INSERT INTO host(name) VALUES (?1)";
-		sqlite3_stmt * stmt_insert = sl_database_sqlite_connection_prepare(self, insert);
+		sqlite3_stmt * stmt_insert = sl_database_sqlite_util_prepare(self->db_handler, self->prepared_queries, sl_database_sqlite_query_insert_host, insert);
 		if (stmt_insert == NULL) {
 			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'insert into host'");
 			return -2;
@@ -460,29 +1259,156 @@ static int sl_database_sqlite_connection_sync_file(struct sl_database_connection
 	if (self->db_handler == NULL)
 		return 1;
 
-	static const char * insert = "INSERT INTO file(s2fs, inode, path, mode, uid, gid, size, access_time, modif_time) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, datetime(?8, 'unixepoch'), datetime(?9, 'unixepoch'))";
-	sqlite3_stmt * stmt_insert = sl_database_sqlite_connection_prepare(self, insert);
-	if (stmt_insert == NULL) {
-		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'insert into file2session'");
+	// files are usually synced filesystem by filesystem
+	unsigned int i;
+	for (i = self->nb_filters; i > 0; i--)
+		if (self->filters[i - 1].s2fs == s2fs) {
+			if (sl_database_sqlite_filter_add(self->filters + i - 1, st->st_ino))
+				return -5;
+			break;
+		}
+
+	if (self->config->path_storage == sl_database_sqlite_path_storage_tree)
+		return sl_database_sqlite_connection_sync_node(self, s2fs, filename, st);
+
+	if (self->config->file_storage == sl_database_sqlite_file_storage_delta) {
+		unsigned int i;
+		for (i = 0; i < self->nb_deltas; i++)
+			if (self->deltas[i].s2fs == s2fs)
+				return sl_database_sqlite_util_sync_delta_file(self->db_handler, self->prepared_queries, self->deltas[i].filesystem, self->deltas[i].session, self->deltas[i].previous_session, filename, st);
+
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: session2filesystem %d is unknown", s2fs);
 		return -4;
 	}
 
-	sqlite3_bind_int64(stmt_insert, 1, s2fs);
-	sqlite3_bind_int64(stmt_insert, 2, st->st_ino);
-	sqlite3_bind_text(stmt_insert, 3, filename, -1, SQLITE_STATIC);
-	sqlite3_bind_int(stmt_insert, 4, st->st_mode);
-	sqlite3_bind_int(stmt_insert, 5, st->st_uid);
-	sqlite3_bind_int(stmt_insert, 6, st->st_gid);
-	sqlite3_bind_int64(stmt_insert, 7, st->st_size);
-	sqlite3_bind_int64(stmt_insert, 8, st->st_atime);
-	sqlite3_bind_int64(stmt_insert, 9, st->st_mtime);
+	if (self->config->layout == sl_database_sqlite_layout_single)
+		return sl_database_sqlite_util_insert_file(self->db_handler, self->prepared_queries, self->version, s2fs, filename, st);
 
-	int failed = sqlite3_step(stmt_insert);
+	struct sl_database_sqlite_store * store = sl_database_sqlite_connection_get_store_by_s2fs(self, s2fs);
+	if (store == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: there is no database associated to session2filesystem %d", s2fs);
+		return -4;
+	}
 
-	if (failed != SQLITE_DONE)
-		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to insert new file2session (file id: 0, session id: %d)", s2fs);
+	return sl_database_sqlite_store_insert_file(store, s2fs, 0, 0, filename, st);
+}
 
-	return failed != SQLITE_DONE;
+static int sl_database_sqlite_connection_sync_node(struct sl_database_sqlite_connection_private * self, int s2fs, const char * filename, struct stat * st) {
+	struct sl_database_sqlite_store * store = NULL;
+	if (self->config->layout != sl_database_sqlite_layout_single) {
+		store = sl_database_sqlite_connection_get_store_by_s2fs(self, s2fs);
+		if (store == NULL) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: there is no database associated to session2filesystem %d", s2fs);
+			return -4;
+		}
+	}
+
+	struct sl_database_sqlite_connection_tree * tree = NULL;
+	unsigned int i;
+	for (i = 0; i < self->nb_trees && tree == NULL; i++)
+		if (self->trees[i].s2fs == s2fs)
+			tree = self->trees + i;
+
+	if (tree == NULL) {
+		void * new_addr = realloc(self->trees, (self->nb_trees + 1) * sizeof(struct sl_database_sqlite_connection_tree));
+		if (new_addr == NULL) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: not enough memory to synchronize '%s'", filename);
+			return -5;
+		}
+
+		self->trees = new_addr;
+		tree = self->trees + self->nb_trees;
+		self->nb_trees++;
+
+		tree->s2fs = s2fs;
+		tree->dirs = NULL;
+		tree->nb_dirs = 0;
+	}
+
+	/**
+	 * Files are synchronized in depth-first order, so the parent of a
+	 * file is the nearest directory of the stack which is a prefix of
+	 * its path. Root of filesystem is stored with path "".
+	 */
+	const char * name = filename;
+	sqlite3_int64 parent = 0;
+	if (strcmp(filename, "/")) {
+		const char * last_slash = strrchr(filename, '/');
+		size_t length = 0;
+		if (last_slash != NULL) {
+			name = last_slash + 1;
+			length = last_slash - filename;
+		}
+
+		while (tree->nb_dirs > 0) {
+			struct sl_database_sqlite_connection_tree_dir * dir = tree->dirs + tree->nb_dirs - 1;
+			if (strlen(dir->path) == length && !strncmp(dir->path, filename, length))
+				break;
+
+			free(dir->path);
+			tree->nb_dirs--;
+		}
+
+		if (tree->nb_dirs == 0) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: parent directory of '%s' has not been synchronized", filename);
+			return -6;
+		}
+
+		parent = tree->dirs[tree->nb_dirs - 1].id;
+	} else {
+		for (i = 0; i < tree->nb_dirs; i++)
+			free(tree->dirs[i].path);
+		tree->nb_dirs = 0;
+	}
+
+	sqlite3_int64 * next_file_id = store != NULL ? &store->next_file_id : &self->next_file_id;
+	if (*next_file_id < 1)
+		*next_file_id = sl_database_sqlite_util_get_next_file_id(store != NULL ? store->db_handler : self->db_handler);
+	if (*next_file_id < 1)
+		return -7;
+
+	sqlite3_int64 id = (*next_file_id)++;
+
+	if (S_ISDIR(st->st_mode)) {
+		void * new_addr = realloc(tree->dirs, (tree->nb_dirs + 1) * sizeof(struct sl_database_sqlite_connection_tree_dir));
+		if (new_addr == NULL) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: not enough memory to synchronize '%s'", filename);
+			return -5;
+		}
+
+		tree->dirs = new_addr;
+		tree->dirs[tree->nb_dirs].path = strdup(parent > 0 ? filename : "");
+		tree->dirs[tree->nb_dirs].id = id;
+		tree->nb_dirs++;
+	}
+
+	if (store != NULL)
+		return sl_database_sqlite_store_insert_file(store, s2fs, id, parent, name, st);
+
+	return sl_database_sqlite_util_insert_node(self->db_handler, self->prepared_queries, s2fs, id, parent, name, st);
+}
+
+static void sl_database_sqlite_connection_free_sync_state(struct sl_database_sqlite_connection_private * self) {
+	unsigned int i, j;
+	for (i = 0; i < self->nb_trees; i++) {
+		for (j = 0; j < self->trees[i].nb_dirs; j++)
+			free(self->trees[i].dirs[j].path);
+		free(self->trees[i].dirs);
+	}
+
+	free(self->trees);
+	self->trees = NULL;
+	self->nb_trees = 0;
+
+	free(self->deltas);
+	self->deltas = NULL;
+	self->nb_deltas = 0;
+
+	for (i = 0; i < self->nb_filters; i++)
+		sl_database_sqlite_filter_free(self->filters + i);
+	free(self->filters);
+	self->filters = NULL;
+	self->nb_filters = 0;
 }
 
 static int sl_database_sqlite_connection_sync_filesystem(struct sl_database_connection * connect, int session_id, struct sl_filesystem * fs) {
@@ -491,7 +1417,7 @@ static int sl_database_sqlite_connection_sync_filesystem(struct sl_database_conn
 		return 1;
 
 	static const char * query = "SELECT id FROM filesystem WHERE uuid = ?1 LIMIT 1";
-	sqlite3_stmt * stmt_select = sl_database_sqlite_connection_prepare(self, query);
+	sqlite3_stmt * stmt_select = sl_database_sqlite_util_prepare(self->db_handler, self->prepared_queries, sl_database_sqlite_query_select_filesystem, query);
 	if (stmt_select == NULL) {
 		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'get host by uuid'");
 		return -1;
@@ -504,7 +1430,7 @@ static int sl_database_sqlite_connection_sync_filesystem(struct sl_database_conn
 		fs->id = sqlite3_column_int(stmt_select, 0);
 	} else if (failed == SQLITE_DONE) {
 		static const char * insert = "INSERT INTO filesystem(uuid, label, type) VALUES (?1, ?2, ?3)";
-		sqlite3_stmt * stmt_insert = sl_database_sqlite_connection_prepare(self, insert);
+		sqlite3_stmt * stmt_insert = sl_database_sqlite_util_prepare(self->db_handler, self->prepared_queries, sl_database_sqlite_query_insert_filesystem, insert);
 		if (stmt_insert == NULL) {
 			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'insert into filesystem'");
 			return -2;
@@ -523,7 +1449,7 @@ static int sl_database_sqlite_connection_sync_filesystem(struct sl_database_conn
 	}
 
 	static const char * insert = "INSERT INTO session2filesystem(session, filesystem, mount_point, dev_no, disk_free, disk_total, block_size) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7)";
-	sqlite3_stmt * stmt_insert = sl_database_sqlite_connection_prepare(self, insert);
+	sqlite3_stmt * stmt_insert = sl_database_sqlite_util_prepare(self->db_handler, self->prepared_queries, sl_database_sqlite_query_insert_s2fs, insert);
 	if (stmt_insert == NULL) {
 		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'insert into session2filesystem'");
 		return -4;
@@ -541,48 +1467,952 @@ static int sl_database_sqlite_connection_sync_filesystem(struct sl_database_conn
 	if (failed != SQLITE_DONE)
 		return -5;
 
-	return sqlite3_last_insert_rowid(self->db_handler);
+	int s2fs = sqlite3_last_insert_rowid(self->db_handler);
+
+	void * new_filters = realloc(self->filters, (self->nb_filters + 1) * sizeof(struct sl_database_sqlite_filter));
+	if (new_filters == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: not enough memory to register session2filesystem %d", s2fs);
+		return -8;
+	}
+
+	self->filters = new_filters;
+	self->filters[self->nb_filters].s2fs = s2fs;
+	self->filters[self->nb_filters].inodes = NULL;
+	self->filters[self->nb_filters].nb_inodes = 0;
+	self->filters[self->nb_filters].max_inodes = 0;
+	self->nb_filters++;
+
+	if (self->config->file_storage == sl_database_sqlite_file_storage_delta) {
+		// files are compared with the last visit of this filesystem
+		static const char * query_previous = "SELECT MAX(session) FROM session2filesystem WHERE filesystem = ?1 AND session < ?2";
+		stmt_select = sl_database_sqlite_util_prepare(self->db_handler, self->prepared_queries, sl_database_sqlite_query_get_previous_session, query_previous);
+		if (stmt_select == NULL) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'get previous session'");
+			return -6;
+		}
+
+		sqlite3_bind_int(stmt_select, 1, fs->id);
+		sqlite3_bind_int(stmt_select, 2, session_id);
+
+		int previous_session = 0;
+		if (sqlite3_step(stmt_select) == SQLITE_ROW)
+			previous_session = sqlite3_column_int(stmt_select, 0);
+		sqlite3_reset(stmt_select);
+
+		void * new_addr = realloc(self->deltas, (self->nb_deltas + 1) * sizeof(struct sl_database_sqlite_connection_delta));
+		if (new_addr == NULL) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: not enough memory to register session2filesystem %d", s2fs);
+			return -8;
+		}
+
+		self->deltas = new_addr;
+		self->deltas[self->nb_deltas].s2fs = s2fs;
+		self->deltas[self->nb_deltas].filesystem = fs->id;
+		self->deltas[self->nb_deltas].session = session_id;
+		self->deltas[self->nb_deltas].previous_session = previous_session;
+		self->nb_deltas++;
+	}
+
+	if (self->config->layout != sl_database_sqlite_layout_single) {
+		struct sl_database_sqlite_store * store;
+		if (self->config->layout == sl_database_sqlite_layout_session)
+			store = sl_database_sqlite_connection_get_session_store(self, session_id, true);
+		else
+			store = sl_database_sqlite_connection_get_store(self, fs->uuid, true);
+
+		if (store == NULL)
+			return -6;
+
+		if (sl_database_sqlite_store_flush(store))
+			return -7;
+
+		// a cancelled transaction can let some rows with this id
+		sqlite3_stmt * stmt_delete = sl_database_sqlite_util_prepare(store->db_handler, store->prepared_queries, sl_database_sqlite_query_delete_store_files, "DELETE FROM file WHERE s2fs = ?1");
+		if (stmt_delete == NULL) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'delete from file' on '%s'", store->path);
+			return -7;
+		}
+
+		sqlite3_bind_int(stmt_delete, 1, s2fs);
+		if (sqlite3_step(stmt_delete) != SQLITE_DONE)
+			return -7;
+
+		void * new_addr = realloc(self->s2fs_stores, (self->nb_s2fs_stores + 1) * sizeof(struct sl_database_sqlite_connection_store));
+		if (new_addr == NULL) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: not enough memory to register session2filesystem %d", s2fs);
+			return -8;
+		}
+
+		self->s2fs_stores = new_addr;
+		self->s2fs_stores[self->nb_s2fs_stores].s2fs = s2fs;
+		self->s2fs_stores[self->nb_s2fs_stores].store = store;
+		self->nb_s2fs_stores++;
+	}
+
+	return s2fs;
+}
+
+static int sl_database_sqlite_connection_sync_statistics(struct sl_database_connection * connect, int s2fs, const struct sl_result_statistics * stats) {
+	struct sl_database_sqlite_connection_private * self = connect->data;
+	if (self->db_handler == NULL)
+		return 1;
+
+	if (!self->has_statistics) {
+		if (sl_database_sqlite_util_create_statistics_table(self->db_handler))
+			return -1;
+		self->has_statistics = true;
+	}
+
+	static const char * query = "INSERT OR REPLACE INTO session_statistics(s2fs, nb_files, nb_directories, total_size, scan_duration, nb_errors) VALUES (?1, ?2, ?3, ?4, ?5, ?6)";
+	sqlite3_stmt * stmt_insert = sl_database_sqlite_util_prepare(self->db_handler, self->prepared_queries, sl_database_sqlite_query_insert_statistics, query);
+	if (stmt_insert == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'insert into session_statistics'");
+		return -2;
+	}
+
+	sqlite3_bind_int(stmt_insert, 1, s2fs);
+	sqlite3_bind_int64(stmt_insert, 2, stats->nb_files);
+	sqlite3_bind_int64(stmt_insert, 3, stats->nb_directories);
+	sqlite3_bind_int64(stmt_insert, 4, stats->total_size);
+	sqlite3_bind_int64(stmt_insert, 5, stats->scan_duration);
+	sqlite3_bind_int(stmt_insert, 6, stats->nb_errors);
+
+	int failed = sqlite3_step(stmt_insert);
+	if (failed != SQLITE_DONE)
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to insert statistics of session2filesystem %d because %s", s2fs, sqlite3_errmsg(self->db_handler));
+
+	return failed != SQLITE_DONE;
 }
 
 
 static struct sl_result_files * sl_database_sqlite_connection_find(struct sl_database_connection * connect, int host_id, struct sl_request * request) {
+	return sl_database_fetch_files(sl_database_sqlite_connection_open_cursor(connect, host_id, request));
+}
+
+static struct sl_database_cursor * sl_database_sqlite_connection_open_cursor(struct sl_database_connection * connect, int host_id, struct sl_request * request) {
 	struct sl_database_sqlite_connection_private * self = connect->data;
 	if (self->db_handler == NULL)
 		return NULL;
 
-	char * query = sqlite3_mprintf("SELECT s.id, s.start_time, s.end_time, fs.id, fs.uuid, fs.label, s2fs.dev_no, s2fs.mount_point, f.inode, f.path, f.mode, f.uid, f.gid, f.size, f.access_time, f.modif_time FROM session s LEFT JOIN session2filesystem s2fs ON s.id = s2fs.session LEFT JOIN filesystem fs ON s2fs.filesystem = fs.id LEFT JOIN file f ON s2fs.id = f.s2fs WHERE s.host = ?1");
-	int i_param = 2;
+	struct sl_database_sqlite_connection_cursor * cursor_data = malloc(sizeof(struct sl_database_sqlite_connection_cursor));
+	cursor_data->connection = self;
+	cursor_data->host_id = host_id;
+	cursor_data->request = *request;
+	cursor_data->stmt_stores = NULL;
+	cursor_data->sources = NULL;
+	cursor_data->nb_sources = 0;
+	cursor_data->current = NULL;
+	cursor_data->failed = false;
+	cursor_data->has_regex = false;
+	cursor_data->selected = NULL;
+	cursor_data->next_selected = 0;
+	cursor_data->selector = NULL;
+	cursor_data->selected_all = false;
+
+	struct sl_database_cursor * cursor = malloc(sizeof(struct sl_database_cursor));
+	cursor->data = cursor_data;
+	cursor->connect = connect;
+
+	if (request->path_pattern != NULL && request->path_regex) {
+		if (regcomp(&cursor_data->regex, request->path_pattern, REG_EXTENDED | REG_NOSUB)) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: invalid regular expression '%s'", request->path_pattern);
+			sl_database_sqlite_connection_close_cursor(cursor);
+			return NULL;
+		}
+		cursor_data->has_regex = true;
+	}
+
+	if (self->config->layout == sl_database_sqlite_layout_single) {
+		if (sl_database_sqlite_connection_cursor_add_source(cursor_data, self->db_handler, self->prepared_queries)) {
+			sl_database_sqlite_connection_close_cursor(cursor);
+			return NULL;
+		}
+
+		return cursor;
+	}
+
+	// look only into databases of filesystems or of sessions which can match
+	enum sl_database_sqlite_query id;
+	const char * query;
+	if (self->config->layout == sl_database_sqlite_layout_session) {
+		id = sl_database_sqlite_query_get_stores_session;
+		query = "SELECT DISTINCT s.id FROM session s INNER JOIN session2filesystem s2fs ON s.id = s2fs.session INNER JOIN filesystem fs ON s2fs.filesystem = fs.id WHERE s.host = ?1 AND s.end_time IS NOT NULL AND (?2 < 0 OR s2fs.dev_no = ?2 OR (?6 IS NOT NULL AND NOT EXISTS (SELECT 1 FROM session2filesystem o WHERE o.session = s2fs.session AND o.filesystem = s2fs.filesystem AND o.dev_no = ?2))) AND (?3 < 1 OR s.id BETWEEN ?3 AND ?4) AND (?6 IS NULL OR fs.uuid = ?6) ORDER BY s.id DESC";
+	} else {
+		id = sl_database_sqlite_query_get_stores_filesystem;
+		query = "SELECT DISTINCT fs.uuid FROM session s INNER JOIN session2filesystem s2fs ON s.id = s2fs.session INNER JOIN filesystem fs ON s2fs.filesystem = fs.id WHERE s.host = ?1 AND s.end_time IS NOT NULL AND (?2 < 0 OR s2fs.dev_no = ?2 OR (?6 IS NOT NULL AND NOT EXISTS (SELECT 1 FROM session2filesystem o WHERE o.session = s2fs.session AND o.filesystem = s2fs.filesystem AND o.dev_no = ?2))) AND (?3 < 1 OR s.id BETWEEN ?3 AND ?4) AND (?6 IS NULL OR fs.uuid = ?6)";
+	}
+
+	// databases which can not contain the inode are not opened
+	if (self->has_filters && request->inode != (ino_t) -1) {
+		if (self->config->layout == sl_database_sqlite_layout_session) {
+			id = sl_database_sqlite_query_get_stores_session_filter;
+			query = "SELECT DISTINCT s.id FROM session s INNER JOIN session2filesystem s2fs ON s.id = s2fs.session INNER JOIN filesystem fs ON s2fs.filesystem = fs.id LEFT JOIN session_filter flt ON s2fs.id = flt.s2fs WHERE s.host = ?1 AND s.end_time IS NOT NULL AND (?2 < 0 OR s2fs.dev_no = ?2 OR (?6 IS NOT NULL AND NOT EXISTS (SELECT 1 FROM session2filesystem o WHERE o.session = s2fs.session AND o.filesystem = s2fs.filesystem AND o.dev_no = ?2))) AND (?3 < 1 OR s.id BETWEEN ?3 AND ?4) AND sl_filter_contains(flt.data, ?5) AND (?6 IS NULL OR fs.uuid = ?6) ORDER BY s.id DESC";
+		} else {
+			id = sl_database_sqlite_query_get_stores_filesystem_filter;
+			query = "SELECT DISTINCT fs.uuid FROM session s INNER JOIN session2filesystem s2fs ON s.id = s2fs.session INNER JOIN filesystem fs ON s2fs.filesystem = fs.id LEFT JOIN session_filter flt ON s2fs.id = flt.s2fs WHERE s.host = ?1 AND s.end_time IS NOT NULL AND (?2 < 0 OR s2fs.dev_no = ?2 OR (?6 IS NOT NULL AND NOT EXISTS (SELECT 1 FROM session2filesystem o WHERE o.session = s2fs.session AND o.filesystem = s2fs.filesystem AND o.dev_no = ?2))) AND (?3 < 1 OR s.id BETWEEN ?3 AND ?4) AND sl_filter_contains(flt.data, ?5) AND (?6 IS NULL OR fs.uuid = ?6)";
+		}
+	}
+
+	sqlite3_stmt * stmt_select = sl_database_sqlite_util_prepare(self->db_handler, self->prepared_queries, id, query);
+	if (stmt_select == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'get filesystem'");
+		sl_database_sqlite_connection_close_cursor(cursor);
+		return NULL;
+	}
+
+	int session_min = 0, session_max = 0;
 	if (request->session_min_id < request->session_max_id) {
-		char * tmp = query;
-		query = sqlite3_mprintf("%s AND s.id BETWEEN ?%s AND ?%d", query, i_param, i_param + 1);
-		sqlite3_free(tmp);
-		i_param += 2;
-	} else if (request->session_min_id > 0) {
-		char * tmp = query;
-		query = sqlite3_mprintf("%s AND s.id = ?%d", query, i_param);
-		sqlite3_free(tmp);
-		i_param++;
+		session_min = request->session_min_id;
+		session_max = request->session_max_id;
+	} else if (request->session_min_id > 0)
+		session_min = session_max = request->session_min_id;
+
+	sqlite3_bind_int(stmt_select, 1, host_id);
+	sqlite3_bind_int(stmt_select, 2, request->dev_no != (dev_t) -1 ? (int) request->dev_no : -1);
+	sqlite3_bind_int(stmt_select, 3, session_min);
+	sqlite3_bind_int(stmt_select, 4, session_max);
+	if (self->has_filters && request->inode != (ino_t) -1)
+		sqlite3_bind_int64(stmt_select, 5, request->inode);
+	if (request->fs_uuid != NULL)
+		sqlite3_bind_text(stmt_select, 6, request->fs_uuid, -1, SQLITE_STATIC);
+	else
+		sqlite3_bind_null(stmt_select, 6);
+
+	// with layout session, databases are visited from the newest session, while rows are fetched
+	if (self->config->layout == sl_database_sqlite_layout_session) {
+		cursor_data->stmt_stores = stmt_select;
+		return cursor;
 	}
 
-	if (request->dev_no != (dev_t) -1) {
-		char * tmp = query;
-		query = sqlite3_mprintf("%s AND s2fs.dev_no = ?%d", query, i_param);
-		sqlite3_free(tmp);
-		i_param++;
+	// with layout filesystem, rows of each database are merged by session
+	int failed = 0;
+	while (!failed && sqlite3_step(stmt_select) == SQLITE_ROW) {
+		struct sl_database_sqlite_store * store = sl_database_sqlite_connection_get_store(self, (const char *) sqlite3_column_text(stmt_select, 0), false);
+		if (store == NULL)
+			continue;
+
+		failed = sl_database_sqlite_store_attach_meta(store, self->config->path);
+		if (!failed)
+			failed = sl_database_sqlite_connection_cursor_add_source(cursor_data, store->db_handler, store->prepared_queries);
 	}
+	sqlite3_reset(stmt_select);
+
+	if (failed) {
+		sl_database_sqlite_connection_close_cursor(cursor);
+		return NULL;
+	}
+
+	return cursor;
+}
+
+static int sl_database_sqlite_connection_cursor_add_source(struct sl_database_sqlite_connection_cursor * cursor, sqlite3 * db, struct sl_database_sqlite_queries * queries) {
+	struct sl_database_sqlite_connection_private * self = cursor->connection;
+
+	sqlite3_stmt * stmt = sl_database_sqlite_connection_find_in(db, queries, self->config, self->has_filters, self->has_search_index, cursor->host_id, &cursor->request);
+	if (stmt == NULL)
+		return 1;
+
+	void * new_addr = realloc(cursor->sources, (cursor->nb_sources + 1) * sizeof(struct sl_database_sqlite_connection_cursor_source));
+	if (new_addr == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: not enough memory to get result");
+		sqlite3_reset(stmt);
+		return 1;
+	}
+	cursor->sources = new_addr;
+
+	struct sl_database_sqlite_connection_cursor_source * source = cursor->sources + cursor->nb_sources;
+	cursor->nb_sources++;
+
+	source->db = db;
+	source->queries = queries;
+	source->stmt = stmt;
+	source->paths = NULL;
+	if (self->config->path_storage == sl_database_sqlite_path_storage_tree)
+		source->paths = sl_hashtable_new2(sl_string_compute_hash, sl_util_basic_free);
+
+	int failed = sqlite3_step(stmt);
+	source->has_row = failed == SQLITE_ROW;
+
+	return failed != SQLITE_ROW && failed != SQLITE_DONE;
+}
+
+static void sl_database_sqlite_connection_cursor_free_sources(struct sl_database_sqlite_connection_cursor * cursor) {
+	unsigned int i;
+	for (i = 0; i < cursor->nb_sources; i++) {
+		sqlite3_reset(cursor->sources[i].stmt);
+		sl_hashtable_free(cursor->sources[i].paths);
+	}
+
+	free(cursor->sources);
+	cursor->sources = NULL;
+	cursor->nb_sources = 0;
+	cursor->current = NULL;
+}
+
+static const struct sl_result_file * sl_database_sqlite_connection_next_file(struct sl_database_cursor * cursor) {
+	struct sl_database_sqlite_connection_cursor * self = cursor->data;
+	if (!sl_request_need_select(&self->request))
+		return sl_database_sqlite_connection_cursor_next_row(self);
+
+	if (sl_request_can_stream(&self->request))
+		return sl_database_sqlite_connection_next_selected(self);
+
+	// collapsed rows are selected at first call, fetching stops once no more row can be kept
+	if (self->selected == NULL && !self->failed) {
+		struct sl_result_builder * builder = sl_result_builder_new();
+
+		// rows are collapsed only across consecutive sessions of host
+		int * sessions = NULL;
+		unsigned int nb_sessions = 0;
+		int failed = sl_database_sqlite_connection_get_sessions(self->connection, self->host_id, &sessions, &nb_sessions);
+		if (!failed)
+			failed = sl_result_builder_set_sessions(builder, sessions, nb_sessions);
+		free(sessions);
+
+		if (failed) {
+			sl_result_builder_free(builder);
+			self->failed = true;
+			return NULL;
+		}
+
+		const struct sl_result_file * file;
+		int status = 0;
+		while (status >= 0 && status < 2 && (file = sl_database_sqlite_connection_cursor_next_row(self)) != NULL)
+			status = sl_result_builder_select(builder, &self->request, file);
+
+		if (status < 0 || self->failed) {
+			if (status < 0)
+				sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: not enough memory to get result");
+			sl_result_builder_free(builder);
+			self->failed = true;
+			return NULL;
+		}
+
+		self->selected = sl_result_builder_finish(builder);
+		self->failed = self->selected == NULL;
+	}
+
+	if (self->selected == NULL || self->next_selected == self->selected->nb_files)
+		return NULL;
+
+	return self->selected->files + self->next_selected++;
+}
+
+static const struct sl_result_file * sl_database_sqlite_connection_next_selected(struct sl_database_sqlite_connection_cursor * self) {
+	if (self->selector == NULL && !self->failed) {
+		self->selector = sl_result_selector_new(&self->request);
+		if (self->selector == NULL) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: not enough memory to get result");
+			self->failed = true;
+			return NULL;
+		}
+
+		// rows are collapsed only across consecutive sessions of host
+		if (self->request.collapse) {
+			int * sessions = NULL;
+			unsigned int nb_sessions = 0;
+			int failed = sl_database_sqlite_connection_get_sessions(self->connection, self->host_id, &sessions, &nb_sessions);
+			if (!failed)
+				failed = sl_result_selector_set_sessions(self->selector, sessions, nb_sessions);
+			free(sessions);
+
+			if (failed) {
+				self->failed = true;
+				return NULL;
+			}
+		}
+	}
+
+	// a row is returned once no row of an older session can be merged into it
+	while (!self->failed) {
+		const struct sl_result_file * file = sl_result_selector_next(self->selector);
+		if (file != NULL || self->selected_all)
+			return file;
+
+		int status = 2;
+		file = sl_database_sqlite_connection_cursor_next_row(self);
+		if (file != NULL)
+			status = sl_result_selector_add(self->selector, file);
+		else if (self->failed)
+			break;
+
+		if (status == 2) {
+			status = sl_result_selector_finish(self->selector) ? -1 : 0;
+			self->selected_all = true;
+		}
+
+		if (status < 0) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: not enough memory to get result");
+			self->failed = true;
+		}
+	}
+
+	return NULL;
+}
+
+static const struct sl_result_file * sl_database_sqlite_connection_cursor_next_row(struct sl_database_sqlite_connection_cursor * self) {
+	if (self->failed)
+		return NULL;
+
+	for (;;) {
+		// previous row is released only now, strings of row are borrowed from its statement
+		if (self->current != NULL) {
+			int failed = sqlite3_step(self->current->stmt);
+			self->current->has_row = failed == SQLITE_ROW;
+			self->current = NULL;
+
+			if (failed != SQLITE_ROW && failed != SQLITE_DONE) {
+				self->failed = true;
+				return NULL;
+			}
+		}
+
+		for (;;) {
+			unsigned int i;
+			for (i = 0; i < self->nb_sources; i++) {
+				struct sl_database_sqlite_connection_cursor_source * source = self->sources + i;
+				if (source->has_row && (self->current == NULL || sqlite3_column_int(source->stmt, 0) > sqlite3_column_int(self->current->stmt, 0)))
+					self->current = source;
+			}
+
+			if (self->current != NULL)
+				break;
+
+			if (self->stmt_stores == NULL)
+				return NULL;
+
+			// open database of next session
+			int failed = sqlite3_step(self->stmt_stores);
+			if (failed != SQLITE_ROW) {
+				sqlite3_reset(self->stmt_stores);
+				self->stmt_stores = NULL;
+				self->failed = failed != SQLITE_DONE;
+				return NULL;
+			}
+
+			sl_database_sqlite_connection_cursor_free_sources(self);
+
+			struct sl_database_sqlite_store * store = sl_database_sqlite_connection_get_session_store(self->connection, sqlite3_column_int(self->stmt_stores, 0), false);
+			if (store == NULL)
+				continue;
+
+			if (sl_database_sqlite_store_attach_meta(store, self->connection->config->path) || sl_database_sqlite_connection_cursor_add_source(self, store->db_handler, store->prepared_queries)) {
+				self->failed = true;
+				return NULL;
+			}
+		}
+
+		sl_database_sqlite_connection_fill_result(self->current->db, self->current->queries, self->current->paths, self->current->stmt, 0, &self->file);
+
+		// with path_storage = tree, path pattern is checked on rebuilt paths
+		if (self->request.path_pattern == NULL || self->current->paths == NULL)
+			return &self->file;
+		if (self->has_regex ? !regexec(&self->regex, self->file.path, 0, NULL, 0) : !fnmatch(self->request.path_pattern, self->file.path, 0))
+			return &self->file;
+	}
+}
+
+static int sl_database_sqlite_connection_close_cursor(struct sl_database_cursor * cursor) {
+	struct sl_database_sqlite_connection_cursor * self = cursor->data;
+
+	sl_database_sqlite_connection_cursor_free_sources(self);
+	if (self->stmt_stores != NULL)
+		sqlite3_reset(self->stmt_stores);
+
+	int failed = self->failed;
+	sl_result_files_free(self->selected);
+	sl_result_selector_free(self->selector);
+	if (self->has_regex)
+		regfree(&self->regex);
+	free(self);
+	free(cursor);
+
+	return failed;
+}
+
+static void sl_database_sqlite_connection_fill_result(sqlite3 * db, struct sl_database_sqlite_queries * queries, struct sl_hashtable * paths, sqlite3_stmt * stmt, int column, struct sl_result_file * file) {
+	// strings are borrowed from statement
+	file->session_id = sqlite3_column_int(stmt, column);
+	file->first_session_id = file->session_id;
+	file->session_start = sl_database_sqlite_util_get_time(stmt, column + 1);
+	file->session_end = sl_database_sqlite_util_get_time(stmt, column + 2);
+
+	file->fs_id = sqlite3_column_int(stmt, column + 3);
+	file->fs_uuid = (char *) sqlite3_column_text(stmt, column + 4);
+	file->fs_label = (char *) sqlite3_column_text(stmt, column + 5);
+
+	file->dev_no = sqlite3_column_int(stmt, column + 6);
+	file->mount_point = (char *) sqlite3_column_text(stmt, column + 7);
+
+	file->inode = sqlite3_column_int64(stmt, column + 8);
+	if (paths != NULL) {
+		const char * path = sl_database_sqlite_connection_get_path(db, queries, paths, sqlite3_column_int64(stmt, column + 9));
+		file->path = (char *) (path != NULL ? path : "");
+	} else
+		file->path = (char *) sqlite3_column_text(stmt, column + 9);
+	file->mode = sqlite3_column_int(stmt, column + 10);
+	file->uid = sqlite3_column_int(stmt, column + 11);
+	file->gid = sqlite3_column_int(stmt, column + 12);
+	file->size = sqlite3_column_int64(stmt, column + 13);
+	file->atime = sl_database_sqlite_util_get_time(stmt, column + 14);
+	file->mtime = sl_database_sqlite_util_get_time(stmt, column + 15);
+}
+
+static int sl_database_sqlite_connection_get_sessions(struct sl_database_sqlite_connection_private * self, int host_id, int ** sessions, unsigned int * nb_sessions) {
+	static const char * query = "SELECT id FROM session WHERE host = ?1 AND end_time IS NOT NULL ORDER BY id DESC";
+	sqlite3_stmt * stmt_select = sl_database_sqlite_util_prepare(self->db_handler, self->prepared_queries, sl_database_sqlite_query_get_sessions, query);
+	if (stmt_select == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'get sessions'");
+		return 1;
+	}
+
+	sqlite3_bind_int(stmt_select, 1, host_id);
+
+	int failed = 0;
+	while (!failed && sqlite3_step(stmt_select) == SQLITE_ROW) {
+		void * new_addr = realloc(*sessions, (*nb_sessions + 1) * sizeof(int));
+		if (new_addr == NULL) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: not enough memory to get result");
+			failed = 1;
+			break;
+		}
+
+		*sessions = new_addr;
+		(*sessions)[*nb_sessions] = sqlite3_column_int(stmt_select, 0);
+		(*nb_sessions)++;
+	}
+	sqlite3_reset(stmt_select);
+
+	return failed;
+}
+
+static int sl_database_sqlite_connection_compare_session(const void * a, const void * b) {
+	const struct sl_result_file * fa = a, * fb = b;
+	return fb->session_id - fa->session_id;
+}
+
+static struct sl_result_files ** sl_database_sqlite_connection_find_files(struct sl_database_connection * connect, int host_id, struct sl_request * requests, unsigned int nb_requests) {
+	struct sl_database_sqlite_connection_private * self = connect->data;
+	if (self->db_handler == NULL)
+		return NULL;
+
+	struct sl_result_builder ** builders = malloc(nb_requests * sizeof(struct sl_result_builder *));
+	unsigned int i, nb_batched = 0;
+	for (i = 0; i < nb_requests; i++) {
+		builders[i] = sl_result_builder_new();
+		if (sl_database_sqlite_connection_is_batched(requests + i))
+			nb_batched++;
+	}
+
+	// only inodes of a known filesystem (dev_no or uuid) are joined in one query,
+	// others like a path pattern use their own index through a cursor
+	int failed = 0;
+	for (i = 0; !failed && i < nb_requests; i++) {
+		if (sl_database_sqlite_connection_is_batched(requests + i))
+			continue;
+
+		struct sl_database_cursor * cursor = sl_database_sqlite_connection_open_cursor(connect, host_id, requests + i);
+		if (cursor == NULL) {
+			failed = 1;
+			break;
+		}
+
+		const struct sl_result_file * file;
+		while (!failed && (file = sl_database_sqlite_connection_next_file(cursor)) != NULL)
+			failed = sl_result_builder_add(builders[i], file);
+
+		if (sl_database_sqlite_connection_close_cursor(cursor))
+			failed = 1;
+	}
+
+	if (!failed && nb_batched > 0) {
+		if (self->config->layout == sl_database_sqlite_layout_single)
+			failed = sl_database_sqlite_connection_find_files_in(self, self->db_handler, self->prepared_queries, host_id, requests, nb_requests, builders);
+		else {
+			// each database of host is visited once for all requests
+			enum sl_database_sqlite_query id = sl_database_sqlite_query_get_stores_filesystem;
+			const char * query = "SELECT DISTINCT fs.uuid FROM session s INNER JOIN session2filesystem s2fs ON s.id = s2fs.session INNER JOIN filesystem fs ON s2fs.filesystem = fs.id WHERE s.host = ?1 AND s.end_time IS NOT NULL AND (?2 < 0 OR s2fs.dev_no = ?2 OR (?6 IS NOT NULL AND NOT EXISTS (SELECT 1 FROM session2filesystem o WHERE o.session = s2fs.session AND o.filesystem = s2fs.filesystem AND o.dev_no = ?2))) AND (?3 < 1 OR s.id BETWEEN ?3 AND ?4) AND (?6 IS NULL OR fs.uuid = ?6)";
+			if (self->config->layout == sl_database_sqlite_layout_session) {
+				id = sl_database_sqlite_query_get_stores_session;
+				query = "SELECT DISTINCT s.id FROM session s INNER JOIN session2filesystem s2fs ON s.id = s2fs.session INNER JOIN filesystem fs ON s2fs.filesystem = fs.id WHERE s.host = ?1 AND s.end_time IS NOT NULL AND (?2 < 0 OR s2fs.dev_no = ?2 OR (?6 IS NOT NULL AND NOT EXISTS (SELECT 1 FROM session2filesystem o WHERE o.session = s2fs.session AND o.filesystem = s2fs.filesystem AND o.dev_no = ?2))) AND (?3 < 1 OR s.id BETWEEN ?3 AND ?4) AND (?6 IS NULL OR fs.uuid = ?6) ORDER BY s.id DESC";
+			}
+
+			sqlite3_stmt * stmt_select = sl_database_sqlite_util_prepare(self->db_handler, self->prepared_queries, id, query);
+			if (stmt_select == NULL) {
+				sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'get filesystem'");
+				failed = 1;
+			} else {
+				sqlite3_bind_int(stmt_select, 1, host_id);
+				sqlite3_bind_int(stmt_select, 2, -1);
+				sqlite3_bind_int(stmt_select, 3, 0);
+				sqlite3_bind_int(stmt_select, 4, 0);
+				sqlite3_bind_null(stmt_select, 6);
+
+				while (!failed && sqlite3_step(stmt_select) == SQLITE_ROW) {
+					struct sl_database_sqlite_store * store;
+					if (self->config->layout == sl_database_sqlite_layout_session)
+						store = sl_database_sqlite_connection_get_session_store(self, sqlite3_column_int(stmt_select, 0), false);
+					else
+						store = sl_database_sqlite_connection_get_store(self, (const char *) sqlite3_column_text(stmt_select, 0), false);
+
+					if (store == NULL)
+						continue;
+
+					failed = sl_database_sqlite_store_attach_meta(store, self->config->path);
+					if (!failed)
+						failed = sl_database_sqlite_connection_find_files_in(self, store->db_handler, store->prepared_queries, host_id, requests, nb_requests, builders);
+				}
+				sqlite3_reset(stmt_select);
+			}
+		}
+	}
+
+	struct sl_result_files ** results = malloc(nb_requests * sizeof(struct sl_result_files *));
+	for (i = 0; i < nb_requests; i++) {
+		results[i] = NULL;
+		if (failed)
+			sl_result_builder_free(builders[i]);
+		else if ((results[i] = sl_result_builder_finish(builders[i])) == NULL)
+			failed = 1;
+	}
+	free(builders);
+
+	if (failed) {
+		sl_result_files_free_array(results, nb_requests);
+		return NULL;
+	}
+
+	// with layout session, databases are already visited from the newest session
+	if (self->config->layout == sl_database_sqlite_layout_filesystem)
+		for (i = 0; i < nb_requests; i++)
+			if (results[i]->nb_files > 1)
+				qsort(results[i]->files, results[i]->nb_files, sizeof(struct sl_result_file), sl_database_sqlite_connection_compare_session);
+
+	// options of joined requests are applied once rows of every database are sorted
+	for (i = 0; !failed && i < nb_requests; i++) {
+		if (!sl_database_sqlite_connection_is_batched(requests + i) || !sl_request_need_select(requests + i))
+			continue;
+
+		struct sl_result_builder * builder = sl_result_builder_new();
+		if (requests[i].collapse) {
+			int * sessions = NULL;
+			unsigned int nb_sessions = 0;
+			failed = sl_database_sqlite_connection_get_sessions(self, host_id, &sessions, &nb_sessions);
+			if (!failed)
+				failed = sl_result_builder_set_sessions(builder, sessions, nb_sessions);
+			free(sessions);
+
+			if (failed) {
+				sl_result_builder_free(builder);
+				break;
+			}
+		}
+
+		unsigned int j;
+		int status = 0;
+		for (j = 0; status >= 0 && status < 2 && j < results[i]->nb_files; j++)
+			status = sl_result_builder_select(builder, requests + i, results[i]->files + j);
+
+		if (status < 0) {
+			sl_result_builder_free(builder);
+			failed = 1;
+			break;
+		}
+
+		sl_result_files_free(results[i]);
+		if ((results[i] = sl_result_builder_finish(builder)) == NULL)
+			failed = 1;
+	}
+
+	if (failed) {
+		sl_result_files_free_array(results, nb_requests);
+		return NULL;
+	}
+
+	return results;
+}
+
+static bool sl_database_sqlite_connection_is_batched(const struct sl_request * request) {
+	return (request->dev_no != (dev_t) -1 || request->fs_uuid != NULL) && request->inode != (ino_t) -1 && request->path_pattern == NULL && request->path == NULL;
+}
+
+static int sl_database_sqlite_connection_find_files_in(struct sl_database_sqlite_connection_private * self, sqlite3 * db, struct sl_database_sqlite_queries * queries, int host_id, struct sl_request * requests, unsigned int nb_requests, struct sl_result_builder ** builders) {
+	/**
+	 * Requests are loaded into a temporary table, then resolved by one join
+	 * which uses the same indexes as find_file, request by request.
+	 * Temporary tables can be written even with a read only connection.
+	 */
+	int failed = sl_database_sqlite_util_exec(db, "SAVEPOINT lookup");
+	if (failed)
+		return failed;
+
+	failed = sl_database_sqlite_util_exec(db, "CREATE TEMP TABLE IF NOT EXISTS lookup (id INTEGER PRIMARY KEY, dev_no INTEGER NOT NULL, inode INTEGER NOT NULL, session_min INTEGER NOT NULL, session_max INTEGER NOT NULL, fs_uuid TEXT NULL)");
+	// requests are probed for each filesystem of each session
+	if (!failed)
+		failed = sl_database_sqlite_util_exec(db, "CREATE INDEX IF NOT EXISTS temp.lookup_inode ON lookup(dev_no, inode)");
+
+	static const char * query_insert = "INSERT INTO temp.lookup(id, dev_no, inode, session_min, session_max, fs_uuid) VALUES (?1, ?2, ?3, ?4, ?5, ?6)";
+	sqlite3_stmt * stmt_insert = NULL;
+	if (!failed) {
+		stmt_insert = sl_database_sqlite_util_prepare(db, queries, sl_database_sqlite_query_insert_lookup, query_insert);
+		if (stmt_insert == NULL) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'insert into lookup'");
+			failed = 1;
+		}
+	}
+
+	unsigned int i;
+	for (i = 0; !failed && i < nb_requests; i++) {
+		const struct sl_request * request = requests + i;
+		if (!sl_database_sqlite_connection_is_batched(request))
+			continue;
+
+		int session_min = 0, session_max = 0;
+		if (request->session_min_id < request->session_max_id) {
+			session_min = request->session_min_id;
+			session_max = request->session_max_id;
+		} else if (request->session_min_id > 0)
+			session_min = session_max = request->session_min_id;
+
+		sqlite3_bind_int(stmt_insert, 1, i);
+		// -1 when only the uuid of filesystem is known
+		sqlite3_bind_int(stmt_insert, 2, request->dev_no);
+		sqlite3_bind_int64(stmt_insert, 3, request->inode);
+		sqlite3_bind_int(stmt_insert, 4, session_min);
+		sqlite3_bind_int(stmt_insert, 5, session_max);
+		if (request->fs_uuid != NULL)
+			sqlite3_bind_text(stmt_insert, 6, request->fs_uuid, -1, SQLITE_STATIC);
+		else
+			sqlite3_bind_null(stmt_insert, 6);
+
+		failed = sqlite3_step(stmt_insert) != SQLITE_DONE;
+		sqlite3_reset(stmt_insert);
+
+		if (failed)
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to insert into lookup because %s", sqlite3_errmsg(db));
+	}
+
+	enum sl_database_sqlite_query id = self->has_filters ? sl_database_sqlite_query_find_batch_filter : sl_database_sqlite_query_find_batch;
+	sqlite3_stmt * stmt_select = NULL;
+	if (!failed) {
+		char * query = NULL;
+		if (queries->statements[id] == NULL) {
+			const char * path_column = "f.path";
+			if (self->config->path_storage == sl_database_sqlite_path_storage_tree)
+				path_column = "f.id";
+			else if (self->config->path_compression != sl_database_sqlite_path_compression_none)
+				path_column = "sl_decompress_path(f.path, f.s2fs)";
+
+			const char * file_join = "s2fs.id = f.s2fs";
+			if (self->config->file_storage == sl_database_sqlite_file_storage_delta)
+				file_join = "s2fs.filesystem = f.filesystem AND s.id BETWEEN f.first_session AND f.last_session";
+
+			query = sqlite3_mprintf("SELECT l.id, s.id, s.start_time, s.end_time, fs.id, fs.uuid, fs.label, s2fs.dev_no, s2fs.mount_point, f.inode, %s, f.mode, f.uid, f.gid, f.size, f.access_time, f.modif_time FROM temp.lookup l INNER JOIN session s ON s.host = ?1 AND s.end_time IS NOT NULL AND (l.session_min < 1 OR s.id BETWEEN l.session_min AND l.session_max) INNER JOIN session2filesystem s2fs ON s.id = s2fs.session AND (l.dev_no < 0 OR s2fs.dev_no = l.dev_no OR (l.fs_uuid IS NOT NULL AND NOT EXISTS (SELECT 1 FROM session2filesystem o WHERE o.session = s2fs.session AND o.filesystem = s2fs.filesystem AND o.dev_no = l.dev_no))) INNER JOIN filesystem fs ON s2fs.filesystem = fs.id AND (l.fs_uuid IS NULL OR fs.uuid = l.fs_uuid)%s INNER JOIN file f ON %s AND f.inode = l.inode%s ORDER BY l.id, s.id DESC", path_column, self->has_filters ? " LEFT JOIN session_filter flt ON s2fs.id = flt.s2fs" : "", file_join, self->has_filters ? " WHERE sl_filter_contains(flt.data, l.inode)" : "");
+		}
+
+		stmt_select = sl_database_sqlite_util_prepare(db, queries, id, query);
+		sqlite3_free(query);
+
+		if (stmt_select == NULL) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'get files'");
+			failed = 1;
+		}
+	}
+
+	if (!failed) {
+		sqlite3_bind_int(stmt_select, 1, host_id);
+
+		struct sl_hashtable * paths = NULL;
+		if (self->config->path_storage == sl_database_sqlite_path_storage_tree)
+			paths = sl_hashtable_new2(sl_string_compute_hash, sl_util_basic_free);
+
+		int status;
+		while (!failed && (status = sqlite3_step(stmt_select)) == SQLITE_ROW) {
+			struct sl_result_file file;
+			sl_database_sqlite_connection_fill_result(db, queries, paths, stmt_select, 1, &file);
+			failed = sl_result_builder_add(builders[sqlite3_column_int(stmt_select, 0)], &file);
+		}
+
+		if (!failed && status != SQLITE_DONE) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to get files because %s", sqlite3_errmsg(db));
+			failed = 1;
+		}
+
+		sqlite3_reset(stmt_select);
+		sl_hashtable_free(paths);
+	}
+
+	// requests are not kept between lookups
+	if (sl_database_sqlite_util_exec(db, "DELETE FROM temp.lookup"))
+		failed = 1;
+	if (sl_database_sqlite_util_exec(db, "RELEASE lookup"))
+		failed = 1;
+
+	return failed;
+}
+
+static sqlite3_stmt * sl_database_sqlite_connection_find_in(sqlite3 * db, struct sl_database_sqlite_queries * queries, struct sl_database_sqlite_config_private * config, bool use_filters, bool use_search_index, int host_id, struct sl_request * request) {
+	/**
+	 * With path_storage = tree, paths are rebuilt from id of files.
+	 * With path_compression = zstd, only returned paths are decompressed.
+	 * With file_storage = delta, a file belongs to each session of its range.
+	 * Filters skip filesystems which can not contain the inode, before joining table file.
+	 * Path patterns are resolved by index path_index when it exists, except regular expressions
+	 * which are checked on each path. With path_storage = tree, they are checked by the cursor
+	 * once paths are rebuilt.
+	 * A path, or the files under a directory, are a range of index path_order. With path_storage
+	 * = tree, nodes are found from roots by their names then, their children by index parent, and
+	 * files are fetched by id.
+	 * Compressed paths are only sorted by their compressed value, so a directory is listed by
+	 * decompressing each path of sessions which match.
+	 * Inner joins let sqlite start from index session_host and walk sessions
+	 * already sorted by id, so 'ORDER BY' needs no temporary b-tree.
+	 */
+	bool filter = use_filters && request->inode != (ino_t) -1;
+
+	// statements are prepared once by combination of filters
+	int session_filter = 0;
+	if (request->session_min_id < request->session_max_id)
+		session_filter = 1;
+	else if (request->session_min_id > 0)
+		session_filter = 2;
+
+	int inode_filter = 0;
+	if (request->inode != (ino_t) -1)
+		inode_filter = filter ? 2 : 1;
+
+	// a glob goes through path_index only while the index is up to date
+	int pattern_filter = 0;
+	if (request->path_pattern != NULL && request->path_regex)
+		pattern_filter = 2;
+	else if (request->path_pattern != NULL)
+		pattern_filter = use_search_index ? 3 : 1;
+
+	// files under root are every file but root
+	int path_filter = 0;
+	if (request->path != NULL) {
+		if (!request->path_subtree)
+			path_filter = 1;
+		else if (strspn(request->path, "/") < strlen(request->path))
+			path_filter = 2;
+		else
+			path_filter = 3;
+	}
+
+	enum sl_database_sqlite_query id = sl_database_sqlite_query_find + ((((session_filter * 2 + (request->dev_no != (dev_t) -1)) * 2 + (request->fs_uuid != NULL)) * 4 + pattern_filter) * 4 + path_filter) * 3 + inode_filter;
+
+	char * query = NULL;
+	if (queries->statements[id] == NULL) {
+		const char * path_column = "f.path";
+		if (config->path_storage == sl_database_sqlite_path_storage_tree)
+			path_column = "f.id";
+		else if (config->path_compression != sl_database_sqlite_path_compression_none)
+			path_column = "sl_decompress_path(f.path, f.s2fs)";
+
+		const char * file_join = "s2fs.id = f.s2fs";
+		if (config->file_storage == sl_database_sqlite_file_storage_delta)
+			file_join = "s2fs.filesystem = f.filesystem AND s.id BETWEEN f.first_session AND f.last_session";
+		else if (config->path_storage == sl_database_sqlite_path_storage_tree && (path_filter == 1 || path_filter == 2))
+			file_join = "s2fs.id = +f.s2fs";
+
+		query = sqlite3_mprintf("SELECT s.id, s.start_time, s.end_time, fs.id, fs.uuid, fs.label, s2fs.dev_no, s2fs.mount_point, f.inode, %s, f.mode, f.uid, f.gid, f.size, f.access_time, f.modif_time FROM session s INNER JOIN session2filesystem s2fs ON s.id = s2fs.session INNER JOIN filesystem fs ON s2fs.filesystem = fs.id%s INNER JOIN file f ON %s WHERE s.host = ?1 AND s.end_time IS NOT NULL", path_column, filter ? " LEFT JOIN session_filter flt ON s2fs.id = flt.s2fs" : "", file_join);
+		// predicates on session and filesystem also select roots of nodes
+		size_t s2fs_begin = strlen(query);
+		int i_param = 2;
+		if (request->session_min_id < request->session_max_id) {
+			char * tmp = query;
+			query = sqlite3_mprintf("%s AND s.id BETWEEN ?%d AND ?%d", query, i_param, i_param + 1);
+			sqlite3_free(tmp);
+			i_param += 2;
+		} else if (request->session_min_id > 0) {
+			char * tmp = query;
+			query = sqlite3_mprintf("%s AND s.id = ?%d", query, i_param);
+			sqlite3_free(tmp);
+			i_param++;
+		}
+
+		// with uuid, device number only chooses between filesystems which share it, like subvolumes of btrfs
+		if (request->dev_no != (dev_t) -1 && request->fs_uuid != NULL) {
+			char * tmp = query;
+			query = sqlite3_mprintf("%s AND (s2fs.dev_no = ?%d OR NOT EXISTS (SELECT 1 FROM session2filesystem o WHERE o.session = s2fs.session AND o.filesystem = s2fs.filesystem AND o.dev_no = ?%d))", query, i_param, i_param);
+			sqlite3_free(tmp);
+			i_param++;
+		} else if (request->dev_no != (dev_t) -1) {
+			char * tmp = query;
+			query = sqlite3_mprintf("%s AND s2fs.dev_no = ?%d", query, i_param);
+			sqlite3_free(tmp);
+			i_param++;
+		}
+
+		// uuid of filesystem does not change when its device number does
+		if (request->fs_uuid != NULL) {
+			char * tmp = query;
+			query = sqlite3_mprintf("%s AND fs.uuid = ?%d", query, i_param);
+			sqlite3_free(tmp);
+			i_param++;
+		}
+
+		char * s2fs_predicates = sqlite3_mprintf("%s", query + s2fs_begin);
+
+		if (request->path_pattern != NULL && config->path_storage != sl_database_sqlite_path_storage_tree) {
+			char * tmp = query;
+			if (request->path_regex)
+				query = sqlite3_mprintf("%s AND %s REGEXP ?%d", query, path_column, i_param);
+			else if (use_search_index)
+				query = sqlite3_mprintf("%s AND f.rowid IN (SELECT rowid FROM path_index WHERE path GLOB ?%d)", query, i_param);
+			else
+				query = sqlite3_mprintf("%s AND %s GLOB ?%d", query, path_column, i_param);
+			sqlite3_free(tmp);
+			i_param++;
+		}
+
+		if (path_filter > 0) {
+			static const char * find_node = "WITH RECURSIVE node(id, rest) AS (SELECT id, ?%d FROM file WHERE parent IS NULL AND s2fs IN (SELECT s2fs.id FROM session s INNER JOIN session2filesystem s2fs ON s.id = s2fs.session INNER JOIN filesystem fs ON s2fs.filesystem = fs.id WHERE s.host = ?1 AND s.end_time IS NOT NULL%s) UNION ALL SELECT c.id, substr(node.rest, instr(node.rest || '/', '/') + 1) FROM node INNER JOIN file c ON c.parent = node.id AND c.name = substr(node.rest, 1, instr(node.rest || '/', '/') - 1) WHERE node.rest <> '')";
+
+			char * tmp = query;
+			if (config->path_storage == sl_database_sqlite_path_storage_tree) {
+				char * nodes = sqlite3_mprintf(find_node, i_param, s2fs_predicates);
+				if (path_filter == 1)
+					query = sqlite3_mprintf("%s AND f.id IN (%s SELECT id FROM node WHERE rest = '')", query, nodes);
+				else if (path_filter == 2)
+					query = sqlite3_mprintf("%s AND f.id IN (%s, under(id) AS (SELECT c.id FROM node INNER JOIN file c ON c.parent = node.id WHERE node.rest = '' UNION ALL SELECT c.id FROM under INNER JOIN file c ON c.parent = under.id) SELECT id FROM under)", query, nodes);
+				else
+					query = sqlite3_mprintf("%s AND f.parent IS NOT NULL", query);
+				sqlite3_free(nodes);
+			} else if (path_filter == 1 && config->path_compression != sl_database_sqlite_path_compression_none)
+				// rows of a session not compressed yet keep their path as text
+				query = sqlite3_mprintf("%s AND f.path IN (?%d, sl_compress_path(?%d, s2fs.id))", query, i_param, i_param);
+			else if (path_filter == 1)
+				query = sqlite3_mprintf("%s AND f.path = ?%d", query, i_param);
+			else if (path_filter == 2)
+				query = sqlite3_mprintf("%s AND %s >= ?%d AND %s < ?%d", query, path_column, i_param, path_column, i_param + 1);
+			else
+				query = sqlite3_mprintf("%s AND %s <> '/'", query, path_column);
+			sqlite3_free(tmp);
+
+			if (path_filter == 2 && config->path_storage == sl_database_sqlite_path_storage_text)
+				i_param += 2;
+			else if (path_filter < 3)
+				i_param++;
+		}
+		sqlite3_free(s2fs_predicates);
+
+		if (request->inode != (ino_t) -1) {
+			char * tmp = query;
+			if (filter)
+				query = sqlite3_mprintf("%s AND sl_filter_contains(flt.data, ?%d) AND f.inode = ?%d", query, i_param, i_param);
+			else
+				query = sqlite3_mprintf("%s AND f.inode = ?%d", query, i_param);
+			sqlite3_free(tmp);
+			i_param++;
+		}
 
-	if (request->inode != (ino_t) -1) {
 		char * tmp = query;
-		query = sqlite3_mprintf("%s AND f.inode = ?%d", query, i_param);
+		query = sqlite3_mprintf("%s ORDER BY s.id DESC LIMIT ?%d", query, i_param);
 		sqlite3_free(tmp);
-		i_param++;
 	}
 
-	char * tmp = query;
-	query = sqlite3_mprintf("%s ORDER BY s.id DESC", query);
-	sqlite3_free(tmp);
-
-	sqlite3_stmt * stmt_select = sl_database_sqlite_connection_prepare(self, query);
+	sqlite3_stmt * stmt_select = sl_database_sqlite_util_prepare(db, queries, id, query);
 	sqlite3_free(query);
 
 	if (stmt_select == NULL) {
@@ -591,7 +2421,7 @@ static struct sl_result_files * sl_database_sqlite_connection_find(struct sl_dat
 	}
 
 	sqlite3_bind_int(stmt_select, 1, host_id);
-	i_param = 2;
+	int i_param = 2;
 	if (request->session_min_id < request->session_max_id) {
 		sqlite3_bind_int(stmt_select, i_param, request->session_min_id);
 		sqlite3_bind_int(stmt_select, i_param + 1, request->session_max_id);
@@ -606,79 +2436,343 @@ static struct sl_result_files * sl_database_sqlite_connection_find(struct sl_dat
 		i_param++;
 	}
 
+	if (request->fs_uuid != NULL) {
+		sqlite3_bind_text(stmt_select, i_param, request->fs_uuid, -1, SQLITE_STATIC);
+		i_param++;
+	}
+
+	if (request->path_pattern != NULL && config->path_storage != sl_database_sqlite_path_storage_tree) {
+		sqlite3_bind_text(stmt_select, i_param, request->path_pattern, -1, SQLITE_STATIC);
+		i_param++;
+	}
+
+	if (path_filter == 1 || path_filter == 2) {
+		// a directory is given without trailing '/'
+		size_t length = strlen(request->path);
+		while (path_filter == 2 && request->path[length - 1] == '/')
+			length--;
+
+		if (config->path_storage == sl_database_sqlite_path_storage_tree) {
+			// names are looked for from root of filesystem
+			if (!strcmp(request->path, "/"))
+				length = 0;
+			sqlite3_bind_text(stmt_select, i_param, request->path, length, SQLITE_TRANSIENT);
+			i_param++;
+		} else if (path_filter == 1) {
+			sqlite3_bind_text(stmt_select, i_param, request->path, -1, SQLITE_STATIC);
+			i_param++;
+		} else {
+			// files under 'dir' are sorted from 'dir/' and before 'dir0', '0' follows '/'
+			char * first, * last;
+			asprintf(&first, "%.*s/", (int) length, request->path);
+			asprintf(&last, "%.*s0", (int) length, request->path);
+			sqlite3_bind_text(stmt_select, i_param, first, -1, free);
+			sqlite3_bind_text(stmt_select, i_param + 1, last, -1, free);
+			i_param += 2;
+		}
+	}
+
 	if (request->inode != (ino_t) -1) {
-		sqlite3_bind_int(stmt_select, i_param, request->inode);
+		sqlite3_bind_int64(stmt_select, i_param, request->inode);
 		i_param++;
 	}
 
-	int failed = sqlite3_step(stmt_select);
-	struct sl_result_files * result = NULL;
-	if (failed == SQLITE_ROW) {
-		result = malloc(sizeof(struct sl_result_files));
-		result->files = NULL;
-		result->nb_files = 0;
+	// each database needs at most 'limit' rows, unless older rows are merged into kept ones
+	// or rows are skipped by cursor
+	bool checked_by_cursor = request->path_pattern != NULL && config->path_storage == sl_database_sqlite_path_storage_tree;
+	if (request->limit > 0 && !request->collapse && !checked_by_cursor)
+		sqlite3_bind_int(stmt_select, i_param, request->limit);
+	else
+		sqlite3_bind_int(stmt_select, i_param, -1);
 
+	return stmt_select;
+}
+
+static sqlite3_int64 sl_database_sqlite_connection_find_node(sqlite3 * db, struct sl_database_sqlite_queries * queries, int session_id, int fs_id, const char * path) {
+	static const char * query_root = "SELECT id FROM file WHERE parent IS NULL AND +s2fs IN (SELECT id FROM session2filesystem WHERE session = ?1 AND filesystem = ?2) LIMIT 1";
+	sqlite3_stmt * stmt_root = sl_database_sqlite_util_prepare(db, queries, sl_database_sqlite_query_get_root, query_root);
+	if (stmt_root == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'get root'");
+		return -1;
+	}
+
+	sqlite3_bind_int(stmt_root, 1, session_id);
+	sqlite3_bind_int(stmt_root, 2, fs_id);
+
+	sqlite3_int64 id = 0;
+	if (sqlite3_step(stmt_root) == SQLITE_ROW)
+		id = sqlite3_column_int64(stmt_root, 0);
+	sqlite3_reset(stmt_root);
+
+	if (id < 1 || !strcmp(path, "/"))
+		return id;
+
+	static const char * query_child = "SELECT id FROM file WHERE parent = ?1 AND name = ?2 LIMIT 1";
+	sqlite3_stmt * stmt_child = sl_database_sqlite_util_prepare(db, queries, sl_database_sqlite_query_get_child, query_child);
+	if (stmt_child == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'get child'");
+		return -1;
+	}
+
+	char * components = strdup(path);
+	char * save_ptr = NULL;
+	char * name;
+	for (name = strtok_r(components, "/", &save_ptr); name != NULL && id > 0; name = strtok_r(NULL, "/", &save_ptr)) {
+		sqlite3_bind_int64(stmt_child, 1, id);
+		sqlite3_bind_text(stmt_child, 2, name, -1, SQLITE_STATIC);
+
+		id = 0;
+		if (sqlite3_step(stmt_child) == SQLITE_ROW)
+			id = sqlite3_column_int64(stmt_child, 0);
+		sqlite3_reset(stmt_child);
+	}
+	free(components);
+
+	return id;
+}
+
+static const char * sl_database_sqlite_connection_get_path(sqlite3 * db, struct sl_database_sqlite_queries * queries, struct sl_hashtable * paths, sqlite3_int64 id) {
+	char key[24];
+	snprintf(key, 24, "%lld", id);
+
+	struct sl_hashtable_value val = sl_hashtable_get(paths, key);
+	if (val.type == sl_hashtable_value_string)
+		return val.value.string;
+
+	static const char * query = "SELECT parent, name FROM file WHERE id = ?1";
+	sqlite3_stmt * stmt_select = sl_database_sqlite_util_prepare(db, queries, sl_database_sqlite_query_get_node, query);
+	if (stmt_select == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'get parent'");
+		return NULL;
+	}
+
+	sqlite3_bind_int64(stmt_select, 1, id);
+	if (sqlite3_step(stmt_select) != SQLITE_ROW) {
+		sqlite3_reset(stmt_select);
+		return NULL;
+	}
+
+	// statement is reused by recursive calls
+	sqlite3_int64 parent = sqlite3_column_int64(stmt_select, 0);
+	char * path = strdup((const char *) sqlite3_column_text(stmt_select, 1));
+	sqlite3_reset(stmt_select);
+
+	// root of filesystem is named "/"
+	if (parent > 0) {
+		const char * parent_path = sl_database_sqlite_connection_get_path(db, queries, paths, parent);
+		if (parent_path == NULL) {
+			free(path);
+			return NULL;
+		}
+
+		if (strcmp(parent_path, "/")) {
+			char * name = path;
+			asprintf(&path, "%s/%s", parent_path, name);
+			free(name);
+		}
+	}
+
+	sl_hashtable_put(paths, strdup(key), sl_hashtable_val_string(path));
+
+	return path;
+}
+
+static struct sl_result_files * sl_database_sqlite_connection_get_ancestors(struct sl_database_connection * connect, int session_id, int fs_id, const char * path) {
+	struct sl_database_sqlite_connection_private * self = connect->data;
+
+	sqlite3 * db;
+	struct sl_database_sqlite_queries * queries;
+	if (sl_database_sqlite_connection_get_file_db(self, session_id, fs_id, &db, &queries))
+		return NULL;
+
+	return sl_database_sqlite_connection_get_ancestors_in(db, queries, self->config, session_id, fs_id, path);
+}
+
+static struct sl_result_files * sl_database_sqlite_connection_get_ancestors_in(sqlite3 * db, struct sl_database_sqlite_queries * queries, struct sl_database_sqlite_config_private * config, int session_id, int fs_id, const char * path) {
+	struct sl_result_builder * builder = sl_result_builder_new();
+
+	// ancestors of 'a/b/c' are 'a' and 'a/b'
+	char * parent = strdup(path);
+	char * last = strrchr(parent, '/');
+	if (last == NULL || last == parent) {
+		free(parent);
+		return sl_result_builder_finish(builder);
+	}
+	*last = '\0';
+
+	if (config->path_storage == sl_database_sqlite_path_storage_tree || config->path_compression != sl_database_sqlite_path_compression_none) {
+		// nodes and compressed paths are resolved one by one
+		char * slash = parent;
+		int failed = 0;
 		do {
-			void * new_addr = realloc(result->files, (result->nb_files + 1) * sizeof(struct sl_result_file));
-			if (new_addr == NULL) {
-				sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: not enough memory to get result");
-				sl_result_files_free(result);
-				return NULL;
+			slash = strchr(slash + 1, '/');
+			if (slash != NULL)
+				*slash = '\0';
+
+			struct sl_result_file * file = sl_database_sqlite_connection_get_file_info_in(db, queries, config, session_id, fs_id, parent);
+			if (file != NULL) {
+				failed = sl_result_builder_add(builder, file);
+				sl_result_file_free(file);
+				free(file);
 			}
 
-			result->files = new_addr;
-			struct sl_result_file * file = result->files + result->nb_files;
-			result->nb_files++;
-
-			file->session_id = sqlite3_column_int(stmt_select, 0);
-			file->session_start = sl_database_sqlite_util_convert_to_time((const char *) sqlite3_column_text(stmt_select, 1));
-			file->session_end = sl_database_sqlite_util_convert_to_time((const char *) sqlite3_column_text(stmt_select, 2));
-
-			file->fs_id = sqlite3_column_int(stmt_select, 3);
-			file->fs_uuid = strdup((const char *) sqlite3_column_text(stmt_select, 4));
-			file->fs_label = NULL;
-			const char * fs_label = (const char *) sqlite3_column_text(stmt_select, 5);
-			if (fs_label != NULL)
-				file->fs_label = strdup(fs_label);
-
-			file->dev_no = sqlite3_column_int(stmt_select, 6);
-			file->mount_point = strdup((const char *) sqlite3_column_text(stmt_select, 7));
-
-			file->inode = sqlite3_column_int64(stmt_select, 8);
-			file->path = strdup((const char *) sqlite3_column_text(stmt_select, 9));
-			file->mode = sqlite3_column_int(stmt_select, 10);
-			file->uid = sqlite3_column_int(stmt_select, 11);
-			file->gid = sqlite3_column_int(stmt_select, 12);
-			file->size = sqlite3_column_int64(stmt_select, 13);
-			file->atime = sl_database_sqlite_util_convert_to_time((const char *) sqlite3_column_text(stmt_select, 14));
-			file->mtime = sl_database_sqlite_util_convert_to_time((const char *) sqlite3_column_text(stmt_select, 15));
-
-			failed = sqlite3_step(stmt_select);
-		} while (failed == SQLITE_ROW);
-	} else if (failed == SQLITE_DONE) {
-		result = malloc(sizeof(struct sl_result_files));
-		result->files = NULL;
-		result->nb_files = 0;
+			if (slash != NULL)
+				*slash = '/';
+		} while (!failed && slash != NULL);
+
+		free(parent);
+
+		if (failed) {
+			sl_result_builder_free(builder);
+			return NULL;
+		}
+
+		return sl_result_builder_finish(builder);
 	}
 
-	return result;
+	enum sl_database_sqlite_query id = sl_database_sqlite_query_get_ancestors_text;
+	const char * query = "WITH RECURSIVE ancestor(path, rest) AS (SELECT substr(?3, 1, instr(?3 || '/', '/') - 1), substr(?3, instr(?3 || '/', '/') + 1) UNION ALL SELECT path || '/' || substr(rest, 1, instr(rest || '/', '/') - 1), substr(rest, instr(rest || '/', '/') + 1) FROM ancestor WHERE rest <> '') SELECT s.id, s.start_time, s.end_time, fs.id, fs.uuid, fs.label, s2fs.dev_no, s2fs.mount_point, f.inode, f.path, f.mode, f.uid, f.gid, f.size, f.access_time, f.modif_time FROM session s INNER JOIN session2filesystem s2fs ON s.id = s2fs.session INNER JOIN filesystem fs ON s2fs.filesystem = fs.id INNER JOIN file f ON s2fs.id = f.s2fs WHERE s.id = ?1 AND s.end_time IS NOT NULL AND s2fs.filesystem = ?2 AND f.path IN (SELECT path FROM ancestor) ORDER BY length(f.path)";
+	if (config->file_storage == sl_database_sqlite_file_storage_delta) {
+		id = sl_database_sqlite_query_get_ancestors_delta;
+		query = "WITH RECURSIVE ancestor(path, rest) AS (SELECT substr(?3, 1, instr(?3 || '/', '/') - 1), substr(?3, instr(?3 || '/', '/') + 1) UNION ALL SELECT path || '/' || substr(rest, 1, instr(rest || '/', '/') - 1), substr(rest, instr(rest || '/', '/') + 1) FROM ancestor WHERE rest <> '') SELECT s.id, s.start_time, s.end_time, fs.id, fs.uuid, fs.label, s2fs.dev_no, s2fs.mount_point, f.inode, f.path, f.mode, f.uid, f.gid, f.size, f.access_time, f.modif_time FROM session s INNER JOIN session2filesystem s2fs ON s.id = s2fs.session INNER JOIN filesystem fs ON s2fs.filesystem = fs.id INNER JOIN file f ON s2fs.filesystem = f.filesystem AND s.id BETWEEN f.first_session AND f.last_session WHERE s.id = ?1 AND s.end_time IS NOT NULL AND s2fs.filesystem = ?2 AND f.path IN (SELECT path FROM ancestor) ORDER BY length(f.path)";
+	}
+
+	sqlite3_stmt * stmt_select = sl_database_sqlite_util_prepare(db, queries, id, query);
+	if (stmt_select == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'get ancestors'");
+		sl_result_builder_free(builder);
+		free(parent);
+		return NULL;
+	}
+
+	sqlite3_bind_int(stmt_select, 1, session_id);
+	sqlite3_bind_int(stmt_select, 2, fs_id);
+	sqlite3_bind_text(stmt_select, 3, parent, -1, SQLITE_STATIC);
+
+	int failed = 0, status;
+	while (!failed && (status = sqlite3_step(stmt_select)) == SQLITE_ROW) {
+		struct sl_result_file file;
+		sl_database_sqlite_connection_fill_result(db, queries, NULL, stmt_select, 0, &file);
+		failed = sl_result_builder_add(builder, &file);
+	}
+	sqlite3_reset(stmt_select);
+	free(parent);
+
+	if (!failed && status != SQLITE_DONE) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while fetching ancestors because %s", sqlite3_errmsg(db));
+		failed = 1;
+	}
+
+	if (failed) {
+		sl_result_builder_free(builder);
+		return NULL;
+	}
+
+	return sl_result_builder_finish(builder);
+}
+
+static int sl_database_sqlite_connection_get_file_db(struct sl_database_sqlite_connection_private * self, int session_id, int fs_id, sqlite3 ** db, struct sl_database_sqlite_queries ** queries) {
+	if (self->db_handler == NULL)
+		return 1;
+
+	if (self->config->layout == sl_database_sqlite_layout_single) {
+		*db = self->db_handler;
+		*queries = self->prepared_queries;
+		return 0;
+	}
+
+	struct sl_database_sqlite_store * store = NULL;
+	if (self->config->layout == sl_database_sqlite_layout_session)
+		store = sl_database_sqlite_connection_get_session_store(self, session_id, false);
+	else {
+		static const char * query = "SELECT uuid FROM filesystem WHERE id = ?1 LIMIT 1";
+		sqlite3_stmt * stmt_select = sl_database_sqlite_util_prepare(self->db_handler, self->prepared_queries, sl_database_sqlite_query_get_filesystem_uuid, query);
+		if (stmt_select == NULL) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'get filesystem'");
+			return 1;
+		}
+
+		sqlite3_bind_int(stmt_select, 1, fs_id);
+
+		if (sqlite3_step(stmt_select) == SQLITE_ROW)
+			store = sl_database_sqlite_connection_get_store(self, (const char *) sqlite3_column_text(stmt_select, 0), false);
+		sqlite3_reset(stmt_select);
+	}
+
+	if (store == NULL || sl_database_sqlite_store_attach_meta(store, self->config->path))
+		return 1;
+
+	*db = store->db_handler;
+	*queries = store->prepared_queries;
+	return 0;
 }
 
 static struct sl_result_file * sl_database_sqlite_connection_get_file_info(struct sl_database_connection * connect, int session_id, int fs_id, const char * path) {
 	struct sl_database_sqlite_connection_private * self = connect->data;
-	if (self->db_handler == NULL)
+
+	sqlite3 * db;
+	struct sl_database_sqlite_queries * queries;
+	if (sl_database_sqlite_connection_get_file_db(self, session_id, fs_id, &db, &queries))
 		return NULL;
 
-	char * query = "SELECT s.id, s.start_time, s.end_time, fs.id, fs.uuid, fs.label, s2fs.dev_no, s2fs.mount_point, f.inode, f.path, f.mode, f.uid, f.gid, f.size, f.access_time, f.modif_time FROM session s LEFT JOIN session2filesystem s2fs ON s.id = s2fs.session LEFT JOIN filesystem fs ON s2fs.filesystem = fs.id LEFT JOIN file f ON s2fs.id = f.s2fs WHERE s.id = ?1 AND s2fs.filesystem = ?2 AND f.path = ?3 LIMIT 1";
-	sqlite3_stmt * stmt_select = sl_database_sqlite_connection_prepare(self, query);
+	return sl_database_sqlite_connection_get_file_info_in(db, queries, self->config, session_id, fs_id, path);
+}
+
+static struct sl_result_file * sl_database_sqlite_connection_get_file_info_in(sqlite3 * db, struct sl_database_sqlite_queries * queries, struct sl_database_sqlite_config_private * config, int session_id, int fs_id, const char * path) {
+	sqlite3_int64 file_id = 0;
+	if (config->path_storage == sl_database_sqlite_path_storage_tree) {
+		file_id = sl_database_sqlite_connection_find_node(db, queries, session_id, fs_id, path);
+		if (file_id < 1)
+			return NULL;
+	}
+
+	// compressed paths are compared without being decompressed
+	sqlite3_stmt * stmt_compress = NULL;
+	if (config->path_compression != sl_database_sqlite_path_compression_none) {
+		static const char * query_compress = "SELECT sl_compress_path(?3, s2fs.id) FROM session2filesystem s2fs WHERE s2fs.session = ?1 AND s2fs.filesystem = ?2 LIMIT 1";
+		stmt_compress = sl_database_sqlite_util_prepare(db, queries, sl_database_sqlite_query_compress_path, query_compress);
+		if (stmt_compress == NULL) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'compress path'");
+			return NULL;
+		}
+
+		sqlite3_bind_int(stmt_compress, 1, session_id);
+		sqlite3_bind_int(stmt_compress, 2, fs_id);
+		sqlite3_bind_text(stmt_compress, 3, path, -1, SQLITE_STATIC);
+
+		if (sqlite3_step(stmt_compress) != SQLITE_ROW) {
+			sqlite3_reset(stmt_compress);
+			return NULL;
+		}
+	}
+
+	enum sl_database_sqlite_query id = sl_database_sqlite_query_get_file_info_tree;
+	const char * query = "SELECT s.id, s.start_time, s.end_time, fs.id, fs.uuid, fs.label, s2fs.dev_no, s2fs.mount_point, f.inode, f.id, f.mode, f.uid, f.gid, f.size, f.access_time, f.modif_time FROM session s INNER JOIN session2filesystem s2fs ON s.id = s2fs.session INNER JOIN filesystem fs ON s2fs.filesystem = fs.id INNER JOIN file f ON s2fs.id = f.s2fs WHERE s.id = ?1 AND s.end_time IS NOT NULL AND s2fs.filesystem = ?2 AND f.id = ?3 LIMIT 1";
+	if (config->file_storage == sl_database_sqlite_file_storage_delta) {
+		id = sl_database_sqlite_query_get_file_info_delta;
+		query = "SELECT s.id, s.start_time, s.end_time, fs.id, fs.uuid, fs.label, s2fs.dev_no, s2fs.mount_point, f.inode, f.path, f.mode, f.uid, f.gid, f.size, f.access_time, f.modif_time FROM session s INNER JOIN session2filesystem s2fs ON s.id = s2fs.session INNER JOIN filesystem fs ON s2fs.filesystem = fs.id INNER JOIN file f ON s2fs.filesystem = f.filesystem AND s.id BETWEEN f.first_session AND f.last_session WHERE s.id = ?1 AND s.end_time IS NOT NULL AND s2fs.filesystem = ?2 AND f.path = ?3 LIMIT 1";
+	} else if (config->path_storage == sl_database_sqlite_path_storage_text) {
+		id = sl_database_sqlite_query_get_file_info_text;
+		query = "SELECT s.id, s.start_time, s.end_time, fs.id, fs.uuid, fs.label, s2fs.dev_no, s2fs.mount_point, f.inode, f.path, f.mode, f.uid, f.gid, f.size, f.access_time, f.modif_time FROM session s INNER JOIN session2filesystem s2fs ON s.id = s2fs.session INNER JOIN filesystem fs ON s2fs.filesystem = fs.id INNER JOIN file f ON s2fs.id = f.s2fs WHERE s.id = ?1 AND s.end_time IS NOT NULL AND s2fs.filesystem = ?2 AND f.path = ?3 LIMIT 1";
+	}
+
+	sqlite3_stmt * stmt_select = sl_database_sqlite_util_prepare(db, queries, id, query);
 	if (stmt_select == NULL) {
 		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'get file info'");
+		if (stmt_compress != NULL)
+			sqlite3_reset(stmt_compress);
 		return NULL;
 	}
 
 	sqlite3_bind_int(stmt_select, 1, session_id);
 	sqlite3_bind_int(stmt_select, 2, fs_id);
-	sqlite3_bind_text(stmt_select, 3, path, -1, SQLITE_STATIC);
+	if (config->path_storage == sl_database_sqlite_path_storage_tree)
+		sqlite3_bind_int64(stmt_select, 3, file_id);
+	else if (stmt_compress != NULL) {
+		sqlite3_bind_value(stmt_select, 3, sqlite3_column_value(stmt_compress, 0));
+		sqlite3_reset(stmt_compress);
+	} else
+		sqlite3_bind_text(stmt_select, 3, path, -1, SQLITE_STATIC);
 
 	int failed = sqlite3_step(stmt_select);
 
@@ -687,8 +2781,9 @@ static struct sl_result_file * sl_database_sqlite_connection_get_file_info(struc
 		result = malloc(sizeof(struct sl_result_file));
 
 		result->session_id = sqlite3_column_int(stmt_select, 0);
-		result->session_start = sl_database_sqlite_util_convert_to_time((const char *) sqlite3_column_text(stmt_select, 1));
-		result->session_end = sl_database_sqlite_util_convert_to_time((const char *) sqlite3_column_text(stmt_select, 2));
+		result->first_session_id = result->session_id;
+		result->session_start = sl_database_sqlite_util_get_time(stmt_select, 1);
+		result->session_end = sl_database_sqlite_util_get_time(stmt_select, 2);
 
 		result->fs_id = sqlite3_column_int(stmt_select, 3);
 		result->fs_uuid = strdup((const char *) sqlite3_column_text(stmt_select, 4));
@@ -701,15 +2796,50 @@ static struct sl_result_file * sl_database_sqlite_connection_get_file_info(struc
 		result->mount_point = strdup((const char *) sqlite3_column_text(stmt_select, 7));
 
 		result->inode = sqlite3_column_int64(stmt_select, 8);
-		result->path = strdup((const char *) sqlite3_column_text(stmt_select, 9));
+		if (config->path_storage == sl_database_sqlite_path_storage_tree || config->path_compression != sl_database_sqlite_path_compression_none)
+			result->path = strdup(path);
+		else
+			result->path = strdup((const char *) sqlite3_column_text(stmt_select, 9));
 		result->mode = sqlite3_column_int(stmt_select, 10);
 		result->uid = sqlite3_column_int(stmt_select, 11);
 		result->gid = sqlite3_column_int(stmt_select, 12);
 		result->size = sqlite3_column_int64(stmt_select, 13);
-		result->atime = sl_database_sqlite_util_convert_to_time((const char *) sqlite3_column_text(stmt_select, 14));
-		result->mtime = sl_database_sqlite_util_convert_to_time((const char *) sqlite3_column_text(stmt_select, 15));
+		result->atime = sl_database_sqlite_util_get_time(stmt_select, 14);
+		result->mtime = sl_database_sqlite_util_get_time(stmt_select, 15);
 	}
 
+	// statement is cached, so it is reused by next call
+	sqlite3_reset(stmt_select);
+	sqlite3_clear_bindings(stmt_select);
+
 	return result;
 }
 
+static struct sl_result_statistics * sl_database_sqlite_connection_get_statistics(struct sl_database_connection * connect, int session_id, int fs_id) {
+	struct sl_database_sqlite_connection_private * self = connect->data;
+	if (self->db_handler == NULL || !self->has_statistics)
+		return NULL;
+
+	static const char * query = "SELECT st.nb_files, st.nb_directories, st.total_size, st.scan_duration, st.nb_errors FROM session_statistics st INNER JOIN session2filesystem s2fs ON st.s2fs = s2fs.id WHERE s2fs.session = ?1 AND s2fs.filesystem = ?2 LIMIT 1";
+	sqlite3_stmt * stmt_select = sl_database_sqlite_util_prepare(self->db_handler, self->prepared_queries, sl_database_sqlite_query_get_statistics, query);
+	if (stmt_select == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'get statistics'");
+		return NULL;
+	}
+
+	sqlite3_bind_int(stmt_select, 1, session_id);
+	sqlite3_bind_int(stmt_select, 2, fs_id);
+
+	struct sl_result_statistics * stats = NULL;
+	if (sqlite3_step(stmt_select) == SQLITE_ROW) {
+		stats = malloc(sizeof(struct sl_result_statistics));
+		stats->nb_files = sqlite3_column_int64(stmt_select, 0);
+		stats->nb_directories = sqlite3_column_int64(stmt_select, 1);
+		stats->total_size = sqlite3_column_int64(stmt_select, 2);
+		stats->scan_duration = sqlite3_column_int64(stmt_select, 3);
+		stats->nb_errors = sqlite3_column_int(stmt_select, 4);
+	}
+	sqlite3_reset(stmt_select);
+
+	return stats;
+}
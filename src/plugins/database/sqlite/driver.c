@@ -73,7 +73,7 @@ static struct sl_database_config * sl_database_sqlite_get_default_config() {
 }
 
 static int sl_database_sqlite_get_max_version_supported() {
-	return 1;
+	return 2;
 }
 
 static void sl_database_sqlite_init(void) {
@@ -0,0 +1,161 @@
+/*************************************************************************\
+*                  ______  __                 __                          *
+*                 / __/ /_/ /  ___  _______ _/ /____                      *
+*                _\ \/ __/ /__/ _ \/ __/ _ `/ __/ -_)                     *
+*               /___/\__/____/\___/\__/\_,_/\__/\__/                      *
+*                                                                         *
+*  ---------------------------------------------------------------------  *
+*  This file is a part of StLocate                                        *
+*                                                                         *
+*  StLocate is free software; you can redistribute it and/or              *
+*  modify it under the terms of the GNU General Public License            *
+*  as published by the Free Software Foundation; either version 3         *
+*  of the License, or (at your option) any later version.                 *
+*                                                                         *
+*  This program is distributed in the hope that it will be useful,        *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+*  GNU General Public License for more details.                           *
+*                                                                         *
+*  You should have received a copy of the GNU General Public License      *
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.  *
+*                                                                         *
+*  ---------------------------------------------------------------------  *
+*  Copyright (C) 2013, Clercin guillaume <gclercin@intellique.com>        *
+*  Last modified: Mon, 19 Oct 2026                                        *
+\*************************************************************************/
+
+// free, malloc, realloc
+#include <stdlib.h>
+// memset
+#include <string.h>
+
+#include <stlocate/log.h>
+
+#include "common.h"
+
+/**
+ * A filter is a Bloom filter over inodes of one session2filesystem.
+ * First byte of data is the number of hashes, next bytes are the bits.
+ */
+#define SL_DATABASE_SQLITE_FILTER_BITS_PER_INODE 10
+#define SL_DATABASE_SQLITE_FILTER_NB_HASHES 7
+
+static void sl_database_sqlite_filter_contains(sqlite3_context * context, int argc, sqlite3_value ** argv);
+static uint64_t sl_database_sqlite_filter_hash(uint64_t value);
+
+
+int sl_database_sqlite_filter_add(struct sl_database_sqlite_filter * filter, uint64_t inode) {
+	if (filter->nb_inodes == filter->max_inodes) {
+		unsigned int max_inodes = filter->max_inodes > 0 ? filter->max_inodes << 1 : 1024;
+		void * new_addr = realloc(filter->inodes, max_inodes * sizeof(uint64_t));
+		if (new_addr == NULL) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: not enough memory to add inode into filter of session2filesystem %d", filter->s2fs);
+			return -1;
+		}
+
+		filter->inodes = new_addr;
+		filter->max_inodes = max_inodes;
+	}
+
+	filter->inodes[filter->nb_inodes] = inode;
+	filter->nb_inodes++;
+
+	return 0;
+}
+
+/**
+ * sl_filter_contains(filter, inode)
+ *
+ * Return 0 only if \a inode is not into \a filter. A missing filter
+ * contains all inodes.
+ */
+static void sl_database_sqlite_filter_contains(sqlite3_context * context, int argc __attribute__((unused)), sqlite3_value ** argv) {
+	if (sqlite3_value_type(argv[0]) != SQLITE_BLOB || sqlite3_value_bytes(argv[0]) < 2) {
+		sqlite3_result_int(context, 1);
+		return;
+	}
+
+	const unsigned char * data = sqlite3_value_blob(argv[0]);
+	uint64_t nb_bits = (uint64_t) (sqlite3_value_bytes(argv[0]) - 1) << 3;
+
+	uint64_t h1 = sl_database_sqlite_filter_hash(sqlite3_value_int64(argv[1]));
+	uint64_t h2 = sl_database_sqlite_filter_hash(h1) | 1;
+
+	unsigned int i;
+	for (i = 0; i < data[0]; i++) {
+		uint64_t bit = (h1 + i * h2) % nb_bits;
+		if (!(data[1 + (bit >> 3)] & (1 << (bit & 7)))) {
+			sqlite3_result_int(context, 0);
+			return;
+		}
+	}
+
+	sqlite3_result_int(context, 1);
+}
+
+void sl_database_sqlite_filter_free(struct sl_database_sqlite_filter * filter) {
+	free(filter->inodes);
+	filter->inodes = NULL;
+	filter->nb_inodes = filter->max_inodes = 0;
+}
+
+// finalizer of splitmix64
+static uint64_t sl_database_sqlite_filter_hash(uint64_t value) {
+	value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+	return value ^ (value >> 31);
+}
+
+int sl_database_sqlite_filter_register(sqlite3 * db) {
+	int failed = sqlite3_create_function_v2(db, "sl_filter_contains", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL, sl_database_sqlite_filter_contains, NULL, NULL, NULL);
+	if (failed != SQLITE_OK)
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to register filter function because %s", sqlite3_errmsg(db));
+
+	return failed != SQLITE_OK;
+}
+
+int sl_database_sqlite_filter_write(sqlite3 * db, struct sl_database_sqlite_queries * queries, const struct sl_database_sqlite_filter * filter) {
+	uint64_t nb_bits = (uint64_t) filter->nb_inodes * SL_DATABASE_SQLITE_FILTER_BITS_PER_INODE;
+	if (nb_bits < 64)
+		nb_bits = 64;
+	nb_bits = (nb_bits + 7) & ~7ULL;
+
+	size_t length = 1 + (nb_bits >> 3);
+	unsigned char * data = malloc(length);
+	memset(data, 0, length);
+	data[0] = SL_DATABASE_SQLITE_FILTER_NB_HASHES;
+
+	unsigned int i, j;
+	for (i = 0; i < filter->nb_inodes; i++) {
+		// inodes are stored as signed integers by sqlite
+		uint64_t h1 = sl_database_sqlite_filter_hash((sqlite3_int64) filter->inodes[i]);
+		uint64_t h2 = sl_database_sqlite_filter_hash(h1) | 1;
+
+		for (j = 0; j < SL_DATABASE_SQLITE_FILTER_NB_HASHES; j++) {
+			uint64_t bit = (h1 + j * h2) % nb_bits;
+			data[1 + (bit >> 3)] |= 1 << (bit & 7);
+		}
+	}
+
+	static const char * insert = "INSERT OR REPLACE INTO session_filter(s2fs, nb_inodes, data) VALUES (?1, ?2, ?3)";
+	sqlite3_stmt * stmt_insert = sl_database_sqlite_util_prepare(db, queries, sl_database_sqlite_query_insert_filter, insert);
+	if (stmt_insert == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'insert into session_filter'");
+		free(data);
+		return -1;
+	}
+
+	sqlite3_bind_int(stmt_insert, 1, filter->s2fs);
+	sqlite3_bind_int(stmt_insert, 2, filter->nb_inodes);
+	sqlite3_bind_blob(stmt_insert, 3, data, length, free);
+
+	int failed = sqlite3_step(stmt_insert) != SQLITE_DONE;
+	if (failed)
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to insert filter of session2filesystem %d because %s", filter->s2fs, sqlite3_errmsg(db));
+	else
+		sl_log_write(sl_log_level_debug, sl_log_type_plugin_database, "Sqlite: filter of session2filesystem %d built (%u inodes, %zu bytes)", filter->s2fs, filter->nb_inodes, length);
+	sqlite3_reset(stmt_insert);
+
+	return failed;
+}
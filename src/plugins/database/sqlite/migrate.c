@@ -0,0 +1,167 @@
+/*************************************************************************\
+*                  ______  __                 __                          *
+*                 / __/ /_/ /  ___  _______ _/ /____                      *
+*                _\ \/ __/ /__/ _ \/ __/ _ `/ __/ -_)                     *
+*               /___/\__/____/\___/\__/\_,_/\__/\__/                      *
+*                                                                         *
+*  ---------------------------------------------------------------------  *
+*  This file is a part of StLocate                                        *
+*                                                                         *
+*  StLocate is free software; you can redistribute it and/or              *
+*  modify it under the terms of the GNU General Public License            *
+*  as published by the Free Software Foundation; either version 3         *
+*  of the License, or (at your option) any later version.                 *
+*                                                                         *
+*  This program is distributed in the hope that it will be useful,        *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+*  GNU General Public License for more details.                           *
+*                                                                         *
+*  You should have received a copy of the GNU General Public License      *
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.  *
+*                                                                         *
+*  ---------------------------------------------------------------------  *
+*  Copyright (C) 2013, Clercin guillaume <gclercin@intellique.com>        *
+*  Last modified: Mon, 19 Oct 2026                                        *
+\*************************************************************************/
+
+// time
+#include <time.h>
+
+#include <stlocate/log.h>
+
+#include "common.h"
+
+/**
+ * Each step converts rows which still match \a pending, so an interrupted
+ * migration is resumed by running it again. Rows are converted by batches,
+ * each batch is committed alone so lookups are never blocked for long.
+ */
+static const struct sl_database_sqlite_migration_step sl_database_sqlite_migrate_1_to_2[] = {
+	{
+		.description = "dates of sessions",
+		.scope       = sl_database_sqlite_migration_scope_main,
+		.prepare     = NULL,
+		.table       = "session",
+		.pending     = "typeof(start_time) = 'text' OR typeof(end_time) = 'text'",
+		.update      = "start_time = CASE typeof(start_time) WHEN 'text' THEN CAST(strftime('%s', start_time) AS INTEGER) ELSE start_time END, end_time = CASE typeof(end_time) WHEN 'text' THEN CAST(strftime('%s', end_time) AS INTEGER) ELSE end_time END",
+	},
+	{
+		.description = "dates of files",
+		.scope       = sl_database_sqlite_migration_scope_file,
+		.prepare     = NULL,
+		.table       = "file",
+		.pending     = "typeof(access_time) = 'text' OR typeof(modif_time) = 'text'",
+		.update      = "access_time = CASE typeof(access_time) WHEN 'text' THEN CAST(strftime('%s', access_time) AS INTEGER) ELSE access_time END, modif_time = CASE typeof(modif_time) WHEN 'text' THEN CAST(strftime('%s', modif_time) AS INTEGER) ELSE modif_time END",
+	},
+};
+
+static const struct sl_database_sqlite_migration sl_database_sqlite_migrations[] = {
+	{ 1, 2, sl_database_sqlite_migrate_1_to_2, sizeof(sl_database_sqlite_migrate_1_to_2) / sizeof(*sl_database_sqlite_migrate_1_to_2) },
+};
+
+
+const struct sl_database_sqlite_migration * sl_database_sqlite_migrate_get(int from_version) {
+	unsigned int i;
+	for (i = 0; i < sizeof(sl_database_sqlite_migrations) / sizeof(*sl_database_sqlite_migrations); i++)
+		if (sl_database_sqlite_migrations[i].from_version == from_version)
+			return sl_database_sqlite_migrations + i;
+
+	return NULL;
+}
+
+int sl_database_sqlite_migrate_step(sqlite3 * db, const char * name, const struct sl_database_sqlite_migration_step * step, unsigned int batch_size) {
+	if (step->prepare != NULL && sl_database_sqlite_util_exec(db, step->prepare))
+		return 1;
+
+	char * query = sqlite3_mprintf("SELECT COUNT(*) FROM %s WHERE %s", step->table, step->pending);
+	sqlite3_stmt * stmt_count;
+	int failed = sqlite3_prepare_v2(db, query, -1, &stmt_count, NULL);
+	sqlite3_free(query);
+
+	if (failed) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'count %s' on '%s' because %s", step->description, name, sqlite3_errmsg(db));
+		return 1;
+	}
+
+	sqlite3_int64 nb_rows = 0;
+	if (sqlite3_step(stmt_count) == SQLITE_ROW)
+		nb_rows = sqlite3_column_int64(stmt_count, 0);
+	sqlite3_finalize(stmt_count);
+
+	if (nb_rows == 0)
+		return 0;
+
+	sl_log_write(sl_log_level_notice, sl_log_type_plugin_database, "Sqlite: migrating %s of '%s' (%lld rows)", step->description, name, nb_rows);
+
+	/**
+	 * A batch is the next rows after the last converted one, so the table
+	 * is walked only once, in the order of rowid
+	 */
+	query = sqlite3_mprintf("SELECT MAX(rowid) FROM (SELECT rowid FROM %s WHERE rowid > ?1 AND (%s) ORDER BY rowid LIMIT ?2)", step->table, step->pending);
+	sqlite3_stmt * stmt_batch;
+	failed = sqlite3_prepare_v2(db, query, -1, &stmt_batch, NULL);
+	sqlite3_free(query);
+
+	if (failed) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'select batch of %s' on '%s' because %s", step->description, name, sqlite3_errmsg(db));
+		return 1;
+	}
+
+	query = sqlite3_mprintf("UPDATE %s SET %s WHERE rowid > ?1 AND rowid <= ?2 AND (%s)", step->table, step->update, step->pending);
+	sqlite3_stmt * stmt_update;
+	failed = sqlite3_prepare_v2(db, query, -1, &stmt_update, NULL);
+	sqlite3_free(query);
+
+	if (failed) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'migrate %s' on '%s' because %s", step->description, name, sqlite3_errmsg(db));
+		sqlite3_finalize(stmt_batch);
+		return 1;
+	}
+
+	sqlite3_bind_int(stmt_batch, 2, batch_size);
+
+	sqlite3_int64 nb_done = 0, last_rowid = 0;
+	time_t last = time(NULL);
+	for (;;) {
+		sqlite3_bind_int64(stmt_batch, 1, last_rowid);
+
+		// MAX() of an empty batch is NULL
+		failed = sqlite3_step(stmt_batch) != SQLITE_ROW;
+		bool done = failed || sqlite3_column_type(stmt_batch, 0) == SQLITE_NULL;
+		sqlite3_int64 next_rowid = done ? 0 : sqlite3_column_int64(stmt_batch, 0);
+		sqlite3_reset(stmt_batch);
+
+		if (done)
+			break;
+
+		// each batch is a transaction by itself
+		sqlite3_bind_int64(stmt_update, 1, last_rowid);
+		sqlite3_bind_int64(stmt_update, 2, next_rowid);
+		failed = sqlite3_step(stmt_update) != SQLITE_DONE;
+		sqlite3_reset(stmt_update);
+
+		if (failed)
+			break;
+
+		nb_done += sqlite3_changes(db);
+		last_rowid = next_rowid;
+
+		time_t now = time(NULL);
+		if (now > last) {
+			sl_log_write(sl_log_level_info, sl_log_type_plugin_database, "Sqlite: migrating %s of '%s', %lld/%lld rows (%lld%%)", step->description, name, nb_done, nb_rows, nb_done < nb_rows ? nb_done * 100 / nb_rows : 100);
+			last = now;
+		}
+	}
+
+	if (failed)
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to migrate %s of '%s' because %s", step->description, name, sqlite3_errmsg(db));
+
+	sqlite3_finalize(stmt_batch);
+	sqlite3_finalize(stmt_update);
+
+	if (!failed)
+		sl_log_write(sl_log_level_notice, sl_log_type_plugin_database, "Sqlite: %s of '%s' migrated (%lld rows)", step->description, name, nb_done);
+
+	return failed;
+}
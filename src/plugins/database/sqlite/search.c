@@ -0,0 +1,158 @@
+/*************************************************************************\
+*                  ______  __                 __                          *
+*                 / __/ /_/ /  ___  _______ _/ /____                      *
+*                _\ \/ __/ /__/ _ \/ __/ _ `/ __/ -_)                     *
+*               /___/\__/____/\___/\__/\_,_/\__/\__/                      *
+*                                                                         *
+*  ---------------------------------------------------------------------  *
+*  This file is a part of StLocate                                        *
+*                                                                         *
+*  StLocate is free software; you can redistribute it and/or              *
+*  modify it under the terms of the GNU General Public License            *
+*  as published by the Free Software Foundation; either version 3         *
+*  of the License, or (at your option) any later version.                 *
+*                                                                         *
+*  This program is distributed in the hope that it will be useful,        *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+*  GNU General Public License for more details.                           *
+*                                                                         *
+*  You should have received a copy of the GNU General Public License      *
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.  *
+*                                                                         *
+*  ---------------------------------------------------------------------  *
+*  Copyright (C) 2013, Clercin guillaume <gclercin@intellique.com>        *
+*  Last modified: Mon, 19 Oct 2026                                        *
+\*************************************************************************/
+
+// regcomp, regexec, regfree
+#include <regex.h>
+// free, malloc
+#include <stdlib.h>
+
+#include <stlocate/log.h>
+
+#include "common.h"
+
+/**
+ * Table path_index contains a copy of path of each row of table file,
+ * with the same rowid. Its trigram tokenizer lets sqlite answer GLOB and
+ * LIKE with at least three consecutive characters without reading every
+ * path. Rows of table file are indexed once their session ends.
+ *
+ * With file_storage snapshot and path_storage text, rowid of table file
+ * is implicit, so a manual VACUUM can renumber it and desynchronize
+ * path_index. An update with search_index = none drops it, the next one
+ * with trigram indexes every row again.
+ */
+
+static void sl_database_sqlite_search_regexp(sqlite3_context * context, int argc, sqlite3_value ** argv);
+static void sl_database_sqlite_search_regexp_free(void * regex);
+
+
+int sl_database_sqlite_search_create(sqlite3 * db, enum sl_database_sqlite_file_storage file_storage) {
+	int failed = sl_database_sqlite_util_exec(db, "CREATE VIRTUAL TABLE path_index USING fts5(path, tokenize = 'trigram', detail = 'none')");
+	if (failed)
+		return failed;
+
+	// retention, and removal of unfinished sessions, never leave rows into index
+	failed = sl_database_sqlite_util_exec(db, "CREATE TRIGGER path_index_delete AFTER DELETE ON file BEGIN DELETE FROM path_index WHERE rowid = old.rowid; END");
+	if (failed)
+		return failed;
+
+	// sessions stored before index was enabled
+	if (file_storage == sl_database_sqlite_file_storage_delta)
+		failed = sl_database_sqlite_util_exec(db, "INSERT INTO path_index(rowid, path) SELECT id, path FROM file");
+	else
+		failed = sl_database_sqlite_util_exec(db, "INSERT INTO path_index(rowid, path) SELECT rowid, sl_decompress_path(path, s2fs) FROM file");
+
+	if (!failed)
+		sl_log_write(sl_log_level_notice, sl_log_type_plugin_database, "Sqlite: index of paths created, %d paths indexed", sqlite3_changes(db));
+
+	return failed;
+}
+
+/**
+ * regexp(pattern, path), called by 'path REGEXP pattern'
+ *
+ * Pattern is a POSIX extended regular expression which should match a
+ * part of path. It is compiled once by statement.
+ */
+static void sl_database_sqlite_search_regexp(sqlite3_context * context, int argc __attribute__((unused)), sqlite3_value ** argv) {
+	if (sqlite3_value_type(argv[0]) == SQLITE_NULL || sqlite3_value_type(argv[1]) == SQLITE_NULL)
+		return;
+
+	regex_t * regex = sqlite3_get_auxdata(context, 0);
+	if (regex == NULL) {
+		regex = malloc(sizeof(regex_t));
+		if (regcomp(regex, (const char *) sqlite3_value_text(argv[0]), REG_EXTENDED | REG_NOSUB)) {
+			free(regex);
+			sqlite3_result_error(context, "invalid regular expression", -1);
+			return;
+		}
+
+		sqlite3_set_auxdata(context, 0, regex, sl_database_sqlite_search_regexp_free);
+		regex = sqlite3_get_auxdata(context, 0);
+		if (regex == NULL) {
+			sqlite3_result_error_nomem(context);
+			return;
+		}
+	}
+
+	sqlite3_result_int(context, !regexec(regex, (const char *) sqlite3_value_text(argv[1]), 0, NULL, 0));
+}
+
+static void sl_database_sqlite_search_regexp_free(void * regex) {
+	regfree(regex);
+	free(regex);
+}
+
+int sl_database_sqlite_search_drop(sqlite3 * db) {
+	int failed = sl_database_sqlite_util_exec(db, "DROP TRIGGER IF EXISTS path_index_delete");
+	if (!failed)
+		failed = sl_database_sqlite_util_exec(db, "DROP TABLE IF EXISTS path_index");
+
+	if (!failed)
+		sl_log_write(sl_log_level_notice, sl_log_type_plugin_database, "Sqlite: index of paths removed");
+
+	return failed;
+}
+
+int sl_database_sqlite_search_index_session(sqlite3 * db, struct sl_database_sqlite_queries * queries, enum sl_database_sqlite_file_storage file_storage, int session_id) {
+	/**
+	 * With file_storage = delta, only rows created by session are new,
+	 * others only see their last_session moved forward.
+	 * Paths are indexed before being compressed.
+	 */
+	enum sl_database_sqlite_query id = sl_database_sqlite_query_search_index_snapshot;
+	const char * query = "INSERT INTO path_index(rowid, path) SELECT f.rowid, f.path FROM session2filesystem s2fs INNER JOIN file f ON s2fs.id = f.s2fs WHERE s2fs.session = ?1";
+	if (file_storage == sl_database_sqlite_file_storage_delta) {
+		id = sl_database_sqlite_query_search_index_delta;
+		query = "INSERT INTO path_index(rowid, path) SELECT f.id, f.path FROM session2filesystem s2fs INNER JOIN file f ON s2fs.filesystem = f.filesystem AND f.last_session = ?1 AND f.first_session = ?1 WHERE s2fs.session = ?1";
+	}
+
+	sqlite3_stmt * stmt_insert = sl_database_sqlite_util_prepare(db, queries, id, query);
+	if (stmt_insert == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'index paths'");
+		return -1;
+	}
+
+	sqlite3_bind_int(stmt_insert, 1, session_id);
+
+	int failed = sqlite3_step(stmt_insert) != SQLITE_DONE;
+	if (failed)
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to index paths of session %d because %s", session_id, sqlite3_errmsg(db));
+	else
+		sl_log_write(sl_log_level_debug, sl_log_type_plugin_database, "Sqlite: %d paths of session %d indexed", sqlite3_changes(db), session_id);
+	sqlite3_reset(stmt_insert);
+
+	return failed;
+}
+
+int sl_database_sqlite_search_register(sqlite3 * db) {
+	int failed = sqlite3_create_function_v2(db, "regexp", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL, sl_database_sqlite_search_regexp, NULL, NULL, NULL);
+	if (failed != SQLITE_OK)
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to register regexp function because %s", sqlite3_errmsg(db));
+
+	return failed != SQLITE_OK;
+}
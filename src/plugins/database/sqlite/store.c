@@ -0,0 +1,288 @@
+/*************************************************************************\
+*                  ______  __                 __                          *
+*                 / __/ /_/ /  ___  _______ _/ /____                      *
+*                _\ \/ __/ /__/ _ \/ __/ _ `/ __/ -_)                     *
+*               /___/\__/____/\___/\__/\_,_/\__/\__/                      *
+*                                                                         *
+*  ---------------------------------------------------------------------  *
+*  This file is a part of StLocate                                        *
+*                                                                         *
+*  StLocate is free software; you can redistribute it and/or              *
+*  modify it under the terms of the GNU General Public License            *
+*  as published by the Free Software Foundation; either version 3         *
+*  of the License, or (at your option) any later version.                 *
+*                                                                         *
+*  This program is distributed in the hope that it will be useful,        *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+*  GNU General Public License for more details.                           *
+*                                                                         *
+*  You should have received a copy of the GNU General Public License      *
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.  *
+*                                                                         *
+*  ---------------------------------------------------------------------  *
+*  Copyright (C) 2013, Clercin guillaume <gclercin@intellique.com>        *
+*  Last modified: Mon, 19 Oct 2026 09:12:40 +0200                         *
+\*************************************************************************/
+
+// free, malloc
+#include <stdlib.h>
+// strdup
+#include <string.h>
+
+#include <stlocate/log.h>
+#include <stlocate/thread_pool.h>
+
+#include "common.h"
+
+static void sl_database_sqlite_store_writer(void * arg);
+
+
+int sl_database_sqlite_store_attach_meta(struct sl_database_sqlite_store * store, const char * meta_path) {
+	if (store->meta_attached)
+		return 0;
+
+	sqlite3_stmt * stmt_attach;
+	int failed = sqlite3_prepare_v2(store->db_handler, "ATTACH DATABASE ?1 AS meta", -1, &stmt_attach, NULL);
+	if (failed) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'attach database'");
+		return 1;
+	}
+
+	char * uri = NULL;
+	if (store->read_only)
+		uri = sl_database_sqlite_util_read_only_uri(meta_path, false);
+
+	sqlite3_bind_text(stmt_attach, 1, uri != NULL ? uri : meta_path, -1, SQLITE_STATIC);
+	failed = sqlite3_step(stmt_attach);
+	sqlite3_finalize(stmt_attach);
+	sqlite3_free(uri);
+
+	if (failed != SQLITE_DONE) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to attach '%s' to '%s' because %s", meta_path, store->path, sqlite3_errmsg(store->db_handler));
+		return 1;
+	}
+
+	store->meta_attached = true;
+	return 0;
+}
+
+int sl_database_sqlite_store_begin(struct sl_database_sqlite_store * store) {
+	int failed = sl_database_sqlite_store_flush(store);
+	if (failed)
+		return failed;
+
+	return sl_database_sqlite_util_exec(store->db_handler, "BEGIN TRANSACTION");
+}
+
+int sl_database_sqlite_store_commit(struct sl_database_sqlite_store * store) {
+	int failed = sl_database_sqlite_store_flush(store);
+	if (failed)
+		return failed;
+
+	return sl_database_sqlite_util_exec(store->db_handler, "COMMIT");
+}
+
+int sl_database_sqlite_store_flush(struct sl_database_sqlite_store * store) {
+	pthread_mutex_lock(&store->lock);
+
+	// without writer, queued files would never be inserted
+	while ((store->nb_files > 0 && store->running) || store->busy)
+		pthread_cond_wait(&store->wait, &store->lock);
+
+	int failed = store->failed;
+
+	pthread_mutex_unlock(&store->lock);
+
+	return failed;
+}
+
+void sl_database_sqlite_store_free(struct sl_database_sqlite_store * store) {
+	if (store == NULL)
+		return;
+
+	pthread_mutex_lock(&store->lock);
+
+	store->stop = true;
+	pthread_cond_broadcast(&store->wait);
+
+	while (store->running)
+		pthread_cond_wait(&store->wait, &store->lock);
+
+	pthread_mutex_unlock(&store->lock);
+
+	sl_database_sqlite_util_free_queries(store->prepared_queries);
+	sqlite3_close(store->db_handler);
+
+	pthread_cond_destroy(&store->wait);
+	pthread_mutex_destroy(&store->lock);
+
+	free(store->files);
+	free(store->path);
+	free(store);
+}
+
+int sl_database_sqlite_store_insert_file(struct sl_database_sqlite_store * store, int s2fs, sqlite3_int64 id, sqlite3_int64 parent, const char * filename, const struct stat * st) {
+	pthread_mutex_lock(&store->lock);
+
+	while (store->nb_files == store->max_files && store->failed == 0)
+		pthread_cond_wait(&store->wait, &store->lock);
+
+	int failed = store->failed;
+	if (failed == 0) {
+		struct sl_database_sqlite_store_file * file = store->files + (store->first_file + store->nb_files) % store->max_files;
+		file->s2fs = s2fs;
+		file->id = id;
+		file->parent = parent;
+		file->filename = strdup(filename);
+		file->st = *st;
+		store->nb_files++;
+
+		if (!store->running) {
+			store->running = true;
+			store->stop = false;
+			if (sl_thread_pool_run(sl_database_sqlite_store_writer, store)) {
+				sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to start writer of '%s'", store->path);
+
+				// nobody will insert this file
+				store->nb_files--;
+				free(file->filename);
+
+				store->running = false;
+				store->failed = failed = 1;
+			}
+		}
+
+		pthread_cond_broadcast(&store->wait);
+	}
+
+	pthread_mutex_unlock(&store->lock);
+
+	return failed;
+}
+
+struct sl_database_sqlite_store * sl_database_sqlite_store_open(const char * path, int version, enum sl_database_sqlite_path_storage path_storage, bool read_only, int64_t mmap_size) {
+	sqlite3 * handler;
+	if (read_only)
+		handler = sl_database_sqlite_util_open_read_only(path, mmap_size, false);
+	else
+		handler = sl_database_sqlite_util_open(path);
+	if (handler == NULL)
+		return NULL;
+
+	sqlite3_stmt * stmt_select;
+	int failed = sqlite3_prepare_v2(handler, "SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name = 'file'", -1, &stmt_select, NULL);
+	if (failed) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'get file table'");
+		sqlite3_close(handler);
+		return NULL;
+	}
+
+	bool has_table = false;
+	if (sqlite3_step(stmt_select) == SQLITE_ROW)
+		has_table = sqlite3_column_int(stmt_select, 0) > 0;
+	sqlite3_finalize(stmt_select);
+
+	if (!has_table && read_only) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: there is no table file into '%s'", path);
+		sqlite3_close(handler);
+		return NULL;
+	}
+
+	if (!has_table && (sl_database_sqlite_util_exec(handler, "PRAGMA auto_vacuum = INCREMENTAL") || sl_database_sqlite_util_create_file_table(handler, false, path_storage))) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to create table file into '%s'", path);
+		sqlite3_close(handler);
+		return NULL;
+	}
+
+	// stores created before this index get it from their next update
+	if (!read_only && path_storage == sl_database_sqlite_path_storage_text && sl_database_sqlite_util_create_path_index(handler, sl_database_sqlite_file_storage_snapshot)) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to create index of paths into '%s'", path);
+		sqlite3_close(handler);
+		return NULL;
+	}
+
+	struct sl_database_sqlite_store * store = malloc(sizeof(struct sl_database_sqlite_store));
+	store->path = strdup(path);
+	store->db_handler = handler;
+	store->prepared_queries = sl_database_sqlite_util_new_queries();
+	store->meta_attached = false;
+	store->read_only = read_only;
+	store->version = version;
+	store->path_storage = path_storage;
+	store->next_file_id = 1;
+	if (path_storage == sl_database_sqlite_path_storage_tree)
+		store->next_file_id = sl_database_sqlite_util_get_next_file_id(handler);
+
+	pthread_mutex_init(&store->lock, NULL);
+	pthread_cond_init(&store->wait, NULL);
+
+	store->max_files = 1024;
+	store->files = calloc(store->max_files, sizeof(struct sl_database_sqlite_store_file));
+	store->first_file = 0;
+	store->nb_files = 0;
+
+	store->running = false;
+	store->busy = false;
+	store->stop = false;
+	store->failed = 0;
+
+	return store;
+}
+
+int sl_database_sqlite_store_rollback(struct sl_database_sqlite_store * store) {
+	sl_database_sqlite_store_flush(store);
+
+	pthread_mutex_lock(&store->lock);
+	store->failed = 0;
+	pthread_mutex_unlock(&store->lock);
+
+	return sl_database_sqlite_util_exec(store->db_handler, "ROLLBACK");
+}
+
+static void sl_database_sqlite_store_writer(void * arg) {
+	struct sl_database_sqlite_store * store = arg;
+
+	sl_log_write(sl_log_level_debug, sl_log_type_plugin_database, "Sqlite: start writer of '%s'", store->path);
+
+	pthread_mutex_lock(&store->lock);
+
+	for (;;) {
+		while (store->nb_files == 0 && !store->stop)
+			pthread_cond_wait(&store->wait, &store->lock);
+
+		if (store->nb_files == 0)
+			break;
+
+		struct sl_database_sqlite_store_file file = store->files[store->first_file];
+		store->first_file = (store->first_file + 1) % store->max_files;
+		store->nb_files--;
+		store->busy = true;
+
+		pthread_cond_broadcast(&store->wait);
+		pthread_mutex_unlock(&store->lock);
+
+		int failed;
+		if (store->path_storage == sl_database_sqlite_path_storage_tree)
+			failed = sl_database_sqlite_util_insert_node(store->db_handler, store->prepared_queries, file.s2fs, file.id, file.parent, file.filename, &file.st);
+		else
+			failed = sl_database_sqlite_util_insert_file(store->db_handler, store->prepared_queries, store->version, file.s2fs, file.filename, &file.st);
+		free(file.filename);
+
+		pthread_mutex_lock(&store->lock);
+
+		if (failed && store->failed == 0)
+			store->failed = failed;
+		store->busy = false;
+
+		pthread_cond_broadcast(&store->wait);
+	}
+
+	sl_log_write(sl_log_level_debug, sl_log_type_plugin_database, "Sqlite: stop writer of '%s'", store->path);
+
+	// store can be released as soon as lock is released
+	store->running = false;
+	pthread_cond_broadcast(&store->wait);
+
+	pthread_mutex_unlock(&store->lock);
+}
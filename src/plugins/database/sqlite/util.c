@@ -26,15 +26,510 @@
 \*************************************************************************/
 
 #define _GNU_SOURCE
-// mktime, strptime
+// asprintf
+#include <stdio.h>
+// calloc, free
+#include <stdlib.h>
+// memset
+#include <string.h>
+// struct stat
+#include <sys/stat.h>
+// strptime, timegm
 #include <time.h>
 
+#include <stlocate/log.h>
+
 #include "common.h"
 
-int sl_database_sqlite_util_convert_to_time(const char * time) {
-	struct tm t;
-	strptime(time, "%F %T", &t);
+static int sl_database_sqlite_util_delete_by_chunks(sqlite3 * db, sqlite3_stmt * stmt_delete, const char * description, unsigned int chunk_size, unsigned int vacuum_pages);
+
+
+time_t sl_database_sqlite_util_get_time(sqlite3_stmt * stmt, int column) {
+	switch (sqlite3_column_type(stmt, column)) {
+		case SQLITE_INTEGER:
+			return sqlite3_column_int64(stmt, column);
+
+		case SQLITE_TEXT: {
+				// version 1 of database stores UTC dates as text
+				struct tm t;
+				memset(&t, 0, sizeof(t));
+				strptime((const char *) sqlite3_column_text(stmt, column), "%F %T", &t);
+
+				return timegm(&t);
+			}
+
+		default:
+			return 0;
+	}
+}
+
+void sl_database_sqlite_util_clear_queries(struct sl_database_sqlite_queries * queries) {
+	unsigned int i;
+	for (i = 0; i < sl_database_sqlite_query_nb; i++) {
+		sqlite3_finalize(queries->statements[i]);
+		queries->statements[i] = NULL;
+	}
+}
+
+int sl_database_sqlite_util_create_delta_file_table(sqlite3 * db) {
+	// a row describes a file which has not changed from first_session to last_session
+	int failed = sl_database_sqlite_util_exec(db, "CREATE TABLE file (id INTEGER PRIMARY KEY, filesystem INTEGER NOT NULL REFERENCES filesystem(id) ON UPDATE CASCADE ON DELETE CASCADE, first_session INTEGER NOT NULL, last_session INTEGER NOT NULL, inode INTEGER NOT NULL CHECK (inode >= 0), path TEXT NOT NULL, mode INTEGER NOT NULL CHECK (mode >= 0), uid INTEGER NOT NULL CHECK (uid >= 0), gid INTEGER NOT NULL CHECK (gid >= 0), size INTEGER NOT NULL CHECK (size >= 0), access_time INTEGER NOT NULL, modif_time INTEGER NOT NULL, CHECK (first_session <= last_session))");
+	if (failed)
+		return failed;
+
+	failed = sl_database_sqlite_util_exec(db, "CREATE INDEX last_session ON file(filesystem, last_session, path)");
+	if (failed)
+		return failed;
+
+	// sessions of a version are checked without reading rows of table file
+	return sl_database_sqlite_util_exec(db, "CREATE INDEX inode_range ON file(filesystem, inode, first_session, last_session)");
+}
+
+int sl_database_sqlite_util_create_filter_table(sqlite3 * db) {
+	// databases created before filters get this table from their next update
+	return sl_database_sqlite_util_exec(db, "CREATE TABLE IF NOT EXISTS session_filter (s2fs INTEGER PRIMARY KEY REFERENCES session2filesystem(id) ON UPDATE CASCADE ON DELETE CASCADE, nb_inodes INTEGER NOT NULL CHECK (nb_inodes >= 0), data BLOB NOT NULL)");
+}
+
+int sl_database_sqlite_util_create_statistics_table(sqlite3 * db) {
+	return sl_database_sqlite_util_exec(db, "CREATE TABLE IF NOT EXISTS session_statistics (s2fs INTEGER PRIMARY KEY REFERENCES session2filesystem(id) ON UPDATE CASCADE ON DELETE CASCADE, nb_files INTEGER NOT NULL CHECK (nb_files >= 0), nb_directories INTEGER NOT NULL CHECK (nb_directories >= 0), total_size INTEGER NOT NULL CHECK (total_size >= 0), scan_duration INTEGER NOT NULL, nb_errors INTEGER NOT NULL CHECK (nb_errors >= 0))");
+}
+
+int sl_database_sqlite_util_create_indexes(sqlite3 * db, const struct sl_database_sqlite_config_private * config) {
+	// databases created before those indexes get them from their next update
+	int failed = sl_database_sqlite_util_exec(db, "CREATE INDEX IF NOT EXISTS session_host ON session(host, id)");
+	if (!failed)
+		failed = sl_database_sqlite_util_exec(db, "CREATE INDEX IF NOT EXISTS session2filesystem_session ON session2filesystem(session, dev_no)");
+	// lookups by uuid of filesystem, sessions sorted
+	if (!failed)
+		failed = sl_database_sqlite_util_exec(db, "CREATE INDEX IF NOT EXISTS session2filesystem_filesystem ON session2filesystem(filesystem, session)");
+
+	if (!failed && config->file_storage == sl_database_sqlite_file_storage_delta) {
+		failed = sl_database_sqlite_util_exec(db, "CREATE INDEX IF NOT EXISTS inode_range ON file(filesystem, inode, first_session, last_session)");
+		if (!failed)
+			failed = sl_database_sqlite_util_exec(db, "DROP INDEX IF EXISTS inode");
+	}
+
+	// with other layouts, table file is into stores which get this index when they are opened
+	if (!failed && config->layout == sl_database_sqlite_layout_single && config->path_storage == sl_database_sqlite_path_storage_text)
+		failed = sl_database_sqlite_util_create_path_index(db, config->file_storage);
+
+	return failed;
+}
+
+int sl_database_sqlite_util_create_path_index(sqlite3 * db, enum sl_database_sqlite_file_storage file_storage) {
+	/**
+	 * Rows sorted by path, so a path or the files under a directory are a
+	 * range of this index, into each session. Compressed paths are sorted
+	 * too, which lets a path be found once compressed with the dictionary
+	 * of its session.
+	 */
+	if (file_storage == sl_database_sqlite_file_storage_delta)
+		return sl_database_sqlite_util_exec(db, "CREATE INDEX IF NOT EXISTS path_order ON file(filesystem, path, first_session)");
+
+	return sl_database_sqlite_util_exec(db, "CREATE INDEX IF NOT EXISTS path_order ON file(s2fs, path)");
+}
+
+int sl_database_sqlite_util_create_file_table(sqlite3 * db, bool foreign_key, enum sl_database_sqlite_path_storage path_storage) {
+	int failed;
+	if (path_storage == sl_database_sqlite_path_storage_tree) {
+		// root of filesystem has no parent
+		if (foreign_key)
+			failed = sl_database_sqlite_util_exec(db, "CREATE TABLE file (id INTEGER PRIMARY KEY, s2fs INTEGER NOT NULL REFERENCES session2filesystem(id) ON UPDATE CASCADE ON DELETE CASCADE, parent INTEGER NULL, name TEXT NOT NULL, inode INTEGER NOT NULL CHECK (inode >= 0), mode INTEGER NOT NULL CHECK (mode >= 0), uid INTEGER NOT NULL CHECK (uid >= 0), gid INTEGER NOT NULL CHECK (gid >= 0), size INTEGER NOT NULL CHECK (size >= 0), access_time INTEGER NOT NULL, modif_time INTEGER NOT NULL)");
+		else
+			failed = sl_database_sqlite_util_exec(db, "CREATE TABLE file (id INTEGER PRIMARY KEY, s2fs INTEGER NOT NULL, parent INTEGER NULL, name TEXT NOT NULL, inode INTEGER NOT NULL CHECK (inode >= 0), mode INTEGER NOT NULL CHECK (mode >= 0), uid INTEGER NOT NULL CHECK (uid >= 0), gid INTEGER NOT NULL CHECK (gid >= 0), size INTEGER NOT NULL CHECK (size >= 0), access_time INTEGER NOT NULL, modif_time INTEGER NOT NULL)");
+
+		if (!failed)
+			failed = sl_database_sqlite_util_exec(db, "CREATE INDEX parent ON file(parent, name)");
+	} else if (foreign_key)
+		failed = sl_database_sqlite_util_exec(db, "CREATE TABLE file (s2fs INTEGER NOT NULL REFERENCES session2filesystem(id) ON UPDATE CASCADE ON DELETE CASCADE, inode INTEGER NOT NULL CHECK (inode >= 0), path TEXT NOT NULL, mode INTEGER NOT NULL CHECK (mode >= 0), uid INTEGER NOT NULL CHECK (uid >= 0), gid INTEGER NOT NULL CHECK (gid >= 0), size INTEGER NOT NULL CHECK (size >= 0), access_time INTEGER NOT NULL, modif_time INTEGER NOT NULL)");
+	else
+		failed = sl_database_sqlite_util_exec(db, "CREATE TABLE file (s2fs INTEGER NOT NULL, inode INTEGER NOT NULL CHECK (inode >= 0), path TEXT NOT NULL, mode INTEGER NOT NULL CHECK (mode >= 0), uid INTEGER NOT NULL CHECK (uid >= 0), gid INTEGER NOT NULL CHECK (gid >= 0), size INTEGER NOT NULL CHECK (size >= 0), access_time INTEGER NOT NULL, modif_time INTEGER NOT NULL)");
+	if (failed)
+		return failed;
+
+	return sl_database_sqlite_util_exec(db, "CREATE INDEX inode ON file(s2fs, inode)");
+}
+
+static int sl_database_sqlite_util_delete_by_chunks(sqlite3 * db, sqlite3_stmt * stmt_delete, const char * description, unsigned int chunk_size, unsigned int vacuum_pages) {
+	// short transactions let readers and writers interleave with retention
+	int nb_deleted, failed = 0;
+	do {
+		failed = sl_database_sqlite_util_exec(db, "BEGIN IMMEDIATE");
+		if (failed)
+			break;
+
+		failed = sqlite3_step(stmt_delete) != SQLITE_DONE;
+		nb_deleted = sqlite3_changes(db);
+		sqlite3_reset(stmt_delete);
+
+		if (failed) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to remove files of %s because %s", description, sqlite3_errmsg(db));
+			sl_database_sqlite_util_exec(db, "ROLLBACK");
+			break;
+		}
+
+		failed = sl_database_sqlite_util_exec(db, "COMMIT");
+
+		if (!failed)
+			failed = sl_database_sqlite_util_incremental_vacuum(db, vacuum_pages);
+	} while (!failed && (unsigned int) nb_deleted == chunk_size);
+
+	return failed;
+}
+
+int sl_database_sqlite_util_delete_dead_files(sqlite3 * db, struct sl_database_sqlite_queries * queries, int fs_id, int last_session, unsigned int chunk_size, unsigned int vacuum_pages) {
+	// a row is dead when none of the remaining sessions falls into its range
+	static const char * query = "DELETE FROM file WHERE rowid IN (SELECT rowid FROM file f WHERE f.filesystem = ?1 AND f.last_session <= ?2 AND NOT EXISTS (SELECT 1 FROM session2filesystem s2fs WHERE s2fs.filesystem = ?1 AND s2fs.session BETWEEN f.first_session AND f.last_session) LIMIT ?3)";
+	sqlite3_stmt * stmt_delete = sl_database_sqlite_util_prepare(db, queries, sl_database_sqlite_query_delete_dead_files, query);
+	if (stmt_delete == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'delete from file'");
+		return -1;
+	}
+
+	sqlite3_bind_int(stmt_delete, 1, fs_id);
+	sqlite3_bind_int(stmt_delete, 2, last_session);
+	sqlite3_bind_int(stmt_delete, 3, chunk_size);
+
+	char * description;
+	asprintf(&description, "filesystem %d", fs_id);
+
+	int failed = sl_database_sqlite_util_delete_by_chunks(db, stmt_delete, description, chunk_size, vacuum_pages);
+	free(description);
+
+	return failed;
+}
+
+int sl_database_sqlite_util_delete_files(sqlite3 * db, struct sl_database_sqlite_queries * queries, int s2fs, unsigned int chunk_size, unsigned int vacuum_pages) {
+	static const char * query = "DELETE FROM file WHERE rowid IN (SELECT rowid FROM file WHERE s2fs = ?1 LIMIT ?2)";
+	sqlite3_stmt * stmt_delete = sl_database_sqlite_util_prepare(db, queries, sl_database_sqlite_query_delete_files, query);
+	if (stmt_delete == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'delete from file'");
+		return -1;
+	}
+
+	sqlite3_bind_int(stmt_delete, 1, s2fs);
+	sqlite3_bind_int(stmt_delete, 2, chunk_size);
+
+	char * description;
+	asprintf(&description, "session2filesystem %d", s2fs);
+
+	int failed = sl_database_sqlite_util_delete_by_chunks(db, stmt_delete, description, chunk_size, vacuum_pages);
+	free(description);
+
+	return failed;
+}
+
+int sl_database_sqlite_util_exec(sqlite3 * db, const char * query) {
+	char * error = NULL;
+	int failed = sqlite3_exec(db, query, NULL, NULL, &error);
+
+	if (failed != SQLITE_OK) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to execute query %s because %s", query, error);
+		sqlite3_free(error);
+	}
+
+	return failed != SQLITE_OK;
+}
+
+const char * sl_database_sqlite_util_file_storage_to_string(enum sl_database_sqlite_file_storage file_storage) {
+	switch (file_storage) {
+		case sl_database_sqlite_file_storage_delta:
+			return "delta";
+
+		default:
+			return "snapshot";
+	}
+}
+
+void sl_database_sqlite_util_free_queries(struct sl_database_sqlite_queries * queries) {
+	if (queries == NULL)
+		return;
+
+	sl_database_sqlite_util_clear_queries(queries);
+	free(queries);
+}
+
+sqlite3_int64 sl_database_sqlite_util_get_next_file_id(sqlite3 * db) {
+	sqlite3_stmt * stmt_select;
+	int failed = sqlite3_prepare_v2(db, "SELECT COALESCE(MAX(id), 0) + 1 FROM file", -1, &stmt_select, NULL);
+	if (failed) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'get next file id'");
+		return -1;
+	}
+
+	sqlite3_int64 id = -1;
+	if (sqlite3_step(stmt_select) == SQLITE_ROW)
+		id = sqlite3_column_int64(stmt_select, 0);
+	sqlite3_finalize(stmt_select);
+
+	return id;
+}
+
+int sl_database_sqlite_util_incremental_vacuum(sqlite3 * db, unsigned int nb_pages) {
+	if (nb_pages == 0)
+		return 0;
+
+	char * query;
+	asprintf(&query, "PRAGMA incremental_vacuum(%u)", nb_pages);
+
+	// does nothing if database has not auto_vacuum = INCREMENTAL
+	int failed = sl_database_sqlite_util_exec(db, query);
+	free(query);
+
+	return failed;
+}
+
+int sl_database_sqlite_util_insert_file(sqlite3 * db, struct sl_database_sqlite_queries * queries, int version, int s2fs, const char * filename, const struct stat * st) {
+	enum sl_database_sqlite_query id = sl_database_sqlite_query_insert_file;
+	const char * insert = "INSERT INTO file(s2fs, inode, path, mode, uid, gid, size, access_time, modif_time) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9)";
+	if (version < 2) {
+		id = sl_database_sqlite_query_insert_file_v1;
+		insert = "INSERT INTO file(s2fs, inode, path, mode, uid, gid, size, access_time, modif_time) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, datetime(?8, 'unixepoch'), datetime(?9, 'unixepoch'))";
+	}
+
+	sqlite3_stmt * stmt_insert = sl_database_sqlite_util_prepare(db, queries, id, insert);
+	if (stmt_insert == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'insert into file2session'");
+		return -4;
+	}
 
-	return mktime(&t);
+	sqlite3_bind_int64(stmt_insert, 1, s2fs);
+	sqlite3_bind_int64(stmt_insert, 2, st->st_ino);
+	sqlite3_bind_text(stmt_insert, 3, filename, -1, SQLITE_STATIC);
+	sqlite3_bind_int(stmt_insert, 4, st->st_mode);
+	sqlite3_bind_int(stmt_insert, 5, st->st_uid);
+	sqlite3_bind_int(stmt_insert, 6, st->st_gid);
+	sqlite3_bind_int64(stmt_insert, 7, st->st_size);
+	sqlite3_bind_int64(stmt_insert, 8, st->st_atime);
+	sqlite3_bind_int64(stmt_insert, 9, st->st_mtime);
+
+	int failed = sqlite3_step(stmt_insert);
+
+	if (failed != SQLITE_DONE)
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to insert new file2session (file id: 0, session id: %d)", s2fs);
+
+	return failed != SQLITE_DONE;
 }
 
+int sl_database_sqlite_util_insert_node(sqlite3 * db, struct sl_database_sqlite_queries * queries, int s2fs, sqlite3_int64 id, sqlite3_int64 parent, const char * name, const struct stat * st) {
+	static const char * insert = "INSERT INTO file(id, s2fs, parent, name, inode, mode, uid, gid, size, access_time, modif_time) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11)";
+	sqlite3_stmt * stmt_insert = sl_database_sqlite_util_prepare(db, queries, sl_database_sqlite_query_insert_node, insert);
+	if (stmt_insert == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'insert into file'");
+		return -4;
+	}
+
+	sqlite3_bind_int64(stmt_insert, 1, id);
+	sqlite3_bind_int(stmt_insert, 2, s2fs);
+	if (parent > 0)
+		sqlite3_bind_int64(stmt_insert, 3, parent);
+	else
+		sqlite3_bind_null(stmt_insert, 3);
+	sqlite3_bind_text(stmt_insert, 4, name, -1, SQLITE_STATIC);
+	sqlite3_bind_int64(stmt_insert, 5, st->st_ino);
+	sqlite3_bind_int(stmt_insert, 6, st->st_mode);
+	sqlite3_bind_int(stmt_insert, 7, st->st_uid);
+	sqlite3_bind_int(stmt_insert, 8, st->st_gid);
+	sqlite3_bind_int64(stmt_insert, 9, st->st_size);
+	sqlite3_bind_int64(stmt_insert, 10, st->st_atime);
+	sqlite3_bind_int64(stmt_insert, 11, st->st_mtime);
+
+	int failed = sqlite3_step(stmt_insert);
+
+	if (failed != SQLITE_DONE)
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to insert new file (file id: %lld, session2filesystem id: %d)", id, s2fs);
+
+	return failed != SQLITE_DONE;
+}
+
+const char * sl_database_sqlite_util_layout_to_string(enum sl_database_sqlite_layout layout) {
+	switch (layout) {
+		case sl_database_sqlite_layout_filesystem:
+			return "filesystem";
+
+		case sl_database_sqlite_layout_session:
+			return "session";
+
+		default:
+			return "single";
+	}
+}
+
+struct sl_database_sqlite_queries * sl_database_sqlite_util_new_queries() {
+	return calloc(1, sizeof(struct sl_database_sqlite_queries));
+}
+
+sqlite3 * sl_database_sqlite_util_open(const char * path) {
+	sqlite3 * handler = NULL;
+	int ret = sqlite3_open(path, &handler);
+	if (ret != SQLITE_OK) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to open database at '%s'", path);
+		sqlite3_close(handler);
+		return NULL;
+	}
+
+	sqlite3_busy_timeout(handler, 30000);
+	sl_database_sqlite_util_exec(handler, "PRAGMA foreign_keys = ON");
+	// lookups read a snapshot of database while it is updated
+	sl_database_sqlite_util_exec(handler, "PRAGMA journal_mode = WAL");
+	sl_database_sqlite_util_exec(handler, "PRAGMA synchronous = NORMAL");
+	sl_database_sqlite_compress_register(handler);
+	sl_database_sqlite_filter_register(handler);
+	sl_database_sqlite_search_register(handler);
+
+	sl_log_write(sl_log_level_info, sl_log_type_plugin_database, "Sqlite: open database at '%s', OK", path);
+
+	return handler;
+}
+
+sqlite3 * sl_database_sqlite_util_open_read_only(const char * path, int64_t mmap_size, bool immutable) {
+	char * uri = sl_database_sqlite_util_read_only_uri(path, immutable);
+
+	sqlite3 * handler = NULL;
+	int ret = sqlite3_open_v2(uri, &handler, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI, NULL);
+	if (ret != SQLITE_OK) {
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to open database at '%s' in read-only mode", path);
+		sqlite3_close(handler);
+		sqlite3_free(uri);
+		return NULL;
+	}
+
+	sqlite3_busy_timeout(handler, 30000);
+
+	char * pragma = sqlite3_mprintf("PRAGMA mmap_size = %lld", (long long) mmap_size);
+	sl_database_sqlite_util_exec(handler, pragma);
+	sqlite3_free(pragma);
+
+	sl_database_sqlite_compress_register(handler);
+	sl_database_sqlite_filter_register(handler);
+	sl_database_sqlite_search_register(handler);
+
+	sl_log_write(sl_log_level_info, sl_log_type_plugin_database, "Sqlite: open database at '%s' in read-only mode, OK", uri);
+	sqlite3_free(uri);
+
+	return handler;
+}
+
+const char * sl_database_sqlite_util_path_compression_to_string(enum sl_database_sqlite_path_compression path_compression) {
+	switch (path_compression) {
+		case sl_database_sqlite_path_compression_zstd:
+			return "zstd";
+
+		default:
+			return "none";
+	}
+}
+
+const char * sl_database_sqlite_util_path_storage_to_string(enum sl_database_sqlite_path_storage path_storage) {
+	switch (path_storage) {
+		case sl_database_sqlite_path_storage_tree:
+			return "tree";
+
+		default:
+			return "text";
+	}
+}
+
+sqlite3_stmt * sl_database_sqlite_util_prepare(sqlite3 * db, struct sl_database_sqlite_queries * queries, enum sl_database_sqlite_query id, const char * query) {
+	sqlite3_stmt * query_smt = queries->statements[id];
+	if (query_smt != NULL) {
+		sqlite3_reset(query_smt);
+		return query_smt;
+	}
+
+	int failed = sqlite3_prepare_v2(db, query, -1, &query_smt, NULL);
+	if (!failed) {
+		queries->statements[id] = query_smt;
+		return query_smt;
+	}
+
+	return NULL;
+}
+
+char * sl_database_sqlite_util_read_only_uri(const char * path, bool immutable) {
+	/**
+	 * An immutable database is read without taking any lock, which is
+	 * only safe when writers never modify this file, like in swap mode
+	 * where it is replaced. Otherwise readers use the write-ahead log.
+	 */
+	sqlite3_str * uri = sqlite3_str_new(NULL);
+	sqlite3_str_appendall(uri, "file:");
+
+	const char * ptr;
+	for (ptr = path; *ptr != '\0'; ptr++) {
+		// those characters have a meaning into an uri
+		if (*ptr == '%' || *ptr == '?' || *ptr == '#')
+			sqlite3_str_appendf(uri, "%%%02X", (unsigned char) *ptr);
+		else
+			sqlite3_str_appendchar(uri, 1, *ptr);
+	}
+
+	sqlite3_str_appendall(uri, immutable ? "?mode=ro&immutable=1" : "?mode=ro");
+
+	return sqlite3_str_finish(uri);
+}
+
+int sl_database_sqlite_util_sync_delta_file(sqlite3 * db, struct sl_database_sqlite_queries * queries, int fs_id, int session_id, int previous_session, const char * filename, const struct stat * st) {
+	/**
+	 * Version of file found by previous session. Reading a file changes its
+	 * access time, not the file itself, so a new version is not stored only
+	 * because of its access time.
+	 */
+	sqlite3_int64 file_id = 0;
+	if (previous_session > 0) {
+		static const char * query = "SELECT id, inode, mode, uid, gid, size, modif_time FROM file WHERE filesystem = ?1 AND last_session = ?2 AND path = ?3 LIMIT 1";
+		sqlite3_stmt * stmt_select = sl_database_sqlite_util_prepare(db, queries, sl_database_sqlite_query_delta_select, query);
+		if (stmt_select == NULL) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'get file'");
+			return -4;
+		}
+
+		sqlite3_bind_int(stmt_select, 1, fs_id);
+		sqlite3_bind_int(stmt_select, 2, previous_session);
+		sqlite3_bind_text(stmt_select, 3, filename, -1, SQLITE_STATIC);
+
+		if (sqlite3_step(stmt_select) == SQLITE_ROW && sqlite3_column_int64(stmt_select, 1) == (sqlite3_int64) st->st_ino && sqlite3_column_int(stmt_select, 2) == (int) st->st_mode && sqlite3_column_int(stmt_select, 3) == (int) st->st_uid && sqlite3_column_int(stmt_select, 4) == (int) st->st_gid && sqlite3_column_int64(stmt_select, 5) == st->st_size && sqlite3_column_int64(stmt_select, 6) == st->st_mtime)
+			file_id = sqlite3_column_int64(stmt_select, 0);
+		sqlite3_reset(stmt_select);
+	}
+
+	int failed;
+	if (file_id > 0) {
+		static const char * update = "UPDATE file SET last_session = ?2 WHERE id = ?1";
+		sqlite3_stmt * stmt_update = sl_database_sqlite_util_prepare(db, queries, sl_database_sqlite_query_delta_update, update);
+		if (stmt_update == NULL) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'update file'");
+			return -4;
+		}
+
+		sqlite3_bind_int64(stmt_update, 1, file_id);
+		sqlite3_bind_int(stmt_update, 2, session_id);
+
+		failed = sqlite3_step(stmt_update);
+	} else {
+		static const char * insert = "INSERT INTO file(filesystem, first_session, last_session, inode, path, mode, uid, gid, size, access_time, modif_time) VALUES (?1, ?2, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10)";
+		sqlite3_stmt * stmt_insert = sl_database_sqlite_util_prepare(db, queries, sl_database_sqlite_query_delta_insert, insert);
+		if (stmt_insert == NULL) {
+			sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: error while preparing query 'insert into file'");
+			return -4;
+		}
+
+		sqlite3_bind_int(stmt_insert, 1, fs_id);
+		sqlite3_bind_int(stmt_insert, 2, session_id);
+		sqlite3_bind_int64(stmt_insert, 3, st->st_ino);
+		sqlite3_bind_text(stmt_insert, 4, filename, -1, SQLITE_STATIC);
+		sqlite3_bind_int(stmt_insert, 5, st->st_mode);
+		sqlite3_bind_int(stmt_insert, 6, st->st_uid);
+		sqlite3_bind_int(stmt_insert, 7, st->st_gid);
+		sqlite3_bind_int64(stmt_insert, 8, st->st_size);
+		sqlite3_bind_int64(stmt_insert, 9, st->st_atime);
+		sqlite3_bind_int64(stmt_insert, 10, st->st_mtime);
+
+		failed = sqlite3_step(stmt_insert);
+	}
+
+	if (failed != SQLITE_DONE)
+		sl_log_write(sl_log_level_err, sl_log_type_plugin_database, "Sqlite: failed to synchronize file '%s' (filesystem id: %d, session id: %d)", filename, fs_id, session_id);
+
+	return failed != SQLITE_DONE;
+}
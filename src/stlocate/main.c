@@ -0,0 +1,467 @@
+/*************************************************************************\
+*                  ______  __                 __                          *
+*                 / __/ /_/ /  ___  _______ _/ /____                      *
+*                _\ \/ __/ /__/ _ \/ __/ _ `/ __/ -_)                     *
+*               /___/\__/____/\___/\__/\_,_/\__/\__/                      *
+*                                                                         *
+*  ---------------------------------------------------------------------  *
+*  This file is a part of StLocate                                        *
+*                                                                         *
+*  StLocate is free software; you can redistribute it and/or              *
+*  modify it under the terms of the GNU General Public License            *
+*  as published by the Free Software Foundation; either version 3         *
+*  of the License, or (at your option) any later version.                 *
+*                                                                         *
+*  This program is distributed in the hope that it will be useful,        *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+*  GNU General Public License for more details.                           *
+*                                                                         *
+*  You should have received a copy of the GNU General Public License      *
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.  *
+*                                                                         *
+*  ---------------------------------------------------------------------  *
+*  Copyright (C) 2013, Clercin guillaume <gclercin@intellique.com>        *
+*  Last modified: Mon, 19 Oct 2026                                        *
+\*************************************************************************/
+
+#define _GNU_SOURCE
+// getopt_long
+#include <getopt.h>
+// bool
+#include <stdbool.h>
+// asprintf, printf
+#include <stdio.h>
+// atoi, free, realloc
+#include <stdlib.h>
+// strcmp, strdup, strlen, strncmp, strpbrk
+#include <string.h>
+// uname
+#include <sys/utsname.h>
+// localtime_r, strftime
+#include <time.h>
+// getcwd
+#include <unistd.h>
+
+#include <stlocate/conf.h>
+#include <stlocate/database.h>
+#include <stlocate/log.h>
+#include <stlocate/result.h>
+
+#include <config.h>
+#include <stlocate.version>
+#include <stlocate.chcksum>
+
+static int sl_find_path(struct sl_database_connection * connect, int host_id, const struct sl_request * request, const char * arg, bool show_sessions, bool show_details, bool * found);
+static bool sl_is_under(const char * path, const char * directory, size_t length);
+static void sl_print_file(const struct sl_result_file * file, bool show_sessions, bool show_details);
+static void sl_show_help(void);
+
+int main(int argc, char * argv[]) {
+	sl_log_write(sl_log_level_notice, sl_log_type_core, "Starting StLocate, version: " STLOCATE_VERSION ", build: " __DATE__ " " __TIME__);
+
+	enum {
+		OPT_ALL       = 'a',
+		OPT_CONFIG    = 'c',
+		OPT_DIRECTORY = 'd',
+		OPT_HELP      = 'h',
+		OPT_HISTORY   = 'y',
+		OPT_HOST      = 'H',
+		OPT_LIMIT     = 'l',
+		OPT_LONG      = 'L',
+		OPT_NEWEST    = 'n',
+		OPT_REGEX     = 'r',
+		OPT_SESSION   = 's',
+		OPT_SESSIONS  = 'S',
+		OPT_VERBOSE   = 'v',
+		OPT_VERSION   = 'V',
+	};
+
+	static int option_index = 0;
+	static struct option long_options[] = {
+		{ "all",       0, NULL, OPT_ALL },
+		{ "config",    1, NULL, OPT_CONFIG },
+		{ "directory", 0, NULL, OPT_DIRECTORY },
+		{ "help",      0, NULL, OPT_HELP },
+		{ "history",   0, NULL, OPT_HISTORY },
+		{ "host",      1, NULL, OPT_HOST },
+		{ "limit",     1, NULL, OPT_LIMIT },
+		{ "long",      0, NULL, OPT_LONG },
+		{ "newest",    0, NULL, OPT_NEWEST },
+		{ "regex",     0, NULL, OPT_REGEX },
+		{ "session",   1, NULL, OPT_SESSION },
+		{ "sessions",  0, NULL, OPT_SESSIONS },
+		{ "verbose",   0, NULL, OPT_VERBOSE },
+		{ "version",   0, NULL, OPT_VERSION },
+
+		{NULL, 0, NULL, 0},
+	};
+
+	static const char * config = CONFIG_FILE;
+	const char * host = NULL;
+	short verbose = 0;
+	bool show_sessions = false;
+	bool show_details = false;
+	// arguments are paths instead of patterns
+	bool by_path = false;
+
+	// a path found into several sessions is shown once
+	struct sl_request req;
+	sl_request_init(&req);
+	req.collapse = true;
+
+	// parse option
+	int opt;
+	do {
+		opt = getopt_long(argc, argv, "ac:dhH:l:Lnrs:SvVy", long_options, &option_index);
+
+		switch (opt) {
+			case -1:
+				break;
+
+			case OPT_ALL:
+				req.collapse = false;
+				break;
+
+			case OPT_CONFIG:
+				config = optarg;
+				sl_log_write(sl_log_level_notice, sl_log_type_core, "Using configuration file: '%s'", optarg);
+				break;
+
+			case OPT_DIRECTORY:
+				by_path = req.path_subtree = true;
+				break;
+
+			case OPT_HELP:
+				sl_log_disable_display_log();
+
+				sl_show_help();
+				return 0;
+
+			case OPT_HISTORY:
+				// each version of a file is shown with its session
+				by_path = show_sessions = show_details = true;
+				req.path_subtree = req.collapse = false;
+				break;
+
+			case OPT_HOST:
+				host = optarg;
+				sl_log_write(sl_log_level_notice, sl_log_type_core, "Using alternative host; '%s'", optarg);
+				break;
+
+			case OPT_LIMIT:
+				if (atoi(optarg) < 1) {
+					sl_log_write(sl_log_level_crit, sl_log_type_core, "Limit should be a positive integer but not '%s'", optarg);
+					return 1;
+				}
+				req.limit = atoi(optarg);
+				break;
+
+			case OPT_LONG:
+				show_details = true;
+				break;
+
+			case OPT_NEWEST:
+				req.newest_only = true;
+				break;
+
+			case OPT_REGEX:
+				req.path_regex = true;
+				break;
+
+			case OPT_SESSION:
+				req.session_min_id = atoi(optarg);
+				break;
+
+			case OPT_SESSIONS:
+				show_sessions = true;
+				break;
+
+			case OPT_VERBOSE:
+				if (verbose < 3)
+					verbose++;
+				break;
+
+			case OPT_VERSION:
+				sl_log_disable_display_log();
+
+				printf("StLocate, version: " STLOCATE_VERSION ", build: " __DATE__ " " __TIME__ "\n");
+				printf("sha1sum: " STLOCATE_SRCSUM ", commit: " STLOCATE_GIT_COMMIT "\n");
+				return 0;
+
+			default:
+				sl_log_write(sl_log_level_crit, sl_log_type_core, "Unsupported parameter '%d : %s'", opt, optarg);
+				return 1;
+		}
+	} while (opt > -1);
+
+	sl_log_set_verbose(verbose);
+
+	if (optind == argc) {
+		sl_log_write(sl_log_level_crit, sl_log_type_core, "No pattern given");
+		return 2;
+	}
+
+	// read configuration
+	if (sl_conf_read_config(config)) {
+		sl_log_write(sl_log_level_crit, sl_log_type_core, "Error while parsing '%s'", config);
+		return 4;
+	}
+
+	// check db connection
+	int failed = 0;
+	struct sl_database_config * db_config = sl_database_get_config_by_name("main");
+	if (db_config == NULL) {
+		sl_log_write(sl_log_level_crit, sl_log_type_core, "There is no database config with storage = main in config file '%s'", config);
+		failed = 5;
+	}
+
+	struct sl_database_connection * connect = NULL;
+	if (failed == 0) {
+		connect = db_config->ops->connect_read_only(db_config);
+		if (connect == NULL) {
+			sl_log_write(sl_log_level_crit, sl_log_type_core, "Connection to database filed");
+			failed = 6;
+		}
+	}
+
+	bool found = false;
+	if (!failed) {
+		if (host == NULL) {
+			static struct utsname name;
+			uname(&name);
+
+			host = name.nodename;
+		}
+
+		sl_log_write(sl_log_level_debug, sl_log_type_core, "Looking for host_id of '%s'...", host);
+
+		int host_id = connect->ops->get_host_by_name(connect, host);
+
+		if (host_id < 0) {
+			sl_log_write(sl_log_level_err, sl_log_type_core, "Host '%s' not found", host);
+			failed = 7;
+		} else
+			sl_log_write(sl_log_level_debug, sl_log_type_core, "Host '%s' found with id: %d", host, host_id);
+
+		for (; !failed && optind < argc; optind++) {
+			if (by_path) {
+				failed = sl_find_path(connect, host_id, &req, argv[optind], show_sessions, show_details, &found);
+				continue;
+			}
+
+			// like locate, a pattern without wildcard matches any path which contains it
+			char * pattern = NULL;
+			if (!req.path_regex && strpbrk(argv[optind], "*?[") == NULL)
+				asprintf(&pattern, "*%s*", argv[optind]);
+			else
+				pattern = strdup(argv[optind]);
+
+			sl_log_write(sl_log_level_debug, sl_log_type_core, "Looking for paths which match '%s'", pattern);
+			req.path_pattern = pattern;
+
+			struct sl_database_cursor * cursor = connect->ops->open_cursor(connect, host_id, &req);
+			if (cursor == NULL) {
+				sl_log_write(sl_log_level_err, sl_log_type_core, "An error occured when getting result");
+				free(pattern);
+				failed = 8;
+				break;
+			}
+
+			const struct sl_result_file * file;
+			while ((file = connect->ops->next_file(cursor)) != NULL) {
+				sl_print_file(file, show_sessions, show_details);
+				found = true;
+			}
+
+			if (connect->ops->close_cursor(cursor)) {
+				sl_log_write(sl_log_level_err, sl_log_type_core, "An error occured when getting result");
+				failed = 8;
+			}
+
+			free(pattern);
+		}
+	}
+
+	if (connect != NULL)
+		connect->ops->free(connect);
+
+	sl_log_stop_logger();
+
+	if (!failed && !found)
+		return 1;
+
+	return failed;
+}
+
+static int sl_find_path(struct sl_database_connection * connect, int host_id, const struct sl_request * request, const char * arg, bool show_sessions, bool show_details, bool * found) {
+	// path is absolute, without trailing '/'
+	char * path;
+	if (arg[0] == '/')
+		path = strdup(arg);
+	else {
+		char * cwd = getcwd(NULL, 0);
+		asprintf(&path, "%s/%s", cwd != NULL ? cwd : "", arg);
+		free(cwd);
+	}
+
+	size_t length = strlen(path);
+	while (length > 0 && path[length - 1] == '/')
+		path[--length] = '\0';
+
+	sl_log_write(sl_log_level_debug, sl_log_type_core, "Looking for %s '%s'", request->path_subtree ? "files under" : "versions of", length > 0 ? path : "/");
+
+	// mount points of filesystems are found from their root, into each session
+	struct sl_request root = *request;
+	root.path = "/";
+	root.path_subtree = root.newest_only = root.collapse = false;
+	root.limit = 0;
+
+	struct sl_database_cursor * cursor = connect->ops->open_cursor(connect, host_id, &root);
+	if (cursor == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_core, "An error occured when getting result");
+		free(path);
+		return 8;
+	}
+
+	struct sl_mount {
+		char * uuid;
+		char * mount_point;
+	} * mounts = NULL;
+	unsigned int i, nb_mounts = 0;
+	int failed = 0;
+
+	const struct sl_result_file * file;
+	while ((file = connect->ops->next_file(cursor)) != NULL) {
+		for (i = 0; i < nb_mounts; i++)
+			if (!strcmp(mounts[i].uuid, file->fs_uuid) && !strcmp(mounts[i].mount_point, file->mount_point))
+				break;
+
+		if (i < nb_mounts)
+			continue;
+
+		void * new_addr = realloc(mounts, (nb_mounts + 1) * sizeof(struct sl_mount));
+		if (new_addr == NULL) {
+			sl_log_write(sl_log_level_err, sl_log_type_core, "Not enough memory to list mount points");
+			failed = 8;
+			break;
+		}
+
+		mounts = new_addr;
+		mounts[nb_mounts].uuid = strdup(file->fs_uuid);
+		mounts[nb_mounts].mount_point = strdup(file->mount_point);
+		nb_mounts++;
+	}
+
+	if (connect->ops->close_cursor(cursor) && !failed) {
+		sl_log_write(sl_log_level_err, sl_log_type_core, "An error occured when getting result");
+		failed = 8;
+	}
+
+	for (i = 0; !failed && i < nb_mounts; i++) {
+		size_t mount_length = strlen(mounts[i].mount_point);
+		while (mount_length > 0 && mounts[i].mount_point[mount_length - 1] == '/')
+			mount_length--;
+
+		// path belongs to this filesystem, or with --directory, this filesystem is mounted under path
+		struct sl_request req = *request;
+		req.fs_uuid = mounts[i].uuid;
+		if (sl_is_under(path, mounts[i].mount_point, mount_length)) {
+			req.path = path + mount_length;
+			while (*req.path == '/')
+				req.path++;
+			if (*req.path == '\0')
+				req.path = "/";
+		} else if (request->path_subtree && sl_is_under(mounts[i].mount_point, path, length))
+			req.path = NULL;
+		else
+			continue;
+
+		cursor = connect->ops->open_cursor(connect, host_id, &req);
+		if (cursor == NULL) {
+			sl_log_write(sl_log_level_err, sl_log_type_core, "An error occured when getting result");
+			failed = 8;
+			break;
+		}
+
+		// a filesystem can be mounted elsewhere by other sessions
+		while ((file = connect->ops->next_file(cursor)) != NULL) {
+			if (strcmp(file->mount_point, mounts[i].mount_point))
+				continue;
+
+			sl_print_file(file, show_sessions, show_details);
+			*found = true;
+		}
+
+		if (connect->ops->close_cursor(cursor)) {
+			sl_log_write(sl_log_level_err, sl_log_type_core, "An error occured when getting result");
+			failed = 8;
+		}
+	}
+
+	for (i = 0; i < nb_mounts; i++) {
+		free(mounts[i].uuid);
+		free(mounts[i].mount_point);
+	}
+	free(mounts);
+	free(path);
+
+	return failed;
+}
+
+static bool sl_is_under(const char * path, const char * directory, size_t length) {
+	// root is given with length 0
+	return !strncmp(path, directory, length) && (path[length] == '/' || path[length] == '\0');
+}
+
+static void sl_print_file(const struct sl_result_file * file, bool show_sessions, bool show_details) {
+	// paths are relative to mount point, root of filesystem is stored as "/"
+	const char * separator = "/";
+	size_t length = strlen(file->mount_point);
+	if (length > 0 && file->mount_point[length - 1] == '/')
+		separator = "";
+
+	const char * path = file->path;
+	if (!strcmp(path, "/"))
+		path = separator = "";
+
+	if (show_sessions && file->first_session_id < file->session_id)
+		printf("%d-%d\t", file->first_session_id, file->session_id);
+	else if (show_sessions)
+		printf("%d\t", file->session_id);
+
+	if (show_details) {
+		char mtime[24];
+		struct tm tm;
+		localtime_r(&file->mtime, &tm);
+		strftime(mtime, 24, "%F %T", &tm);
+
+		printf("%llu\t%o\t%lld\t%s\t", (unsigned long long) file->inode, (unsigned int) file->mode, (long long) file->size, mtime);
+	}
+
+	printf("%s%s%s\n", file->mount_point, separator, path);
+}
+
+static void sl_show_help() {
+	sl_log_disable_display_log();
+
+	printf("StLocate [OPTIONS]... PATTERN...\n");
+	printf("  Show paths of files, found into database, which match PATTERN. PATTERN is a glob\n");
+	printf("  pattern matched against path relative to mount point, or a part of path if it\n");
+	printf("  contains none of '*', '?' or '['. Exits with 1 if no path matches.\n");
+	printf("  With --directory or --history, each PATTERN is a path of file instead.\n\n");
+	printf("    --all,                     -a : Show a path once by session, instead of once\n");
+	printf("    --config,                  -c : Read this config file instead of \"" CONFIG_FILE "\"\n");
+	printf("    --directory,               -d : Show files which were under directory PATTERN, at any depth\n");
+	printf("    --help,                    -h : Show this and exit\n");
+	printf("    --history,                 -y : Show each version of file PATTERN, by session, with its details\n");
+	printf("    --host,                    -H : Look for files of this host instead of current one\n");
+	printf("    --limit,                   -l : Show at most this number of paths by pattern\n");
+	printf("    --long,                    -L : Show inode, mode, size and modification time of files\n");
+	printf("    --newest,                  -n : Show only paths of the newest session which matches\n");
+	printf("    --regex,                   -r : PATTERN is an extended regular expression which matches a part of path\n");
+	printf("    --session,                 -s : Look only into this session\n");
+	printf("    --sessions,                -S : Show sessions of each path\n");
+	printf("    --verbose,                 -v : Increase verbosity\n");
+	printf("    --version,                 -V : Show the version of StLocate then exit\n");
+}
@@ -26,6 +26,10 @@
 \*************************************************************************/
 
 #define _GNU_SOURCE
+// blkid_devno_to_devname, blkid_get_tag_value
+#include <blkid/blkid.h>
+// closedir, opendir, readdir
+#include <dirent.h>
 // getopt_long
 #include <getopt.h>
 // dirname
@@ -34,14 +38,16 @@
 #include <limits.h>
 // bool
 #include <stdbool.h>
-// printf, rename
+// asprintf, printf, rename
 #include <stdio.h>
-// free, realpath
+// free, realloc, realpath
 #include <stdlib.h>
 // strcmp, strlen, strrchr
 #include <string.h>
-// lstat, mkdir
+// lstat, mkdir, stat
 #include <sys/stat.h>
+// pthread_cond_signal, pthread_cond_wait, pthread_mutex_lock, pthread_mutex_unlock
+#include <pthread.h>
 // lstat
 #include <sys/types.h>
 // uname
@@ -53,6 +59,7 @@
 #include <stlocate/database.h>
 #include <stlocate/log.h>
 #include <stlocate/result.h>
+#include <stlocate/thread_pool.h>
 
 #include "prompt.h"
 
@@ -60,6 +67,40 @@
 #include <stlocate.version>
 #include <stmvfile.chcksum>
 
+/**
+ * \brief Candidates of an argument
+ *
+ * With a cursor, a candidate is fetched only when it is shown, and kept to
+ * propose it again.
+ */
+struct sl_candidates {
+	struct sl_database_cursor * cursor;
+	struct sl_result_file * files;
+	unsigned int nb_files;
+	bool copied;
+	bool failed;
+};
+
+/**
+ * \brief Arguments looked up in one call, by another thread
+ */
+struct sl_find_files {
+	struct sl_database_connection * connect;
+	int host_id;
+	struct sl_request * requests;
+	unsigned int nb_requests;
+
+	struct sl_result_files ** results;
+	bool running;
+	pthread_mutex_t lock;
+	pthread_cond_t wait;
+};
+
+static void sl_candidates_free(struct sl_candidates * candidates);
+static const struct sl_result_file * sl_candidates_get(struct sl_candidates * candidates, unsigned int index);
+static void sl_find_files(void * arg);
+static void sl_find_files_wait(struct sl_find_files * batch);
+static char * sl_get_filesystem_uuid(dev_t device);
 static void sl_show_help(void);
 
 int main(int argc, char * argv[]) {
@@ -149,7 +190,7 @@ int main(int argc, char * argv[]) {
 
 	struct sl_database_connection * connect = NULL;
 	if (failed == 0) {
-		connect = db_config->ops->connect(db_config);
+		connect = db_config->ops->connect_read_only(db_config);
 		if (connect == NULL) {
 			sl_log_write(sl_log_level_crit, sl_log_type_core, "Connection to database filed");
 			failed = 6;
@@ -174,59 +215,163 @@ int main(int argc, char * argv[]) {
 		} else
 			sl_log_write(sl_log_level_debug, sl_log_type_core, "Host '%s' found with id: %d", host, host_id);
 
-		for (; !failed && optind < argc; optind++) {
+		// every argument is looked up before its prompt
+		unsigned int nb_args = argc - optind, nb_requests = 0;
+		struct sl_request * requests = NULL;
+		char ** parents = NULL;
+		int * args = NULL;
+		if (!failed && nb_args > 0) {
+			requests = calloc(nb_args, sizeof(struct sl_request));
+			parents = calloc(nb_args, sizeof(char *));
+			args = calloc(nb_args, sizeof(int));
+			if (requests == NULL || parents == NULL || args == NULL) {
+				sl_log_write(sl_log_level_err, sl_log_type_core, "Failed to allocate requests");
+				failed = 8;
+			}
+		}
+
+		unsigned int arg;
+		for (arg = optind; !failed && arg < (unsigned int) argc; arg++) {
 			struct stat st;
-			int failed = stat(argv[optind], &st);
+			int failed = stat(argv[arg], &st);
 			if (failed) {
-				sl_log_write(sl_log_level_warn, sl_log_type_core, "failed to get info of '%s' because %m", argv[optind]);
+				sl_log_write(sl_log_level_warn, sl_log_type_core, "failed to get info of '%s' because %m", argv[arg]);
 				continue;
 			}
 
-			struct sl_request req;
-			sl_request_init(&req);
-
-			req.dev_no = st.st_dev;
-			req.inode = st.st_ino;
+			struct sl_request * req = requests + nb_requests;
+			sl_request_init(req);
+
+			/**
+			 * Device number of a filesystem can change after a reboot, not its
+			 * uuid. But subvolumes of btrfs share an uuid and not their inode
+			 * numbers, so device number still chooses between them.
+			 */
+			char * fs_uuid = sl_get_filesystem_uuid(st.st_dev);
+			if (fs_uuid != NULL) {
+				sl_log_write(sl_log_level_debug, sl_log_type_core, "Filesystem of '%s' has uuid: %s", argv[arg], fs_uuid);
+				req->fs_uuid = fs_uuid;
+			}
+			req->dev_no = st.st_dev;
+			req->inode = st.st_ino;
+			// a file which has not moved between sessions is proposed once
+			req->collapse = true;
 
-			char * parent = realpath(argv[optind], NULL);
+			char * parent = realpath(argv[arg], NULL);
 			struct stat st_mp;
-			char old = '\0';
+			// dirname cuts parent at its last slash, or after it for the root directory
+			char * cut = NULL, old = '\0';
 			do {
-				char * slash = strrchr(parent, '/');
-				if (slash != NULL)
-					old = slash[1];
+				cut = strrchr(parent, '/');
+				if (cut == parent)
+					cut++;
+				if (cut != NULL)
+					old = *cut;
 
 				parent = dirname(parent);
 				failed = stat(parent, &st_mp);
-			} while (!failed && st.st_dev == st_mp.st_dev);
+			} while (!failed && st.st_dev == st_mp.st_dev && strcmp(parent, "/"));
 
-			if (old)
-				parent[strlen(parent)] = old;
+			if (!failed && st.st_dev == st_mp.st_dev)
+				// file is on the root filesystem
+				parent[0] = '\0';
+			else if (cut != NULL)
+				*cut = old;
 
-			struct sl_result_files * result = connect->ops->find_file(connect, host_id, &req);
-			if (result == NULL) {
-				sl_log_write(sl_log_level_err, sl_log_type_core, "An error occured when getting result");
-				free(parent);
-				break;
+			parents[nb_requests] = parent;
+			args[nb_requests] = arg;
+			nb_requests++;
+		}
+
+		/**
+		 * First argument is streamed, so that its first candidate is shown
+		 * at once. Meanwhile, other arguments are looked up in one call, by
+		 * another connection.
+		 */
+		struct sl_find_files batch = {
+			.connect     = NULL,
+			.host_id     = host_id,
+			.requests    = requests + 1,
+			.nb_requests = nb_requests > 1 ? nb_requests - 1 : 0,
+			.results     = NULL,
+			.running     = false,
+			.lock        = PTHREAD_MUTEX_INITIALIZER,
+			.wait        = PTHREAD_COND_INITIALIZER,
+		};
+		if (!failed && batch.nb_requests > 0) {
+			batch.connect = db_config->ops->connect_read_only(db_config);
+			if (batch.connect != NULL) {
+				batch.running = true;
+				if (sl_thread_pool_run(sl_find_files, &batch))
+					batch.running = false;
+			}
+
+			// else they are looked up before the first prompt
+			if (!batch.running) {
+				sl_log_write(sl_log_level_debug, sl_log_type_core, "Looking up arguments before the first prompt");
+
+				if (batch.connect == NULL) {
+					batch.connect = connect;
+					sl_find_files(&batch);
+					batch.connect = NULL;
+				} else
+					sl_find_files(&batch);
+			}
+		}
+
+		for (arg = 0; !failed && arg < nb_requests; arg++) {
+			optind = args[arg];
+
+			const char * parent = parents[arg];
+			struct sl_candidates candidates = {
+				.cursor   = NULL,
+				.files    = NULL,
+				.nb_files = 0,
+				.copied   = false,
+				.failed   = false,
+			};
+
+			if (arg == 0) {
+				candidates.cursor = connect->ops->open_cursor(connect, host_id, requests);
+				candidates.copied = true;
+				candidates.failed = candidates.cursor == NULL;
+			} else {
+				sl_find_files_wait(&batch);
+				if (batch.results != NULL) {
+					candidates.files = batch.results[arg - 1]->files;
+					candidates.nb_files = batch.results[arg - 1]->nb_files;
+				} else
+					candidates.failed = true;
 			}
 
-			if (result->nb_files == 0) {
+			const struct sl_result_file * rf = NULL;
+			if (!candidates.failed)
+				rf = sl_candidates_get(&candidates, 0);
+
+			if (candidates.failed) {
+				sl_log_write(sl_log_level_err, sl_log_type_core, "An error occured when getting result");
+				failed = 8;
+			} else if (rf == NULL) {
 				sl_log_write(sl_log_level_info, sl_log_type_core, "No file found: %s", argv[optind]);
 				printf("%s: No file found into database\n", argv[optind]);
 			} else {
 				bool stop = false, move = false;
 				unsigned int index = 0;
 
-				char * computed;
+				char * computed = NULL;
 				while (!stop) {
 					char * current = realpath(argv[optind], NULL);
-					asprintf(&computed, "%s/%s", parent, result->files[index].path);
+					free(computed);
+					asprintf(&computed, "%s/%s", parent, rf->path);
 
 					if (!strcmp(current, computed)) {
 						printf("File '%s' is already at the correct position\n", argv[optind]);
 						stop = true;
 					} else {
-						printf("There is %u file%c that match '%s' into database\n", result->nb_files, result->nb_files != 1 ? 's' : '\0', argv[optind]);
+						if (rf->first_session_id < rf->session_id)
+							printf("Candidate #%u that match '%s' into database, from session %d to %d\n", index + 1, argv[optind], rf->first_session_id, rf->session_id);
+						else
+							printf("Candidate #%u that match '%s' into database\n", index + 1, argv[optind]);
 						char * action = sl_prompt("Move '%s' to '%s' [yes/Next/quit] ? ", argv[optind], computed);
 
 						if (action == NULL) {
@@ -237,9 +382,20 @@ int main(int argc, char * argv[]) {
 						else if (!strcmp(action, "y") || !strcmp(action, "yes"))
 							stop = true, move = true;
 						else if (strlen(action) == 0 || !strcmp(action, "next") || !strcmp(action, "next")) {
-							index++;
-							if (index == result->nb_files)
+							rf = sl_candidates_get(&candidates, index + 1);
+							if (rf != NULL)
+								index++;
+							else if (!candidates.failed) {
+								// restart from the first candidate
 								index = 0;
+								rf = sl_candidates_get(&candidates, 0);
+							}
+
+							if (candidates.failed) {
+								sl_log_write(sl_log_level_err, sl_log_type_core, "An error occured when getting result");
+								failed = 8;
+								stop = true;
+							}
 						}
 
 						free(action);
@@ -248,6 +404,12 @@ int main(int argc, char * argv[]) {
 					free(current);
 				}
 
+				// cursor is closed before looking up ancestors
+				if (candidates.cursor != NULL) {
+					candidates.cursor->connect->ops->close_cursor(candidates.cursor);
+					candidates.cursor = NULL;
+				}
+
 				if (move) {
 					char * computed2 = dirname(computed);
 
@@ -255,13 +417,14 @@ int main(int argc, char * argv[]) {
 					for (i = 0; strcmp(computed2, ".") && access(computed2, F_OK); i++)
 						computed2 = dirname(computed2);
 
-					struct sl_result_file * rf = result->files + index;
-
 					if (i > 0) {
 						sl_log_write(sl_log_level_info, sl_log_type_core, "Rebuild path to: %s/%s", parent, rf->path);
 
 						size_t parent_size = strlen(parent) + 1;
 
+						// metadata of every missing directory, in one lookup
+						struct sl_result_files * ancestors = connect->ops->get_ancestors(connect, rf->session_id, rf->fs_id, rf->path);
+
 						while (!failed && i > 0) {
 							computed[strlen(computed)] = '/';
 							i--;
@@ -269,7 +432,12 @@ int main(int argc, char * argv[]) {
 							sl_log_write(sl_log_level_info, sl_log_type_core, "Restore directory '%s'", computed);
 
 							// find file info into database
-							struct sl_result_file * file = connect->ops->get_file_info(connect, rf->session_id, rf->fs_id, computed + parent_size);
+							const struct sl_result_file * file = NULL;
+							unsigned int j;
+							for (j = 0; ancestors != NULL && j < ancestors->nb_files && file == NULL; j++)
+								if (!strcmp(ancestors->files[j].path, computed + parent_size))
+									file = ancestors->files + j;
+
 							if (file != NULL) {
 								failed = mkdir(computed, file->mode);
 								if (failed)
@@ -280,9 +448,6 @@ int main(int argc, char * argv[]) {
 									if (failed)
 										sl_log_write(sl_log_level_err, sl_log_type_core, "Failed to restore owner and group for directory '%s' because %m", computed);
 								}
-
-								sl_result_file_free(file);
-								free(file);
 							} else {
 								// warn, no info of file computed
 								failed = mkdir(computed, 0777);
@@ -290,6 +455,8 @@ int main(int argc, char * argv[]) {
 									sl_log_write(sl_log_level_err, sl_log_type_core, "Failed to create directory '%s' because %m", computed);
 							}
 						}
+
+						sl_result_files_free(ancestors);
 					}
 
 					computed[strlen(computed)] = '/';
@@ -306,9 +473,23 @@ int main(int argc, char * argv[]) {
 				free(computed);
 			}
 
-			free(parent);
-			sl_result_files_free(result);
+			sl_candidates_free(&candidates);
+		}
+
+		// thread should not use requests anymore
+		sl_find_files_wait(&batch);
+		if (batch.results != NULL)
+			sl_result_files_free_array(batch.results, batch.nb_requests);
+		if (batch.connect != NULL)
+			batch.connect->ops->free(batch.connect);
+
+		for (arg = 0; arg < nb_requests; arg++) {
+			free((char *) requests[arg].fs_uuid);
+			free(parents[arg]);
 		}
+		free(requests);
+		free(parents);
+		free(args);
 	}
 
 	connect->ops->free(connect);
@@ -318,6 +499,105 @@ int main(int argc, char * argv[]) {
 	return failed;
 }
 
+static void sl_candidates_free(struct sl_candidates * candidates) {
+	if (candidates->cursor != NULL)
+		candidates->cursor->connect->ops->close_cursor(candidates->cursor);
+	candidates->cursor = NULL;
+
+	if (candidates->copied) {
+		unsigned int i;
+		for (i = 0; i < candidates->nb_files; i++)
+			sl_result_file_free(candidates->files + i);
+		free(candidates->files);
+	}
+
+	candidates->files = NULL;
+	candidates->nb_files = 0;
+}
+
+static const struct sl_result_file * sl_candidates_get(struct sl_candidates * candidates, unsigned int index) {
+	if (index < candidates->nb_files)
+		return candidates->files + index;
+
+	if (candidates->cursor == NULL)
+		return NULL;
+
+	const struct sl_result_file * file = candidates->cursor->connect->ops->next_file(candidates->cursor);
+	if (file == NULL) {
+		// every candidate is known
+		candidates->failed = candidates->cursor->connect->ops->close_cursor(candidates->cursor) != 0;
+		candidates->cursor = NULL;
+		return NULL;
+	}
+
+	void * new_addr = realloc(candidates->files, (candidates->nb_files + 1) * sizeof(struct sl_result_file));
+	if (new_addr == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_core, "Failed to allocate candidates");
+		candidates->failed = true;
+		return NULL;
+	}
+
+	candidates->files = new_addr;
+	sl_result_file_copy(candidates->files + candidates->nb_files, file);
+
+	return candidates->files + candidates->nb_files++;
+}
+
+static void sl_find_files(void * arg) {
+	struct sl_find_files * batch = arg;
+
+	struct sl_result_files ** results = batch->connect->ops->find_files(batch->connect, batch->host_id, batch->requests, batch->nb_requests);
+
+	pthread_mutex_lock(&batch->lock);
+	batch->results = results;
+	batch->running = false;
+	pthread_cond_signal(&batch->wait);
+	pthread_mutex_unlock(&batch->lock);
+}
+
+static void sl_find_files_wait(struct sl_find_files * batch) {
+	pthread_mutex_lock(&batch->lock);
+	while (batch->running)
+		pthread_cond_wait(&batch->wait, &batch->lock);
+	pthread_mutex_unlock(&batch->lock);
+}
+
+static char * sl_get_filesystem_uuid(dev_t device) {
+	char * uuid = NULL;
+
+	char * devname = blkid_devno_to_devname(device);
+	if (devname != NULL) {
+		uuid = blkid_get_tag_value(NULL, "UUID", devname);
+		free(devname);
+	}
+
+	if (uuid != NULL)
+		return uuid;
+
+	// without access to the device, links maintained by udev give the same uuid
+	DIR * dir = opendir("/dev/disk/by-uuid");
+	if (dir == NULL)
+		return NULL;
+
+	struct dirent * dp;
+	while (uuid == NULL && (dp = readdir(dir)) != NULL) {
+		if (dp->d_name[0] == '.')
+			continue;
+
+		char * link;
+		asprintf(&link, "/dev/disk/by-uuid/%s", dp->d_name);
+
+		struct stat st;
+		if (!stat(link, &st) && S_ISBLK(st.st_mode) && st.st_rdev == device)
+			uuid = strdup(dp->d_name);
+
+		free(link);
+	}
+	closedir(dir);
+
+	return uuid;
+}
+
 static void sl_show_help() {
 	sl_log_disable_display_log();
 
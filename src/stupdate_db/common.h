@@ -28,6 +28,8 @@
 #ifndef __STUPDATE_DB_COMMON_H__
 #define __STUPDATE_DB_COMMON_H__
 
+#define CURRENT_DB_VERSION 2
+
 struct sl_database_connection;
 
 int sl_db_update(struct sl_database_connection * db, int host_id, int version);
@@ -29,6 +29,8 @@
 #include <getopt.h>
 // printf, sscanf
 #include <stdio.h>
+// setpriority
+#include <sys/resource.h>
 // uname
 #include <sys/utsname.h>
 
@@ -53,22 +55,28 @@ int main(int argc, char * argv[]) {
 		OPT_VERBOSE = 'v',
 		OPT_VERSION = 'V',
 
-		OPT_KEEP_SESSION = 100,
+		OPT_KEEP_SESSION   = 100,
+		OPT_NO_RETENTION   = 101,
+		OPT_RETENTION_ONLY = 102,
 	};
 
 	static int option_index = 0;
 	static struct option long_options[] = {
 		{ "config",       1, NULL, OPT_CONFIG },
-		{ "keep-session", 1, NULL, OPT_KEEP_SESSION },
-		{ "help",         0, NULL, OPT_HELP },
-		{ "verbose",      0, NULL, OPT_VERBOSE },
-		{ "version",      0, NULL, OPT_VERSION },
+		{ "keep-session",   1, NULL, OPT_KEEP_SESSION },
+		{ "help",           0, NULL, OPT_HELP },
+		{ "no-retention",   0, NULL, OPT_NO_RETENTION },
+		{ "retention-only", 0, NULL, OPT_RETENTION_ONLY },
+		{ "verbose",        0, NULL, OPT_VERBOSE },
+		{ "version",        0, NULL, OPT_VERSION },
 
 		{NULL, 0, NULL, 0},
 	};
 
 	static const char * config = CONFIG_FILE;
 	int keep_session = 0;
+	bool retention = true;
+	bool retention_only = false;
 	short verbose = 0;
 
 	// parse option
@@ -94,6 +102,15 @@ int main(int argc, char * argv[]) {
 					sl_log_write(sl_log_level_crit, sl_log_type_core, "parameter: --keep-session require a positive integer as option instead of %d", keep_session);
 					return 1;
 				}
+				retention_only = true;
+				break;
+
+			case OPT_NO_RETENTION:
+				retention = false;
+				break;
+
+			case OPT_RETENTION_ONLY:
+				retention_only = true;
 				break;
 
 			case OPT_HELP:
@@ -122,6 +139,11 @@ int main(int argc, char * argv[]) {
 
 	sl_log_set_verbose(verbose);
 
+	if (!retention && retention_only) {
+		sl_log_write(sl_log_level_crit, sl_log_type_core, "parameters: --no-retention and --retention-only are exclusive");
+		return 1;
+	}
+
 	sl_log_write(sl_log_level_info, sl_log_type_core, "Parsing option: ok");
 
 	// read configuration
@@ -169,12 +191,39 @@ int main(int argc, char * argv[]) {
 		failed = 6;
 	}
 
+	// removing old sessions should not slow down other processes
+	if (retention_only && setpriority(PRIO_PROCESS, 0, 19))
+		sl_log_write(sl_log_level_warn, sl_log_type_core, "Failed to lower priority because %m");
+
+	// even retention only never modifies in place a database opened by readers as immutable
+	if (failed == 0) {
+		failed = connect->ops->start_update(connect);
+		if (failed)
+			sl_log_write(sl_log_level_crit, sl_log_type_core, "Failed to prepare database for update");
+	}
+
+	if (!retention_only && failed == 0 && current_db_version < CURRENT_DB_VERSION) {
+		int db_max_version = db_config->driver->ops->get_max_version_supported();
+		int new_version = db_max_version < CURRENT_DB_VERSION ? db_max_version : CURRENT_DB_VERSION;
+
+		if (current_db_version < new_version) {
+			sl_log_write(sl_log_level_notice, sl_log_type_core, "Upgrade database from version %d to version %d", current_db_version, new_version);
+
+			failed = connect->ops->upgrade_database(connect, new_version);
+			if (failed) {
+				sl_log_write(sl_log_level_crit, sl_log_type_core, "Failed to upgrade database");
+				failed = 8;
+			} else
+				current_db_version = new_version;
+		}
+	}
+
 	static struct utsname name;
 	uname(&name);
 
 	int host_id = connect->ops->get_host_by_name(connect, name.nodename);
 
-	if (keep_session == 0 && failed == 0) {
+	if (!retention_only && failed == 0) {
 		sl_log_write(sl_log_level_notice, sl_log_type_core, "Start updating");
 		failed = sl_db_update(connect, host_id, current_db_version);
 
@@ -184,7 +233,7 @@ int main(int argc, char * argv[]) {
 			sl_log_write(sl_log_level_notice, sl_log_type_core, "Updating finished without errors");
 	}
 
-	if (failed == 0) {
+	if (failed == 0 && retention) {
 		if (keep_session == 0)
 			keep_session = db_config->nb_session_kept;
 
@@ -197,6 +246,12 @@ int main(int argc, char * argv[]) {
 			sl_log_write(sl_log_level_notice, sl_log_type_core, "Deleting old session finished without errors");
 	}
 
+	if (connect != NULL && connect->ops->finish_update(connect, failed == 0)) {
+		sl_log_write(sl_log_level_err, sl_log_type_core, "Failed to publish updated database");
+		if (failed == 0)
+			failed = 7;
+	}
+
 	connect->ops->free(connect);
 
 	sl_log_write(sl_log_level_notice, sl_log_type_core, "StUpdate_db finished");
@@ -211,8 +266,10 @@ static void sl_show_help() {
 
 	printf("StUpdate_db, version: " STLOCATE_VERSION ", build: " __DATE__ " " __TIME__ "\n");
 	printf("    --config,                -c : Read this config file instead of \"" CONFIG_FILE "\"\n");
-	printf("    --keep-session <nb_session> : Keep at least nb_session from database\n");
+	printf("    --keep-session <nb_session> : Keep at least nb_session from database, implies --retention-only\n");
 	printf("    --help,                  -h : Show this and exit\n");
+	printf("    --no-retention              : Do not remove old sessions after updating\n");
+	printf("    --retention-only            : Only remove old sessions, with a low priority\n");
 	printf("    --version,               -V : Show the version of STone then exit\n");
 }
 
@@ -37,11 +37,13 @@
 #include <fcntl.h>
 // realpath
 #include <limits.h>
-// free, realpath
+// bool
+#include <stdbool.h>
+// free, realloc, realpath
 #include <stdlib.h>
 // asprintf
 #include <stdio.h>
-// strcmp, strdup, strlen
+// memset, strcmp, strdup, strlen
 #include <string.h>
 // lstat, open
 #include <sys/stat.h>
@@ -58,14 +60,36 @@
 #include <stlocate/database.h>
 #include <stlocate/filesystem.h>
 #include <stlocate/log.h>
+#include <stlocate/result.h>
 
 #include "common.h"
 
-static blkid_cache cache;
+// number of older sessions probed to find counters of a filesystem
+#define SL_DB_UPDATE_PREVIOUS_SESSIONS 16
 
+static blkid_cache cache;
+static time_t last_commit = 0;
+static unsigned int nb_uncommitted_files = 0;
+static bool incomplete_session = false;
+
+// counters of each session2filesystem of current session
+static struct sl_db_update_statistics {
+	int s2fs;
+	struct sl_result_statistics stats;
+	// files and directories found by previous session, 0 if unknown
+	unsigned long long expected;
+} * statistics = NULL;
+static unsigned int nb_statistics = 0;
+
+static int sl_db_update_commit(struct sl_database_connection * db);
 static int sl_db_update_file(struct sl_database_connection * db, int host_id, int session_id, int s2fs, const char * root, const char * path, struct stat * st);
 static int sl_db_update_file_filter(const struct dirent * file);
 static int sl_db_update_filesystem(struct sl_database_connection * db, int host_id, int session_id, const char * path);
+static int sl_db_update_filesystem_sync(struct sl_database_connection * db, int host_id, int session_id, const char * path);
+static struct sl_db_update_statistics * sl_db_update_find_statistics(int s2fs);
+static void sl_db_update_free_statistics(void);
+static unsigned long long sl_db_update_get_expected(struct sl_database_connection * db, int session_id, int fs_id);
+static struct sl_result_statistics * sl_db_update_get_statistics(int s2fs);
 static void sl_db_update_init(void) __attribute__((constructor));
 
 
@@ -85,6 +109,11 @@ int sl_db_update(struct sl_database_connection * db, int host_id, int version __
 	}
 	sl_log_write(sl_log_level_info, sl_log_type_core, "Create new session, id: %d", session_id);
 
+	last_commit = time(NULL);
+	nb_uncommitted_files = 0;
+	incomplete_session = false;
+	sl_db_update_free_statistics();
+
 	sl_log_write(sl_log_level_info, sl_log_type_core, "Start update db");
 	failed = sl_db_update_filesystem(db, host_id, session_id, "/");
 	if (failed) {
@@ -93,6 +122,17 @@ int sl_db_update(struct sl_database_connection * db, int host_id, int version __
 	}
 	sl_log_write(sl_log_level_info, sl_log_type_core, "Start update db, finished with status %d", failed);
 
+	unsigned int i;
+	for (i = 0; i < nb_statistics && !failed; i++)
+		failed = db->ops->sync_statistics(db, statistics[i].s2fs, &statistics[i].stats);
+	sl_db_update_free_statistics();
+
+	if (failed) {
+		db->ops->cancel_transaction(db);
+		sl_log_write(sl_log_level_err, sl_log_type_core, "Failed to store statistics of current session");
+		return failed;
+	}
+
 	failed = db->ops->end_session(db, session_id);
 	if (failed) {
 		db->ops->cancel_transaction(db);
@@ -101,6 +141,10 @@ int sl_db_update(struct sl_database_connection * db, int host_id, int version __
 	}
 	sl_log_write(sl_log_level_info, sl_log_type_core, "Finish session: OK");
 
+	// other filesystems are still published, failures are counted by statistics of each filesystem
+	if (incomplete_session)
+		sl_log_write(sl_log_level_err, sl_log_type_core, "Session %d is incomplete because some filesystems failed to be updated", session_id);
+
 	failed = db->ops->finish_transaction(db);
 	if (failed) {
 		db->ops->cancel_transaction(db);
@@ -112,6 +156,24 @@ int sl_db_update(struct sl_database_connection * db, int host_id, int version __
 	return 0;
 }
 
+static int sl_db_update_commit(struct sl_database_connection * db) {
+	int failed = db->ops->finish_transaction(db);
+	if (failed) {
+		db->ops->cancel_transaction(db);
+		sl_log_write(sl_log_level_err, sl_log_type_core, "Failed to commit current transaction");
+		return failed;
+	}
+
+	failed = db->ops->start_transaction(db);
+	if (failed)
+		sl_log_write(sl_log_level_err, sl_log_type_core, "Failed to start new transaction");
+
+	last_commit = time(NULL);
+	nb_uncommitted_files = 0;
+
+	return failed;
+}
+
 static int sl_db_update_file(struct sl_database_connection * db, int host_id, int session_id, int s2fs, const char * root, const char * path, struct stat * sfile) {
 	static time_t last = 0;
 	static unsigned int nb_file = 0;
@@ -126,7 +188,11 @@ static int sl_db_update_file(struct sl_database_connection * db, int host_id, in
 	nb_file++;
 
 	if (now > last) {
-		sl_log_write(sl_log_level_debug, sl_log_type_core, "Current file: %s, nb file: %u", file, nb_file);
+		const struct sl_db_update_statistics * current = sl_db_update_find_statistics(s2fs);
+		if (current->expected > 0)
+			sl_log_write(sl_log_level_debug, sl_log_type_core, "Current file: %s, nb file: %u, progress: %.1f%%", file, nb_file, 100.0 * (current->stats.nb_files + current->stats.nb_directories) / current->expected);
+		else
+			sl_log_write(sl_log_level_debug, sl_log_type_core, "Current file: %s, nb file: %u", file, nb_file);
 		last = now;
 		nb_file = 0;
 	}
@@ -138,9 +204,30 @@ static int sl_db_update_file(struct sl_database_connection * db, int host_id, in
 		return failed;
 	}
 
+	struct sl_result_statistics * stats = sl_db_update_get_statistics(s2fs);
+	if (S_ISDIR(sfile->st_mode))
+		stats->nb_directories++;
+	else
+		stats->nb_files++;
+	if (S_ISREG(sfile->st_mode))
+		stats->total_size += sfile->st_size;
+
+	struct sl_database_config * config = db->config;
+	nb_uncommitted_files++;
+	if ((config->commit_nb_files > 0 && nb_uncommitted_files >= config->commit_nb_files) || (config->commit_delay > 0 && now >= last_commit + config->commit_delay)) {
+		failed = sl_db_update_commit(db);
+		if (failed) {
+			free(file);
+			return failed;
+		}
+	}
+
 	if (S_ISDIR(sfile->st_mode)) {
 		struct dirent ** nl = NULL;
 		int i, nb_files = scandir(file, &nl, sl_db_update_file_filter, versionsort);
+		if (nb_files < 0)
+			stats->nb_errors++;
+
 		for (i = 0; i < nb_files; i++) {
 			if (!failed) {
 				char * subfile = NULL;
@@ -153,15 +240,20 @@ static int sl_db_update_file(struct sl_database_connection * db, int host_id, in
 				failed = lstat(subfile, &ssubfile);
 
 				if (!failed) {
-					if (sfile->st_dev != ssubfile.st_dev)
+					if (sfile->st_dev != ssubfile.st_dev) {
+						// time spent into another filesystem is not counted twice
+						time_t start = time(NULL);
 						failed = sl_db_update_filesystem(db, host_id, session_id, subfile);
-					else {
+						sl_db_update_get_statistics(s2fs)->scan_duration -= time(NULL) - start;
+					} else {
 						size_t length = strlen(root);
 						if (length > 1)
 							length++;
 						failed = sl_db_update_file(db, host_id, session_id, s2fs, root, subfile + length, &ssubfile);
 					}
 				} else {
+					sl_db_update_get_statistics(s2fs)->nb_errors++;
+
 					switch (errno) {
 						case EACCES:
 							failed = 0;
@@ -195,6 +287,36 @@ static int sl_db_update_file_filter(const struct dirent * file) {
 }
 
 static int sl_db_update_filesystem(struct sl_database_connection * db, int host_id, int session_id, const char * path) {
+	if (db->config->commit == sl_database_commit_session)
+		return sl_db_update_filesystem_sync(db, host_id, session_id, path);
+
+	// each filesystem is committed separately so a failure does not abort others
+	int failed = sl_db_update_commit(db);
+	if (failed)
+		return failed;
+
+	unsigned int nb_known = nb_statistics;
+	failed = sl_db_update_filesystem_sync(db, host_id, session_id, path);
+	if (!failed)
+		return sl_db_update_commit(db);
+
+	sl_log_write(sl_log_level_err, sl_log_type_core, "Failed to update filesystem: { path: %s }, modifications since last commit are discarded", path);
+
+	// filesystem has been committed before its files, so its failure is kept with it
+	if (nb_statistics > nb_known)
+		statistics[nb_known].stats.nb_errors++;
+
+	incomplete_session = true;
+	db->ops->cancel_transaction(db);
+
+	failed = db->ops->start_transaction(db);
+	if (failed)
+		sl_log_write(sl_log_level_err, sl_log_type_core, "Failed to start new transaction");
+
+	return failed;
+}
+
+static int sl_db_update_filesystem_sync(struct sl_database_connection * db, int host_id, int session_id, const char * path) {
 	struct stat st;
 	int failed = stat(path, &st);
 	if (failed)
@@ -270,13 +392,78 @@ static int sl_db_update_filesystem(struct sl_database_connection * db, int host_
 		return s2fs;
 	}
 
+	void * new_addr = realloc(statistics, (nb_statistics + 1) * sizeof(struct sl_db_update_statistics));
+	if (new_addr == NULL) {
+		sl_log_write(sl_log_level_err, sl_log_type_core, "Not enough memory to collect statistics of filesystem: { path: %s }", path);
+		sl_filesystem_free(fs);
+		return -1;
+	}
+
+	statistics = new_addr;
+	memset(statistics + nb_statistics, 0, sizeof(struct sl_db_update_statistics));
+	statistics[nb_statistics].s2fs = s2fs;
+	statistics[nb_statistics].expected = sl_db_update_get_expected(db, session_id, fs->id);
+	nb_statistics++;
+
+	if (statistics[nb_statistics - 1].expected > 0)
+		sl_log_write(sl_log_level_info, sl_log_type_core, "Filesystem: { path: %s } had %llu files and directories at previous session", path, statistics[nb_statistics - 1].expected);
+
+	// filesystem remains into session even if its files fail to be updated
+	if (db->config->commit != sl_database_commit_session) {
+		failed = sl_db_update_commit(db);
+		if (failed) {
+			nb_statistics--;
+			sl_filesystem_free(fs);
+			return failed;
+		}
+	}
+
+	time_t start = time(NULL);
 	failed = sl_db_update_file(db, host_id, session_id, s2fs, path, NULL, &st);
+	sl_db_update_get_statistics(s2fs)->scan_duration += time(NULL) - start;
 
 	sl_filesystem_free(fs);
 
 	return failed;
 }
 
+static struct sl_db_update_statistics * sl_db_update_find_statistics(int s2fs) {
+	// usually the last one, unless a nested filesystem has just been updated
+	unsigned int i;
+	for (i = nb_statistics; i > 0; i--)
+		if (statistics[i - 1].s2fs == s2fs)
+			return statistics + i - 1;
+
+	return NULL;
+}
+
+static void sl_db_update_free_statistics() {
+	free(statistics);
+	statistics = NULL;
+	nb_statistics = 0;
+}
+
+static unsigned long long sl_db_update_get_expected(struct sl_database_connection * db, int session_id, int fs_id) {
+	// only finished sessions have counters, sessions of other hosts have not this filesystem
+	struct sl_result_statistics * stats = NULL;
+	int previous;
+	for (previous = session_id - 1; stats == NULL && previous > 0 && previous >= session_id - SL_DB_UPDATE_PREVIOUS_SESSIONS; previous--)
+		stats = db->ops->get_statistics(db, previous, fs_id);
+
+	if (stats == NULL)
+		return 0;
+
+	unsigned long long expected = stats->nb_files + stats->nb_directories;
+	free(stats);
+
+	return expected;
+}
+
+static struct sl_result_statistics * sl_db_update_get_statistics(int s2fs) {
+	struct sl_db_update_statistics * current = sl_db_update_find_statistics(s2fs);
+	return current != NULL ? &current->stats : NULL;
+}
+
 static void sl_db_update_init() {
 	blkid_get_cache(&cache, NULL);
 }